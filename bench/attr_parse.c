@@ -0,0 +1,245 @@
+/** @file
+ * NetLabel Attribute Parsing Benchmark
+ *
+ * Author: Paul Moore <paul@paul-moore.com>
+ *
+ */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Build a synthetic static label dump, as the kernel would send it, and time
+ * parsing every entry in it; first by looking up each attribute with
+ * nla_find(), as the library used to, and then with a single policy driven
+ * pass using nlbl_attr_parse() and the library's attribute policy.  The
+ * kernel is not needed.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+#include <libnetlabel.h>
+
+#include "../libnetlabel/netlabel_internal.h"
+#include "bench.h"
+
+#define BENCH_ENTRIES		10000
+#define BENCH_RUNS		100
+
+#define BENCH_DEV		"eth0"
+#define BENCH_LABEL		"system_u:object_r:bench_t:s0"
+
+/* synthetic dump buffer */
+struct bench_dump {
+	unsigned char *buf;
+	size_t len;
+};
+
+/**
+ * Build a synthetic static label dump
+ * @param dump the dump buffer
+ * @param count the number of static labels
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int bench_dump_build(struct bench_dump *dump, unsigned int count)
+{
+	int rc = -ENOMEM;
+	struct nl_msg *msg = NULL;
+	struct nlmsghdr *nl_hdr;
+	struct genlmsghdr genl_hdr;
+	struct in_addr addr, mask;
+	unsigned char *buf_new;
+	unsigned int iter;
+
+	memset(dump, 0, sizeof(*dump));
+	memset(&genl_hdr, 0, sizeof(genl_hdr));
+	genl_hdr.cmd = NLBL_UNLABEL_C_STATICLIST;
+	mask.s_addr = 0xffffffff;
+
+	for (iter = 0; iter < count; iter++) {
+		msg = nlmsg_alloc_simple(0, NLM_F_MULTI);
+		if (msg == NULL)
+			goto build_return;
+		addr.s_addr = htonl(0x0a000000 + iter);
+		if (nlmsg_append(msg, &genl_hdr, sizeof(genl_hdr),
+				 NLMSG_ALIGNTO) < 0 ||
+		    nla_put_string(msg, NLBL_UNLABEL_A_IFACE, BENCH_DEV) < 0 ||
+		    nla_put(msg, NLBL_UNLABEL_A_IPV4ADDR,
+			    sizeof(addr), &addr) < 0 ||
+		    nla_put(msg, NLBL_UNLABEL_A_IPV4MASK,
+			    sizeof(mask), &mask) < 0 ||
+		    nla_put_string(msg, NLBL_UNLABEL_A_SECCTX,
+				   BENCH_LABEL) < 0)
+			goto build_return;
+
+		nl_hdr = nlmsg_hdr(msg);
+		buf_new = realloc(dump->buf,
+				  dump->len + NLMSG_ALIGN(nl_hdr->nlmsg_len));
+		if (buf_new == NULL)
+			goto build_return;
+		dump->buf = buf_new;
+		memcpy(dump->buf + dump->len, nl_hdr, nl_hdr->nlmsg_len);
+		dump->len += NLMSG_ALIGN(nl_hdr->nlmsg_len);
+		nlmsg_free(msg);
+		msg = NULL;
+	}
+	rc = 0;
+
+build_return:
+	nlmsg_free(msg);
+	if (rc < 0)
+		free(dump->buf);
+	return rc;
+}
+
+/**
+ * Parse a static label entry by searching for each attribute
+ * @param nla_head the entry's attributes
+ * @param attrlen the length of the attributes
+ * @param addr the static label address mapping
+ */
+static int bench_parse_find(struct nlattr *nla_head, int attrlen,
+			    struct nlbl_addrmap *addr)
+{
+	struct nlattr *nla;
+
+	nla = nla_find(nla_head, attrlen, NLBL_UNLABEL_A_IFACE);
+	if (nla != NULL)
+		addr->dev = nla_data(nla);
+	nla = nla_find(nla_head, attrlen, NLBL_UNLABEL_A_SECCTX);
+	if (nla == NULL)
+		return -EBADMSG;
+	addr->label = nla_data(nla);
+	if (nla_find(nla_head, attrlen, NLBL_UNLABEL_A_IPV4ADDR) != NULL) {
+		nla = nla_find(nla_head, attrlen, NLBL_UNLABEL_A_IPV4ADDR);
+		memcpy(&addr->addr.addr.v4, nla_data(nla), nla_len(nla));
+		nla = nla_find(nla_head, attrlen, NLBL_UNLABEL_A_IPV4MASK);
+		if (nla == NULL)
+			return -EBADMSG;
+		memcpy(&addr->addr.mask.v4, nla_data(nla), nla_len(nla));
+	}
+
+	return 0;
+}
+
+/**
+ * Parse a static label entry in a single pass
+ * @param nla_head the entry's attributes
+ * @param attrlen the length of the attributes
+ * @param addr the static label address mapping
+ */
+static int bench_parse_table(struct nlattr *nla_head, int attrlen,
+			     struct nlbl_addrmap *addr)
+{
+	struct nlattr *tb[NLBL_UNLABEL_A_MAX + 1];
+
+	if (nlbl_attr_parse(tb, NLBL_UNLABEL_A_MAX,
+			    nla_head, attrlen, nlbl_unlbl_policy) < 0)
+		return -EBADMSG;
+	if (tb[NLBL_UNLABEL_A_IFACE] != NULL)
+		addr->dev = nla_get_string(tb[NLBL_UNLABEL_A_IFACE]);
+	if (tb[NLBL_UNLABEL_A_SECCTX] == NULL)
+		return -EBADMSG;
+	addr->label = nla_get_string(tb[NLBL_UNLABEL_A_SECCTX]);
+	if (tb[NLBL_UNLABEL_A_IPV4ADDR] != NULL) {
+		if (tb[NLBL_UNLABEL_A_IPV4MASK] == NULL)
+			return -EBADMSG;
+		memcpy(&addr->addr.addr.v4,
+		       nla_data(tb[NLBL_UNLABEL_A_IPV4ADDR]),
+		       sizeof(struct in_addr));
+		memcpy(&addr->addr.mask.v4,
+		       nla_data(tb[NLBL_UNLABEL_A_IPV4MASK]),
+		       sizeof(struct in_addr));
+	}
+
+	return 0;
+}
+
+/**
+ * Time parsing a synthetic dump
+ * @param dump the dump buffer
+ * @param parse the entry parser
+ *
+ * Returns the best time per entry in nanoseconds, negative values on failure.
+ *
+ */
+static double bench_dump_parse(const struct bench_dump *dump,
+			       int (*parse)(struct nlattr *, int,
+					    struct nlbl_addrmap *))
+{
+	double start, time, best = 0;
+	struct nlmsghdr *nl_hdr;
+	struct genlmsghdr *genl_hdr;
+	struct nlbl_addrmap addr;
+	unsigned int count;
+	unsigned int run;
+	int len;
+
+	for (run = 0; run < BENCH_RUNS; run++) {
+		start = bench_now();
+		count = 0;
+		len = dump->len;
+		nl_hdr = (struct nlmsghdr *)dump->buf;
+		while (nlmsg_ok(nl_hdr, len)) {
+			genl_hdr = nlmsg_data(nl_hdr);
+			if (parse(genlmsg_attrdata(genl_hdr, 0),
+				  genlmsg_attrlen(genl_hdr, 0), &addr) < 0)
+				return -EBADMSG;
+			count++;
+			nl_hdr = nlmsg_next(nl_hdr, &len);
+		}
+		time = (bench_now() - start) / count;
+		if (run == 0 || time < best)
+			best = time;
+	}
+
+	return best;
+}
+
+/**
+ * The benchmark entry point
+ */
+int main(void)
+{
+	struct bench_dump dump;
+	double time_find, time_table;
+
+	if (bench_dump_build(&dump, BENCH_ENTRIES) < 0) {
+		fprintf(stderr, "error: unable to build the dump\n");
+		return 1;
+	}
+
+	time_find = bench_dump_parse(&dump, bench_parse_find);
+	time_table = bench_dump_parse(&dump, bench_parse_table);
+	free(dump.buf);
+	if (time_find < 0 || time_table < 0) {
+		fprintf(stderr, "error: unable to parse the dump\n");
+		return 1;
+	}
+
+	printf("# static label attribute parsing, %u entries\n",
+	       BENCH_ENTRIES);
+	printf("%16s %16s\n", "find ns/entry", "table ns/entry");
+	printf("%16.1f %16.1f\n", time_find, time_table);
+
+	return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * Header file for the NetLabel benchmarks
+ *
+ * Author: Paul Moore <paul@paul-moore.com>
+ *
+ */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include <libnetlabel.h>
+
+/* first address of the synthetic static labels */
+#define BENCH_ADDR_BASE		0x0a000000
+
+/**
+ * Return the current time in nanoseconds
+ */
+static inline double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e9 + ts.tv_nsec);
+}
+
+/**
+ * Return a pseudo random 32-bit value
+ * @param state the generator state
+ */
+static inline uint32_t bench_rand(uint32_t *state)
+{
+	/* xorshift32 */
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+/**
+ * Fill in a static label address
+ * @param addr the address
+ * @param iter the static label number
+ */
+static inline void bench_addr(struct nlbl_netaddr *addr, unsigned int iter)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->type = AF_INET;
+	addr->addr.v4.s_addr = htonl(BENCH_ADDR_BASE + iter);
+	addr->mask.v4.s_addr = 0xffffffff;
+}
+
+#endif
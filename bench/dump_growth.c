@@ -0,0 +1,305 @@
+/** @file
+ * NetLabel Dump Result Array Benchmark
+ *
+ * Author: Paul Moore <paul@paul-moore.com>
+ *
+ */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * The benchmark has two parts:
+ *
+ * 1. The result array growth, measured without the kernel by appending N
+ *    static label entries to an array, first with the growable arrays used
+ *    by the list operations and then by growing the array one entry at a
+ *    time as the library used to; N runs from 10^3 to 10^6.
+ *
+ * 2. With "-k <max>", a nlbl_unlbl_staticlist() round trip against the
+ *    running kernel for N = 100, 1000, ... up to <max> static labels.  The
+ *    labels are loaded with a batch, listed, and then removed.  This requires
+ *    CAP_NET_ADMIN and clobbers any static labels in 10.0.0.0/8 on the
+ *    loopback device.  The kernel keeps the static labels in a sorted list so
+ *    loading N labels costs O(N^2) in the kernel; 10^5 labels takes minutes
+ *    and 10^6 is impractical, which is why the first part exists.
+ *
+ * For each N the time per entry is reported, it should stay flat as N grows;
+ * the array growth times are the best of several runs.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include <libnetlabel.h>
+
+#include "../libnetlabel/netlabel_internal.h"
+#include "bench.h"
+
+#define BENCH_DEV		"lo"
+#define BENCH_LABEL		"system_u:object_r:bench_t:s0"
+
+#define BENCH_ARRAY_MAX		1000000
+#define BENCH_ARRAY_RUNS	3
+
+/**
+ * Append entries to a growable array
+ * @param count the number of entries
+ *
+ * Returns the time taken in nanoseconds, negative values on failure.
+ *
+ */
+static double bench_array_vec(unsigned int count)
+{
+	double start, end;
+	struct nlbl_vec vec;
+	struct nlbl_addrmap *entry;
+	unsigned int iter;
+
+	start = bench_now();
+	nlbl_vec_init(&vec, sizeof(*entry), 0);
+	for (iter = 0; iter < count; iter++) {
+		entry = nlbl_vec_add(&vec);
+		if (entry == NULL) {
+			nlbl_vec_free(&vec);
+			return -ENOMEM;
+		}
+		bench_addr(&entry->addr, iter);
+	}
+	free(nlbl_vec_finish(&vec));
+	end = bench_now();
+
+	return end - start;
+}
+
+/**
+ * Append entries to an array grown one entry at a time
+ * @param count the number of entries
+ *
+ * Returns the time taken in nanoseconds, negative values on failure.
+ *
+ */
+static double bench_array_realloc(unsigned int count)
+{
+	double start, end;
+	struct nlbl_addrmap *array = NULL, *array_new;
+	unsigned int iter;
+
+	start = bench_now();
+	for (iter = 0; iter < count; iter++) {
+		array_new = realloc(array, sizeof(*array) * (iter + 1));
+		if (array_new == NULL) {
+			free(array);
+			return -ENOMEM;
+		}
+		array = array_new;
+		memset(&array[iter], 0, sizeof(*array));
+		bench_addr(&array[iter].addr, iter);
+	}
+	free(array);
+	end = bench_now();
+
+	return end - start;
+}
+
+/**
+ * Load or remove static labels using a batch
+ * @param hndl the NetLabel handle
+ * @param count the number of static labels
+ * @param add true to add the labels, false to remove them
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int bench_kernel_load(struct nlbl_handle *hndl,
+			     unsigned int count, int add)
+{
+	int rc;
+	int *results = NULL;
+	struct nlbl_netaddr addr;
+	unsigned int iter;
+
+	rc = nlbl_batch_begin(hndl);
+	if (rc < 0)
+		return rc;
+	for (iter = 0; iter < count; iter++) {
+		bench_addr(&addr, iter);
+		if (add)
+			rc = nlbl_unlbl_staticadd(hndl, BENCH_DEV,
+						  &addr, BENCH_LABEL);
+		else
+			rc = nlbl_unlbl_staticdel(hndl, BENCH_DEV, &addr);
+		if (rc < 0) {
+			nlbl_batch_abort(hndl);
+			return rc;
+		}
+	}
+	rc = nlbl_batch_commit(hndl, &results);
+	if (rc < 0)
+		return rc;
+
+	/* an add must succeed, a delete can fail if the add didn't happen */
+	rc = 0;
+	for (iter = 0; add && iter < count; iter++)
+		if (results[iter] < 0) {
+			rc = results[iter];
+			break;
+		}
+	free(results);
+	return rc;
+}
+
+/**
+ * List the static labels in the kernel
+ * @param hndl the NetLabel handle
+ * @param count the number of static labels to load
+ *
+ * Returns the time taken in nanoseconds, negative values on failure.
+ *
+ */
+static double bench_kernel_list(struct nlbl_handle *hndl, unsigned int count)
+{
+	int rc;
+	double start = 0, end = 0;
+	struct nlbl_addrmap *addrs = NULL;
+	int iter;
+
+	rc = bench_kernel_load(hndl, count, 1);
+	if (rc < 0)
+		goto list_return;
+
+	start = bench_now();
+	rc = nlbl_unlbl_staticlist(hndl, &addrs);
+	end = bench_now();
+	if (rc < 0)
+		goto list_return;
+	if ((unsigned int)rc < count) {
+		rc = -ENODATA;
+		goto list_return;
+	}
+	for (iter = 0; iter < rc; iter++) {
+		free(addrs[iter].dev);
+		free(addrs[iter].label);
+	}
+	free(addrs);
+	rc = 0;
+
+list_return:
+	bench_kernel_load(hndl, count, 0);
+	if (rc < 0)
+		return rc;
+	return end - start;
+}
+
+/**
+ * Display the benchmark usage
+ * @param name the program name
+ */
+static void bench_usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-k <max static labels>]\n", name);
+	exit(1);
+}
+
+/**
+ * The benchmark entry point
+ * @param argc the number of arguments
+ * @param argv the argument list
+ */
+int main(int argc, char *argv[])
+{
+	int rc = 0;
+	int arg;
+	unsigned int kernel_max = 0;
+	unsigned int count;
+	unsigned int run;
+	double time, time_vec, time_realloc;
+	double time_list;
+	struct nlbl_handle *hndl = NULL;
+
+	while ((arg = getopt(argc, argv, "hk:")) > 0) {
+		switch (arg) {
+		case 'k':
+			kernel_max = atoi(optarg);
+			break;
+		default:
+			bench_usage(argv[0]);
+		}
+	}
+
+	printf("# result array growth\n");
+	printf("%10s %16s %16s\n",
+	       "entries", "vec ns/entry", "realloc ns/entry");
+	for (count = 1000; count <= BENCH_ARRAY_MAX; count *= 10) {
+		time_vec = 0;
+		time_realloc = 0;
+		for (run = 0; run < BENCH_ARRAY_RUNS; run++) {
+			time = bench_array_vec(count);
+			if (time < 0)
+				goto main_nomem;
+			if (run == 0 || time < time_vec)
+				time_vec = time;
+			time = bench_array_realloc(count);
+			if (time < 0)
+				goto main_nomem;
+			if (run == 0 || time < time_realloc)
+				time_realloc = time;
+		}
+		printf("%10u %16.1f %16.1f\n",
+		       count, time_vec / count, time_realloc / count);
+	}
+
+	if (kernel_max == 0)
+		return 0;
+
+	rc = nlbl_init();
+	if (rc < 0)
+		goto main_return;
+	hndl = nlbl_comm_open();
+	if (hndl == NULL) {
+		rc = -ENOMEM;
+		goto main_return;
+	}
+
+	printf("# nlbl_unlbl_staticlist()\n");
+	printf("%10s %16s\n", "entries", "list ns/entry");
+	for (count = 100; count <= kernel_max; count *= 10) {
+		time_list = bench_kernel_list(hndl, count);
+		if (time_list < 0) {
+			rc = time_list;
+			goto main_return;
+		}
+		printf("%10u %16.1f\n", count, time_list / count);
+	}
+
+main_return:
+	if (hndl != NULL)
+		nlbl_comm_close(hndl);
+	nlbl_exit();
+	if (rc < 0) {
+		fprintf(stderr, "error: %s\n", strerror(-rc));
+		return 1;
+	}
+	return 0;
+
+main_nomem:
+	fprintf(stderr, "error: out of memory\n");
+	return 1;
+}
@@ -0,0 +1,271 @@
+/** @file
+ * NetLabel Domain Mapping Resolution Benchmark
+ *
+ * Author: Paul Moore <paul@paul-moore.com>
+ *
+ */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Build a synthetic set of LSM domain mappings, most of them with IPv4
+ * address selectors, and time resolving the mapping for random domains and
+ * destination addresses; first with a linear scan of the domain mapping array
+ * and its address selectors, as callers had to do, and then with
+ * nlbl_mgmt_resolve() and nlbl_mgmt_resolve_batch() on a domain mapping
+ * table.  The kernel is not needed.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+#include <libnetlabel.h>
+
+#include "bench.h"
+
+#define BENCH_DOMAINS		10000
+#define BENCH_SELECTORS		8
+#define BENCH_QUERIES		1000000
+#define BENCH_SCAN_QUERIES	10000
+#define BENCH_BLOCK		100
+#define BENCH_RUNS		5
+
+/**
+ * Build the synthetic domain mappings
+ * @param count the number of domain mappings
+ * @param addrsel the address selector array
+ *
+ * Returns the domain mapping array on success, NULL on failure.
+ *
+ */
+static struct nlbl_dommap *bench_domains_build(
+					unsigned int count,
+					struct nlbl_dommap_addr **addrsel)
+{
+	struct nlbl_dommap *domains;
+	struct nlbl_dommap_addr *sel;
+	char name[32];
+	uint32_t net;
+	unsigned int plen;
+	unsigned int iter;
+	unsigned int iter_s;
+
+	domains = calloc(count, sizeof(*domains));
+	*addrsel = calloc(count * BENCH_SELECTORS, sizeof(**addrsel));
+	if (domains == NULL || *addrsel == NULL)
+		goto build_failure;
+
+	for (iter = 0; iter < count; iter++) {
+		snprintf(name, sizeof(name), "bench_%u_t", iter);
+		domains[iter].domain = strdup(name);
+		if (domains[iter].domain == NULL)
+			goto build_failure;
+		domains[iter].family = AF_INET;
+
+		/* one in four domains uses a single protocol */
+		if (iter % 4 == 0) {
+			domains[iter].proto_type = NETLBL_NLTYPE_CIPSOV4;
+			domains[iter].proto.cip_doi = iter;
+			continue;
+		}
+
+		/* unique /16 to /28 networks inside 10.0.0.0/8, multiplying by
+		 * an odd constant modulo a power of two is a permutation */
+		sel = &(*addrsel)[iter * BENCH_SELECTORS];
+		for (iter_s = 0; iter_s < BENCH_SELECTORS; iter_s++) {
+			plen = 16 + (iter + iter_s) % 13;
+			net = iter * BENCH_SELECTORS + iter_s;
+			net = (net * 2654435761u) & ((1 << (plen - 8)) - 1);
+			sel[iter_s].addr.type = AF_INET;
+			sel[iter_s].addr.addr.v4.s_addr =
+				htonl(0x0a000000 | (net << (32 - plen)));
+			sel[iter_s].addr.mask.v4.s_addr =
+				htonl(0xffffffff << (32 - plen));
+			sel[iter_s].proto_type = NETLBL_NLTYPE_CIPSOV4;
+			sel[iter_s].proto.cip_doi = iter_s;
+			if (iter_s + 1 < BENCH_SELECTORS)
+				sel[iter_s].next = &sel[iter_s + 1];
+		}
+		domains[iter].proto_type = NETLBL_NLTYPE_ADDRSELECT;
+		domains[iter].proto.addrsel = sel;
+		domains[iter].addrsel_count = BENCH_SELECTORS;
+	}
+
+	return domains;
+
+build_failure:
+	if (domains != NULL) {
+		for (iter = 0; iter < count; iter++)
+			free(domains[iter].domain);
+	}
+	free(domains);
+	free(*addrsel);
+	return NULL;
+}
+
+/**
+ * Resolve a domain mapping with a linear scan
+ * @param domains the domain mappings
+ * @param count the number of domain mappings
+ * @param def the default domain mapping
+ * @param domain the LSM domain
+ * @param addr the destination address
+ * @param addrsel the matching address selector
+ *
+ * Returns the domain mapping used, setting @addrsel to the matching address
+ * selector if the mapping has address selectors.
+ *
+ */
+static const struct nlbl_dommap *bench_scan(
+					const struct nlbl_dommap *domains,
+					unsigned int count,
+					const struct nlbl_dommap *def,
+					const char *domain,
+					const struct nlbl_netaddr *addr,
+					const struct nlbl_dommap_addr **addrsel)
+{
+	const struct nlbl_dommap_addr *iter_s;
+	unsigned int iter;
+
+	*addrsel = NULL;
+	for (iter = 0; iter < count; iter++)
+		if (strcmp(domains[iter].domain, domain) == 0)
+			break;
+	if (iter == count)
+		return def;
+	if (domains[iter].proto_type != NETLBL_NLTYPE_ADDRSELECT)
+		return &domains[iter];
+
+	for (iter_s = domains[iter].proto.addrsel; iter_s != NULL;
+	     iter_s = iter_s->next) {
+		if ((addr->addr.v4.s_addr & iter_s->addr.mask.v4.s_addr) !=
+		    iter_s->addr.addr.v4.s_addr)
+			continue;
+		if (*addrsel == NULL ||
+		    ntohl(iter_s->addr.mask.v4.s_addr) >
+		    ntohl((*addrsel)->addr.mask.v4.s_addr))
+			*addrsel = iter_s;
+	}
+
+	return &domains[iter];
+}
+
+/**
+ * The benchmark entry point
+ */
+int main(void)
+{
+	int rc = 1;
+	struct nlbl_dommap *domains = NULL;
+	struct nlbl_dommap_addr *addrsel = NULL;
+	struct nlbl_dommap def;
+	struct nlbl_mgmt_table *table = NULL;
+	struct nlbl_netaddr *lookups = NULL;
+	const char **names = NULL;
+	const struct nlbl_dommap_addr **targets = NULL;
+	double start, time_scan = 0, time_single = 0, time_batch = 0, time;
+	uint32_t state = 2;
+	unsigned int iter;
+	unsigned int run;
+
+	/* the default mapping is unlabeled, as it is when the kernel boots */
+	memset(&def, 0, sizeof(def));
+	def.family = AF_UNSPEC;
+	def.proto_type = NETLBL_NLTYPE_UNLABELED;
+
+	domains = bench_domains_build(BENCH_DOMAINS, &addrsel);
+	lookups = calloc(BENCH_QUERIES, sizeof(*lookups));
+	names = calloc(BENCH_QUERIES / BENCH_BLOCK, sizeof(*names));
+	targets = calloc(BENCH_QUERIES, sizeof(*targets));
+	if (domains == NULL || lookups == NULL || names == NULL ||
+	    targets == NULL)
+		goto bench_return;
+	if (nlbl_mgmt_table_build(domains, BENCH_DOMAINS, &def, 1,
+				  &table) < 0) {
+		fprintf(stderr, "error: unable to build the table\n");
+		goto bench_return;
+	}
+	/* each block of addresses is sent from a single domain */
+	for (iter = 0; iter < BENCH_QUERIES / BENCH_BLOCK; iter++)
+		names[iter] =
+			domains[bench_rand(&state) % BENCH_DOMAINS].domain;
+	for (iter = 0; iter < BENCH_QUERIES; iter++) {
+		lookups[iter].type = AF_INET;
+		lookups[iter].addr.v4.s_addr =
+			htonl(0x0a000000 | (bench_rand(&state) & 0x00ffffff));
+	}
+
+	for (run = 0; run < BENCH_RUNS; run++) {
+		start = bench_now();
+		for (iter = 0; iter < BENCH_SCAN_QUERIES; iter++)
+			bench_scan(domains, BENCH_DOMAINS, &def,
+				   names[iter / BENCH_BLOCK], &lookups[iter],
+				   &targets[iter]);
+		time = (bench_now() - start) / BENCH_SCAN_QUERIES;
+		if (run == 0 || time < time_scan)
+			time_scan = time;
+
+		start = bench_now();
+		for (iter = 0; iter < BENCH_QUERIES; iter++)
+			targets[iter] = nlbl_mgmt_resolve(table,
+							  names[iter /
+								BENCH_BLOCK],
+							  &lookups[iter]);
+		time = (bench_now() - start) / BENCH_QUERIES;
+		if (run == 0 || time < time_single)
+			time_single = time;
+
+		start = bench_now();
+		for (iter = 0; iter < BENCH_QUERIES; iter += BENCH_BLOCK)
+			if (nlbl_mgmt_resolve_batch(table,
+						    names[iter / BENCH_BLOCK],
+						    &lookups[iter],
+						    BENCH_BLOCK,
+						    &targets[iter]) < 0)
+				goto bench_return;
+		time = (bench_now() - start) / BENCH_QUERIES;
+		if (run == 0 || time < time_batch)
+			time_batch = time;
+	}
+
+	printf("# domain mapping resolution, %u domains, %u addresses per "
+	       "batch\n", BENCH_DOMAINS, BENCH_BLOCK);
+	printf("%16s %16s %16s\n",
+	       "scan ns/addr", "resolve ns/addr", "batch ns/addr");
+	printf("%16.1f %16.1f %16.1f\n", time_scan, time_single, time_batch);
+	printf("%16s %16s %16s\n",
+	       "scan Maddr/s", "resolve Maddr/s", "batch Maddr/s");
+	printf("%16.2f %16.2f %16.2f\n",
+	       1e3 / time_scan, 1e3 / time_single, 1e3 / time_batch);
+	rc = 0;
+
+bench_return:
+	nlbl_mgmt_table_free(table);
+	if (domains != NULL) {
+		for (iter = 0; iter < BENCH_DOMAINS; iter++)
+			free(domains[iter].domain);
+	}
+	free(targets);
+	free(names);
+	free(lookups);
+	free(addrsel);
+	free(domains);
+	return rc;
+}
@@ -0,0 +1,511 @@
+/** @file
+ * NetLabel Mock Kernel Operations Benchmark
+ *
+ * Author: Paul Moore <paul@paul-moore.com>
+ *
+ */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Time the library's operations end to end, from the public API call through
+ * message building, the socket round trip and the response parsing, against
+ * the in-process mock kernel so that neither root nor kernel support is
+ * needed and the results are repeatable:
+ *
+ * 1. Single requests: nlbl_mgmt_version(), which gets a reply, and a
+ *    nlbl_unlbl_staticadd()/nlbl_unlbl_staticdel() pair, which only get acks.
+ *
+ * 2. N static label adds, and then N deletes, sent one at a time, as a batch
+ *    and as asynchronous requests.
+ *
+ * 3. For N = 100, 1000, ... up to the "-n <max>" static labels, default
+ *    10^4: a nlbl_unlbl_staticlist_result() dump, a nlbl_config_load() of the
+ *    whole configuration, and nlbl_config_plan()/nlbl_config_apply() of the
+ *    changes needed to remove every static label.  The plan removes the
+ *    static labels in order, which costs the mock kernel O(N) per removal
+ *    just as it does the kernel, so the apply time grows with N.
+ *
+ * 4. Static label add/delete pairs sent from 1, 2, 4 and 8 threads at once,
+ *    each thread using its own default handle.  The mock kernel processes
+ *    one request at a time, as the kernel does for the NetLabel families, so
+ *    this shows how much of the library's share of the work overlaps.
+ *
+ * The times include the mock kernel's own processing, which is much cheaper
+ * than the kernel's, so they show the library's share of each operation.
+ * Every time is the best of several runs.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include <libnetlabel.h>
+
+#include "bench.h"
+
+#define BENCH_REQUESTS		10000
+#define BENCH_DUMP_MAX		10000
+#define BENCH_RUNS		3
+#define BENCH_THREADS_MAX	8
+/* asynchronous requests in flight, their acks must fit in the socket */
+#define BENCH_ASYNC_WINDOW	64
+
+#define BENCH_DEV		"eth0"
+#define BENCH_LABEL		"system_u:object_r:bench_t:s0"
+
+/* the ways of sending a group of requests */
+enum bench_mode {
+	BENCH_MODE_SYNC,
+	BENCH_MODE_BATCH,
+	BENCH_MODE_ASYNC,
+	BENCH_MODE_MAX,
+};
+
+static const char *bench_mode_names[BENCH_MODE_MAX] = {
+	[BENCH_MODE_SYNC] = "sync",
+	[BENCH_MODE_BATCH] = "batch",
+	[BENCH_MODE_ASYNC] = "async",
+};
+
+/* asynchronous request failures */
+static int bench_async_rc;
+
+/* benchmark thread */
+struct bench_thread {
+	pthread_t thread;
+	unsigned int first;
+	unsigned int count;
+	int rc;
+};
+
+/**
+ * Record the result of an asynchronous request
+ * @param hndl the NetLabel handle
+ * @param id the request id
+ * @param rc the request result
+ * @param arg unused
+ */
+static void bench_async_cb(struct nlbl_handle *hndl, int id, int rc, void *arg)
+{
+	if (rc < 0 && bench_async_rc == 0)
+		bench_async_rc = rc;
+}
+
+/**
+ * Add or remove static labels
+ * @param hndl the NetLabel handle
+ * @param mode how to send the requests
+ * @param count the number of static labels
+ * @param add true to add the labels, false to remove them
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int bench_static(struct nlbl_handle *hndl, enum bench_mode mode,
+			unsigned int count, int add)
+{
+	int rc = 0;
+	int *results = NULL;
+	struct nlbl_netaddr addr;
+	struct pollfd pfd;
+	unsigned int iter;
+
+	switch (mode) {
+	case BENCH_MODE_BATCH:
+		rc = nlbl_batch_begin(hndl);
+		break;
+	case BENCH_MODE_ASYNC:
+		bench_async_rc = 0;
+		rc = nlbl_async_begin(hndl, bench_async_cb, NULL);
+		break;
+	default:
+		break;
+	}
+	if (rc < 0)
+		return rc;
+	pfd.fd = nlbl_comm_fd(hndl);
+	pfd.events = POLLIN;
+
+	/* the mock kernel keeps the static labels sorted, so add them in
+	 * order and remove them in reverse to keep its own cost down */
+	for (iter = 0; iter < count && rc >= 0; iter++) {
+		if (add) {
+			bench_addr(&addr, iter);
+			rc = nlbl_unlbl_staticadd(hndl, BENCH_DEV,
+						  &addr, BENCH_LABEL);
+		} else {
+			bench_addr(&addr, count - iter - 1);
+			rc = nlbl_unlbl_staticdel(hndl, BENCH_DEV, &addr);
+		}
+		while (rc >= 0 && mode == BENCH_MODE_ASYNC &&
+		       nlbl_async_pending(hndl) >= BENCH_ASYNC_WINDOW) {
+			poll(&pfd, 1, -1);
+			rc = nlbl_async_dispatch(hndl);
+		}
+	}
+
+	switch (mode) {
+	case BENCH_MODE_BATCH:
+		if (rc < 0) {
+			nlbl_batch_abort(hndl);
+			break;
+		}
+		rc = nlbl_batch_commit(hndl, &results);
+		for (iter = 0; rc >= 0 && iter < count; iter++)
+			if (results[iter] < 0)
+				rc = results[iter];
+		free(results);
+		break;
+	case BENCH_MODE_ASYNC:
+		while (rc >= 0 && nlbl_async_pending(hndl) > 0) {
+			poll(&pfd, 1, -1);
+			rc = nlbl_async_dispatch(hndl);
+		}
+		nlbl_async_end(hndl);
+		if (rc >= 0)
+			rc = bench_async_rc;
+		break;
+	default:
+		break;
+	}
+
+	return (rc < 0 ? rc : 0);
+}
+
+/**
+ * Time single requests
+ * @param hndl the NetLabel handle
+ * @param time_reply the time of a request with a reply
+ * @param time_ack the time of a request with an ack
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int bench_single(struct nlbl_handle *hndl,
+			double *time_reply, double *time_ack)
+{
+	int rc;
+	double start;
+	uint32_t version;
+	struct nlbl_netaddr addr;
+	unsigned int iter;
+
+	bench_addr(&addr, 0);
+
+	start = bench_now();
+	for (iter = 0; iter < BENCH_REQUESTS; iter++) {
+		rc = nlbl_mgmt_version(hndl, &version);
+		if (rc < 0)
+			return rc;
+	}
+	*time_reply = (bench_now() - start) / BENCH_REQUESTS;
+
+	start = bench_now();
+	for (iter = 0; iter < BENCH_REQUESTS; iter++) {
+		rc = nlbl_unlbl_staticadd(hndl, BENCH_DEV, &addr, BENCH_LABEL);
+		if (rc < 0)
+			return rc;
+		rc = nlbl_unlbl_staticdel(hndl, BENCH_DEV, &addr);
+		if (rc < 0)
+			return rc;
+	}
+	*time_ack = (bench_now() - start) / (BENCH_REQUESTS * 2);
+
+	return 0;
+}
+
+/**
+ * Time dumping, loading and reconciling the configuration
+ * @param hndl the NetLabel handle
+ * @param count the number of static labels
+ * @param times the time of the dump, load, plan and apply
+ *
+ * Load @count static labels into the mock kernel, time the operations and
+ * leave the mock kernel without any static labels.  Returns zero on success,
+ * negative values on failure.
+ *
+ */
+static int bench_config(struct nlbl_handle *hndl, unsigned int count,
+			double times[4])
+{
+	int rc;
+	double start;
+	struct nlbl_addrmap *addrs;
+	struct nlbl_result *result;
+	struct nlbl_config *cur = NULL;
+	struct nlbl_config *want = NULL;
+	struct nlbl_config_op *ops;
+	int *results = NULL;
+	int iter;
+
+	rc = bench_static(hndl, BENCH_MODE_BATCH, count, 1);
+	if (rc < 0)
+		return rc;
+
+	start = bench_now();
+	rc = nlbl_unlbl_staticlist_result(hndl, &addrs, &result);
+	times[0] = bench_now() - start;
+	if (rc < 0)
+		goto config_return;
+	nlbl_result_free(result);
+	if ((unsigned int)rc != count) {
+		rc = -ENODATA;
+		goto config_return;
+	}
+
+	start = bench_now();
+	rc = nlbl_config_load(hndl, &cur);
+	times[1] = bench_now() - start;
+	if (rc < 0)
+		goto config_return;
+
+	want = nlbl_config_new();
+	if (want == NULL) {
+		rc = -ENOMEM;
+		goto config_return;
+	}
+	start = bench_now();
+	rc = nlbl_config_plan(cur, want, &ops, &result);
+	times[2] = bench_now() - start;
+	if (rc < 0)
+		goto config_return;
+
+	start = bench_now();
+	rc = nlbl_config_apply(hndl, ops, rc, &results);
+	times[3] = bench_now() - start;
+	for (iter = 0; iter < rc; iter++)
+		if (results[iter] < 0) {
+			rc = results[iter];
+			break;
+		}
+	free(results);
+	nlbl_result_free(result);
+
+config_return:
+	if (rc < 0)
+		bench_static(hndl, BENCH_MODE_BATCH, count, 0);
+	nlbl_config_free(cur);
+	nlbl_config_free(want);
+	return (rc < 0 ? rc : 0);
+}
+
+/**
+ * Add and remove static labels on a thread's default handle
+ * @param arg the benchmark thread
+ */
+static void *bench_thread_run(void *arg)
+{
+	int rc = 0;
+	struct bench_thread *thr = arg;
+	struct nlbl_netaddr addr;
+	unsigned int iter;
+
+	for (iter = 0; iter < thr->count && rc >= 0; iter++) {
+		bench_addr(&addr, thr->first + iter);
+		rc = nlbl_unlbl_staticadd(NULL, BENCH_DEV, &addr, BENCH_LABEL);
+		if (rc >= 0)
+			rc = nlbl_unlbl_staticdel(NULL, BENCH_DEV, &addr);
+	}
+	thr->rc = rc;
+
+	return NULL;
+}
+
+/**
+ * Time requests sent from several threads at once
+ * @param threads the number of threads
+ * @param time the time of each request
+ *
+ * Split BENCH_REQUESTS static label add/delete pairs between @threads
+ * threads, each adding and removing its own static labels.  Returns zero on
+ * success, negative values on failure.
+ *
+ */
+static int bench_threads(unsigned int threads, double *time)
+{
+	int rc = 0;
+	double start;
+	struct bench_thread thr[BENCH_THREADS_MAX];
+	unsigned int started;
+	unsigned int iter;
+
+	start = bench_now();
+	for (started = 0; started < threads; started++) {
+		thr[started].first = started * BENCH_REQUESTS;
+		thr[started].count = BENCH_REQUESTS / threads;
+		thr[started].rc = 0;
+		rc = -pthread_create(&thr[started].thread, NULL,
+				     bench_thread_run, &thr[started]);
+		if (rc < 0)
+			break;
+	}
+	for (iter = 0; iter < started; iter++) {
+		pthread_join(thr[iter].thread, NULL);
+		if (rc == 0 && thr[iter].rc < 0)
+			rc = thr[iter].rc;
+	}
+	*time = (bench_now() - start) / (BENCH_REQUESTS / threads * threads * 2);
+
+	return rc;
+}
+
+/**
+ * Keep the best of several times
+ * @param best the best times
+ * @param times the new times
+ * @param count the number of times
+ * @param run the run number
+ */
+static void bench_best(double *best, const double *times,
+		       unsigned int count, unsigned int run)
+{
+	unsigned int iter;
+
+	for (iter = 0; iter < count; iter++)
+		if (run == 0 || times[iter] < best[iter])
+			best[iter] = times[iter];
+}
+
+/**
+ * Display the benchmark usage
+ * @param name the program name
+ */
+static void bench_usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-n <max static labels>]\n", name);
+	exit(1);
+}
+
+/**
+ * The benchmark entry point
+ * @param argc the number of arguments
+ * @param argv the argument list
+ */
+int main(int argc, char *argv[])
+{
+	int rc;
+	int arg;
+	unsigned int dump_max = BENCH_DUMP_MAX;
+	unsigned int count;
+	unsigned int threads;
+	unsigned int run;
+	enum bench_mode mode;
+	double start;
+	double times[4], best[4];
+	struct nlbl_mock *mock = NULL;
+	struct nlbl_handle *hndl = NULL;
+
+	while ((arg = getopt(argc, argv, "hn:")) > 0) {
+		switch (arg) {
+		case 'n':
+			dump_max = atoi(optarg);
+			break;
+		default:
+			bench_usage(argv[0]);
+		}
+	}
+
+	rc = nlbl_init();
+	if (rc < 0)
+		goto main_return;
+	mock = nlbl_mock_new(NULL);
+	if (mock == NULL) {
+		rc = -ENOMEM;
+		goto main_return;
+	}
+	nlbl_mock_use(mock);
+	hndl = nlbl_comm_open();
+	if (hndl == NULL) {
+		rc = -ENOMEM;
+		goto main_return;
+	}
+
+	printf("# single requests\n");
+	printf("%16s %16s\n", "reply ns/req", "ack ns/req");
+	for (run = 0; run < BENCH_RUNS; run++) {
+		rc = bench_single(hndl, &times[0], &times[1]);
+		if (rc < 0)
+			goto main_return;
+		bench_best(best, times, 2, run);
+	}
+	printf("%16.1f %16.1f\n", best[0], best[1]);
+
+	printf("# %u static label adds and deletes\n", BENCH_REQUESTS);
+	printf("%10s %16s %16s\n", "mode", "add ns/req", "del ns/req");
+	for (mode = 0; mode < BENCH_MODE_MAX; mode++) {
+		for (run = 0; run < BENCH_RUNS; run++) {
+			start = bench_now();
+			rc = bench_static(hndl, mode, BENCH_REQUESTS, 1);
+			if (rc < 0)
+				goto main_return;
+			times[0] = bench_now() - start;
+			start = bench_now();
+			rc = bench_static(hndl, mode, BENCH_REQUESTS, 0);
+			if (rc < 0)
+				goto main_return;
+			times[1] = bench_now() - start;
+			bench_best(best, times, 2, run);
+		}
+		printf("%10s %16.1f %16.1f\n", bench_mode_names[mode],
+		       best[0] / BENCH_REQUESTS, best[1] / BENCH_REQUESTS);
+	}
+
+	printf("# configuration dump, load and reconcile\n");
+	printf("%10s %16s %16s %16s %16s\n", "entries",
+	       "list ns/entry", "load ns/entry",
+	       "plan ns/entry", "apply ns/entry");
+	for (count = 100; count <= dump_max; count *= 10) {
+		for (run = 0; run < BENCH_RUNS; run++) {
+			rc = bench_config(hndl, count, times);
+			if (rc < 0)
+				goto main_return;
+			bench_best(best, times, 4, run);
+		}
+		printf("%10u %16.1f %16.1f %16.1f %16.1f\n", count,
+		       best[0] / count, best[1] / count,
+		       best[2] / count, best[3] / count);
+	}
+
+	printf("# concurrent static label adds and deletes\n");
+	printf("%10s %16s\n", "threads", "ns/req");
+	for (threads = 1; threads <= BENCH_THREADS_MAX; threads *= 2) {
+		for (run = 0; run < BENCH_RUNS; run++) {
+			rc = bench_threads(threads, &times[0]);
+			if (rc < 0)
+				goto main_return;
+			bench_best(best, times, 1, run);
+		}
+		printf("%10u %16.1f\n", threads, best[0]);
+	}
+
+main_return:
+	if (hndl != NULL)
+		nlbl_comm_close(hndl);
+	nlbl_mock_free(mock);
+	nlbl_exit();
+	if (rc < 0) {
+		fprintf(stderr, "error: %s\n", strerror(-rc));
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,180 @@
+/** @file
+ * NetLabel Request Message Benchmark
+ *
+ * Author: Paul Moore <paul@paul-moore.com>
+ *
+ */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Time building a static label add request, as nlbl_unlbl_staticadd() does;
+ * first by allocating a new message for every request and patching its
+ * headers, as the library used to, and then by reusing a message from a
+ * handle's message pool with the headers copied from the request template.
+ * The kernel is not needed, the messages are built but never sent.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+#include <libnetlabel.h>
+
+#include "../libnetlabel/netlabel_internal.h"
+#include "bench.h"
+
+#define BENCH_BUILDS		1000000
+#define BENCH_RUNS		5
+
+#define BENCH_FAMILY		0x20
+#define BENCH_DEV		"eth0"
+#define BENCH_LABEL		"system_u:object_r:bench_t:s0"
+
+/**
+ * Add the static label attributes to a request
+ * @param msg the request
+ * @param iter the request number
+ */
+static int bench_msg_fill(nlbl_msg *msg, unsigned int iter)
+{
+	struct in_addr addr, mask;
+
+	addr.s_addr = htonl(0x0a000000 + iter);
+	mask.s_addr = 0xffffffff;
+	if (nla_put_string(msg, NLBL_UNLABEL_A_IFACE, BENCH_DEV) < 0 ||
+	    nla_put_string(msg, NLBL_UNLABEL_A_SECCTX, BENCH_LABEL) < 0 ||
+	    nla_put(msg, NLBL_UNLABEL_A_IPV4ADDR, sizeof(addr), &addr) < 0 ||
+	    nla_put(msg, NLBL_UNLABEL_A_IPV4MASK, sizeof(mask), &mask) < 0)
+		return -ENOMEM;
+
+	return 0;
+}
+
+/**
+ * Build a request with a newly allocated message
+ * @param hndl the NetLabel handle
+ * @param iter the request number
+ */
+static int bench_build_alloc(struct nlbl_handle *hndl, unsigned int iter)
+{
+	int rc = -ENOMEM;
+	nlbl_msg *msg;
+	struct nlmsghdr *nl_hdr;
+	struct genlmsghdr *genl_hdr;
+
+	msg = nlbl_msg_new();
+	if (msg == NULL)
+		return -ENOMEM;
+	nl_hdr = nlbl_msg_nlhdr(msg);
+	if (nl_hdr == NULL)
+		goto alloc_return;
+	nl_hdr->nlmsg_type = BENCH_FAMILY;
+	nl_hdr->nlmsg_flags = 0;
+	genl_hdr = nlbl_msg_genlhdr(msg);
+	if (genl_hdr == NULL)
+		goto alloc_return;
+	genl_hdr->cmd = NLBL_UNLABEL_C_STATICADD;
+
+	rc = bench_msg_fill(msg, iter);
+
+alloc_return:
+	nlbl_msg_free(msg);
+	return rc;
+}
+
+/**
+ * Build a request with a message from the handle's message pool
+ * @param hndl the NetLabel handle
+ * @param iter the request number
+ */
+static int bench_build_pool(struct nlbl_handle *hndl, unsigned int iter)
+{
+	int rc;
+	nlbl_msg *msg;
+
+	msg = nlbl_msg_request(hndl, NLBL_FAMILY_UNLBL,
+			       NLBL_UNLABEL_C_STATICADD, 0);
+	if (msg == NULL)
+		return -ENOMEM;
+
+	rc = bench_msg_fill(msg, iter);
+
+	nlbl_msg_release(hndl, msg);
+	return rc;
+}
+
+/**
+ * Time building requests
+ * @param hndl the NetLabel handle
+ * @param build the request builder
+ *
+ * Returns the best time per request in nanoseconds, negative values on
+ * failure.
+ *
+ */
+static double bench_build(struct nlbl_handle *hndl,
+			  int (*build)(struct nlbl_handle *, unsigned int))
+{
+	double start, time, best = 0;
+	unsigned int iter;
+	unsigned int run;
+
+	for (run = 0; run < BENCH_RUNS; run++) {
+		start = bench_now();
+		for (iter = 0; iter < BENCH_BUILDS; iter++)
+			if (build(hndl, iter) < 0)
+				return -ENOMEM;
+		time = (bench_now() - start) / BENCH_BUILDS;
+		if (run == 0 || time < best)
+			best = time;
+	}
+
+	return best;
+}
+
+/**
+ * The benchmark entry point
+ */
+int main(void)
+{
+	struct nlbl_handle hndl;
+	double time_alloc, time_pool;
+
+	/* the messages are never sent, a socket is not needed */
+	memset(&hndl, 0, sizeof(hndl));
+	nlmsg_set_default_size(8192);
+	nlbl_msg_tmpl_init(NLBL_FAMILY_SRC_KERNEL, NLBL_FAMILY_UNLBL,
+			   BENCH_FAMILY);
+
+	time_alloc = bench_build(&hndl, bench_build_alloc);
+	time_pool = bench_build(&hndl, bench_build_pool);
+	nlbl_msg_pool_free(&hndl);
+	if (time_alloc < 0 || time_pool < 0) {
+		fprintf(stderr, "error: unable to build the requests\n");
+		return 1;
+	}
+
+	printf("# static label add request building, %u requests\n",
+	       BENCH_BUILDS);
+	printf("%16s %16s\n", "alloc ns/req", "pool ns/req");
+	printf("%16.1f %16.1f\n", time_alloc, time_pool);
+
+	return 0;
+}
@@ -0,0 +1,184 @@
+/** @file
+ * NetLabel Static Label Lookup Benchmark
+ *
+ * Author: Paul Moore <paul@paul-moore.com>
+ *
+ */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Build a synthetic set of IPv4 static labels on a single interface and time
+ * finding the static label for random source addresses; first with a linear
+ * scan of the static label array, as callers had to do, and then with
+ * nlbl_unlbl_lookup() and nlbl_unlbl_lookup_batch() on a static label table.
+ * The kernel is not needed.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+#include <libnetlabel.h>
+
+#include "bench.h"
+
+#define BENCH_ENTRIES		10000
+#define BENCH_ADDRS		1000000
+#define BENCH_SCAN_ADDRS	10000
+#define BENCH_RUNS		5
+
+#define BENCH_DEV		"eth0"
+#define BENCH_LABEL		"system_u:object_r:bench_t:s0"
+
+/**
+ * Build the synthetic static labels
+ * @param count the number of static labels
+ *
+ * Returns the static label array on success, NULL on failure.
+ *
+ */
+static struct nlbl_addrmap *bench_addrs_build(unsigned int count)
+{
+	struct nlbl_addrmap *addrs;
+	uint32_t net;
+	unsigned int plen;
+	unsigned int iter;
+
+	addrs = calloc(count, sizeof(*addrs));
+	if (addrs == NULL)
+		return NULL;
+
+	/* unique /20 to /28 networks inside 10.0.0.0/8, multiplying by an odd
+	 * constant modulo a power of two is a permutation */
+	for (iter = 0; iter < count; iter++) {
+		plen = 20 + iter % 9;
+		net = ((iter / 9) * 2654435761u) & ((1 << (plen - 8)) - 1);
+		addrs[iter].dev = BENCH_DEV;
+		addrs[iter].label = BENCH_LABEL;
+		addrs[iter].addr.type = AF_INET;
+		addrs[iter].addr.addr.v4.s_addr =
+			htonl(0x0a000000 | (net << (32 - plen)));
+		addrs[iter].addr.mask.v4.s_addr =
+			htonl(0xffffffff << (32 - plen));
+	}
+
+	return addrs;
+}
+
+/**
+ * Find a static label with a linear scan
+ * @param addrs the static labels
+ * @param count the number of static labels
+ * @param addr the source address
+ */
+static const struct nlbl_addrmap *bench_scan(const struct nlbl_addrmap *addrs,
+					     unsigned int count,
+					     const struct nlbl_netaddr *addr)
+{
+	const struct nlbl_addrmap *best = NULL;
+	unsigned int iter;
+
+	for (iter = 0; iter < count; iter++) {
+		if ((addr->addr.v4.s_addr & addrs[iter].addr.mask.v4.s_addr) !=
+		    addrs[iter].addr.addr.v4.s_addr)
+			continue;
+		if (best == NULL ||
+		    ntohl(addrs[iter].addr.mask.v4.s_addr) >
+		    ntohl(best->addr.mask.v4.s_addr))
+			best = &addrs[iter];
+	}
+
+	return best;
+}
+
+/**
+ * The benchmark entry point
+ */
+int main(void)
+{
+	int rc = 1;
+	struct nlbl_addrmap *addrs = NULL;
+	struct nlbl_unlbl_table *table = NULL;
+	struct nlbl_netaddr *lookups = NULL;
+	const struct nlbl_addrmap **labels = NULL;
+	double start, time_scan = 0, time_single = 0, time_batch = 0, time;
+	uint32_t state = 2;
+	unsigned int iter;
+	unsigned int run;
+
+	addrs = bench_addrs_build(BENCH_ENTRIES);
+	lookups = calloc(BENCH_ADDRS, sizeof(*lookups));
+	labels = calloc(BENCH_ADDRS, sizeof(*labels));
+	if (addrs == NULL || lookups == NULL || labels == NULL)
+		goto bench_return;
+	if (nlbl_unlbl_table_build(addrs, BENCH_ENTRIES, NULL, 0, &table) < 0) {
+		fprintf(stderr, "error: unable to build the table\n");
+		goto bench_return;
+	}
+	for (iter = 0; iter < BENCH_ADDRS; iter++) {
+		lookups[iter].type = AF_INET;
+		lookups[iter].addr.v4.s_addr =
+			htonl(0x0a000000 | (bench_rand(&state) & 0x00ffffff));
+	}
+
+	for (run = 0; run < BENCH_RUNS; run++) {
+		start = bench_now();
+		for (iter = 0; iter < BENCH_SCAN_ADDRS; iter++)
+			labels[iter] = bench_scan(addrs, BENCH_ENTRIES,
+						  &lookups[iter]);
+		time = (bench_now() - start) / BENCH_SCAN_ADDRS;
+		if (run == 0 || time < time_scan)
+			time_scan = time;
+
+		start = bench_now();
+		for (iter = 0; iter < BENCH_ADDRS; iter++)
+			labels[iter] = nlbl_unlbl_lookup(table, BENCH_DEV,
+							 &lookups[iter]);
+		time = (bench_now() - start) / BENCH_ADDRS;
+		if (run == 0 || time < time_single)
+			time_single = time;
+
+		start = bench_now();
+		if (nlbl_unlbl_lookup_batch(table, BENCH_DEV, lookups,
+					    BENCH_ADDRS, labels) < 0)
+			goto bench_return;
+		time = (bench_now() - start) / BENCH_ADDRS;
+		if (run == 0 || time < time_batch)
+			time_batch = time;
+	}
+
+	printf("# static label lookup, %u IPv4 static labels\n",
+	       BENCH_ENTRIES);
+	printf("%16s %16s %16s\n",
+	       "scan ns/addr", "lookup ns/addr", "batch ns/addr");
+	printf("%16.1f %16.1f %16.1f\n", time_scan, time_single, time_batch);
+	printf("%16s %16s %16s\n",
+	       "scan Maddr/s", "lookup Maddr/s", "batch Maddr/s");
+	printf("%16.2f %16.2f %16.2f\n",
+	       1e3 / time_scan, 1e3 / time_single, 1e3 / time_batch);
+	rc = 0;
+
+bench_return:
+	nlbl_unlbl_table_free(table);
+	free(labels);
+	free(lookups);
+	free(addrs);
+	return rc;
+}
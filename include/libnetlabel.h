@@ -63,6 +63,51 @@ struct nlbl_handle;
  */
 typedef struct nl_msg nlbl_msg;
 
+/**
+ * Number of NetLabel response latency buckets
+ */
+#define NLBL_COMM_LAT_BUCKETS	20
+
+/**
+ * NetLabel handle statistics
+ * @param requests request messages sent
+ * @param writes writes to the kernel, a batch sends many requests at once
+ * @param bytes_sent bytes written
+ * @param reads reads from the kernel, each read takes every datagram waiting
+ * @param dgrams_recv datagrams read
+ * @param bytes_recv bytes read
+ * @param dgrams_dropped datagrams read and discarded, either not sent by the
+ *                       kernel or stale responses to earlier requests
+ * @param timeouts reads which gave up waiting for the kernel
+ * @param lat_count responses timed
+ * @param lat_total_ns total of the response latencies
+ * @param lat_min_ns smallest response latency
+ * @param lat_max_ns largest response latency
+ * @param lat_hist response latencies, bucket N counts the latencies under
+ *                 2^N microseconds, the last bucket counts the rest
+ *
+ * Counters kept by every NetLabel handle, see nlbl_comm_stats().  The response
+ * latency is the time from writing a request to reading the first datagram of
+ * the kernel's response, which covers the whole request for anything but a
+ * dump.
+ *
+ */
+struct nlbl_comm_stats {
+	uint64_t requests;
+	uint64_t writes;
+	uint64_t bytes_sent;
+	uint64_t reads;
+	uint64_t dgrams_recv;
+	uint64_t bytes_recv;
+	uint64_t dgrams_dropped;
+	uint64_t timeouts;
+	uint64_t lat_count;
+	uint64_t lat_total_ns;
+	uint64_t lat_min_ns;
+	uint64_t lat_max_ns;
+	uint64_t lat_hist[NLBL_COMM_LAT_BUCKETS];
+};
+
 /**
  * NetLabel labeling protocol
  *
@@ -245,8 +290,13 @@ struct nlbl_dommap_addr {
  * @param proto.cip_doi CIPSO DOI
  * @param proto.cpl_doi CALIPSO DOI
  * @param proto.addrsel IP address selector(s)
+ * @param addrsel_count number of IP address selectors
  *
  * NetLabel type used to map LSM domains to labeling protocol configurations.
+ * The IP address selectors returned by the library are stored in a single
+ * array of @addrsel_count entries, linked together in order by their next
+ * pointers, so they can either be walked as a list or indexed directly, see
+ * nlbl_mgmt_addrsel().
  *
  */
 struct nlbl_dommap {
@@ -258,6 +308,7 @@ struct nlbl_dommap {
 		nlbl_clp_doi clp_doi;
 		struct nlbl_dommap_addr *addrsel;
 	} proto;
+	uint32_t addrsel_count;
 };
 
 /**
@@ -276,8 +327,168 @@ struct nlbl_addrmap {
 	nlbl_secctx label;
 };
 
+/**
+ * NetLabel result set
+ *
+ * Opaque container used by the *_result() list operations.  Every entry,
+ * string and address selector returned by one of these operations is stored in
+ * the result set and released with a single call to nlbl_result_free().
+ *
+ */
+struct nlbl_result;
+
+/**
+ * NetLabel static label table
+ *
+ * Opaque snapshot of the unlabeled static label configuration, indexed so that
+ * nlbl_unlbl_lookup() can find the static label the kernel would apply to
+ * unlabeled traffic without a linear search.
+ *
+ */
+struct nlbl_unlbl_table;
+
+/**
+ * NetLabel domain mapping table
+ *
+ * Opaque snapshot of the LSM domain mapping configuration, indexed so that
+ * nlbl_mgmt_resolve() can find the labeling the kernel would apply to outbound
+ * traffic without a linear search.
+ *
+ */
+struct nlbl_mgmt_table;
+
+/**
+ * NetLabel configuration
+ *
+ * Opaque description of a complete NetLabel configuration: the CIPSO and
+ * CALIPSO DOIs, the LSM domain mappings, the static labels and the unlabeled
+ * accept flag.  A configuration is either read from the kernel with
+ * nlbl_config_load() or built with nlbl_config_new() and the nlbl_config_*()
+ * operations.
+ *
+ */
+struct nlbl_config;
+
+/**
+ * NetLabel configuration operation types
+ *
+ * The operation types, numbered in the order nlbl_config_plan() emits them so
+ * that the kernel accepts every operation in turn.
+ *
+ */
+enum {
+	NLBL_CONFIG_C_UNSPEC,
+	NLBL_CONFIG_C_MAPDEL,
+	NLBL_CONFIG_C_STATICDEL,
+	NLBL_CONFIG_C_CIPSODEL,
+	NLBL_CONFIG_C_CALIPSODEL,
+	NLBL_CONFIG_C_CIPSOADD,
+	NLBL_CONFIG_C_CALIPSOADD,
+	NLBL_CONFIG_C_MAPADD,
+	NLBL_CONFIG_C_STATICADD,
+	NLBL_CONFIG_C_ACCEPT,
+	NLBL_CONFIG_C_MAX,
+};
+
+/**
+ * NetLabel configuration operation
+ * @param cmd the operation type
+ * @param domain the domain mapping, for NLBL_CONFIG_C_MAP*
+ * @param addr the static label, or the domain mapping's address selector
+ * @param accept the unlabeled accept flag, for NLBL_CONFIG_C_ACCEPT
+ * @param doi the DOI, for NLBL_CONFIG_C_CIPSO* and NLBL_CONFIG_C_CALIPSO*
+ * @param mtype the DOI mapping type
+ * @param tags the CIPSO tags
+ * @param lvls the CIPSO level mappings
+ * @param cats the CIPSO category mappings
+ *
+ * NetLabel type used to represent a single configuration change, equivalent
+ * to one call of the matching nlbl_mgmt_*(), nlbl_unlbl_*(), nlbl_cipso_*()
+ * or nlbl_calipso_*() operation.  A NULL domain or network interface refers
+ * to the default domain mapping or the default static labels.  Address
+ * selectors have an @addr type other than AF_UNSPEC.
+ *
+ */
+struct nlbl_config_op {
+	unsigned int cmd;
+	struct nlbl_dommap domain;
+	struct nlbl_addrmap addr;
+	uint8_t accept;
+	uint32_t doi;
+	uint32_t mtype;
+	struct nlbl_cip_tag_a tags;
+	struct nlbl_cip_lvl_a lvls;
+	struct nlbl_cip_cat_a cats;
+};
+
+/**
+ * NetLabel configuration snapshot
+ *
+ * Opaque, read only, view of a configuration written to a file with
+ * nlbl_config_export().  The snapshot file is mapped into memory and read in
+ * place by the nlbl_snapshot_*() operations.
+ *
+ */
+struct nlbl_snapshot;
+
+/**
+ * NetLabel mock kernel
+ *
+ * Opaque, in process, stand in for the kernel's NetLabel subsystem which
+ * answers the same generic netlink requests from a configuration held in
+ * memory, see nlbl_mock_new().  Used for testing and benchmarking without the
+ * kernel.
+ *
+ */
+struct nlbl_mock;
+
+/* Dump Callback Types */
+
+/**
+ * NetLabel dump callbacks
+ * @param arg the caller's argument
+ *
+ * NetLabel types used by the dump iterators, the callback is called once for
+ * each entry in the dump.  Any pointers passed to the callback, including
+ * strings, point into the receive buffer and are only valid until the callback
+ * returns.  The callback returns zero to continue the dump, positive values to
+ * stop the dump, and negative values to stop the dump with an error.
+ *
+ */
+typedef int (*nlbl_addrmap_cb)(const struct nlbl_addrmap *addr, void *arg);
+typedef int (*nlbl_dommap_cb)(const struct nlbl_dommap *domain, void *arg);
+typedef int (*nlbl_cip_doi_cb)(nlbl_cip_doi doi, nlbl_cip_mtype mtype,
+			       void *arg);
+typedef int (*nlbl_clp_doi_cb)(nlbl_clp_doi doi, nlbl_clp_mtype mtype,
+			       void *arg);
+
+/* Asynchronous Request Types */
+
+/**
+ * NetLabel asynchronous completion callback
+ * @param hndl the NetLabel handle
+ * @param id the request id
+ * @param rc the request result
+ * @param arg the caller's argument
+ *
+ * NetLabel type called by nlbl_async_dispatch() once for each asynchronous
+ * request when it completes.  The request id is the value returned when the
+ * request was sent.  For configuration operations @rc is zero on success and
+ * negative on failure, for dump iterators @rc is the number of entries passed
+ * to the dump callback or a negative value on failure.
+ *
+ */
+typedef void (*nlbl_async_cb)(struct nlbl_handle *hndl, int id, int rc,
+			      void *arg);
+
 /*
  * Functions
+ *
+ * The library may be used from several threads at once provided that each
+ * handle is only used by one thread at a time.  Operations passed a NULL
+ * handle use the calling thread's own default handle, which is closed when the
+ * thread exits.  nlbl_exit() and nlbl_mock_use() must not be called while
+ * other threads are sending requests.
  */
 
 /* Initialization and Termination */
@@ -289,6 +500,12 @@ void nlbl_exit(void);
 
 /* Communications Control */
 void nlbl_comm_timeout(uint32_t seconds);
+void nlbl_comm_hndl_timeout(struct nlbl_handle *hndl, uint32_t seconds);
+int nlbl_comm_hndl_bufsize(struct nlbl_handle *hndl,
+			   uint32_t rcvbuf, uint32_t msgbuf);
+void nlbl_comm_dump_hint(struct nlbl_handle *hndl, uint32_t entries);
+int nlbl_comm_stats(struct nlbl_handle *hndl, struct nlbl_comm_stats *stats);
+void nlbl_comm_stats_reset(struct nlbl_handle *hndl);
 
 /* Raw NetLabel I/O API */
 struct nlbl_handle *nlbl_comm_open(void);
@@ -296,6 +513,7 @@ int nlbl_comm_close(struct nlbl_handle *hndl);
 int nlbl_comm_recv(struct nlbl_handle *hndl, nlbl_msg **msg);
 int nlbl_comm_recv_raw(struct nlbl_handle *hndl, unsigned char **data);
 int nlbl_comm_send(struct nlbl_handle *hndl, nlbl_msg *msg);
+int nlbl_comm_fd(struct nlbl_handle *hndl);
 
 /* Message Handling */
 nlbl_msg *nlbl_msg_new(void);
@@ -308,6 +526,20 @@ struct nlmsgerr *nlbl_msg_err(nlbl_msg *msg);
 struct nlattr *nlbl_attr_head(nlbl_msg *msg);
 struct nlattr *nlbl_attr_find(nlbl_msg *msg, int nla_type);
 
+/* Request Batching */
+int nlbl_batch_begin(struct nlbl_handle *hndl);
+int nlbl_batch_commit(struct nlbl_handle *hndl, int **results);
+void nlbl_batch_abort(struct nlbl_handle *hndl);
+
+/* Asynchronous Requests */
+int nlbl_async_begin(struct nlbl_handle *hndl, nlbl_async_cb cb, void *arg);
+void nlbl_async_end(struct nlbl_handle *hndl);
+int nlbl_async_pending(struct nlbl_handle *hndl);
+int nlbl_async_dispatch(struct nlbl_handle *hndl);
+
+/* Result Sets */
+void nlbl_result_free(struct nlbl_result *result);
+
 /* Configuration Operations */
 
 /* Management */
@@ -322,8 +554,33 @@ int nlbl_mgmt_adddef(struct nlbl_handle *hndl,
 int nlbl_mgmt_del(struct nlbl_handle *hndl, char *domain);
 int nlbl_mgmt_deldef(struct nlbl_handle *hndl);
 int nlbl_mgmt_listall(struct nlbl_handle *hndl, struct nlbl_dommap **domains);
+int nlbl_mgmt_listall_iter(struct nlbl_handle *hndl,
+			   nlbl_dommap_cb cb, void *arg);
+int nlbl_mgmt_listall_result(struct nlbl_handle *hndl,
+			     struct nlbl_dommap **domains,
+			     struct nlbl_result **result);
 int nlbl_mgmt_listdef(struct nlbl_handle *hndl, uint16_t family,
 		      struct nlbl_dommap *domain);
+struct nlbl_dommap_addr *nlbl_mgmt_addrsel(const struct nlbl_dommap *domain,
+					   uint32_t index);
+
+/* Domain Mapping Resolution */
+int nlbl_mgmt_table_build(const struct nlbl_dommap *domains,
+			  size_t domain_count,
+			  const struct nlbl_dommap *defs,
+			  size_t def_count,
+			  struct nlbl_mgmt_table **table);
+int nlbl_mgmt_table_load(struct nlbl_handle *hndl,
+			 struct nlbl_mgmt_table **table);
+void nlbl_mgmt_table_free(struct nlbl_mgmt_table *table);
+const struct nlbl_dommap_addr *nlbl_mgmt_resolve(
+					const struct nlbl_mgmt_table *table,
+					const char *domain,
+					const struct nlbl_netaddr *addr);
+int nlbl_mgmt_resolve_batch(const struct nlbl_mgmt_table *table,
+			    const char *domain,
+			    const struct nlbl_netaddr *addrs, size_t count,
+			    const struct nlbl_dommap_addr **targets);
 
 /* Unlabeled Traffic */
 int nlbl_unlbl_accept(struct nlbl_handle *hndl, uint8_t allow_flag);
@@ -344,6 +601,34 @@ int nlbl_unlbl_staticlist(struct nlbl_handle *hndl,
 			  struct nlbl_addrmap **addrs);
 int nlbl_unlbl_staticlistdef(struct nlbl_handle *hndl,
 			     struct nlbl_addrmap **addrs);
+int nlbl_unlbl_staticlist_iter(struct nlbl_handle *hndl,
+			       nlbl_addrmap_cb cb, void *arg);
+int nlbl_unlbl_staticlistdef_iter(struct nlbl_handle *hndl,
+				  nlbl_addrmap_cb cb, void *arg);
+int nlbl_unlbl_staticlist_result(struct nlbl_handle *hndl,
+				 struct nlbl_addrmap **addrs,
+				 struct nlbl_result **result);
+int nlbl_unlbl_staticlistdef_result(struct nlbl_handle *hndl,
+				    struct nlbl_addrmap **addrs,
+				    struct nlbl_result **result);
+
+/* Static Label Lookup */
+int nlbl_unlbl_table_build(const struct nlbl_addrmap *addrs,
+			   size_t addr_count,
+			   const struct nlbl_addrmap *addrdefs,
+			   size_t addrdef_count,
+			   struct nlbl_unlbl_table **table);
+int nlbl_unlbl_table_load(struct nlbl_handle *hndl,
+			  struct nlbl_unlbl_table **table);
+void nlbl_unlbl_table_free(struct nlbl_unlbl_table *table);
+const struct nlbl_addrmap *nlbl_unlbl_lookup(
+					const struct nlbl_unlbl_table *table,
+					nlbl_netdev dev,
+					const struct nlbl_netaddr *addr);
+int nlbl_unlbl_lookup_batch(const struct nlbl_unlbl_table *table,
+			    nlbl_netdev dev,
+			    const struct nlbl_netaddr *addrs, size_t count,
+			    const struct nlbl_addrmap **labels);
 
 /* CIPSO Protocol */
 int nlbl_cipso_add_trans(struct nlbl_handle *hndl,
@@ -365,6 +650,8 @@ int nlbl_cipso_list(struct nlbl_handle *hndl,
 int nlbl_cipso_listall(struct nlbl_handle *hndl,
 		       nlbl_cip_doi **dois,
 		       nlbl_cip_mtype **mtypes);
+int nlbl_cipso_listall_iter(struct nlbl_handle *hndl,
+			    nlbl_cip_doi_cb cb, void *arg);
 /* CALIPSO Protocol */
 int nlbl_calipso_add_pass(struct nlbl_handle *hndl,
 			  nlbl_clp_doi doi);
@@ -375,5 +662,83 @@ int nlbl_calipso_list(struct nlbl_handle *hndl,
 int nlbl_calipso_listall(struct nlbl_handle *hndl,
 			 nlbl_clp_doi **dois,
 			 nlbl_clp_mtype **mtypes);
+int nlbl_calipso_listall_iter(struct nlbl_handle *hndl,
+			      nlbl_clp_doi_cb cb, void *arg);
+
+/* Configuration Reconciliation */
+struct nlbl_config *nlbl_config_new(void);
+int nlbl_config_load(struct nlbl_handle *hndl, struct nlbl_config **cfg);
+void nlbl_config_free(struct nlbl_config *cfg);
+int nlbl_config_mgmt_add(struct nlbl_config *cfg,
+			 const struct nlbl_dommap *domain,
+			 const struct nlbl_netaddr *addr);
+int nlbl_config_mgmt_adddef(struct nlbl_config *cfg,
+			    const struct nlbl_dommap *domain,
+			    const struct nlbl_netaddr *addr);
+int nlbl_config_mgmt_del(struct nlbl_config *cfg, const char *domain);
+int nlbl_config_mgmt_deldef(struct nlbl_config *cfg);
+int nlbl_config_unlbl_accept(struct nlbl_config *cfg, uint8_t allow_flag);
+int nlbl_config_unlbl_staticadd(struct nlbl_config *cfg,
+				const char *dev,
+				const struct nlbl_netaddr *addr,
+				const char *label);
+int nlbl_config_unlbl_staticadddef(struct nlbl_config *cfg,
+				   const struct nlbl_netaddr *addr,
+				   const char *label);
+int nlbl_config_unlbl_staticdel(struct nlbl_config *cfg,
+				const char *dev,
+				const struct nlbl_netaddr *addr);
+int nlbl_config_unlbl_staticdeldef(struct nlbl_config *cfg,
+				   const struct nlbl_netaddr *addr);
+int nlbl_config_cipso_add_trans(struct nlbl_config *cfg,
+				nlbl_cip_doi doi,
+				const struct nlbl_cip_tag_a *tags,
+				const struct nlbl_cip_lvl_a *lvls,
+				const struct nlbl_cip_cat_a *cats);
+int nlbl_config_cipso_add_pass(struct nlbl_config *cfg,
+			       nlbl_cip_doi doi,
+			       const struct nlbl_cip_tag_a *tags);
+int nlbl_config_cipso_add_local(struct nlbl_config *cfg, nlbl_cip_doi doi);
+int nlbl_config_cipso_del(struct nlbl_config *cfg, nlbl_cip_doi doi);
+int nlbl_config_calipso_add_pass(struct nlbl_config *cfg, nlbl_clp_doi doi);
+int nlbl_config_calipso_del(struct nlbl_config *cfg, nlbl_clp_doi doi);
+int nlbl_config_plan(const struct nlbl_config *cur,
+		     const struct nlbl_config *want,
+		     struct nlbl_config_op **ops,
+		     struct nlbl_result **result);
+int nlbl_config_apply(struct nlbl_handle *hndl,
+		      const struct nlbl_config_op *ops, size_t count,
+		      int **results);
+int nlbl_config_fingerprint(const struct nlbl_config *cfg,
+			    uint64_t *fingerprint);
+
+/* Configuration Snapshots */
+int nlbl_config_export(const struct nlbl_config *cfg, int fd);
+int nlbl_snapshot_open(const char *path, struct nlbl_snapshot **snap);
+void nlbl_snapshot_close(struct nlbl_snapshot *snap);
+int nlbl_snapshot_config(const struct nlbl_snapshot *snap,
+			 struct nlbl_config **cfg);
+uint8_t nlbl_snapshot_accept(const struct nlbl_snapshot *snap);
+int nlbl_snapshot_mgmt_iter(const struct nlbl_snapshot *snap,
+			    nlbl_dommap_cb cb, void *arg);
+int nlbl_snapshot_unlbl_iter(const struct nlbl_snapshot *snap,
+			     nlbl_addrmap_cb cb, void *arg);
+int nlbl_snapshot_cipso_iter(const struct nlbl_snapshot *snap,
+			     nlbl_cip_doi_cb cb, void *arg);
+int nlbl_snapshot_cipso(const struct nlbl_snapshot *snap,
+			nlbl_cip_doi doi,
+			nlbl_cip_mtype *mtype,
+			struct nlbl_cip_tag_a *tags,
+			struct nlbl_cip_lvl_a *lvls,
+			struct nlbl_cip_cat_a *cats);
+int nlbl_snapshot_calipso_iter(const struct nlbl_snapshot *snap,
+			       nlbl_clp_doi_cb cb, void *arg);
+
+/* Mock Kernel */
+struct nlbl_mock *nlbl_mock_new(struct nlbl_config *cfg);
+void nlbl_mock_free(struct nlbl_mock *mock);
+const struct nlbl_config *nlbl_mock_config(const struct nlbl_mock *mock);
+struct nlbl_handle *nlbl_mock_open(struct nlbl_mock *mock);
+void nlbl_mock_use(struct nlbl_mock *mock);
 
 #endif
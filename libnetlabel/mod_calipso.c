@@ -25,6 +25,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -34,52 +35,31 @@
 
 #include "netlabel_internal.h"
 
-/* Generic Netlink family ID */
-static uint16_t nlbl_calipso_fid = 0;
+/* NetLabel CALIPSO attribute policy */
+const struct nla_policy nlbl_calipso_policy[NLBL_CALIPSO_A_MAX + 1] = {
+	[NLBL_CALIPSO_A_DOI] = { .type = NLA_U32 },
+	[NLBL_CALIPSO_A_MTYPE] = { .type = NLA_U32 },
+};
 
 /*
  * Helper functions
  */
 
 /**
- * Create a new NetLabel CALIPSO message
- * @param command the NetLabel management command
+ * Get a NetLabel CALIPSO message
+ * @param hndl the NetLabel handle
+ * @param command the NetLabel CALIPSO command
  * @param flags the message flags
  *
- * This function creates a new NetLabel CALIPSO message using @command and
- * @flags.  Returns a pointer to the new message on success, or NULL on
- * failure.
+ * This function gets a NetLabel CALIPSO message for @command and @flags from
+ * the message pool of @hndl, see nlbl_msg_request().  Returns a pointer to the
+ * message on success, or NULL on failure.
  *
  */
-static nlbl_msg *nlbl_calipso_msg_new(uint16_t command, int flags)
+static nlbl_msg *nlbl_calipso_msg_new(struct nlbl_handle *hndl,
+				      uint16_t command, int flags)
 {
-	nlbl_msg *msg;
-	struct nlmsghdr *nl_hdr;
-	struct genlmsghdr *genl_hdr;
-
-	/* create a new message */
-	msg = nlbl_msg_new();
-	if (msg == NULL)
-		goto msg_new_failure;
-
-	/* setup the netlink header */
-	nl_hdr = nlbl_msg_nlhdr(msg);
-	if (nl_hdr == NULL)
-		goto msg_new_failure;
-	nl_hdr->nlmsg_type = nlbl_calipso_fid;
-	nl_hdr->nlmsg_flags = flags;
-
-	/* setup the generic netlink header */
-	genl_hdr = nlbl_msg_genlhdr(msg);
-	if (genl_hdr == NULL)
-		goto msg_new_failure;
-	genl_hdr->cmd = command;
-
-	return msg;
-
-msg_new_failure:
-	nlbl_msg_free(msg);
-	return NULL;
+	return nlbl_msg_request(hndl, NLBL_FAMILY_CALIPSO, command, flags);
 }
 
 /**
@@ -104,9 +84,10 @@ static int nlbl_calipso_recv(struct nlbl_handle *hndl, nlbl_msg **msg)
 
 	/* process the response */
 	nl_hdr = nlbl_msg_nlhdr(*msg);
-	if (nl_hdr == NULL || (nl_hdr->nlmsg_type != nlbl_calipso_fid &&
-			       nl_hdr->nlmsg_type != NLMSG_DONE &&
-			       nl_hdr->nlmsg_type != NLMSG_ERROR)) {
+	if (nl_hdr == NULL ||
+	    (nl_hdr->nlmsg_type != nlbl_family_id(hndl, NLBL_FAMILY_CALIPSO) &&
+	     nl_hdr->nlmsg_type != NLMSG_DONE &&
+	     nl_hdr->nlmsg_type != NLMSG_ERROR)) {
 		rc = -EBADMSG;
 		goto recv_failure;
 	}
@@ -137,41 +118,6 @@ static int nlbl_calipso_parse_ack(nlbl_msg *msg)
 	return nl_err->error;
 }
 
-/*
- * Init functions
- */
-
-/**
- * Perform any setup needed
- *
- * Do any setup needed for the CALIPSO component, including determining the
- * NetLabel CALIPSO Generic Netlink family ID.  Returns zero on success,
- * negative values on error.
- *
- */
-int nlbl_calipso_init(void)
-{
-	int rc = -ENOMEM;
-	struct nlbl_handle *hndl;
-
-	/* get a netlabel handle */
-	hndl = nlbl_comm_open();
-	if (hndl == NULL)
-		goto init_return;
-
-	/* resolve the family */
-	rc = genl_ctrl_resolve(hndl->nl_sock, NETLBL_NLTYPE_CALIPSO_NAME);
-	if (rc < 0)
-		goto init_return;
-	nlbl_calipso_fid = rc;
-
-	rc = 0;
-
-init_return:
-	nlbl_comm_close(hndl);
-	return rc;
-}
-
 /*
  * NetLabel operations
  */
@@ -182,9 +128,8 @@ init_return:
  * @param doi the CALIPSO DOI number
  *
  * Add the specified static CALIPSO label mapping information to the NetLabel
- * system.  If @hndl is NULL then the function will handle opening and closing
- * it's own NetLabel handle.  Returns zero on success, negative values on
- * failure.
+ * system.  If @hndl is NULL then the library's default NetLabel handle is
+ * used.  Returns zero on success, negative values on failure.
  *
  */
 int nlbl_calipso_add_pass(struct nlbl_handle *hndl,
@@ -199,18 +144,20 @@ int nlbl_calipso_add_pass(struct nlbl_handle *hndl,
 	/* sanity checks */
 	if (doi == 0)
 		return -EINVAL;
-	if (nlbl_calipso_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_CALIPSO);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto add_pass_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_calipso_msg_new(NLBL_CALIPSO_C_ADD, 0);
+	msg = nlbl_calipso_msg_new(p_hndl, NLBL_CALIPSO_C_ADD, 0);
 	if (msg == NULL)
 		goto add_pass_return;
 
@@ -223,6 +170,18 @@ int nlbl_calipso_add_pass(struct nlbl_handle *hndl,
 	if (rc != 0)
 		goto add_pass_return;
 
+	/* queue the request if we are batching */
+	if (nlbl_batch_active(p_hndl)) {
+		rc = nlbl_batch_queue(p_hndl, msg);
+		goto add_pass_return;
+	}
+
+	/* send the request without waiting if we are asynchronous */
+	if (nlbl_async_active(p_hndl)) {
+		rc = nlbl_async_request(p_hndl, msg);
+		goto add_pass_return;
+	}
+
 	/* send the request */
 	rc = nlbl_comm_send(p_hndl, msg);
 	if (rc <= 0) {
@@ -243,9 +202,8 @@ int nlbl_calipso_add_pass(struct nlbl_handle *hndl,
 	rc = nlbl_calipso_parse_ack(ans_msg);
 
 add_pass_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	nlbl_msg_free(msg);
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
 	nlbl_msg_free(nest_msg);
 	nlbl_msg_free(ans_msg);
 	return rc;
@@ -257,8 +215,8 @@ add_pass_return:
  * @param doi the CALIPSO DOI number
  *
  * Remove the CALIPSO label mapping with the DOI value matching @doi.  If @hndl
- * is NULL then the function will handle opening and closing it's own NetLabel
- * handle.  Returns zero on success, negative values on failure.
+ * is NULL then the library's default NetLabel handle is used.  Returns zero on
+ * success, negative values on failure.
  *
  */
 int nlbl_calipso_del(struct nlbl_handle *hndl, nlbl_clp_doi doi)
@@ -271,18 +229,20 @@ int nlbl_calipso_del(struct nlbl_handle *hndl, nlbl_clp_doi doi)
 	/* sanity checks */
 	if (doi == 0)
 		return -EINVAL;
-	if (nlbl_calipso_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_CALIPSO);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto del_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_calipso_msg_new(NLBL_CALIPSO_C_REMOVE, 0);
+	msg = nlbl_calipso_msg_new(p_hndl, NLBL_CALIPSO_C_REMOVE, 0);
 	if (msg == NULL)
 		goto del_return;
 
@@ -291,6 +251,18 @@ int nlbl_calipso_del(struct nlbl_handle *hndl, nlbl_clp_doi doi)
 	if (rc != 0)
 		goto del_return;
 
+	/* queue the request if we are batching */
+	if (nlbl_batch_active(p_hndl)) {
+		rc = nlbl_batch_queue(p_hndl, msg);
+		goto del_return;
+	}
+
+	/* send the request without waiting if we are asynchronous */
+	if (nlbl_async_active(p_hndl)) {
+		rc = nlbl_async_request(p_hndl, msg);
+		goto del_return;
+	}
+
 	/* send the request */
 	rc = nlbl_comm_send(p_hndl, msg);
 	if (rc <= 0) {
@@ -311,9 +283,8 @@ int nlbl_calipso_del(struct nlbl_handle *hndl, nlbl_clp_doi doi)
 	rc = nlbl_calipso_parse_ack(ans_msg);
 
 del_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	nlbl_msg_free(msg);
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
 	nlbl_msg_free(ans_msg);
 	return rc;
 }
@@ -326,8 +297,8 @@ del_return:
  *
  * Query the kernel for the specified CALIPSO mapping specified by @doi and
  * return the details of the mapping to the caller.  If @hndl is NULL then the
- * function will handle opening and closing it's own NetLabel handle.  Returns
- * zero on success, negative values on failure.
+ * library's default NetLabel handle is used.  Returns zero on success, negative
+ * values on failure.
  *
  */
 int nlbl_calipso_list(struct nlbl_handle *hndl,
@@ -344,18 +315,20 @@ int nlbl_calipso_list(struct nlbl_handle *hndl,
 	/* sanity checks */
 	if (doi == 0 || mtype == NULL)
 		return -EINVAL;
-	if (nlbl_calipso_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_CALIPSO);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto list_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_calipso_msg_new(NLBL_CALIPSO_C_LIST, 0);
+	msg = nlbl_calipso_msg_new(p_hndl, NLBL_CALIPSO_C_LIST, 0);
 	if (msg == NULL)
 		goto list_return;
 
@@ -399,157 +372,177 @@ int nlbl_calipso_list(struct nlbl_handle *hndl,
 	rc = 0;
 
 list_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	nlbl_msg_free(msg);
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
 	nlbl_msg_free(ans_msg);
 	return rc;
 }
 
+/* CALIPSO DOI dump state */
+struct nlbl_calipso_dump {
+	nlbl_clp_doi_cb cb;
+	void *arg;
+};
+
+/**
+ * Handle a CALIPSO DOI dump entry
+ * @param nla_head the entry's attributes
+ * @param attrlen the length of the attributes
+ * @param arg the CALIPSO DOI dump state
+ *
+ * Parse a CALIPSO DOI entry and pass it to the caller's callback.  Returns the
+ * return value of the caller's callback on success, negative values on
+ * failure.
+ *
+ */
+static int nlbl_calipso_listall_cb(struct nlattr *nla_head, int attrlen,
+				   void *arg)
+{
+	int rc;
+	struct nlbl_calipso_dump *dump = arg;
+	struct nlattr *tb[NLBL_CALIPSO_A_MAX + 1];
+
+	rc = nlbl_attr_parse(tb, NLBL_CALIPSO_A_MAX,
+			     nla_head, attrlen, nlbl_calipso_policy);
+	if (rc < 0)
+		return rc;
+	if (tb[NLBL_CALIPSO_A_DOI] == NULL || tb[NLBL_CALIPSO_A_MTYPE] == NULL)
+		return -EBADMSG;
+
+	return dump->cb(nla_get_u32(tb[NLBL_CALIPSO_A_DOI]),
+			nla_get_u32(tb[NLBL_CALIPSO_A_MTYPE]), dump->arg);
+}
+
+/* CALIPSO DOI arrays */
+struct nlbl_calipso_array {
+	struct nlbl_vec dois;
+	struct nlbl_vec mtypes;
+};
+
 /**
- * List the CALIPSO label mappings
+ * Add a CALIPSO DOI to the CALIPSO DOI arrays
+ * @param doi the DOI value
+ * @param mtype the mapping type
+ * @param arg the CALIPSO DOI arrays
+ *
+ * Append @doi and @mtype to the CALIPSO DOI arrays in @arg.  Returns zero on
+ * success, negative values on failure.
+ *
+ */
+static int nlbl_calipso_array_add(nlbl_clp_doi doi, nlbl_clp_mtype mtype,
+				  void *arg)
+{
+	struct nlbl_calipso_array *array = arg;
+	nlbl_clp_doi *doi_new;
+	nlbl_clp_mtype *mtype_new;
+
+	doi_new = nlbl_vec_add(&array->dois);
+	if (doi_new == NULL)
+		return -ENOMEM;
+	mtype_new = nlbl_vec_add(&array->mtypes);
+	if (mtype_new == NULL)
+		return -ENOMEM;
+
+	*doi_new = doi;
+	*mtype_new = mtype;
+
+	return 0;
+}
+
+/**
+ * List the CALIPSO label mappings using a callback
  * @param hndl the NetLabel handle
- * @param dois an array of DOI values
- * @param mtypes an array of the mapping types
+ * @param cb the callback
+ * @param arg the callback argument
  *
- * Query the kernel for the configured CALIPSO mappings and return two arrays;
- * @dois which contains the DOI values and @mtypes which contains the
- * type of mapping.  If @hndl is NULL then the function will handle opening
- * and closing it's own NetLabel handle.  Returns the number of mappings on
- * success, zero if no mappings exist, and negative values on failure.
+ * Query the kernel for the configured CALIPSO mappings, calling @cb once for
+ * each mapping with the DOI value and the type of mapping.  If @hndl is NULL
+ * then the library's default NetLabel handle is used.  Returns the number of
+ * mappings passed to @cb on success, negative values on failure.
  *
  */
-int nlbl_calipso_listall(struct nlbl_handle *hndl,
-			 nlbl_clp_doi **dois,
-			 nlbl_clp_mtype **mtypes)
+int nlbl_calipso_listall_iter(struct nlbl_handle *hndl,
+			      nlbl_clp_doi_cb cb, void *arg)
 {
 	int rc = -ENOMEM;
 	struct nlbl_handle *p_hndl = hndl;
-	unsigned char *data = NULL;
 	nlbl_msg *msg = NULL;
-	struct nlmsghdr *nl_hdr;
-	struct genlmsghdr *genl_hdr;
-	struct nlattr *nla_head;
-	struct nlattr *nla;
-	int data_len;
-	int data_attrlen;
-	nlbl_clp_doi *doi_a = NULL, *doi_a_new;
-	nlbl_clp_mtype *mtype_a = NULL, *mtype_a_new;
-	uint32_t count = 0;
+	struct nlbl_calipso_dump dump;
 
 	/* sanity checks */
-	if (dois == NULL || mtypes == NULL)
+	if (cb == NULL)
 		return -EINVAL;
-	if (nlbl_calipso_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_CALIPSO);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto listall_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_calipso_msg_new(NLBL_CALIPSO_C_LISTALL, NLM_F_DUMP);
-	if (msg == NULL) {
-		rc = -ENOMEM;
-		goto listall_return;
-	}
-
-	/* send the request */
-	rc = nlbl_comm_send(p_hndl, msg);
-	if (rc <= 0) {
-		if (rc == 0)
-			rc = -ENODATA;
+	msg = nlbl_calipso_msg_new(p_hndl, NLBL_CALIPSO_C_LISTALL, NLM_F_DUMP);
+	if (msg == NULL)
 		goto listall_return;
-	}
 
-	/* read all of the messages (multi-message response) */
-	do {
-		if (data) {
-			free(data);
-			data = NULL;
-		}
-
-		/* get the next set of messages */
-		rc = nlbl_comm_recv_raw(p_hndl, &data);
-		if (rc <= 0) {
-			if (rc == 0)
-				rc = -ENODATA;
-			goto listall_return;
-		}
-		data_len = rc;
-		nl_hdr = (struct nlmsghdr *)data;
-
-		/* check to see if this is a netlink control message we don't
-		 * care about */
-		if (nl_hdr->nlmsg_type == NLMSG_NOOP ||
-		    nl_hdr->nlmsg_type == NLMSG_ERROR ||
-		    nl_hdr->nlmsg_type == NLMSG_OVERRUN) {
-			rc = -EBADMSG;
-			goto listall_return;
-		}
-
-		/* loop through the messages */
-		while (nlmsg_ok(nl_hdr, data_len) &&
-		       nl_hdr->nlmsg_type != NLMSG_DONE) {
-			/* get the header pointers */
-			genl_hdr = (struct genlmsghdr *)nlmsg_data(nl_hdr);
-			if (genl_hdr == NULL ||
-			    genl_hdr->cmd != NLBL_CALIPSO_C_LISTALL) {
-				rc = -EBADMSG;
-				goto listall_return;
-			}
-			nla_head = (struct nlattr *)(&genl_hdr[1]);
-			data_attrlen = genlmsg_attrlen(genl_hdr, 0);
-
-			/* resize the arrays */
-			doi_a_new = realloc(doi_a,
-					    sizeof(nlbl_clp_doi) * (count + 1));
-			if (doi_a_new == NULL)
-				goto listall_return;
-			doi_a = doi_a_new;
-			mtype_a_new = realloc(mtype_a,
-					      sizeof(nlbl_clp_mtype) * (count + 1));
-			if (mtype_a_new == NULL)
-				goto listall_return;
-			mtype_a = mtype_a_new;
-
-			/* get the attribute information */
-			nla = nla_find(nla_head,
-				       data_attrlen, NLBL_CALIPSO_A_DOI);
-			if (nla == NULL)
-				goto listall_return;
-			doi_a[count] = nla_get_u32(nla);
-			nla = nla_find(nla_head,
-				       data_attrlen, NLBL_CALIPSO_A_MTYPE);
-			if (nla == NULL)
-				goto listall_return;
-			mtype_a[count] = nla_get_u32(nla);
-
-			count++;
-
-			/* next message */
-			nl_hdr = nlmsg_next(nl_hdr, &data_len);
-		}
-	} while (NL_MULTI_CONTINUE(nl_hdr));
-
-	*dois = doi_a;
-	*mtypes = mtype_a;
-	rc = count;
+	/* perform the dump */
+	dump.cb = cb;
+	dump.arg = arg;
+	if (nlbl_async_active(p_hndl))
+		rc = nlbl_async_dump(p_hndl, msg, NLBL_CALIPSO_C_LISTALL,
+				     nlbl_calipso_listall_cb,
+				     &dump, sizeof(dump), NULL);
+	else
+		rc = nlbl_comm_dump(p_hndl, msg, NLBL_CALIPSO_C_LISTALL,
+				    nlbl_calipso_listall_cb, &dump);
 
 listall_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
+	return rc;
+}
+
+/**
+ * List the CALIPSO label mappings
+ * @param hndl the NetLabel handle
+ * @param dois an array of DOI values
+ * @param mtypes an array of the mapping types
+ *
+ * Query the kernel for the configured CALIPSO mappings and return two arrays;
+ * @dois which contains the DOI values and @mtypes which contains the
+ * type of mapping.  If @hndl is NULL then the library's default NetLabel handle
+ * is used.  Returns the number of mappings on success, zero if no mappings
+ * exist, and negative values on failure.
+ *
+ */
+int nlbl_calipso_listall(struct nlbl_handle *hndl,
+			 nlbl_clp_doi **dois,
+			 nlbl_clp_mtype **mtypes)
+{
+	int rc;
+	struct nlbl_calipso_array array;
+
+	/* sanity checks */
+	if (dois == NULL || mtypes == NULL)
+		return -EINVAL;
+	if (nlbl_async_active(hndl))
+		return -EBUSY;
+
+	nlbl_vec_init(&array.dois, sizeof(**dois), nlbl_comm_hint(hndl));
+	nlbl_vec_init(&array.mtypes, sizeof(**mtypes), nlbl_comm_hint(hndl));
+	rc = nlbl_calipso_listall_iter(hndl, nlbl_calipso_array_add, &array);
 	if (rc < 0) {
-		if (doi_a != NULL)
-			free(doi_a);
-		if (mtype_a != NULL)
-			free(mtype_a);
+		nlbl_vec_free(&array.dois);
+		nlbl_vec_free(&array.mtypes);
+		return rc;
 	}
-	if (data != NULL)
-		free(data);
-	nlbl_msg_free(msg);
+
+	rc = array.dois.count;
+	*dois = nlbl_vec_finish(&array.dois);
+	*mtypes = nlbl_vec_finish(&array.mtypes);
 	return rc;
 }
@@ -1,32 +0,0 @@
-/*
- * CALIPSO Module Functions
- *
- * Author: Paul Moore <paul@paul-moore.com>
- * Author: Huw Davies <huw@codeweavers.com>
- *
- */
-
-/*
- * (c) Copyright Hewlett-Packard Development Company, L.P., 2006
- * (c) Copyright Huw Davies <huw@codeweavers.com>, 2015
- *
- * This program is free software: you can redistribute it and/or modify
- * it under the terms of version 2 of the GNU General Public License as
- * published by the Free Software Foundation.
- *
- * This program is distributed in the hope that it will be useful,
- * but WITHOUT ANY WARRANTY; without even the implied warranty of
- * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
- * GNU General Public License for more details.
- *
- * You should have received a copy of the GNU General Public License
- * along with this program.  If not, see <http://www.gnu.org/licenses/>.
- *
- */
-
-#ifndef _MOD_CALIPSO_H_
-#define _MOD_CALIPSO_H_
-
-int nlbl_calipso_init(void);
-
-#endif
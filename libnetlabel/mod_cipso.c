@@ -23,6 +23,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -32,52 +33,41 @@
 
 #include "netlabel_internal.h"
 
-/* Generic Netlink family ID */
-static uint16_t nlbl_cipso_fid = 0;
+/* NetLabel CIPSO attribute policy */
+const struct nla_policy nlbl_cipso_policy[NLBL_CIPSOV4_A_MAX + 1] = {
+	[NLBL_CIPSOV4_A_DOI] = { .type = NLA_U32 },
+	[NLBL_CIPSOV4_A_MTYPE] = { .type = NLA_U32 },
+	[NLBL_CIPSOV4_A_TAG] = { .type = NLA_U8 },
+	[NLBL_CIPSOV4_A_TAGLST] = { .type = NLA_NESTED },
+	[NLBL_CIPSOV4_A_MLSLVLLOC] = { .type = NLA_U32 },
+	[NLBL_CIPSOV4_A_MLSLVLREM] = { .type = NLA_U32 },
+	[NLBL_CIPSOV4_A_MLSLVL] = { .type = NLA_NESTED },
+	[NLBL_CIPSOV4_A_MLSLVLLST] = { .type = NLA_NESTED },
+	[NLBL_CIPSOV4_A_MLSCATLOC] = { .type = NLA_U32 },
+	[NLBL_CIPSOV4_A_MLSCATREM] = { .type = NLA_U32 },
+	[NLBL_CIPSOV4_A_MLSCAT] = { .type = NLA_NESTED },
+	[NLBL_CIPSOV4_A_MLSCATLST] = { .type = NLA_NESTED },
+};
 
 /*
  * Helper functions
  */
 
 /**
- * Create a new NetLabel CIPSO message
- * @param command the NetLabel management command
+ * Get a NetLabel CIPSO message
+ * @param hndl the NetLabel handle
+ * @param command the NetLabel CIPSO command
  * @param flags the message flags
  *
- * This function creates a new NetLabel CIPSO message using @command and
- * @flags.  Returns a pointer to the new message on success, or NULL on
- * failure.
+ * This function gets a NetLabel CIPSO message for @command and @flags from the
+ * message pool of @hndl, see nlbl_msg_request().  Returns a pointer to the
+ * message on success, or NULL on failure.
  *
  */
-static nlbl_msg *nlbl_cipso_msg_new(uint16_t command, int flags)
+static nlbl_msg *nlbl_cipso_msg_new(struct nlbl_handle *hndl,
+				    uint16_t command, int flags)
 {
-	nlbl_msg *msg;
-	struct nlmsghdr *nl_hdr;
-	struct genlmsghdr *genl_hdr;
-
-	/* create a new message */
-	msg = nlbl_msg_new();
-	if (msg == NULL)
-		goto msg_new_failure;
-
-	/* setup the netlink header */
-	nl_hdr = nlbl_msg_nlhdr(msg);
-	if (nl_hdr == NULL)
-		goto msg_new_failure;
-	nl_hdr->nlmsg_type = nlbl_cipso_fid;
-	nl_hdr->nlmsg_flags = flags;
-
-	/* setup the generic netlink header */
-	genl_hdr = nlbl_msg_genlhdr(msg);
-	if (genl_hdr == NULL)
-		goto msg_new_failure;
-	genl_hdr->cmd = command;
-
-	return msg;
-
-msg_new_failure:
-	nlbl_msg_free(msg);
-	return NULL;
+	return nlbl_msg_request(hndl, NLBL_FAMILY_CIPSO, command, flags);
 }
 
 /**
@@ -102,9 +92,10 @@ static int nlbl_cipso_recv(struct nlbl_handle *hndl, nlbl_msg **msg)
 
 	/* process the response */
 	nl_hdr = nlbl_msg_nlhdr(*msg);
-	if (nl_hdr == NULL || (nl_hdr->nlmsg_type != nlbl_cipso_fid &&
-			       nl_hdr->nlmsg_type != NLMSG_DONE &&
-			       nl_hdr->nlmsg_type != NLMSG_ERROR)) {
+	if (nl_hdr == NULL ||
+	    (nl_hdr->nlmsg_type != nlbl_family_id(hndl, NLBL_FAMILY_CIPSO) &&
+	     nl_hdr->nlmsg_type != NLMSG_DONE &&
+	     nl_hdr->nlmsg_type != NLMSG_ERROR)) {
 		rc = -EBADMSG;
 		goto recv_failure;
 	}
@@ -135,41 +126,6 @@ static int nlbl_cipso_parse_ack(nlbl_msg *msg)
 	return nl_err->error;
 }
 
-/*
- * Init functions
- */
-
-/**
- * Perform any setup needed
- *
- * Do any setup needed for the CIPSO component, including determining the
- * NetLabel CIPSO Generic Netlink family ID.  Returns zero on success,
- * negative values on error.
- *
- */
-int nlbl_cipso_init(void)
-{
-	int rc = -ENOMEM;
-	struct nlbl_handle *hndl;
-
-	/* get a netlabel handle */
-	hndl = nlbl_comm_open();
-	if (hndl == NULL)
-		goto init_return;
-
-	/* resolve the family */
-	rc = genl_ctrl_resolve(hndl->nl_sock, NETLBL_NLTYPE_CIPSOV4_NAME);
-	if (rc < 0)
-		goto init_return;
-	nlbl_cipso_fid = rc;
-
-	rc = 0;
-
-init_return:
-	nlbl_comm_close(hndl);
-	return rc;
-}
-
 /*
  * NetLabel operations
  */
@@ -183,9 +139,8 @@ init_return:
  * @param cats array of category mappings, may be NULL
  *
  * Add the specified static CIPSO label mapping information to the NetLabel
- * system.  If @hndl is NULL then the function will handle opening and closing
- * it's own NetLabel handle.  Returns zero on success, negative values on
- * failure.
+ * system.  If @hndl is NULL then the library's default NetLabel handle is
+ * used.  Returns zero on success, negative values on failure.
  *
  */
 int nlbl_cipso_add_trans(struct nlbl_handle *hndl,
@@ -207,18 +162,20 @@ int nlbl_cipso_add_trans(struct nlbl_handle *hndl,
 	    tags == NULL || tags->size == 0 ||
 	    lvls == NULL || lvls->size == 0)
 		return -EINVAL;
-	if (nlbl_cipso_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_CIPSO);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto add_std_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_cipso_msg_new(NLBL_CIPSOV4_C_ADD, 0);
+	msg = nlbl_cipso_msg_new(p_hndl, NLBL_CIPSOV4_C_ADD, 0);
 	if (msg == NULL)
 		goto add_std_return;
 
@@ -317,6 +274,18 @@ int nlbl_cipso_add_trans(struct nlbl_handle *hndl,
 	nlbl_msg_free(nest_msg_a);
 	nest_msg_a = NULL;
 
+	/* queue the request if we are batching */
+	if (nlbl_batch_active(p_hndl)) {
+		rc = nlbl_batch_queue(p_hndl, msg);
+		goto add_std_return;
+	}
+
+	/* send the request without waiting if we are asynchronous */
+	if (nlbl_async_active(p_hndl)) {
+		rc = nlbl_async_request(p_hndl, msg);
+		goto add_std_return;
+	}
+
 	/* send the request */
 	rc = nlbl_comm_send(p_hndl, msg);
 	if (rc <= 0) {
@@ -337,9 +306,8 @@ int nlbl_cipso_add_trans(struct nlbl_handle *hndl,
 	rc = nlbl_cipso_parse_ack(ans_msg);
 
 add_std_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	nlbl_msg_free(msg);
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
 	nlbl_msg_free(nest_msg_a);
 	nlbl_msg_free(nest_msg_b);
 	nlbl_msg_free(ans_msg);
@@ -353,9 +321,8 @@ add_std_return:
  * @param tags array of tags
  *
  * Add the specified static CIPSO label mapping information to the NetLabel
- * system.  If @hndl is NULL then the function will handle opening and closing
- * it's own NetLabel handle.  Returns zero on success, negative values on
- * failure.
+ * system.  If @hndl is NULL then the library's default NetLabel handle is
+ * used.  Returns zero on success, negative values on failure.
  *
  */
 int nlbl_cipso_add_pass(struct nlbl_handle *hndl,
@@ -373,18 +340,20 @@ int nlbl_cipso_add_pass(struct nlbl_handle *hndl,
 	if (doi == 0 ||
 	    tags == NULL || tags->size == 0)
 		return -EINVAL;
-	if (nlbl_cipso_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_CIPSO);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto add_pass_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_cipso_msg_new(NLBL_CIPSOV4_C_ADD, 0);
+	msg = nlbl_cipso_msg_new(p_hndl, NLBL_CIPSOV4_C_ADD, 0);
 	if (msg == NULL)
 		goto add_pass_return;
 
@@ -412,6 +381,18 @@ int nlbl_cipso_add_pass(struct nlbl_handle *hndl,
 	if (rc != 0)
 		goto add_pass_return;
 
+	/* queue the request if we are batching */
+	if (nlbl_batch_active(p_hndl)) {
+		rc = nlbl_batch_queue(p_hndl, msg);
+		goto add_pass_return;
+	}
+
+	/* send the request without waiting if we are asynchronous */
+	if (nlbl_async_active(p_hndl)) {
+		rc = nlbl_async_request(p_hndl, msg);
+		goto add_pass_return;
+	}
+
 	/* send the request */
 	rc = nlbl_comm_send(p_hndl, msg);
 	if (rc <= 0) {
@@ -432,9 +413,8 @@ int nlbl_cipso_add_pass(struct nlbl_handle *hndl,
 	rc = nlbl_cipso_parse_ack(ans_msg);
 
 add_pass_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	nlbl_msg_free(msg);
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
 	nlbl_msg_free(nest_msg);
 	nlbl_msg_free(ans_msg);
 	return rc;
@@ -446,9 +426,8 @@ add_pass_return:
  * @param doi the CIPSO DOI number
  *
  * Add the specified static CIPSO label mapping information to the NetLabel
- * system.  If @hndl is NULL then the function will handle opening and closing
- * it's own NetLabel handle.  Returns zero on success, negative values on
- * failure.
+ * system.  If @hndl is NULL then the library's default NetLabel handle is
+ * used.  Returns zero on success, negative values on failure.
  *
  */
 int nlbl_cipso_add_local(struct nlbl_handle *hndl, nlbl_cip_doi doi)
@@ -462,18 +441,20 @@ int nlbl_cipso_add_local(struct nlbl_handle *hndl, nlbl_cip_doi doi)
 	/* sanity checks */
 	if (doi == 0)
 		return -EINVAL;
-	if (nlbl_cipso_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_CIPSO);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto add_local_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_cipso_msg_new(NLBL_CIPSOV4_C_ADD, 0);
+	msg = nlbl_cipso_msg_new(p_hndl, NLBL_CIPSOV4_C_ADD, 0);
 	if (msg == NULL)
 		goto add_local_return;
 
@@ -498,6 +479,18 @@ int nlbl_cipso_add_local(struct nlbl_handle *hndl, nlbl_cip_doi doi)
 	if (rc != 0)
 		goto add_local_return;
 
+	/* queue the request if we are batching */
+	if (nlbl_batch_active(p_hndl)) {
+		rc = nlbl_batch_queue(p_hndl, msg);
+		goto add_local_return;
+	}
+
+	/* send the request without waiting if we are asynchronous */
+	if (nlbl_async_active(p_hndl)) {
+		rc = nlbl_async_request(p_hndl, msg);
+		goto add_local_return;
+	}
+
 	/* send the request */
 	rc = nlbl_comm_send(p_hndl, msg);
 	if (rc <= 0) {
@@ -518,9 +511,8 @@ int nlbl_cipso_add_local(struct nlbl_handle *hndl, nlbl_cip_doi doi)
 	rc = nlbl_cipso_parse_ack(ans_msg);
 
 add_local_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	nlbl_msg_free(msg);
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
 	nlbl_msg_free(nest_msg);
 	nlbl_msg_free(ans_msg);
 	return rc;
@@ -531,9 +523,9 @@ add_local_return:
  * @param hndl the NetLabel handle
  * @param doi the CIPSO DOI number
  *
- * Remove the CIPSO label mapping with the DOI value matching @doi.  If @hndl
- * is NULL then the function will handle opening and closing it's own NetLabel
- * handle.  Returns zero on success, negative values on failure.
+ * Remove the CIPSO label mapping with the DOI value matching @doi.  If @hndl is
+ * NULL then the library's default NetLabel handle is used.  Returns zero on
+ * success, negative values on failure.
  *
  */
 int nlbl_cipso_del(struct nlbl_handle *hndl, nlbl_cip_doi doi)
@@ -546,18 +538,20 @@ int nlbl_cipso_del(struct nlbl_handle *hndl, nlbl_cip_doi doi)
 	/* sanity checks */
 	if (doi == 0)
 		return -EINVAL;
-	if (nlbl_cipso_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_CIPSO);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto del_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_cipso_msg_new(NLBL_CIPSOV4_C_REMOVE, 0);
+	msg = nlbl_cipso_msg_new(p_hndl, NLBL_CIPSOV4_C_REMOVE, 0);
 	if (msg == NULL)
 		goto del_return;
 
@@ -566,6 +560,18 @@ int nlbl_cipso_del(struct nlbl_handle *hndl, nlbl_cip_doi doi)
 	if (rc != 0)
 		goto del_return;
 
+	/* queue the request if we are batching */
+	if (nlbl_batch_active(p_hndl)) {
+		rc = nlbl_batch_queue(p_hndl, msg);
+		goto del_return;
+	}
+
+	/* send the request without waiting if we are asynchronous */
+	if (nlbl_async_active(p_hndl)) {
+		rc = nlbl_async_request(p_hndl, msg);
+		goto del_return;
+	}
+
 	/* send the request */
 	rc = nlbl_comm_send(p_hndl, msg);
 	if (rc <= 0) {
@@ -586,9 +592,8 @@ int nlbl_cipso_del(struct nlbl_handle *hndl, nlbl_cip_doi doi)
 	rc = nlbl_cipso_parse_ack(ans_msg);
 
 del_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	nlbl_msg_free(msg);
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
 	nlbl_msg_free(ans_msg);
 	return rc;
 }
@@ -602,10 +607,10 @@ del_return:
  * @param lvls array of level mappings
  * @param cats array of category mappings
  *
- * Query the kernel for the specified CIPSO mapping specified by @doi and
- * return the details of the mapping to the caller.  If @hndl is NULL then the
- * function will handle opening and closing it's own NetLabel handle.  Returns
- * zero on success, negative values on failure.
+ * Query the kernel for the specified CIPSO mapping specified by @doi and return
+ * the details of the mapping to the caller.  If @hndl is NULL then the
+ * library's default NetLabel handle is used.  Returns zero on success, negative
+ * values on failure.
  *
  */
 int nlbl_cipso_list(struct nlbl_handle *hndl,
@@ -630,18 +635,20 @@ int nlbl_cipso_list(struct nlbl_handle *hndl,
 	if (doi == 0 ||
 	    mtype == NULL || tags == NULL || lvls == NULL || cats == NULL)
 		return -EINVAL;
-	if (nlbl_cipso_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_CIPSO);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto list_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_cipso_msg_new(NLBL_CIPSOV4_C_LIST, 0);
+	msg = nlbl_cipso_msg_new(p_hndl, NLBL_CIPSOV4_C_LIST, 0);
 	if (msg == NULL)
 		goto list_return;
 
@@ -764,157 +771,177 @@ int nlbl_cipso_list(struct nlbl_handle *hndl,
 	rc = 0;
 
 list_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	nlbl_msg_free(msg);
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
 	nlbl_msg_free(ans_msg);
 	return rc;
 }
 
+/* CIPSO DOI dump state */
+struct nlbl_cipso_dump {
+	nlbl_cip_doi_cb cb;
+	void *arg;
+};
+
 /**
- * List the CIPSO label mappings
+ * Handle a CIPSO DOI dump entry
+ * @param nla_head the entry's attributes
+ * @param attrlen the length of the attributes
+ * @param arg the CIPSO DOI dump state
+ *
+ * Parse a CIPSO DOI entry and pass it to the caller's callback.  Returns the
+ * return value of the caller's callback on success, negative values on
+ * failure.
+ *
+ */
+static int nlbl_cipso_listall_cb(struct nlattr *nla_head, int attrlen,
+				 void *arg)
+{
+	int rc;
+	struct nlbl_cipso_dump *dump = arg;
+	struct nlattr *tb[NLBL_CIPSOV4_A_MAX + 1];
+
+	rc = nlbl_attr_parse(tb, NLBL_CIPSOV4_A_MAX,
+			     nla_head, attrlen, nlbl_cipso_policy);
+	if (rc < 0)
+		return rc;
+	if (tb[NLBL_CIPSOV4_A_DOI] == NULL || tb[NLBL_CIPSOV4_A_MTYPE] == NULL)
+		return -EBADMSG;
+
+	return dump->cb(nla_get_u32(tb[NLBL_CIPSOV4_A_DOI]),
+			nla_get_u32(tb[NLBL_CIPSOV4_A_MTYPE]), dump->arg);
+}
+
+/* CIPSO DOI arrays */
+struct nlbl_cipso_array {
+	struct nlbl_vec dois;
+	struct nlbl_vec mtypes;
+};
+
+/**
+ * Add a CIPSO DOI to the CIPSO DOI arrays
+ * @param doi the DOI value
+ * @param mtype the mapping type
+ * @param arg the CIPSO DOI arrays
+ *
+ * Append @doi and @mtype to the CIPSO DOI arrays in @arg.  Returns zero on
+ * success, negative values on failure.
+ *
+ */
+static int nlbl_cipso_array_add(nlbl_cip_doi doi, nlbl_cip_mtype mtype,
+				void *arg)
+{
+	struct nlbl_cipso_array *array = arg;
+	nlbl_cip_doi *doi_new;
+	nlbl_cip_mtype *mtype_new;
+
+	doi_new = nlbl_vec_add(&array->dois);
+	if (doi_new == NULL)
+		return -ENOMEM;
+	mtype_new = nlbl_vec_add(&array->mtypes);
+	if (mtype_new == NULL)
+		return -ENOMEM;
+
+	*doi_new = doi;
+	*mtype_new = mtype;
+
+	return 0;
+}
+
+/**
+ * List the CIPSO label mappings using a callback
  * @param hndl the NetLabel handle
- * @param dois an array of DOI values
- * @param mtypes an array of the mapping types
+ * @param cb the callback
+ * @param arg the callback argument
  *
- * Query the kernel for the configured CIPSO mappings and return two arrays;
- * @dois which contains the DOI values and @mtypes which contains the
- * type of mapping.  If @hndl is NULL then the function will handle opening
- * and closing it's own NetLabel handle.  Returns the number of mappings on
- * success, zero if no mappings exist, and negative values on failure.
+ * Query the kernel for the configured CIPSO mappings, calling @cb once for
+ * each mapping with the DOI value and the type of mapping.  If @hndl is NULL
+ * then the library's default NetLabel handle is used.  Returns the number of
+ * mappings passed to @cb on success, negative values on failure.
  *
  */
-int nlbl_cipso_listall(struct nlbl_handle *hndl,
-		       nlbl_cip_doi **dois,
-		       nlbl_cip_mtype **mtypes)
+int nlbl_cipso_listall_iter(struct nlbl_handle *hndl,
+			    nlbl_cip_doi_cb cb, void *arg)
 {
 	int rc = -ENOMEM;
 	struct nlbl_handle *p_hndl = hndl;
-	unsigned char *data = NULL;
 	nlbl_msg *msg = NULL;
-	struct nlmsghdr *nl_hdr;
-	struct genlmsghdr *genl_hdr;
-	struct nlattr *nla_head;
-	struct nlattr *nla;
-	int data_len;
-	int data_attrlen;
-	nlbl_cip_doi *doi_a = NULL, *doi_a_new;
-	nlbl_cip_mtype *mtype_a = NULL, *mtype_a_new;
-	uint32_t count = 0;
+	struct nlbl_cipso_dump dump;
 
 	/* sanity checks */
-	if (dois == NULL || mtypes == NULL)
+	if (cb == NULL)
 		return -EINVAL;
-	if (nlbl_cipso_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_CIPSO);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto listall_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_cipso_msg_new(NLBL_CIPSOV4_C_LISTALL, NLM_F_DUMP);
-	if (msg == NULL) {
-		rc = -ENOMEM;
-		goto listall_return;
-	}
-
-	/* send the request */
-	rc = nlbl_comm_send(p_hndl, msg);
-	if (rc <= 0) {
-		if (rc == 0)
-			rc = -ENODATA;
+	msg = nlbl_cipso_msg_new(p_hndl, NLBL_CIPSOV4_C_LISTALL, NLM_F_DUMP);
+	if (msg == NULL)
 		goto listall_return;
-	}
 
-	/* read all of the messages (multi-message response) */
-	do {
-		if (data) {
-			free(data);
-			data = NULL;
-		}
+	/* perform the dump */
+	dump.cb = cb;
+	dump.arg = arg;
+	if (nlbl_async_active(p_hndl))
+		rc = nlbl_async_dump(p_hndl, msg, NLBL_CIPSOV4_C_LISTALL,
+				     nlbl_cipso_listall_cb,
+				     &dump, sizeof(dump), NULL);
+	else
+		rc = nlbl_comm_dump(p_hndl, msg, NLBL_CIPSOV4_C_LISTALL,
+				    nlbl_cipso_listall_cb, &dump);
 
-		/* get the next set of messages */
-		rc = nlbl_comm_recv_raw(p_hndl, &data);
-		if (rc <= 0) {
-			if (rc == 0)
-				rc = -ENODATA;
-			goto listall_return;
-		}
-		data_len = rc;
-		nl_hdr = (struct nlmsghdr *)data;
-
-		/* check to see if this is a netlink control message we don't
-		 * care about */
-		if (nl_hdr->nlmsg_type == NLMSG_NOOP ||
-		    nl_hdr->nlmsg_type == NLMSG_ERROR ||
-		    nl_hdr->nlmsg_type == NLMSG_OVERRUN) {
-			rc = -EBADMSG;
-			goto listall_return;
-		}
+listall_return:
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
+	return rc;
+}
 
-		/* loop through the messages */
-		while (nlmsg_ok(nl_hdr, data_len) &&
-		       nl_hdr->nlmsg_type != NLMSG_DONE) {
-			/* get the header pointers */
-			genl_hdr = (struct genlmsghdr *)nlmsg_data(nl_hdr);
-			if (genl_hdr == NULL ||
-			    genl_hdr->cmd != NLBL_CIPSOV4_C_LISTALL) {
-				rc = -EBADMSG;
-				goto listall_return;
-			}
-			nla_head = (struct nlattr *)(&genl_hdr[1]);
-			data_attrlen = genlmsg_attrlen(genl_hdr, 0);
-
-			/* resize the arrays */
-			doi_a_new = realloc(doi_a,
-					    sizeof(nlbl_cip_doi) * (count + 1));
-			if (doi_a_new == NULL)
-				goto listall_return;
-			doi_a = doi_a_new;
-			mtype_a_new = realloc(mtype_a,
-					      sizeof(nlbl_cip_mtype) * (count + 1));
-			if (mtype_a_new == NULL)
-				goto listall_return;
-			mtype_a = mtype_a_new;
-
-			/* get the attribute information */
-			nla = nla_find(nla_head,
-				       data_attrlen, NLBL_CIPSOV4_A_DOI);
-			if (nla == NULL)
-				goto listall_return;
-			doi_a[count] = nla_get_u32(nla);
-			nla = nla_find(nla_head,
-				       data_attrlen, NLBL_CIPSOV4_A_MTYPE);
-			if (nla == NULL)
-				goto listall_return;
-			mtype_a[count] = nla_get_u32(nla);
-
-			count++;
-
-			/* next message */
-			nl_hdr = nlmsg_next(nl_hdr, &data_len);
-		}
-	} while (NL_MULTI_CONTINUE(nl_hdr));
+/**
+ * List the CIPSO label mappings
+ * @param hndl the NetLabel handle
+ * @param dois an array of DOI values
+ * @param mtypes an array of the mapping types
+ *
+ * Query the kernel for the configured CIPSO mappings and return two arrays;
+ * @dois which contains the DOI values and @mtypes which contains the
+ * type of mapping.  If @hndl is NULL then the library's default NetLabel handle
+ * is used.  Returns the number of mappings on success, zero if no mappings
+ * exist, and negative values on failure.
+ *
+ */
+int nlbl_cipso_listall(struct nlbl_handle *hndl,
+		       nlbl_cip_doi **dois,
+		       nlbl_cip_mtype **mtypes)
+{
+	int rc;
+	struct nlbl_cipso_array array;
 
-	*dois = doi_a;
-	*mtypes = mtype_a;
-	rc = count;
+	/* sanity checks */
+	if (dois == NULL || mtypes == NULL)
+		return -EINVAL;
+	if (nlbl_async_active(hndl))
+		return -EBUSY;
 
-listall_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
+	nlbl_vec_init(&array.dois, sizeof(**dois), nlbl_comm_hint(hndl));
+	nlbl_vec_init(&array.mtypes, sizeof(**mtypes), nlbl_comm_hint(hndl));
+	rc = nlbl_cipso_listall_iter(hndl, nlbl_cipso_array_add, &array);
 	if (rc < 0) {
-		if (doi_a != NULL)
-			free(doi_a);
-		if (mtype_a != NULL)
-			free(mtype_a);
-	}
-	if (data != NULL)
-		free(data);
-	nlbl_msg_free(msg);
+		nlbl_vec_free(&array.dois);
+		nlbl_vec_free(&array.mtypes);
+		return rc;
+	}
+
+	rc = array.dois.count;
+	*dois = nlbl_vec_finish(&array.dois);
+	*mtypes = nlbl_vec_finish(&array.mtypes);
 	return rc;
 }
@@ -32,52 +32,41 @@
 
 #include "netlabel_internal.h"
 
-/* Generic Netlink family ID */
-static uint16_t nlbl_mgmt_fid = 0;
+/* NetLabel management attribute policy */
+const struct nla_policy nlbl_mgmt_policy[NLBL_MGMT_A_MAX + 1] = {
+	[NLBL_MGMT_A_DOMAIN] = { .type = NLA_STRING },
+	[NLBL_MGMT_A_PROTOCOL] = { .type = NLA_U32 },
+	[NLBL_MGMT_A_VERSION] = { .type = NLA_U32 },
+	[NLBL_MGMT_A_CV4DOI] = { .type = NLA_U32 },
+	[NLBL_MGMT_A_IPV6ADDR] = NLBL_POLICY_LEN(sizeof(struct in6_addr)),
+	[NLBL_MGMT_A_IPV6MASK] = NLBL_POLICY_LEN(sizeof(struct in6_addr)),
+	[NLBL_MGMT_A_IPV4ADDR] = NLBL_POLICY_LEN(sizeof(struct in_addr)),
+	[NLBL_MGMT_A_IPV4MASK] = NLBL_POLICY_LEN(sizeof(struct in_addr)),
+	[NLBL_MGMT_A_ADDRSELECTOR] = { .type = NLA_NESTED },
+	[NLBL_MGMT_A_SELECTORLIST] = { .type = NLA_NESTED },
+	[NLBL_MGMT_A_FAMILY] = { .type = NLA_U16 },
+	[NLBL_MGMT_A_CLPDOI] = { .type = NLA_U32 },
+};
 
 /*
  * Helper functions
  */
 
 /**
- * Create a new NetLabel management message
+ * Get a NetLabel management message
+ * @param hndl the NetLabel handle
  * @param command the NetLabel management command
  * @param flags the message flags
  *
- * This function creates a new NetLabel management message using @command and
- * @flags.  Returns a pointer to the new message on success, or NULL on
- * failure.
+ * This function gets a NetLabel management message for @command and @flags from
+ * the message pool of @hndl, see nlbl_msg_request().  Returns a pointer to the
+ * message on success, or NULL on failure.
  *
  */
-static nlbl_msg *nlbl_mgmt_msg_new(uint16_t command, int flags)
+static nlbl_msg *nlbl_mgmt_msg_new(struct nlbl_handle *hndl,
+				   uint16_t command, int flags)
 {
-	nlbl_msg *msg;
-	struct nlmsghdr *nl_hdr;
-	struct genlmsghdr *genl_hdr;
-
-	/* create a new message */
-	msg = nlbl_msg_new();
-	if (msg == NULL)
-		goto msg_new_failure;
-
-	/* setup the netlink header */
-	nl_hdr = nlbl_msg_nlhdr(msg);
-	if (nl_hdr == NULL)
-		goto msg_new_failure;
-	nl_hdr->nlmsg_type = nlbl_mgmt_fid;
-	nl_hdr->nlmsg_flags = flags;
-
-	/* setup the generic netlink header */
-	genl_hdr = nlbl_msg_genlhdr(msg);
-	if (genl_hdr == NULL)
-		goto msg_new_failure;
-	genl_hdr->cmd = command;
-
-	return msg;
-
-msg_new_failure:
-	nlbl_msg_free(msg);
-	return NULL;
+	return nlbl_msg_request(hndl, NLBL_FAMILY_MGMT, command, flags);
 }
 
 /**
@@ -102,9 +91,10 @@ static int nlbl_mgmt_recv(struct nlbl_handle *hndl, nlbl_msg **msg)
 
 	/* process the response */
 	nl_hdr = nlbl_msg_nlhdr(*msg);
-	if (nl_hdr == NULL || (nl_hdr->nlmsg_type != nlbl_mgmt_fid &&
-			       nl_hdr->nlmsg_type != NLMSG_DONE &&
-			       nl_hdr->nlmsg_type != NLMSG_ERROR)) {
+	if (nl_hdr == NULL ||
+	    (nl_hdr->nlmsg_type != nlbl_family_id(hndl, NLBL_FAMILY_MGMT) &&
+	     nl_hdr->nlmsg_type != NLMSG_DONE &&
+	     nl_hdr->nlmsg_type != NLMSG_ERROR)) {
 		rc = -EBADMSG;
 		goto recv_failure;
 	}
@@ -136,148 +126,194 @@ static int nlbl_mgmt_parse_ack(nlbl_msg *msg)
 }
 
 /**
- * Parse a LIST message with address selectors
+ * Parse an address selector
+ * @param nla_head the NLBL_MGMT_A_ADDRSELECTOR attribute
+ * @param addr the address selector
+ *
+ * Parse the NLBL_MGMT_A_ADDRSELECTOR attribute and populate @addr with the
+ * information, the next pointer in @addr is left untouched.  Returns zero on
+ * success, negative values on failure.
+ *
+ */
+static int nlbl_mgmt_parse_addr(const struct nlattr *nla_head,
+				struct nlbl_dommap_addr *addr)
+{
+	struct nlattr *tb[NLBL_MGMT_A_MAX + 1];
+
+	if (nlbl_attr_parse(tb, NLBL_MGMT_A_MAX,
+			    nla_data(nla_head), nla_len(nla_head),
+			    nlbl_mgmt_policy) < 0)
+		return -EINVAL;
+
+	if (tb[NLBL_MGMT_A_IPV4ADDR] != NULL) {
+		if (tb[NLBL_MGMT_A_IPV4MASK] == NULL)
+			return -EINVAL;
+		memcpy(&addr->addr.addr.v4,
+		       nla_data(tb[NLBL_MGMT_A_IPV4ADDR]),
+		       sizeof(struct in_addr));
+		memcpy(&addr->addr.mask.v4,
+		       nla_data(tb[NLBL_MGMT_A_IPV4MASK]),
+		       sizeof(struct in_addr));
+		addr->addr.type = AF_INET;
+		if (tb[NLBL_MGMT_A_PROTOCOL] == NULL)
+			return -EINVAL;
+		addr->proto_type = nla_get_u32(tb[NLBL_MGMT_A_PROTOCOL]);
+		switch (addr->proto_type) {
+		case NETLBL_NLTYPE_CIPSOV4:
+			if (tb[NLBL_MGMT_A_CV4DOI] == NULL)
+				return -EINVAL;
+			addr->proto.cip_doi =
+				nla_get_u32(tb[NLBL_MGMT_A_CV4DOI]);
+			break;
+		}
+	} else if (tb[NLBL_MGMT_A_IPV6ADDR] != NULL) {
+		if (tb[NLBL_MGMT_A_IPV6MASK] == NULL)
+			return -EINVAL;
+		memcpy(&addr->addr.addr.v6,
+		       nla_data(tb[NLBL_MGMT_A_IPV6ADDR]),
+		       sizeof(struct in6_addr));
+		memcpy(&addr->addr.mask.v6,
+		       nla_data(tb[NLBL_MGMT_A_IPV6MASK]),
+		       sizeof(struct in6_addr));
+		addr->addr.type = AF_INET6;
+		if (tb[NLBL_MGMT_A_PROTOCOL] == NULL)
+			return -EINVAL;
+		addr->proto_type = nla_get_u32(tb[NLBL_MGMT_A_PROTOCOL]);
+		switch (addr->proto_type) {
+		case NETLBL_NLTYPE_CALIPSO:
+			if (tb[NLBL_MGMT_A_CLPDOI] == NULL)
+				return -EINVAL;
+			addr->proto.clp_doi =
+				nla_get_u32(tb[NLBL_MGMT_A_CLPDOI]);
+			break;
+		}
+	} else
+		return -EINVAL;
+
+	return 0;
+}
+
+/**
+ * Count the address selectors in a NLBL_MGMT_A_SELECTORLIST attribute
  * @param nla_head the NLBL_MGMT_A_SELECTORLIST attribute
- * @param domain the domain mapping entry
  *
- * Parse the NLBL_MGMT_A_SELECTORLIST attribute and populate @domain with
- * the information.  Returns zero on success, negative values on failure.
+ * Returns the number of NLBL_MGMT_A_ADDRSELECTOR attributes in @nla_head.
  *
  */
-static int nlbl_mgmt_list_addr(const struct nlattr *nla_head,
-			       struct nlbl_dommap *domain)
+static unsigned int nlbl_mgmt_addrsel_count(const struct nlattr *nla_head)
 {
-	struct nlbl_dommap_addr *addr_iter;
 	struct nlattr *nla_a;
-	struct nlattr *nla_b;
 	int nla_a_rem;
+	unsigned int count = 0;
 
-	domain->proto_type = NETLBL_NLTYPE_ADDRSELECT;
+	nla_for_each_attr(nla_a,
+			  nla_data(nla_head), nla_len(nla_head),
+			  nla_a_rem)
+		if (nla_a->nla_type == NLBL_MGMT_A_ADDRSELECTOR)
+			count++;
+
+	return count;
+}
+
+/**
+ * Parse the address selectors in a NLBL_MGMT_A_SELECTORLIST attribute
+ * @param nla_head the NLBL_MGMT_A_SELECTORLIST attribute
+ * @param addrsel the address selector array
+ *
+ * Parse the address selectors in @nla_head into @addrsel, which must have
+ * room for nlbl_mgmt_addrsel_count() entries, and chain the entries together
+ * using their next pointers.  Returns the number of address selectors on
+ * success, negative values on failure.
+ *
+ */
+static int nlbl_mgmt_addrsel_parse(const struct nlattr *nla_head,
+				   struct nlbl_dommap_addr *addrsel)
+{
+	struct nlattr *nla_a;
+	int nla_a_rem;
+	int count = 0;
 
-	/* parse the attributes */
 	nla_for_each_attr(nla_a,
 			  nla_data(nla_head), nla_len(nla_head),
 			  nla_a_rem)
-	if (nla_a->nla_type == NLBL_MGMT_A_ADDRSELECTOR) {
-		addr_iter = malloc(sizeof(*addr_iter));
-		if (addr_iter == NULL)
-			return -ENOMEM;
-		memset(addr_iter, 0, sizeof(*addr_iter));
-		if (domain->proto.addrsel != NULL) {
-			struct nlbl_dommap_addr *iter;
-			iter = domain->proto.addrsel;
-			while (iter->next != NULL)
-				iter = iter->next;
-			iter->next = addr_iter;
-		} else
-			domain->proto.addrsel = addr_iter;
-
-		nla_b = nla_find(nla_data(nla_a), nla_len(nla_a),
-				 NLBL_MGMT_A_IPV4ADDR);
-		if (nla_b != NULL) {
-			if (nla_len(nla_b) != sizeof(struct in_addr))
-				return -EINVAL;
-			memcpy(&addr_iter->addr.addr.v4,
-			       nla_data(nla_b), nla_len(nla_b));
-			nla_b = nla_find(nla_data(nla_a),
-					 nla_len(nla_a),
-					 NLBL_MGMT_A_IPV4MASK);
-			if (nla_b == NULL ||
-			    nla_len(nla_b) != sizeof(struct in_addr))
-				return -EINVAL;
-			memcpy(&addr_iter->addr.mask.v4,
-			       nla_data(nla_b), nla_len(nla_b));
-			addr_iter->addr.type = AF_INET;
-			nla_b = nla_find(nla_data(nla_a),
-					 nla_len(nla_a),
-					 NLBL_MGMT_A_PROTOCOL);
-			if (nla_b == NULL)
-				return -EINVAL;
-			addr_iter->proto_type = nla_get_u32(nla_b);
-			switch (addr_iter->proto_type) {
-			case NETLBL_NLTYPE_CIPSOV4:
-				nla_b = nla_find(nla_data(nla_a),
-						 nla_len(nla_a),
-						 NLBL_MGMT_A_CV4DOI);
-				if (nla_b == NULL)
-					return -EINVAL;
-				addr_iter->proto.cip_doi =
-					nla_get_u32(nla_b);
-				break;
-			}
-		} else if ((nla_b = nla_find(nla_data(nla_a),
-					     nla_len(nla_a),
-					     NLBL_MGMT_A_IPV6ADDR))) {
-			if (nla_len(nla_b) != sizeof(struct in6_addr))
-				return -EINVAL;
-			memcpy(&addr_iter->addr.addr.v6,
-			       nla_data(nla_b), nla_len(nla_b));
-			nla_b = nla_find(nla_data(nla_a),
-					 nla_len(nla_a),
-					 NLBL_MGMT_A_IPV6MASK);
-			if (nla_b == NULL ||
-			    nla_len(nla_b) != sizeof(struct in6_addr))
+		if (nla_a->nla_type == NLBL_MGMT_A_ADDRSELECTOR) {
+			memset(&addrsel[count], 0, sizeof(*addrsel));
+			if (nlbl_mgmt_parse_addr(nla_a, &addrsel[count]) != 0)
 				return -EINVAL;
-			memcpy(&addr_iter->addr.mask.v6,
-			       nla_data(nla_b), nla_len(nla_b));
-			addr_iter->addr.type = AF_INET6;
-			nla_b = nla_find(nla_data(nla_a),
-					 nla_len(nla_a),
-					 NLBL_MGMT_A_PROTOCOL);
-			if (nla_b == NULL)
-				return -EINVAL;
-			addr_iter->proto_type = nla_get_u32(nla_b);
-			switch (addr_iter->proto_type) {
-			case NETLBL_NLTYPE_CALIPSO:
-				nla_b = nla_find(nla_data(nla_a),
-						 nla_len(nla_a),
-						 NLBL_MGMT_A_CLPDOI);
-				if (nla_b == NULL)
-					return -EINVAL;
-				addr_iter->proto.clp_doi =
-					nla_get_u32(nla_b);
-				break;
-			}
-		} else
-			return -EINVAL;
-	}
+			if (count > 0)
+				addrsel[count - 1].next = &addrsel[count];
+			count++;
+		}
 
-	return 0;
+	return count;
 }
 
-/*
- * Init functions
+/**
+ * Parse a LIST message with address selectors
+ * @param nla_head the NLBL_MGMT_A_SELECTORLIST attribute
+ * @param domain the domain mapping entry
+ *
+ * Parse the NLBL_MGMT_A_SELECTORLIST attribute and populate @domain with
+ * the information.  The address selectors are stored in a single array, see
+ * struct nlbl_dommap.  Returns zero on success, negative values on failure.
+ *
  */
+static int nlbl_mgmt_list_addr(const struct nlattr *nla_head,
+			       struct nlbl_dommap *domain)
+{
+	int rc;
+	struct nlbl_dommap_addr *addrsel = NULL;
+	unsigned int count;
+
+	count = nlbl_mgmt_addrsel_count(nla_head);
+	if (count > 0) {
+		addrsel = calloc(count, sizeof(*addrsel));
+		if (addrsel == NULL)
+			return -ENOMEM;
+		rc = nlbl_mgmt_addrsel_parse(nla_head, addrsel);
+		if (rc < 0) {
+			free(addrsel);
+			return rc;
+		}
+	}
+
+	domain->proto_type = NETLBL_NLTYPE_ADDRSELECT;
+	domain->proto.addrsel = addrsel;
+	domain->addrsel_count = count;
+
+	return 0;
+}
 
 /**
- * Perform any setup needed
+ * Handle a protocol dump entry
+ * @param nla_head the entry's attributes
+ * @param attrlen the length of the attributes
+ * @param arg the protocol array
  *
- * Do any setup needed for the management component, including determining the
- * NetLabel Mangement Generic Netlink family ID.  Returns zero on success,
- * negative values on error.
+ * Parse a protocol entry and append it to the protocol array in @arg.  Returns
+ * zero on success, negative values on failure.
  *
  */
-int nlbl_mgmt_init(void)
+static int nlbl_mgmt_protocols_cb(struct nlattr *nla_head, int attrlen,
+				  void *arg)
 {
-	int rc = -ENOMEM;
-	struct nlbl_handle *hndl;
-
-	/* get a netlabel handle */
-	hndl = nlbl_comm_open();
-	if (hndl == NULL)
-		goto init_return;
+	int rc;
+	struct nlattr *tb[NLBL_MGMT_A_MAX + 1];
+	nlbl_proto *proto;
 
-	/* resolve the family */
-	rc = genl_ctrl_resolve(hndl->nl_sock, NETLBL_NLTYPE_MGMT_NAME);
+	rc = nlbl_attr_parse(tb, NLBL_MGMT_A_MAX,
+			     nla_head, attrlen, nlbl_mgmt_policy);
 	if (rc < 0)
-		goto init_return;
-	nlbl_mgmt_fid = rc;
+		return rc;
+	if (tb[NLBL_MGMT_A_PROTOCOL] == NULL)
+		return -EBADMSG;
 
-	rc = 0;
+	proto = nlbl_vec_add(arg);
+	if (proto == NULL)
+		return -ENOMEM;
+	*proto = nla_get_u32(tb[NLBL_MGMT_A_PROTOCOL]);
 
-init_return:
-	nlbl_comm_close(hndl);
-	return rc;
+	return 0;
 }
 
 /*
@@ -290,125 +326,54 @@ init_return:
  * @param protocols protocol array
  *
  * Query the NetLabel subsystem and return the supported protocols in
- * @protocols.  If @hndl is NULL then the function will handle opening and
- * closing it's own NetLabel handle.  Returns the number of protocols on
- * success, zero if no protocols are supported, and negative values on failure.
+ * @protocols.  If @hndl is NULL then the library's default NetLabel handle is
+ * used.  Returns the number of protocols on success, zero if no protocols are
+ * supported, and negative values on failure.
  *
  */
 int nlbl_mgmt_protocols(struct nlbl_handle *hndl, nlbl_proto **protocols)
 {
 	int rc = -ENOMEM;
 	struct nlbl_handle *p_hndl = hndl;
-	unsigned char *data = NULL;
 	nlbl_msg *msg = NULL;
-	struct nlmsghdr *nl_hdr;
-	struct genlmsghdr *genl_hdr;
-	struct nlattr *nla_head;
-	struct nlattr *nla;
-	int data_len;
-	int data_attrlen;
-	nlbl_proto *protos = NULL, *protos_new;
-	uint32_t protos_count = 0;
+	struct nlbl_vec protos;
 
 	/* sanity checks */
 	if (protocols == NULL)
 		return -EINVAL;
-	if (nlbl_mgmt_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_MGMT);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
+
+	nlbl_vec_init(&protos, sizeof(**protocols), 0);
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto protocols_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_mgmt_msg_new(NLBL_MGMT_C_PROTOCOLS, NLM_F_DUMP);
-	if (msg == NULL) {
-		rc = -ENOMEM;
+	msg = nlbl_mgmt_msg_new(p_hndl, NLBL_MGMT_C_PROTOCOLS, NLM_F_DUMP);
+	if (msg == NULL)
 		goto protocols_return;
-	}
 
-	/* send the request */
-	rc = nlbl_comm_send(p_hndl, msg);
-	if (rc <= 0) {
-		if (rc == 0)
-			rc = -ENODATA;
+	/* perform the dump */
+	rc = nlbl_comm_dump(p_hndl, msg, NLBL_MGMT_C_PROTOCOLS,
+			    nlbl_mgmt_protocols_cb, &protos);
+	if (rc < 0)
 		goto protocols_return;
-	}
-
-	/* read all of the messages (multi-message response) */
-	do {
-		if (data != NULL) {
-			free(data);
-			data = NULL;
-		}
-
-		/* get the next set of messages */
-		rc = nlbl_comm_recv_raw(p_hndl, &data);
-		if (rc <= 0) {
-			if (rc == 0)
-				rc = -ENODATA;
-			goto protocols_return;
-		}
-		data_len = rc;
-		nl_hdr = (struct nlmsghdr *)data;
-
-		/* check to see if this is a netlink control message we don't
-		 * care about */
-		if (nl_hdr->nlmsg_type == NLMSG_NOOP ||
-		    nl_hdr->nlmsg_type == NLMSG_ERROR ||
-		    nl_hdr->nlmsg_type == NLMSG_OVERRUN) {
-			rc = -EBADMSG;
-			goto protocols_return;
-		}
-
-		/* loop through the messages */
-		while (nlmsg_ok(nl_hdr, data_len) &&
-		       nl_hdr->nlmsg_type != NLMSG_DONE) {
-			/* get the header pointers */
-			genl_hdr = (struct genlmsghdr *)nlmsg_data(nl_hdr);
-			if (genl_hdr == NULL ||
-			    genl_hdr->cmd != NLBL_MGMT_C_PROTOCOLS) {
-				rc = -EBADMSG;
-				goto protocols_return;
-			}
-			nla_head = (struct nlattr *)(&genl_hdr[1]);
-			data_attrlen = genlmsg_attrlen(genl_hdr, 0);
-
-			/* resize the array */
-			protos_new = realloc(protos,
-					     sizeof(nlbl_proto) *
-					     (protos_count + 1));
-			if (protos_new == NULL)
-				goto protocols_return;
-			protos = protos_new;
-
-			/* get the attribute information */
-			nla = nla_find(nla_head,
-				       data_attrlen, NLBL_MGMT_A_PROTOCOL);
-			if (nla == NULL)
-				goto protocols_return;
-			protos[protos_count] = nla_get_u32(nla);
-			protos_count++;
-
-			/* next message */
-			nl_hdr = nlmsg_next(nl_hdr, &data_len);
-		}
-	} while (NL_MULTI_CONTINUE(nl_hdr));
 
-	*protocols = protos;
-	rc = protos_count;
+	rc = protos.count;
+	*protocols = nlbl_vec_finish(&protos);
 
 protocols_return:
-	if (rc < 0 && protos)
-		free(protos);
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	if (data != NULL)
-		free(data);
-	nlbl_msg_free(msg);
+	if (rc < 0)
+		nlbl_vec_free(&protos);
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
 	return rc;
 }
 
@@ -418,9 +383,8 @@ protocols_return:
  * @param version the protocol version
  *
  * Request the NetLabel protocol version from the kernel and return the result
- * to the caller.  If @hndl is NULL then the function will handle opening and
- * closing it's own NetLabel handle.  Returns zero on success, negative values
- * on failure.
+ * to the caller.  If @hndl is NULL then the library's default NetLabel handle
+ * is used.  Returns zero on success, negative values on failure.
  *
  */
 int nlbl_mgmt_version(struct nlbl_handle *hndl, uint32_t *version)
@@ -435,24 +399,26 @@ int nlbl_mgmt_version(struct nlbl_handle *hndl, uint32_t *version)
 	/* sanity checks */
 	if (version == NULL)
 		return -EINVAL;
-	if (nlbl_mgmt_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_MGMT);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto version_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_mgmt_msg_new(NLBL_MGMT_C_VERSION, 0);
+	msg = nlbl_mgmt_msg_new(p_hndl, NLBL_MGMT_C_VERSION, 0);
 	if (msg == NULL)
 		goto version_return;
 
 	/* send the request */
 	rc = nlbl_comm_send(p_hndl, msg);
-	if (rc == 0) {
+	if (rc <= 0) {
 		if (rc == 0)
 			rc = -ENODATA;
 		goto version_return;
@@ -487,9 +453,8 @@ int nlbl_mgmt_version(struct nlbl_handle *hndl, uint32_t *version)
 	rc = 0;
 
 version_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	nlbl_msg_free(msg);
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
 	nlbl_msg_free(ans_msg);
 	return rc;
 }
@@ -501,8 +466,8 @@ version_return:
  * @param addr the network IP address
  *
  * Add the domain mapping in @domain to the NetLabel system.  If @hndl is NULL
- * then the function will handle opening and closing it's own NetLabel handle.
- * Returns zero on success, negative values on failure.
+ * then the library's default NetLabel handle is used. Returns zero on success,
+ * negative values on failure.
  *
  */
 int nlbl_mgmt_add(struct nlbl_handle *hndl,
@@ -517,18 +482,20 @@ int nlbl_mgmt_add(struct nlbl_handle *hndl,
 	/* sanity checks */
 	if (domain == NULL || domain->domain == NULL)
 		return -EINVAL;
-	if (nlbl_mgmt_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_MGMT);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto add_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_mgmt_msg_new(NLBL_MGMT_C_ADD, 0);
+	msg = nlbl_mgmt_msg_new(p_hndl, NLBL_MGMT_C_ADD, 0);
 	if (msg == NULL)
 		goto add_return;
 
@@ -597,6 +564,18 @@ int nlbl_mgmt_add(struct nlbl_handle *hndl,
 		goto add_return;
 	}
 
+	/* queue the request if we are batching */
+	if (nlbl_batch_active(p_hndl)) {
+		rc = nlbl_batch_queue(p_hndl, msg);
+		goto add_return;
+	}
+
+	/* send the request without waiting if we are asynchronous */
+	if (nlbl_async_active(p_hndl)) {
+		rc = nlbl_async_request(p_hndl, msg);
+		goto add_return;
+	}
+
 	/* send the request */
 	rc = nlbl_comm_send(p_hndl, msg);
 	if (rc <= 0) {
@@ -617,9 +596,8 @@ int nlbl_mgmt_add(struct nlbl_handle *hndl,
 	rc = nlbl_mgmt_parse_ack(ans_msg);
 
 add_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	nlbl_msg_free(msg);
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
 	nlbl_msg_free(ans_msg);
 	return rc;
 }
@@ -631,9 +609,8 @@ add_return:
  * @param addr the network IP address
  *
  * Add the domain mapping in @domain to the NetLabel system as the default
- * mapping.  If @hndl is NULL then the function will handle opening and
- * closing it's own NetLabel handle.  Returns zero on success, negative values
- * on failure.
+ * mapping.  If @hndl is NULL then the library's default NetLabel handle is
+ * used.  Returns zero on success, negative values on failure.
  *
  */
 int nlbl_mgmt_adddef(struct nlbl_handle *hndl,
@@ -648,18 +625,20 @@ int nlbl_mgmt_adddef(struct nlbl_handle *hndl,
 	/* sanity checks */
 	if (domain == NULL)
 		return -EINVAL;
-	if (nlbl_mgmt_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_MGMT);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto adddef_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_mgmt_msg_new(NLBL_MGMT_C_ADDDEF, 0);
+	msg = nlbl_mgmt_msg_new(p_hndl, NLBL_MGMT_C_ADDDEF, 0);
 	if (msg == NULL)
 		goto adddef_return;
 
@@ -725,6 +704,18 @@ int nlbl_mgmt_adddef(struct nlbl_handle *hndl,
 		goto adddef_return;
 	}
 
+	/* queue the request if we are batching */
+	if (nlbl_batch_active(p_hndl)) {
+		rc = nlbl_batch_queue(p_hndl, msg);
+		goto adddef_return;
+	}
+
+	/* send the request without waiting if we are asynchronous */
+	if (nlbl_async_active(p_hndl)) {
+		rc = nlbl_async_request(p_hndl, msg);
+		goto adddef_return;
+	}
+
 	/* send the request */
 	rc = nlbl_comm_send(p_hndl, msg);
 	if (rc <= 0) {
@@ -745,9 +736,8 @@ int nlbl_mgmt_adddef(struct nlbl_handle *hndl,
 	rc = nlbl_mgmt_parse_ack(ans_msg);
 
 adddef_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	nlbl_msg_free(msg);
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
 	nlbl_msg_free(ans_msg);
 	return rc;
 }
@@ -757,9 +747,9 @@ adddef_return:
  * @param hndl the NetLabel handle
  * @param domain the domain
  *
- * Remove the domain mapping specified by @domain from the NetLabel system.
- * If @hndl is NULL then the function will handle opening and closing it's own
- * NetLabel handle.  Returns zero on success, negative values on failure.
+ * Remove the domain mapping specified by @domain from the NetLabel system. If
+ * @hndl is NULL then the library's default NetLabel handle is used.  Returns
+ * zero on success, negative values on failure.
  *
  */
 int nlbl_mgmt_del(struct nlbl_handle *hndl, char *domain)
@@ -772,18 +762,20 @@ int nlbl_mgmt_del(struct nlbl_handle *hndl, char *domain)
 	/* sanity checks */
 	if (domain == NULL)
 		return -EINVAL;
-	if (nlbl_mgmt_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_MGMT);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto del_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_mgmt_msg_new(NLBL_MGMT_C_REMOVE, 0);
+	msg = nlbl_mgmt_msg_new(p_hndl, NLBL_MGMT_C_REMOVE, 0);
 	if (msg == NULL)
 		goto del_return;
 
@@ -792,6 +784,18 @@ int nlbl_mgmt_del(struct nlbl_handle *hndl, char *domain)
 	if (rc != 0)
 		goto del_return;
 
+	/* queue the request if we are batching */
+	if (nlbl_batch_active(p_hndl)) {
+		rc = nlbl_batch_queue(p_hndl, msg);
+		goto del_return;
+	}
+
+	/* send the request without waiting if we are asynchronous */
+	if (nlbl_async_active(p_hndl)) {
+		rc = nlbl_async_request(p_hndl, msg);
+		goto del_return;
+	}
+
 	/* send the request */
 	rc = nlbl_comm_send(p_hndl, msg);
 	if (rc <= 0) {
@@ -812,9 +816,8 @@ int nlbl_mgmt_del(struct nlbl_handle *hndl, char *domain)
 	rc = nlbl_mgmt_parse_ack(ans_msg);
 
 del_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	nlbl_msg_free(msg);
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
 	nlbl_msg_free(ans_msg);
 	return rc;
 }
@@ -823,9 +826,9 @@ del_return:
  * Remove the default domain mapping from NetLabel
  * @param hndl the NetLabel handle
  *
- * Remove the default domain mapping from the NetLabel system.  If @hndl is
- * NULL then the function will handle opening and closing it's own NetLabel
- * handle.  Returns zero on success, negative values on failure.
+ * Remove the default domain mapping from the NetLabel system.  If @hndl is NULL
+ * then the library's default NetLabel handle is used.  Returns zero on success,
+ * negative values on failure.
  *
  */
 int nlbl_mgmt_deldef(struct nlbl_handle *hndl)
@@ -836,21 +839,35 @@ int nlbl_mgmt_deldef(struct nlbl_handle *hndl)
 	nlbl_msg *ans_msg = NULL;
 
 	/* sanity checks */
-	if (nlbl_mgmt_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_MGMT);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto deldef_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_mgmt_msg_new(NLBL_MGMT_C_REMOVEDEF, 0);
+	msg = nlbl_mgmt_msg_new(p_hndl, NLBL_MGMT_C_REMOVEDEF, 0);
 	if (msg == NULL)
 		goto deldef_return;
 
+	/* queue the request if we are batching */
+	if (nlbl_batch_active(p_hndl)) {
+		rc = nlbl_batch_queue(p_hndl, msg);
+		goto deldef_return;
+	}
+
+	/* send the request without waiting if we are asynchronous */
+	if (nlbl_async_active(p_hndl)) {
+		rc = nlbl_async_request(p_hndl, msg);
+		goto deldef_return;
+	}
+
 	/* send the request */
 	rc = nlbl_comm_send(p_hndl, msg);
 	if (rc <= 0) {
@@ -871,9 +888,8 @@ int nlbl_mgmt_deldef(struct nlbl_handle *hndl)
 	rc = nlbl_mgmt_parse_ack(ans_msg);
 
 deldef_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	nlbl_msg_free(msg);
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
 	nlbl_msg_free(ans_msg);
 	return rc;
 }
@@ -884,9 +900,8 @@ deldef_return:
  * @param domain the default domain map
  *
  * Query the NetLabel subsystem and return the default domain mapping in
- * @domain.  If @hndl is NULL then the function will handle opening and
- * closing it's own NetLabel handle.  Returns zero on success, negative values
- * on failure.
+ * @domain.  If @hndl is NULL then the library's default NetLabel handle is
+ * used.  Returns zero on success, negative values on failure.
  *
  */
 int nlbl_mgmt_listdef(struct nlbl_handle *hndl, uint16_t family,
@@ -902,18 +917,20 @@ int nlbl_mgmt_listdef(struct nlbl_handle *hndl, uint16_t family,
 	/* sanity checks */
 	if (domain == NULL)
 		return -EINVAL;
-	if (nlbl_mgmt_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_MGMT);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto listdef_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_mgmt_msg_new(NLBL_MGMT_C_LISTDEF, 0);
+	msg = nlbl_mgmt_msg_new(p_hndl, NLBL_MGMT_C_LISTDEF, 0);
 	if (msg == NULL)
 		goto listdef_return;
 
@@ -974,7 +991,8 @@ int nlbl_mgmt_listdef(struct nlbl_handle *hndl, uint16_t family,
 			break;
 		}
 	} else if ((nla = nlbl_attr_find(ans_msg, NLBL_MGMT_A_SELECTORLIST))) {
-		if (nlbl_mgmt_list_addr(nla, domain) != 0)
+		rc = nlbl_mgmt_list_addr(nla, domain);
+		if (rc < 0)
 			goto listdef_return;
 	} else
 		goto listdef_return;
@@ -982,195 +1000,382 @@ int nlbl_mgmt_listdef(struct nlbl_handle *hndl, uint16_t family,
 	rc = 0;
 
 listdef_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	nlbl_msg_free(msg);
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
 	nlbl_msg_free(ans_msg);
 	return rc;
 }
 
+/* domain mapping dump state */
+struct nlbl_mgmt_dump {
+	nlbl_dommap_cb cb;
+	void *arg;
+
+	/* address selectors for the current entry, reused for each entry */
+	struct nlbl_dommap_addr *addrsel;
+	unsigned int addrsel_size;
+};
+
+/**
+ * Free a domain mapping dump state
+ * @param arg the domain mapping dump state
+ *
+ * Free the address selector buffer in the dump state, but not the dump state
+ * itself.
+ *
+ */
+static void nlbl_mgmt_dump_free(void *arg)
+{
+	struct nlbl_mgmt_dump *dump = arg;
+
+	free(dump->addrsel);
+}
+
 /**
- * List all of the configured NetLabel domain mappings
+ * Handle a domain mapping dump entry
+ * @param nla_head the entry's attributes
+ * @param attrlen the length of the attributes
+ * @param arg the domain mapping dump state
+ *
+ * Parse a domain mapping entry and pass it to the caller's callback.  The
+ * domain string points directly into the attributes and the address selectors
+ * are stored in a buffer which is reused for each entry.  Returns the return
+ * value of the caller's callback on success, negative values on failure.
+ *
+ */
+static int nlbl_mgmt_listall_cb(struct nlattr *nla_head, int attrlen,
+				void *arg)
+{
+	int rc;
+	struct nlbl_mgmt_dump *dump = arg;
+	struct nlbl_dommap domain;
+	struct nlbl_dommap_addr *addrsel_new;
+	struct nlattr *tb[NLBL_MGMT_A_MAX + 1];
+	struct nlattr *nla;
+	unsigned int count;
+
+	memset(&domain, 0, sizeof(domain));
+
+	/* get the attribute information */
+	rc = nlbl_attr_parse(tb, NLBL_MGMT_A_MAX,
+			     nla_head, attrlen, nlbl_mgmt_policy);
+	if (rc < 0)
+		return rc;
+	if (tb[NLBL_MGMT_A_DOMAIN] == NULL)
+		return -EBADMSG;
+	domain.domain = nla_get_string(tb[NLBL_MGMT_A_DOMAIN]);
+	if (tb[NLBL_MGMT_A_FAMILY] != NULL)
+		domain.family = nla_get_u16(tb[NLBL_MGMT_A_FAMILY]);
+	else
+		domain.family = AF_UNSPEC;
+	if (tb[NLBL_MGMT_A_PROTOCOL] != NULL) {
+		domain.proto_type = nla_get_u32(tb[NLBL_MGMT_A_PROTOCOL]);
+		switch (domain.proto_type) {
+		case NETLBL_NLTYPE_CIPSOV4:
+			if (tb[NLBL_MGMT_A_CV4DOI] == NULL)
+				return -EBADMSG;
+			domain.proto.cip_doi =
+				nla_get_u32(tb[NLBL_MGMT_A_CV4DOI]);
+			break;
+		case NETLBL_NLTYPE_CALIPSO:
+			if (tb[NLBL_MGMT_A_CLPDOI] == NULL)
+				return -EBADMSG;
+			domain.proto.clp_doi =
+				nla_get_u32(tb[NLBL_MGMT_A_CLPDOI]);
+			break;
+		}
+	} else if (tb[NLBL_MGMT_A_SELECTORLIST] != NULL) {
+		nla = tb[NLBL_MGMT_A_SELECTORLIST];
+		domain.proto_type = NETLBL_NLTYPE_ADDRSELECT;
+
+		/* make sure there is room for the address selectors */
+		count = nlbl_mgmt_addrsel_count(nla);
+		if (count > dump->addrsel_size) {
+			addrsel_new = realloc(dump->addrsel,
+					      sizeof(*addrsel_new) * count);
+			if (addrsel_new == NULL)
+				return -ENOMEM;
+			dump->addrsel = addrsel_new;
+			dump->addrsel_size = count;
+		}
+
+		/* parse the address selectors */
+		if (count > 0) {
+			rc = nlbl_mgmt_addrsel_parse(nla, dump->addrsel);
+			if (rc < 0)
+				return -EBADMSG;
+			domain.proto.addrsel = dump->addrsel;
+			domain.addrsel_count = rc;
+		}
+	} else
+		return -EBADMSG;
+
+	return dump->cb(&domain, dump->arg);
+}
+
+/* domain mapping array */
+struct nlbl_mgmt_array {
+	struct nlbl_vec vec;
+	struct nlbl_result *result;
+};
+
+/**
+ * Free a domain mapping array
+ * @param array the domain mapping array
+ *
+ * Free all of the domain mappings in @array along with the array itself.  The
+ * domain strings and address selectors are left alone if they belong to a
+ * result set.
+ *
+ */
+static void nlbl_mgmt_array_free(struct nlbl_mgmt_array *array)
+{
+	struct nlbl_dommap *domains = array->vec.array;
+	size_t iter;
+
+	if (array->result == NULL) {
+		for (iter = 0; iter < array->vec.count; iter++) {
+			free(domains[iter].domain);
+			if (domains[iter].proto_type ==
+			    NETLBL_NLTYPE_ADDRSELECT)
+				free(domains[iter].proto.addrsel);
+		}
+	}
+	nlbl_vec_free(&array->vec);
+}
+
+/**
+ * Add a domain mapping to a domain mapping array
+ * @param domain the domain mapping
+ * @param arg the domain mapping array
+ *
+ * Copy @domain, including the domain string and any address selectors, to the
+ * end of the domain mapping array in @arg.  Returns zero on success, negative
+ * values on failure.
+ *
+ */
+static int nlbl_mgmt_array_add(const struct nlbl_dommap *domain, void *arg)
+{
+	struct nlbl_mgmt_array *array = arg;
+	struct nlbl_dommap *entry;
+	struct nlbl_dommap_addr *addr_iter;
+	struct nlbl_dommap_addr *addrsel;
+	uint32_t count;
+	uint32_t iter;
+
+	entry = nlbl_vec_add(&array->vec);
+	if (entry == NULL)
+		return -ENOMEM;
+
+	/* copy the domain mapping */
+	*entry = *domain;
+	if (domain->proto_type == NETLBL_NLTYPE_ADDRSELECT) {
+		entry->proto.addrsel = NULL;
+		entry->addrsel_count = 0;
+	}
+	entry->domain = nlbl_result_strdup(array->result, domain->domain);
+	if (entry->domain == NULL)
+		return -ENOMEM;
+	if (domain->proto_type != NETLBL_NLTYPE_ADDRSELECT)
+		return 0;
+
+	/* copy the address selectors into a single array */
+	count = 0;
+	for (addr_iter = domain->proto.addrsel;
+	     addr_iter != NULL;
+	     addr_iter = addr_iter->next)
+		count++;
+	if (count == 0)
+		return 0;
+	addrsel = nlbl_result_alloc(array->result, sizeof(*addrsel) * count);
+	if (addrsel == NULL)
+		return -ENOMEM;
+	for (addr_iter = domain->proto.addrsel, iter = 0;
+	     addr_iter != NULL;
+	     addr_iter = addr_iter->next, iter++) {
+		addrsel[iter] = *addr_iter;
+		addrsel[iter].next = (iter + 1 < count ?
+				      &addrsel[iter + 1] : NULL);
+	}
+	entry->proto.addrsel = addrsel;
+	entry->addrsel_count = count;
+
+	return 0;
+}
+
+/**
+ * List the NetLabel domain mappings into an array
  * @param hndl the NetLabel handle
  * @param domains domain mapping array
+ * @param result the result set, NULL for individual allocations
  *
- * Query the NetLabel subsystem and return the configured domain mappings in
- * @domains.  If @hndl is NULL then the function will handle opening and
- * closing it's own NetLabel handle.  Returns the number of domains on success,
- * zero if no domains are specified, and negative values on failure.
+ * List the domain mappings into the array @domains.  If @result is not NULL the
+ * array, the domain strings and the address selectors belong to @result,
+ * otherwise the caller must free them.  Returns the number of domains on
+ * success, negative values on failure.
  *
  */
-int nlbl_mgmt_listall(struct nlbl_handle *hndl, struct nlbl_dommap **domains)
+static int nlbl_mgmt_array_list(struct nlbl_handle *hndl,
+				struct nlbl_dommap **domains,
+				struct nlbl_result *result)
+{
+	int rc;
+	struct nlbl_mgmt_array array;
+
+	/* the array must be complete before we return */
+	if (nlbl_async_active(hndl))
+		return -EBUSY;
+
+	nlbl_vec_init(&array.vec, sizeof(**domains), nlbl_comm_hint(hndl));
+	array.result = result;
+	rc = nlbl_mgmt_listall_iter(hndl, nlbl_mgmt_array_add, &array);
+	if (rc < 0) {
+		nlbl_mgmt_array_free(&array);
+		return rc;
+	}
+
+	rc = array.vec.count;
+	*domains = nlbl_vec_finish(&array.vec);
+	if (result != NULL)
+		nlbl_result_adopt(result, *domains);
+	return rc;
+}
+
+/**
+ * List the NetLabel domain mappings using a callback
+ * @param hndl the NetLabel handle
+ * @param cb the callback
+ * @param arg the callback argument
+ *
+ * Query the NetLabel subsystem for the domain mappings, calling @cb once for
+ * each domain mapping.  The domain mappings are passed to @cb without being
+ * copied, see nlbl_dommap_cb for details.  If @hndl is NULL then the library's
+ * default NetLabel handle is used.  Returns the number of domain mappings
+ * passed to @cb on success, negative values on failure.
+ *
+ */
+int nlbl_mgmt_listall_iter(struct nlbl_handle *hndl,
+			   nlbl_dommap_cb cb, void *arg)
 {
 	int rc = -ENOMEM;
 	struct nlbl_handle *p_hndl = hndl;
-	unsigned char *data = NULL;
 	nlbl_msg *msg = NULL;
-	struct nlmsghdr *nl_hdr;
-	struct genlmsghdr *genl_hdr;
-	struct nlattr *nla_head;
-	struct nlattr *nla;
-	int data_len;
-	int data_attrlen;
-	struct nlbl_dommap *dmns = NULL, *dmns_new;
-	uint32_t dmns_count = 0;
+	struct nlbl_mgmt_dump dump;
 
 	/* sanity checks */
-	if (domains == NULL)
+	if (cb == NULL)
 		return -EINVAL;
-	if (nlbl_mgmt_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_MGMT);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
+
+	memset(&dump, 0, sizeof(dump));
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto listall_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_mgmt_msg_new(NLBL_MGMT_C_LISTALL, NLM_F_DUMP);
-	if (msg == NULL) {
-		rc = -ENOMEM;
+	msg = nlbl_mgmt_msg_new(p_hndl, NLBL_MGMT_C_LISTALL, NLM_F_DUMP);
+	if (msg == NULL)
 		goto listall_return;
-	}
 
-	/* send the request */
-	rc = nlbl_comm_send(p_hndl, msg);
-	if (rc <= 0) {
-		if (rc == 0)
-			rc = -ENODATA;
-		goto listall_return;
-	}
+	/* perform the dump */
+	dump.cb = cb;
+	dump.arg = arg;
+	if (nlbl_async_active(p_hndl))
+		rc = nlbl_async_dump(p_hndl, msg, NLBL_MGMT_C_LISTALL,
+				     nlbl_mgmt_listall_cb, &dump, sizeof(dump),
+				     nlbl_mgmt_dump_free);
+	else
+		rc = nlbl_comm_dump(p_hndl, msg, NLBL_MGMT_C_LISTALL,
+				    nlbl_mgmt_listall_cb, &dump);
 
-	/* read all of the messages (multi-message response) */
-	do {
-		if (data != NULL) {
-			free(data);
-			data = NULL;
-		}
+listall_return:
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
+	free(dump.addrsel);
+	return rc;
+}
 
-		/* get the next set of messages */
-		rc = nlbl_comm_recv_raw(p_hndl, &data);
-		if (rc <= 0) {
-			if (rc == 0)
-				rc = -ENODATA;
-			goto listall_return;
-		}
-		data_len = rc;
-		nl_hdr = (struct nlmsghdr *)data;
-
-		/* check to see if this is a netlink control message we don't
-		 * care about */
-		if (nl_hdr->nlmsg_type == NLMSG_NOOP ||
-		    nl_hdr->nlmsg_type == NLMSG_ERROR ||
-		    nl_hdr->nlmsg_type == NLMSG_OVERRUN) {
-			rc = -EBADMSG;
-			goto listall_return;
-		}
+/**
+ * List all of the configured NetLabel domain mappings
+ * @param hndl the NetLabel handle
+ * @param domains domain mapping array
+ *
+ * Query the NetLabel subsystem and return the configured domain mappings in
+ * @domains.  If @hndl is NULL then the library's default NetLabel handle is
+ * used.  Returns the number of domains on success, zero if no domains are
+ * specified, and negative values on failure.
+ *
+ */
+int nlbl_mgmt_listall(struct nlbl_handle *hndl, struct nlbl_dommap **domains)
+{
+	/* sanity checks */
+	if (domains == NULL)
+		return -EINVAL;
 
-		/* loop through the messages */
-		while (nlmsg_ok(nl_hdr, data_len) &&
-		       nl_hdr->nlmsg_type != NLMSG_DONE) {
-			/* get the header pointers */
-			genl_hdr = (struct genlmsghdr *)nlmsg_data(nl_hdr);
-			if (genl_hdr == NULL ||
-			    genl_hdr->cmd != NLBL_MGMT_C_LISTALL) {
-				rc = -EBADMSG;
-				goto listall_return;
-			}
-			nla_head = (struct nlattr *)(&genl_hdr[1]);
-			data_attrlen = genlmsg_attrlen(genl_hdr, 0);
-
-			/* resize the array */
-			dmns_new = realloc(dmns,
-					   sizeof(*dmns) * (dmns_count + 1));
-			if (dmns_new == NULL)
-				goto listall_return;
-			dmns = dmns_new;
-			memset(&dmns[dmns_count], 0, sizeof(*dmns));
-
-			/* get the attribute information */
-			nla = nla_find(nla_head,
-				       data_attrlen, NLBL_MGMT_A_DOMAIN);
-			if (nla == NULL)
-				goto listall_return;
-			dmns[dmns_count].domain = malloc(nla_len(nla));
-			if (dmns[dmns_count].domain == NULL)
-				goto listall_return;
-			strncpy(dmns[dmns_count].domain, nla_data(nla),
-				nla_len(nla));
-			nla = nla_find(nla_head,
-				       data_attrlen, NLBL_MGMT_A_FAMILY);
-			if (nla != NULL)
-				dmns[dmns_count].family = nla_get_u16(nla);
-			else
-				dmns[dmns_count].family = AF_UNSPEC;
-			nla = nla_find(nla_head,
-				       data_attrlen, NLBL_MGMT_A_PROTOCOL);
-			if (nla != NULL) {
-				dmns[dmns_count].proto_type = nla_get_u32(nla);
-				switch (dmns[dmns_count].proto_type) {
-				case NETLBL_NLTYPE_CIPSOV4:
-					nla = nla_find(nla_head,
-						       data_attrlen,
-						       NLBL_MGMT_A_CV4DOI);
-					if (nla == NULL)
-						goto listall_return;
-					dmns[dmns_count].proto.cip_doi =
-						nla_get_u32(nla);
-					break;
-				case NETLBL_NLTYPE_CALIPSO:
-					nla = nla_find(nla_head,
-						       data_attrlen,
-						       NLBL_MGMT_A_CLPDOI);
-					if (nla == NULL)
-						goto listall_return;
-					dmns[dmns_count].proto.clp_doi =
-						nla_get_u32(nla);
-					break;
-				}
-			} else if ((nla = nla_find(nla_head, data_attrlen,
-						   NLBL_MGMT_A_SELECTORLIST))) {
-				if (nlbl_mgmt_list_addr(nla,
-							&dmns[dmns_count]) != 0)
-					goto listall_return;
-			} else
-				goto listall_return;
-
-			dmns_count++;
-
-			/* next message */
-			nl_hdr = nlmsg_next(nl_hdr, &data_len);
-		}
-	} while (NL_MULTI_CONTINUE(nl_hdr));
+	return nlbl_mgmt_array_list(hndl, domains, NULL);
+}
+
+/**
+ * List all of the configured NetLabel domain mappings into a result set
+ * @param hndl the NetLabel handle
+ * @param domains domain mapping array
+ * @param result the result set
+ *
+ * Query the NetLabel subsystem like nlbl_mgmt_listall(), except that
+ * @domains and all of the domain strings and address selectors it references
+ * are stored in @result and released with a single call to nlbl_result_free().
+ * If @hndl is NULL then the library's default NetLabel handle is used.
+ * Returns the number of domains on success, zero if no domains are specified,
+ * and negative values on failure.
+ *
+ */
+int nlbl_mgmt_listall_result(struct nlbl_handle *hndl,
+			     struct nlbl_dommap **domains,
+			     struct nlbl_result **result)
+{
+	int rc;
+	struct nlbl_result *res;
 
-	*domains = dmns;
-	rc = dmns_count;
+	/* sanity checks */
+	if (domains == NULL || result == NULL)
+		return -EINVAL;
 
-listall_return:
-	if (rc < 0 && dmns) {
-		do {
-			if (dmns[dmns_count].domain) {
-				free(dmns[dmns_count].domain);
-				if (dmns[dmns_count].proto_type ==
-				    NETLBL_NLTYPE_ADDRSELECT) {
-					struct nlbl_dommap_addr *iter, *prev;
-					iter = dmns[dmns_count].proto.addrsel;
-					while (iter) {
-						prev = iter;
-						iter = iter->next;
-						free(prev);
-					}
-				}
-			}
-		} while (dmns_count-- > 0);
-		free(dmns);
+	res = nlbl_result_new();
+	if (res == NULL)
+		return -ENOMEM;
+	rc = nlbl_mgmt_array_list(hndl, domains, res);
+	if (rc < 0) {
+		nlbl_result_free(res);
+		return rc;
 	}
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	if (data)
-		free(data);
-	nlbl_msg_free(msg);
+
+	*result = res;
 	return rc;
 }
+
+/**
+ * Get an address selector from a domain mapping
+ * @param domain the domain mapping
+ * @param index the address selector index
+ *
+ * Return the address selector at position @index in @domain, which must have
+ * been returned by the library.  Returns NULL if @domain does not use address
+ * selectors or @index is out of range.
+ *
+ */
+struct nlbl_dommap_addr *nlbl_mgmt_addrsel(const struct nlbl_dommap *domain,
+					   uint32_t index)
+{
+	if (domain == NULL || domain->proto_type != NETLBL_NLTYPE_ADDRSELECT ||
+	    index >= domain->addrsel_count)
+		return NULL;
+
+	return &domain->proto.addrsel[index];
+}
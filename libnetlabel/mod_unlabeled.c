@@ -23,6 +23,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -32,52 +33,36 @@
 
 #include "netlabel_internal.h"
 
-/* Generic Netlink family ID */
-static uint16_t nlbl_unlbl_fid = 0;
+/* NetLabel unlabeled attribute policy */
+const struct nla_policy nlbl_unlbl_policy[NLBL_UNLABEL_A_MAX + 1] = {
+	[NLBL_UNLABEL_A_ACPTFLG] = { .type = NLA_U8 },
+	[NLBL_UNLABEL_A_IPV6ADDR] = NLBL_POLICY_LEN(sizeof(struct in6_addr)),
+	[NLBL_UNLABEL_A_IPV6MASK] = NLBL_POLICY_LEN(sizeof(struct in6_addr)),
+	[NLBL_UNLABEL_A_IPV4ADDR] = NLBL_POLICY_LEN(sizeof(struct in_addr)),
+	[NLBL_UNLABEL_A_IPV4MASK] = NLBL_POLICY_LEN(sizeof(struct in_addr)),
+	[NLBL_UNLABEL_A_IFACE] = { .type = NLA_STRING },
+	[NLBL_UNLABEL_A_SECCTX] = { .type = NLA_STRING },
+};
 
 /*
  * Helper functions
  */
 
 /**
- * Create a new NetLabel unlbl message
+ * Get a NetLabel unlbl message
+ * @param hndl the NetLabel handle
  * @param command the NetLabel unlbl command
  * @param flags the message flags
  *
- * This function creates a new NetLabel unlbl message using @command and
- * @flags.  Returns a pointer to the new message on success, or NULL on
- * failure.
+ * This function gets a NetLabel unlbl message for @command and @flags from the
+ * message pool of @hndl, see nlbl_msg_request().  Returns a pointer to the
+ * message on success, or NULL on failure.
  *
  */
-static nlbl_msg *nlbl_unlbl_msg_new(uint16_t command, int flags)
+static nlbl_msg *nlbl_unlbl_msg_new(struct nlbl_handle *hndl,
+				    uint16_t command, int flags)
 {
-	nlbl_msg *msg;
-	struct nlmsghdr *nl_hdr;
-	struct genlmsghdr *genl_hdr;
-
-	/* create a new message */
-	msg = nlbl_msg_new();
-	if (msg == NULL)
-		goto msg_new_failure;
-
-	/* setup the netlink header */
-	nl_hdr = nlbl_msg_nlhdr(msg);
-	if (nl_hdr == NULL)
-		goto msg_new_failure;
-	nl_hdr->nlmsg_type = nlbl_unlbl_fid;
-	nl_hdr->nlmsg_flags = flags;
-
-	/* setup the generic netlink header */
-	genl_hdr = nlbl_msg_genlhdr(msg);
-	if (genl_hdr == NULL)
-		goto msg_new_failure;
-	genl_hdr->cmd = command;
-
-	return msg;
-
-msg_new_failure:
-	nlbl_msg_free(msg);
-	return NULL;
+	return nlbl_msg_request(hndl, NLBL_FAMILY_UNLBL, command, flags);
 }
 
 /**
@@ -102,9 +87,10 @@ static int nlbl_unlbl_recv(struct nlbl_handle *hndl, nlbl_msg **msg)
 
 	/* process the response */
 	nl_hdr = nlbl_msg_nlhdr(*msg);
-	if (nl_hdr == NULL || (nl_hdr->nlmsg_type != nlbl_unlbl_fid &&
-			       nl_hdr->nlmsg_type != NLMSG_DONE &&
-			       nl_hdr->nlmsg_type != NLMSG_ERROR)) {
+	if (nl_hdr == NULL ||
+	    (nl_hdr->nlmsg_type != nlbl_family_id(hndl, NLBL_FAMILY_UNLBL) &&
+	     nl_hdr->nlmsg_type != NLMSG_DONE &&
+	     nl_hdr->nlmsg_type != NLMSG_ERROR)) {
 		rc = -EBADMSG;
 		goto recv_failure;
 	}
@@ -135,41 +121,288 @@ static int nlbl_unlbl_parse_ack(nlbl_msg *msg)
 	return nl_err->error;
 }
 
-/*
- * Init functions
+/**
+ * Parse a static label entry
+ * @param nla_head the entry's attributes
+ * @param attrlen the length of the attributes
+ * @param addr the static label address mapping
+ *
+ * Parse the static label entry in @nla_head into @addr.  The strings in @addr
+ * point directly into the attributes, no memory is allocated.  Returns zero on
+ * success, negative values on failure.
+ *
  */
+static int nlbl_unlbl_parse_addrmap(struct nlattr *nla_head, int attrlen,
+				    struct nlbl_addrmap *addr)
+{
+	int rc;
+	struct nlattr *tb[NLBL_UNLABEL_A_MAX + 1];
+
+	memset(addr, 0, sizeof(*addr));
+
+	rc = nlbl_attr_parse(tb, NLBL_UNLABEL_A_MAX,
+			     nla_head, attrlen, nlbl_unlbl_policy);
+	if (rc < 0)
+		return rc;
+
+	/* the default static labels do not have an interface */
+	if (tb[NLBL_UNLABEL_A_IFACE] != NULL)
+		addr->dev = nla_get_string(tb[NLBL_UNLABEL_A_IFACE]);
+	if (tb[NLBL_UNLABEL_A_SECCTX] == NULL)
+		return -EBADMSG;
+	addr->label = nla_get_string(tb[NLBL_UNLABEL_A_SECCTX]);
+
+	if (tb[NLBL_UNLABEL_A_IPV4ADDR] != NULL) {
+		if (tb[NLBL_UNLABEL_A_IPV4MASK] == NULL)
+			return -EBADMSG;
+		memcpy(&addr->addr.addr.v4,
+		       nla_data(tb[NLBL_UNLABEL_A_IPV4ADDR]),
+		       sizeof(struct in_addr));
+		memcpy(&addr->addr.mask.v4,
+		       nla_data(tb[NLBL_UNLABEL_A_IPV4MASK]),
+		       sizeof(struct in_addr));
+		addr->addr.type = AF_INET;
+	} else if (tb[NLBL_UNLABEL_A_IPV6ADDR] != NULL) {
+		if (tb[NLBL_UNLABEL_A_IPV6MASK] == NULL)
+			return -EBADMSG;
+		memcpy(&addr->addr.addr.v6,
+		       nla_data(tb[NLBL_UNLABEL_A_IPV6ADDR]),
+		       sizeof(struct in6_addr));
+		memcpy(&addr->addr.mask.v6,
+		       nla_data(tb[NLBL_UNLABEL_A_IPV6MASK]),
+		       sizeof(struct in6_addr));
+		addr->addr.type = AF_INET6;
+	}
+
+	return 0;
+}
+
+/* static label dump state */
+struct nlbl_unlbl_dump {
+	nlbl_addrmap_cb cb;
+	void *arg;
+};
 
 /**
- * Perform any setup needed
+ * Handle a static label dump entry
+ * @param nla_head the entry's attributes
+ * @param attrlen the length of the attributes
+ * @param arg the static label dump state
  *
- * Do any setup needed for the unlbl component, including determining the
- * NetLabel unlbl Generic Netlink family ID.  Returns zero on success,
- * negative values on error.
+ * Parse a static label entry and pass it to the caller's callback.  Returns
+ * the return value of the caller's callback on success, negative values on
+ * failure.
  *
  */
-int nlbl_unlbl_init(void)
+static int nlbl_unlbl_staticdump_cb(struct nlattr *nla_head, int attrlen,
+				    void *arg)
 {
-	int rc = -ENOMEM;
-	struct nlbl_handle *hndl;
+	int rc;
+	struct nlbl_unlbl_dump *dump = arg;
+	struct nlbl_addrmap addr;
+
+	rc = nlbl_unlbl_parse_addrmap(nla_head, attrlen, &addr);
+	if (rc < 0)
+		return rc;
 
-	/* get a netlabel handle */
-	hndl = nlbl_comm_open();
-	if (hndl == NULL)
-		goto init_return;
+	return dump->cb(&addr, dump->arg);
+}
 
-	/* resolve the family */
-	rc = genl_ctrl_resolve(hndl->nl_sock,
-			       NETLBL_NLTYPE_UNLABELED_NAME);
+/**
+ * Dump a static label table using a callback
+ * @param hndl the NetLabel handle
+ * @param cmd the NetLabel unlbl dump command
+ * @param cb the callback
+ * @param arg the callback argument
+ *
+ * Perform the static label dump specified by @cmd, calling @cb once for each
+ * static label.  If @hndl is NULL then the library's default NetLabel handle
+ * is used.  Returns the number of static labels passed to @cb on success,
+ * negative values on failure.
+ *
+ */
+static int nlbl_unlbl_staticdump(struct nlbl_handle *hndl, uint8_t cmd,
+				 nlbl_addrmap_cb cb, void *arg)
+{
+	int rc = -ENOMEM;
+	struct nlbl_handle *p_hndl = hndl;
+	nlbl_msg *msg = NULL;
+	struct nlbl_unlbl_dump dump;
+
+	/* sanity checks */
+	if (cb == NULL)
+		return -EINVAL;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_UNLBL);
 	if (rc < 0)
-		goto init_return;
-	nlbl_unlbl_fid = rc;
+		return rc;
+	rc = -ENOMEM;
 
-	rc = 0;
+	/* use the default handle if we need one */
+	if (p_hndl == NULL) {
+		p_hndl = nlbl_comm_dflt();
+		if (p_hndl == NULL)
+			goto staticdump_return;
+	}
+
+	/* create a new message */
+	msg = nlbl_unlbl_msg_new(p_hndl, cmd, NLM_F_DUMP);
+	if (msg == NULL)
+		goto staticdump_return;
+
+	/* perform the dump */
+	dump.cb = cb;
+	dump.arg = arg;
+	if (nlbl_async_active(p_hndl))
+		rc = nlbl_async_dump(p_hndl, msg, cmd, nlbl_unlbl_staticdump_cb,
+				     &dump, sizeof(dump), NULL);
+	else
+		rc = nlbl_comm_dump(p_hndl, msg, cmd,
+				    nlbl_unlbl_staticdump_cb, &dump);
 
-init_return:
-	nlbl_comm_close(hndl);
+staticdump_return:
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
 	return rc;
+}
+
+/* static label array */
+struct nlbl_unlbl_array {
+	struct nlbl_vec vec;
+	struct nlbl_result *result;
+};
+
+/**
+ * Free a static label array
+ * @param array the static label array
+ *
+ * Free all of the static labels in @array along with the array itself.  The
+ * strings are left alone if they belong to a result set.
+ *
+ */
+static void nlbl_unlbl_array_free(struct nlbl_unlbl_array *array)
+{
+	struct nlbl_addrmap *addrs = array->vec.array;
+	size_t iter;
 
+	if (array->result == NULL) {
+		for (iter = 0; iter < array->vec.count; iter++) {
+			free(addrs[iter].dev);
+			free(addrs[iter].label);
+		}
+	}
+	nlbl_vec_free(&array->vec);
+}
+
+/**
+ * Add a static label to a static label array
+ * @param addr the static label address mapping
+ * @param arg the static label array
+ *
+ * Copy @addr, including its strings, to the end of the static label array in
+ * @arg.  Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_unlbl_array_add(const struct nlbl_addrmap *addr, void *arg)
+{
+	struct nlbl_unlbl_array *array = arg;
+	struct nlbl_addrmap *entry;
+
+	entry = nlbl_vec_add(&array->vec);
+	if (entry == NULL)
+		return -ENOMEM;
+
+	/* copy the static label */
+	entry->addr = addr->addr;
+	if (addr->dev != NULL) {
+		entry->dev = nlbl_result_strdup(array->result, addr->dev);
+		if (entry->dev == NULL)
+			return -ENOMEM;
+	}
+	entry->label = nlbl_result_strdup(array->result, addr->label);
+	if (entry->label == NULL)
+		return -ENOMEM;
+
+	return 0;
+}
+
+/**
+ * Dump the static label configuration into an array
+ * @param hndl the NetLabel handle
+ * @param def true for the default static labels
+ * @param addrs the static label address mappings
+ * @param result the result set, NULL for individual allocations
+ *
+ * Dump the static labels, or the default static labels if @def is true, into
+ * the array @addrs.  If @result is not NULL the array and the strings belong
+ * to @result, otherwise the caller must free them.  Returns the number of
+ * static labels on success, negative values on failure.
+ *
+ */
+static int nlbl_unlbl_array_list(struct nlbl_handle *hndl, int def,
+				 struct nlbl_addrmap **addrs,
+				 struct nlbl_result *result)
+{
+	int rc;
+	struct nlbl_unlbl_array array;
+
+	/* the array must be complete before we return */
+	if (nlbl_async_active(hndl))
+		return -EBUSY;
+
+	nlbl_vec_init(&array.vec, sizeof(**addrs), nlbl_comm_hint(hndl));
+	array.result = result;
+	if (def)
+		rc = nlbl_unlbl_staticlistdef_iter(hndl, nlbl_unlbl_array_add,
+						   &array);
+	else
+		rc = nlbl_unlbl_staticlist_iter(hndl, nlbl_unlbl_array_add,
+						&array);
+	if (rc < 0) {
+		nlbl_unlbl_array_free(&array);
+		return rc;
+	}
+
+	rc = array.vec.count;
+	*addrs = nlbl_vec_finish(&array.vec);
+	if (result != NULL)
+		nlbl_result_adopt(result, *addrs);
+	return rc;
+}
+
+/**
+ * Dump the static label configuration into a result set
+ * @param hndl the NetLabel handle
+ * @param def true for the default static labels
+ * @param addrs the static label address mappings
+ * @param result the result set
+ *
+ * Dump the static labels, or the default static labels if @def is true, into
+ * a new result set.  Returns the number of static labels on success, negative
+ * values on failure.
+ *
+ */
+static int nlbl_unlbl_result_list(struct nlbl_handle *hndl, int def,
+				  struct nlbl_addrmap **addrs,
+				  struct nlbl_result **result)
+{
+	int rc;
+	struct nlbl_result *res;
+
+	/* sanity checks */
+	if (addrs == NULL || result == NULL)
+		return -EINVAL;
+
+	res = nlbl_result_new();
+	if (res == NULL)
+		return -ENOMEM;
+	rc = nlbl_unlbl_array_list(hndl, def, addrs, res);
+	if (rc < 0) {
+		nlbl_result_free(res);
+		return rc;
+	}
+
+	*result = res;
+	return rc;
 }
 
 /*
@@ -181,10 +414,10 @@ init_return:
  * @param hndl the NetLabel handle
  * @param allow_flag the desired accept flag setting
  *
- * Set the unlbl accept flag in the NetLabel system; if @allow_flag is
- * true then set the accept flag, otherwise clear the flag.  If @hndl is NULL
- * then the function will handle opening and closing it's own NetLabel handle.
- * Returns zero on success, negative values on failure.
+ * Set the unlbl accept flag in the NetLabel system; if @allow_flag is true then
+ * set the accept flag, otherwise clear the flag.  If @hndl is NULL then the
+ * library's default NetLabel handle is used. Returns zero on success, negative
+ * values on failure.
  *
  */
 int nlbl_unlbl_accept(struct nlbl_handle *hndl, uint8_t allow_flag)
@@ -195,18 +428,20 @@ int nlbl_unlbl_accept(struct nlbl_handle *hndl, uint8_t allow_flag)
 	nlbl_msg *ans_msg = NULL;
 
 	/* sanity checks */
-	if (nlbl_unlbl_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_UNLBL);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto accept_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_unlbl_msg_new(NLBL_UNLABEL_C_ACCEPT, 0);
+	msg = nlbl_unlbl_msg_new(p_hndl, NLBL_UNLABEL_C_ACCEPT, 0);
 	if (msg == NULL)
 		goto accept_return;
 
@@ -218,6 +453,18 @@ int nlbl_unlbl_accept(struct nlbl_handle *hndl, uint8_t allow_flag)
 	if (rc != 0)
 		goto accept_return;
 
+	/* queue the request if we are batching */
+	if (nlbl_batch_active(p_hndl)) {
+		rc = nlbl_batch_queue(p_hndl, msg);
+		goto accept_return;
+	}
+
+	/* send the request without waiting if we are asynchronous */
+	if (nlbl_async_active(p_hndl)) {
+		rc = nlbl_async_request(p_hndl, msg);
+		goto accept_return;
+	}
+
 	/* send the request */
 	rc = nlbl_comm_send(p_hndl, msg);
 	if (rc <= 0) {
@@ -238,9 +485,8 @@ int nlbl_unlbl_accept(struct nlbl_handle *hndl, uint8_t allow_flag)
 	rc = nlbl_unlbl_parse_ack(ans_msg);
 
 accept_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	nlbl_msg_free(msg);
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
 	nlbl_msg_free(ans_msg);
 	return rc;
 }
@@ -251,8 +497,8 @@ accept_return:
  * @param allow_flag the current accept flag setting
  *
  * Query the unlbl accept flag in the NetLabel system.  If @hndl is NULL then
- * the function will handle opening and closing it's own NetLabel handle.
- * Returns zero on success, negative values on failure.
+ * the library's default NetLabel handle is used. Returns zero on success,
+ * negative values on failure.
  *
  */
 int nlbl_unlbl_list(struct nlbl_handle *hndl, uint8_t *allow_flag)
@@ -267,18 +513,20 @@ int nlbl_unlbl_list(struct nlbl_handle *hndl, uint8_t *allow_flag)
 	/* sanity checks */
 	if (allow_flag == NULL)
 		return -EINVAL;
-	if (nlbl_unlbl_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_UNLBL);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto list_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_unlbl_msg_new(NLBL_UNLABEL_C_LIST, 0);
+	msg = nlbl_unlbl_msg_new(p_hndl, NLBL_UNLABEL_C_LIST, 0);
 	if (msg == NULL)
 		goto list_return;
 
@@ -317,9 +565,8 @@ int nlbl_unlbl_list(struct nlbl_handle *hndl, uint8_t *allow_flag)
 	rc = 0;
 
 list_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	nlbl_msg_free(msg);
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
 	nlbl_msg_free(ans_msg);
 	return rc;
 }
@@ -332,8 +579,8 @@ list_return:
  * @param label the security label
  *
  * Add a new static label configuration to the NetLabel system.  If @hndl is
- * NULL then the function will handle opening and closing it's own NetLabel
- * handle.  Returns zero on success, negative values on failure.
+ * NULL then the library's default NetLabel handle is used.  Returns zero on
+ * success, negative values on failure.
  *
  */
 int nlbl_unlbl_staticadd(struct nlbl_handle *hndl,
@@ -349,18 +596,20 @@ int nlbl_unlbl_staticadd(struct nlbl_handle *hndl,
 	/* sanity checks */
 	if (dev == NULL || addr == NULL || label == NULL)
 		return -EINVAL;
-	if (nlbl_unlbl_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_UNLBL);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto staticadd_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_unlbl_msg_new(NLBL_UNLABEL_C_STATICADD, 0);
+	msg = nlbl_unlbl_msg_new(p_hndl, NLBL_UNLABEL_C_STATICADD, 0);
 	if (msg == NULL)
 		goto staticadd_return;
 
@@ -405,6 +654,18 @@ int nlbl_unlbl_staticadd(struct nlbl_handle *hndl,
 		goto staticadd_return;
 	}
 
+	/* queue the request if we are batching */
+	if (nlbl_batch_active(p_hndl)) {
+		rc = nlbl_batch_queue(p_hndl, msg);
+		goto staticadd_return;
+	}
+
+	/* send the request without waiting if we are asynchronous */
+	if (nlbl_async_active(p_hndl)) {
+		rc = nlbl_async_request(p_hndl, msg);
+		goto staticadd_return;
+	}
+
 	/* send the request */
 	rc = nlbl_comm_send(p_hndl, msg);
 	if (rc <= 0) {
@@ -425,9 +686,8 @@ int nlbl_unlbl_staticadd(struct nlbl_handle *hndl,
 	rc = nlbl_unlbl_parse_ack(ans_msg);
 
 staticadd_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	nlbl_msg_free(msg);
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
 	nlbl_msg_free(ans_msg);
 	return rc;
 }
@@ -438,9 +698,9 @@ staticadd_return:
  * @param addr the network IP address
  * @param label the security label
  *
- * Set the default static label configuration to the NetLabel system.  If
- * @hndl is NULL then the function will handle opening and closing it's own
- * NetLabel handle.  Returns zero on success, negative values on failure.
+ * Set the default static label configuration to the NetLabel system.  If @hndl
+ * is NULL then the library's default NetLabel handle is used.  Returns zero on
+ * success, negative values on failure.
  *
  */
 int nlbl_unlbl_staticadddef(struct nlbl_handle *hndl,
@@ -455,18 +715,20 @@ int nlbl_unlbl_staticadddef(struct nlbl_handle *hndl,
 	/* sanity checks */
 	if (addr == NULL || label == NULL)
 		return -EINVAL;
-	if (nlbl_unlbl_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_UNLBL);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto staticadddef_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_unlbl_msg_new(NLBL_UNLABEL_C_STATICADDDEF, 0);
+	msg = nlbl_unlbl_msg_new(p_hndl, NLBL_UNLABEL_C_STATICADDDEF, 0);
 	if (msg == NULL)
 		goto staticadddef_return;
 
@@ -508,6 +770,18 @@ int nlbl_unlbl_staticadddef(struct nlbl_handle *hndl,
 		goto staticadddef_return;
 	}
 
+	/* queue the request if we are batching */
+	if (nlbl_batch_active(p_hndl)) {
+		rc = nlbl_batch_queue(p_hndl, msg);
+		goto staticadddef_return;
+	}
+
+	/* send the request without waiting if we are asynchronous */
+	if (nlbl_async_active(p_hndl)) {
+		rc = nlbl_async_request(p_hndl, msg);
+		goto staticadddef_return;
+	}
+
 	/* send the request */
 	rc = nlbl_comm_send(p_hndl, msg);
 	if (rc <= 0) {
@@ -528,9 +802,8 @@ int nlbl_unlbl_staticadddef(struct nlbl_handle *hndl,
 	rc = nlbl_unlbl_parse_ack(ans_msg);
 
 staticadddef_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	nlbl_msg_free(msg);
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
 	nlbl_msg_free(ans_msg);
 	return rc;
 }
@@ -542,8 +815,8 @@ staticadddef_return:
  * @param addr the network IP address
  *
  * Delete a new static label configuration to the NetLabel system.  If @hndl is
- * NULL then the function will handle opening and closing it's own NetLabel
- * handle.  Returns zero on success, negative values on failure.
+ * NULL then the library's default NetLabel handle is used.  Returns zero on
+ * success, negative values on failure.
  *
  */
 int nlbl_unlbl_staticdel(struct nlbl_handle *hndl,
@@ -558,18 +831,20 @@ int nlbl_unlbl_staticdel(struct nlbl_handle *hndl,
 	/* sanity checks */
 	if (dev == NULL || addr == NULL)
 		return -EINVAL;
-	if (nlbl_unlbl_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_UNLBL);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto staticdel_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_unlbl_msg_new(NLBL_UNLABEL_C_STATICREMOVE, 0);
+	msg = nlbl_unlbl_msg_new(p_hndl, NLBL_UNLABEL_C_STATICREMOVE, 0);
 	if (msg == NULL)
 		goto staticdel_return;
 
@@ -611,6 +886,18 @@ int nlbl_unlbl_staticdel(struct nlbl_handle *hndl,
 		goto staticdel_return;
 	}
 
+	/* queue the request if we are batching */
+	if (nlbl_batch_active(p_hndl)) {
+		rc = nlbl_batch_queue(p_hndl, msg);
+		goto staticdel_return;
+	}
+
+	/* send the request without waiting if we are asynchronous */
+	if (nlbl_async_active(p_hndl)) {
+		rc = nlbl_async_request(p_hndl, msg);
+		goto staticdel_return;
+	}
+
 	/* send the request */
 	rc = nlbl_comm_send(p_hndl, msg);
 	if (rc <= 0) {
@@ -631,9 +918,8 @@ int nlbl_unlbl_staticdel(struct nlbl_handle *hndl,
 	rc = nlbl_unlbl_parse_ack(ans_msg);
 
 staticdel_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	nlbl_msg_free(msg);
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
 	nlbl_msg_free(ans_msg);
 	return rc;
 }
@@ -644,8 +930,8 @@ staticdel_return:
  * @param addr the network IP address
  *
  * Delete the default static label configuration to the NetLabel system.  If
- * @hndl is NULL then the function will handle opening and closing it's own
- * NetLabel handle.  Returns zero on success, negative values on failure.
+ * @hndl is NULL then the library's default NetLabel handle is used.  Returns
+ * zero on success, negative values on failure.
  *
  */
 int nlbl_unlbl_staticdeldef(struct nlbl_handle *hndl,
@@ -659,18 +945,20 @@ int nlbl_unlbl_staticdeldef(struct nlbl_handle *hndl,
 	/* sanity checks */
 	if (addr == NULL)
 		return -EINVAL;
-	if (nlbl_unlbl_fid == 0)
-		return -ENOPROTOOPT;
+	rc = nlbl_family_check(hndl, NLBL_FAMILY_UNLBL);
+	if (rc < 0)
+		return rc;
+	rc = -ENOMEM;
 
-	/* open a handle if we need one */
+	/* use the default handle if we need one */
 	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
+		p_hndl = nlbl_comm_dflt();
 		if (p_hndl == NULL)
 			goto staticdeldef_return;
 	}
 
 	/* create a new message */
-	msg = nlbl_unlbl_msg_new(NLBL_UNLABEL_C_STATICREMOVEDEF, 0);
+	msg = nlbl_unlbl_msg_new(p_hndl, NLBL_UNLABEL_C_STATICREMOVEDEF, 0);
 	if (msg == NULL)
 		goto staticdeldef_return;
 
@@ -709,6 +997,18 @@ int nlbl_unlbl_staticdeldef(struct nlbl_handle *hndl,
 		goto staticdeldef_return;
 	}
 
+	/* queue the request if we are batching */
+	if (nlbl_batch_active(p_hndl)) {
+		rc = nlbl_batch_queue(p_hndl, msg);
+		goto staticdeldef_return;
+	}
+
+	/* send the request without waiting if we are asynchronous */
+	if (nlbl_async_active(p_hndl)) {
+		rc = nlbl_async_request(p_hndl, msg);
+		goto staticdeldef_return;
+	}
+
 	/* send the request */
 	rc = nlbl_comm_send(p_hndl, msg);
 	if (rc <= 0) {
@@ -729,204 +1029,69 @@ int nlbl_unlbl_staticdeldef(struct nlbl_handle *hndl,
 	rc = nlbl_unlbl_parse_ack(ans_msg);
 
 staticdeldef_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	nlbl_msg_free(msg);
+	nlbl_msg_release(p_hndl, msg);
+	nlbl_comm_dflt_done(hndl, rc);
 	nlbl_msg_free(ans_msg);
 	return rc;
 }
 
+/**
+ * Dump the static label configuration using a callback
+ * @param hndl the NetLabel handle
+ * @param cb the callback
+ * @param arg the callback argument
+ *
+ * Dump the NetLabel static label configuration, calling @cb once for each
+ * static label.  The static labels are passed to @cb without being copied, see
+ * nlbl_addrmap_cb for details.  If @hndl is NULL then the library's default
+ * NetLabel handle is used.  Returns the number of static labels passed to @cb
+ * on success, negative values on failure.
+ *
+ */
+int nlbl_unlbl_staticlist_iter(struct nlbl_handle *hndl,
+			       nlbl_addrmap_cb cb, void *arg)
+{
+	return nlbl_unlbl_staticdump(hndl, NLBL_UNLABEL_C_STATICLIST, cb, arg);
+}
+
+/**
+ * Dump the default static label configuration using a callback
+ * @param hndl the NetLabel handle
+ * @param cb the callback
+ * @param arg the callback argument
+ *
+ * Dump the NetLabel default static label configuration, calling @cb once for
+ * each static label.  The static labels are passed to @cb without being
+ * copied, see nlbl_addrmap_cb for details.  If @hndl is NULL then the
+ * library's default NetLabel handle is used.  Returns the number of static
+ * labels passed to @cb on success, negative values on failure.
+ *
+ */
+int nlbl_unlbl_staticlistdef_iter(struct nlbl_handle *hndl,
+				  nlbl_addrmap_cb cb, void *arg)
+{
+	return nlbl_unlbl_staticdump(hndl,
+				     NLBL_UNLABEL_C_STATICLISTDEF, cb, arg);
+}
+
 /**
  * Dump the static label configuration
  * @param hndl the NetLabel handle
  * @param addrs the static label address mappings
  *
  * Dump the NetLabel static label configuration.  If @hndl is NULL then the
- * function will handle opening and closing it's own NetLabel handle.
- * Returns zero on success, negative values on failure.
+ * library's default NetLabel handle is used.  Returns the number of static
+ * labels on success, negative values on failure.
  *
  */
 int nlbl_unlbl_staticlist(struct nlbl_handle *hndl,
 			  struct nlbl_addrmap **addrs)
 {
-	int rc = -ENOMEM;
-	struct nlbl_handle *p_hndl = hndl;
-	unsigned char *data = NULL;
-	nlbl_msg *msg = NULL;
-	struct nlmsghdr *nl_hdr;
-	struct genlmsghdr *genl_hdr;
-	struct nlattr *nla_head;
-	struct nlattr *nla;
-	int data_len;
-	int data_attrlen;
-	struct nlbl_addrmap *addr_array = NULL, *addr_array_new;
-	uint32_t addr_count = 0;
-
 	/* sanity checks */
 	if (addrs == NULL)
 		return -EINVAL;
-	if (nlbl_unlbl_fid == 0)
-		return -ENOPROTOOPT;
-
-	/* open a handle if we need one */
-	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
-		if (p_hndl == NULL)
-			goto staticlist_return;
-	}
-
-	/* create a new message */
-	msg = nlbl_unlbl_msg_new(NLBL_UNLABEL_C_STATICLIST, NLM_F_DUMP);
-	if (msg == NULL)
-		goto staticlist_return;
-
-	/* send the request */
-	rc = nlbl_comm_send(p_hndl, msg);
-	if (rc <= 0) {
-		if (rc == 0)
-			rc = -ENODATA;
-		goto staticlist_return;
-	}
-
-	/* read all of the messages (multi-message response) */
-	do {
-		if (data) {
-			free(data);
-			data = NULL;
-		}
-
-		/* get the next set of messages */
-		rc = nlbl_comm_recv_raw(p_hndl, &data);
-		if (rc <= 0) {
-			if (rc == 0)
-				rc = -ENODATA;
-			goto staticlist_return;
-		}
-		data_len = rc;
-		nl_hdr = (struct nlmsghdr *)data;
-
-		/* check to see if this is a netlink control message we don't
-		 * care about */
-		if (nl_hdr->nlmsg_type == NLMSG_NOOP ||
-		    nl_hdr->nlmsg_type == NLMSG_ERROR ||
-		    nl_hdr->nlmsg_type == NLMSG_OVERRUN) {
-			rc = -EBADMSG;
-			goto staticlist_return;
-		}
 
-		/* loop through the messages */
-		while (nlmsg_ok(nl_hdr, data_len) &&
-		       nl_hdr->nlmsg_type != NLMSG_DONE) {
-			/* get the header pointers */
-			genl_hdr = (struct genlmsghdr *)nlmsg_data(nl_hdr);
-			if (genl_hdr == NULL ||
-			    genl_hdr->cmd != NLBL_UNLABEL_C_STATICLIST) {
-				rc = -EBADMSG;
-				goto staticlist_return;
-			}
-			nla_head = (struct nlattr *)(&genl_hdr[1]);
-			data_attrlen = genlmsg_attrlen(genl_hdr, 0);
-
-			/* resize the array */
-			addr_array_new = realloc(addr_array,
-						 sizeof(*addr_array) *
-						 (addr_count + 1));
-			if (addr_array_new == NULL)
-				goto staticlist_return;
-			addr_array = addr_array_new;
-			memset(&addr_array[addr_count], 0, sizeof(*addr_array));
-
-			/* get the attribute information */
-			nla = nla_find(nla_head,
-				       data_attrlen, NLBL_UNLABEL_A_IFACE);
-			if (nla == NULL)
-				goto staticlist_return;
-			addr_array[addr_count].dev = malloc(nla_len(nla));
-			if (addr_array[addr_count].dev == NULL)
-				goto staticlist_return;
-			strncpy(addr_array[addr_count].dev,
-				nla_data(nla), nla_len(nla));
-			nla = nla_find(nla_head,
-				       data_attrlen, NLBL_UNLABEL_A_SECCTX);
-			if (nla == NULL)
-				goto staticlist_return;
-			addr_array[addr_count].label = malloc(nla_len(nla));
-			if (addr_array[addr_count].label == NULL)
-				goto staticlist_return;
-			strncpy(addr_array[addr_count].label,
-				nla_data(nla), nla_len(nla));
-			if (nla_find(nla_head,
-				     data_attrlen, NLBL_UNLABEL_A_IPV4ADDR)) {
-				nla = nla_find(nla_head,
-					       data_attrlen,
-					       NLBL_UNLABEL_A_IPV4ADDR);
-				if (nla == NULL)
-					goto staticlist_return;
-				if (nla_len(nla) != sizeof(struct in_addr))
-					goto staticlist_return;
-				memcpy(&addr_array[addr_count].addr.addr.v4,
-				       nla_data(nla),
-				       nla_len(nla));
-				nla = nla_find(nla_head,
-					       data_attrlen,
-					       NLBL_UNLABEL_A_IPV4MASK);
-				if (nla == NULL)
-					goto staticlist_return;
-				if (nla_len(nla) != sizeof(struct in_addr))
-					goto staticlist_return;
-				memcpy(&addr_array[addr_count].addr.mask.v4,
-				       nla_data(nla),
-				       nla_len(nla));
-				addr_array[addr_count].addr.type = AF_INET;
-			} else if (nla_find(nla_head,
-					    data_attrlen,
-					    NLBL_UNLABEL_A_IPV6ADDR)) {
-				nla = nla_find(nla_head,
-					       data_attrlen,
-					       NLBL_UNLABEL_A_IPV6ADDR);
-				if (nla == NULL)
-					goto staticlist_return;
-				if (nla_len(nla) != sizeof(struct in6_addr))
-					goto staticlist_return;
-				memcpy(&addr_array[addr_count].addr.addr.v6,
-				       nla_data(nla),
-				       nla_len(nla));
-				nla = nla_find(nla_head,
-					       data_attrlen,
-					       NLBL_UNLABEL_A_IPV6MASK);
-				if (nla == NULL)
-					goto staticlist_return;
-				if (nla_len(nla) != sizeof(struct in6_addr))
-					goto staticlist_return;
-				memcpy(&addr_array[addr_count].addr.mask.v6,
-				       nla_data(nla),
-				       nla_len(nla));
-				addr_array[addr_count].addr.type = AF_INET6;
-			}
-			addr_count++;
-
-			/* next message */
-			nl_hdr = nlmsg_next(nl_hdr, &data_len);
-		}
-	} while (NL_MULTI_CONTINUE(nl_hdr));
-
-	*addrs = addr_array;
-	rc = addr_count;
-
-staticlist_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	if (rc < 0 && addr_array) {
-		do {
-			if (addr_array[addr_count].dev)
-				free(addr_array[addr_count].dev);
-			if (addr_array[addr_count].label)
-				free(addr_array[addr_count].label);
-		} while (addr_count-- > 0);
-		free(addr_array);
-	}
-	nlbl_msg_free(msg);
-	return rc;
+	return nlbl_unlbl_array_list(hndl, 0, addrs, NULL);
 }
 
 /**
@@ -934,179 +1099,58 @@ staticlist_return:
  * @param hndl the NetLabel handle
  * @param addrs the static label address mappings
  *
- * Dump the NetLabel default static label configuration.  If @hndl is NULL
- * then the function will handle opening and closing it's own NetLabel handle.
- * Returns zero on success, negative values on failure.
+ * Dump the NetLabel default static label configuration.  If @hndl is NULL then
+ * the library's default NetLabel handle is used.  Returns the number of static
+ * labels on success, negative values on failure.
  *
  */
 int nlbl_unlbl_staticlistdef(struct nlbl_handle *hndl,
 			     struct nlbl_addrmap **addrs)
 {
-	int rc = -ENOMEM;
-	struct nlbl_handle *p_hndl = hndl;
-	unsigned char *data = NULL;
-	nlbl_msg *msg = NULL;
-	struct nlmsghdr *nl_hdr;
-	struct genlmsghdr *genl_hdr;
-	struct nlattr *nla_head;
-	struct nlattr *nla;
-	int data_len;
-	int data_attrlen;
-	struct nlbl_addrmap *addr_array = NULL, *addr_array_new;
-	uint32_t addr_count = 0;
-
 	/* sanity checks */
 	if (addrs == NULL)
 		return -EINVAL;
-	if (nlbl_unlbl_fid == 0)
-		return -ENOPROTOOPT;
-
-	/* open a handle if we need one */
-	if (p_hndl == NULL) {
-		p_hndl = nlbl_comm_open();
-		if (p_hndl == NULL)
-			goto staticlistdef_return;
-	}
-
-	/* create a new message */
-	msg = nlbl_unlbl_msg_new(NLBL_UNLABEL_C_STATICLISTDEF, NLM_F_DUMP);
-	if (msg == NULL)
-		goto staticlistdef_return;
-
-	/* send the request */
-	rc = nlbl_comm_send(p_hndl, msg);
-	if (rc <= 0) {
-		if (rc == 0)
-			rc = -ENODATA;
-		goto staticlistdef_return;
-	}
 
-	/* read all of the messages (multi-message response) */
-	do {
-		if (data) {
-			free(data);
-			data = NULL;
-		}
+	return nlbl_unlbl_array_list(hndl, 1, addrs, NULL);
+}
 
-		/* get the next set of messages */
-		rc = nlbl_comm_recv_raw(p_hndl, &data);
-		if (rc <= 0) {
-			if (rc == 0)
-				rc = -ENODATA;
-			goto staticlistdef_return;
-		}
-		data_len = rc;
-		nl_hdr = (struct nlmsghdr *)data;
-
-		/* check to see if this is a netlink control message we don't
-		 * care about */
-		if (nl_hdr->nlmsg_type == NLMSG_NOOP ||
-		    nl_hdr->nlmsg_type == NLMSG_ERROR ||
-		    nl_hdr->nlmsg_type == NLMSG_OVERRUN) {
-			rc = -EBADMSG;
-			goto staticlistdef_return;
-		}
+/**
+ * Dump the static label configuration into a result set
+ * @param hndl the NetLabel handle
+ * @param addrs the static label address mappings
+ * @param result the result set
+ *
+ * Dump the NetLabel static label configuration like nlbl_unlbl_staticlist(),
+ * except that @addrs and all of the strings it references are stored in
+ * @result and released with a single call to nlbl_result_free().  If @hndl is
+ * NULL then the library's default NetLabel handle is used.  Returns the number
+ * of static labels on success, negative values on failure.
+ *
+ */
+int nlbl_unlbl_staticlist_result(struct nlbl_handle *hndl,
+				 struct nlbl_addrmap **addrs,
+				 struct nlbl_result **result)
+{
+	return nlbl_unlbl_result_list(hndl, 0, addrs, result);
+}
 
-		/* loop through the messages */
-		while (nlmsg_ok(nl_hdr, data_len) &&
-		       nl_hdr->nlmsg_type != NLMSG_DONE) {
-			/* get the header pointers */
-			genl_hdr = (struct genlmsghdr *)nlmsg_data(nl_hdr);
-			if (genl_hdr == NULL ||
-			    genl_hdr->cmd != NLBL_UNLABEL_C_STATICLISTDEF) {
-				rc = -EBADMSG;
-				goto staticlistdef_return;
-			}
-			nla_head = (struct nlattr *)(&genl_hdr[1]);
-			data_attrlen = genlmsg_attrlen(genl_hdr, 0);
-
-			/* resize the array */
-			addr_array_new = realloc(addr_array,
-						 sizeof(*addr_array) *
-						 (addr_count + 1));
-			if (addr_array_new == NULL)
-				goto staticlistdef_return;
-			addr_array = addr_array_new;
-			memset(&addr_array[addr_count], 0, sizeof(*addr_array));
-
-			/* get the attribute information */
-			nla = nla_find(nla_head,
-				       data_attrlen, NLBL_UNLABEL_A_SECCTX);
-			if (nla == NULL)
-				goto staticlistdef_return;
-			addr_array[addr_count].label = malloc(nla_len(nla));
-			if (addr_array[addr_count].label == NULL)
-				goto staticlistdef_return;
-			strncpy(addr_array[addr_count].label,
-				nla_data(nla), nla_len(nla));
-			if (nla_find(nla_head,
-				     data_attrlen, NLBL_UNLABEL_A_IPV4ADDR)) {
-				nla = nla_find(nla_head,
-					       data_attrlen,
-					       NLBL_UNLABEL_A_IPV4ADDR);
-				if (nla == NULL)
-					goto staticlistdef_return;
-				if (nla_len(nla) != sizeof(struct in_addr))
-					goto staticlistdef_return;
-				memcpy(&addr_array[addr_count].addr.addr.v4,
-				       nla_data(nla),
-				       nla_len(nla));
-				nla = nla_find(nla_head,
-					       data_attrlen,
-					       NLBL_UNLABEL_A_IPV4MASK);
-				if (nla == NULL)
-					goto staticlistdef_return;
-				if (nla_len(nla) != sizeof(struct in_addr))
-					goto staticlistdef_return;
-				memcpy(&addr_array[addr_count].addr.mask.v4,
-				       nla_data(nla),
-				       nla_len(nla));
-				addr_array[addr_count].addr.type = AF_INET;
-			} else if (nla_find(nla_head,
-					    data_attrlen,
-					    NLBL_UNLABEL_A_IPV6ADDR)) {
-				nla = nla_find(nla_head,
-					       data_attrlen,
-					       NLBL_UNLABEL_A_IPV6ADDR);
-				if (nla == NULL)
-					goto staticlistdef_return;
-				if (nla_len(nla) != sizeof(struct in6_addr))
-					goto staticlistdef_return;
-				memcpy(&addr_array[addr_count].addr.addr.v6,
-				       nla_data(nla),
-				       nla_len(nla));
-				nla = nla_find(nla_head,
-					       data_attrlen,
-					       NLBL_UNLABEL_A_IPV6MASK);
-				if (nla == NULL)
-					goto staticlistdef_return;
-				if (nla_len(nla) != sizeof(struct in6_addr))
-					goto staticlistdef_return;
-				memcpy(&addr_array[addr_count].addr.mask.v6,
-				       nla_data(nla),
-				       nla_len(nla));
-				addr_array[addr_count].addr.type = AF_INET6;
-			}
-			addr_count++;
-
-			/* next message */
-			nl_hdr = nlmsg_next(nl_hdr, &data_len);
-		}
-	} while (NL_MULTI_CONTINUE(nl_hdr));
-
-	*addrs = addr_array;
-	rc = addr_count;
-
-staticlistdef_return:
-	if (hndl == NULL)
-		nlbl_comm_close(p_hndl);
-	if (rc < 0 && addr_array) {
-		do {
-			if (addr_array[addr_count].label)
-				free(addr_array[addr_count].label);
-		} while (addr_count-- > 0);
-		free(addr_array);
-	}
-	nlbl_msg_free(msg);
-	return rc;
+/**
+ * Dump the default static label configuration into a result set
+ * @param hndl the NetLabel handle
+ * @param addrs the static label address mappings
+ * @param result the result set
+ *
+ * Dump the NetLabel default static label configuration like
+ * nlbl_unlbl_staticlistdef(), except that @addrs and all of the strings it
+ * references are stored in @result and released with a single call to
+ * nlbl_result_free().  If @hndl is NULL then the library's default NetLabel
+ * handle is used.  Returns the number of static labels on success, negative
+ * values on failure.
+ *
+ */
+int nlbl_unlbl_staticlistdef_result(struct nlbl_handle *hndl,
+				    struct nlbl_addrmap **addrs,
+				    struct nlbl_result **result)
+{
+	return nlbl_unlbl_result_list(hndl, 1, addrs, result);
 }
@@ -0,0 +1,688 @@
+/** @file
+ * NetLabel Asynchronous Request Functions
+ *
+ * Author: Paul Moore <paul@paul-moore.com>
+ *
+ */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <linux/types.h>
+
+#include <libnetlabel.h>
+
+#include "netlabel_internal.h"
+
+/* socket buffer size requested for asynchronous handles */
+#define NLBL_ASYNC_SOCKBUF	(1024 * 1024)
+
+/* outstanding asynchronous request */
+struct nlbl_async_req {
+	int id;
+	uint32_t seq;
+
+	/* dump requests only, cb is NULL for requests which only get an ack */
+	uint8_t cmd;
+	nlbl_comm_dump_cb cb;
+	void *arg;
+	void (*arg_free)(void *arg);
+	int count;
+	int rc_cb;
+
+	/* queued dump requests which have not been sent yet */
+	nlbl_msg *msg;
+	struct nlbl_async_req *next;
+};
+
+/* sent request slot, req is NULL once the request has completed */
+struct nlbl_async_slot {
+	uint32_t seq;
+	struct nlbl_async_req *req;
+};
+
+/* NetLabel asynchronous request state */
+struct nlbl_async {
+	nlbl_async_cb cb;
+	void *arg;
+
+	/* sent requests in sequence number order */
+	struct nlbl_vec slots;
+	size_t head;
+
+	/* the kernel only runs one dump at a time on a socket */
+	struct nlbl_async_req *dump;
+	struct nlbl_async_req *dump_queue;
+	struct nlbl_async_req *dump_queue_tail;
+
+	unsigned int pending;
+	unsigned int completed;
+	int id_next;
+
+	/* set while nlbl_async_end() cancels the outstanding requests */
+	int ending;
+
+	/* socket buffer sizes before asynchronous mode */
+	struct nlbl_comm_sockbuf sockbuf;
+};
+
+/*
+ * Helper Functions
+ */
+
+/**
+ * Find a sent asynchronous request
+ * @param async the asynchronous request state
+ * @param seq the sequence number
+ *
+ * The requests are sent, and stored, in sequence number order so the request
+ * can be found with a binary search.  Returns the request's slot on success,
+ * NULL if no outstanding request uses @seq.
+ *
+ */
+static struct nlbl_async_slot *nlbl_async_find(struct nlbl_async *async,
+					       uint32_t seq)
+{
+	struct nlbl_async_slot *slots = async->slots.array;
+	size_t lo = async->head;
+	size_t hi = async->slots.count;
+	size_t mid;
+	uint32_t base;
+
+	if (lo >= hi)
+		return NULL;
+
+	/* compare the offsets from the oldest request to handle wrapping */
+	base = slots[lo].seq;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (slots[mid].seq - base < seq - base)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo >= async->slots.count ||
+	    slots[lo].seq != seq || slots[lo].req == NULL)
+		return NULL;
+
+	return &slots[lo];
+}
+
+/**
+ * Free an asynchronous request
+ * @param req the request
+ */
+static void nlbl_async_req_free(struct nlbl_async_req *req)
+{
+	if (req->arg_free != NULL)
+		req->arg_free(req->arg);
+	free(req->arg);
+	nlbl_msg_free(req->msg);
+	free(req);
+}
+
+/**
+ * Finish an asynchronous request
+ * @param hndl the NetLabel handle
+ * @param req the request
+ * @param rc the request result
+ *
+ * Call the completion callback for @req, which must no longer be referenced
+ * by the asynchronous request state, and free it.
+ *
+ */
+static void nlbl_async_finish(struct nlbl_handle *hndl,
+			      struct nlbl_async_req *req, int rc)
+{
+	struct nlbl_async *async = hndl->async;
+
+	async->pending--;
+	async->completed++;
+	if (async->cb != NULL)
+		async->cb(hndl, req->id, rc, async->arg);
+	nlbl_async_req_free(req);
+}
+
+/**
+ * Send an asynchronous request
+ * @param hndl the NetLabel handle
+ * @param msg the request
+ * @param req the request state
+ *
+ * Send @msg without waiting for a response and record @req so that the
+ * response can be matched to it.  Returns zero on success, negative values on
+ * failure.
+ *
+ */
+static int nlbl_async_send(struct nlbl_handle *hndl, nlbl_msg *msg,
+			   struct nlbl_async_req *req)
+{
+	int rc;
+	struct nlbl_async *async = hndl->async;
+	struct nlbl_async_slot *slot;
+	struct nlmsghdr *nl_hdr;
+
+	nl_hdr = nlbl_msg_nlhdr(msg);
+	if (nl_hdr == NULL)
+		return -EBADMSG;
+
+	/* make room for the request before it is sent */
+	slot = nlbl_vec_add(&async->slots);
+	if (slot == NULL)
+		return -ENOMEM;
+
+	rc = nlbl_comm_write(hndl, msg);
+	if (rc < 0) {
+		async->slots.count--;
+		return rc;
+	}
+	req->seq = nl_hdr->nlmsg_seq;
+	slot->seq = req->seq;
+	slot->req = req;
+	NLBL_PROBE3(async_request, hndl, req->id, req->seq);
+
+	return 0;
+}
+
+/**
+ * Send the next queued dump request
+ * @param hndl the NetLabel handle
+ *
+ * If no dump is running on @hndl, send the oldest queued dump request.  Queued
+ * requests which can not be sent are completed with the error.
+ *
+ */
+static void nlbl_async_dump_next(struct nlbl_handle *hndl)
+{
+	int rc;
+	struct nlbl_async *async = hndl->async;
+	struct nlbl_async_req *req;
+
+	while (async->dump == NULL && async->dump_queue != NULL) {
+		req = async->dump_queue;
+		async->dump_queue = req->next;
+		if (async->dump_queue == NULL)
+			async->dump_queue_tail = NULL;
+		req->next = NULL;
+
+		rc = nlbl_async_send(hndl, req->msg, req);
+		if (rc < 0) {
+			nlbl_async_finish(hndl, req, rc);
+			continue;
+		}
+		nlbl_msg_free(req->msg);
+		req->msg = NULL;
+		async->dump = req;
+	}
+}
+
+/**
+ * Complete a sent asynchronous request
+ * @param hndl the NetLabel handle
+ * @param slot the request's slot
+ * @param rc the request result
+ *
+ * Remove the request in @slot from the sent requests, call the completion
+ * callback, and then start the next queued dump if the request was a dump.
+ *
+ */
+static void nlbl_async_complete(struct nlbl_handle *hndl,
+				struct nlbl_async_slot *slot, int rc)
+{
+	struct nlbl_async *async = hndl->async;
+	struct nlbl_async_slot *slots = async->slots.array;
+	struct nlbl_async_req *req = slot->req;
+
+	/* release the slot, dropping completed slots from the front */
+	slot->req = NULL;
+	while (async->head < async->slots.count &&
+	       slots[async->head].req == NULL)
+		async->head++;
+	if (async->head == async->slots.count) {
+		async->slots.count = 0;
+		async->head = 0;
+	} else if (async->head > async->slots.count / 2) {
+		memmove(slots, &slots[async->head],
+			sizeof(*slots) * (async->slots.count - async->head));
+		async->slots.count -= async->head;
+		async->head = 0;
+	}
+	if (async->dump == req)
+		async->dump = NULL;
+
+	NLBL_PROBE3(async_complete, hndl, req->id, rc);
+	nlbl_async_finish(hndl, req, rc);
+	nlbl_async_dump_next(hndl);
+}
+
+/**
+ * Handle a response to an asynchronous request
+ * @param hndl the NetLabel handle
+ * @param nl_hdr the response
+ *
+ * Acks and the end of a dump carry the sequence number of the request, dump
+ * entries don't always do so but there is only ever one dump running.
+ * Responses which do not match an outstanding request are ignored.
+ *
+ */
+static void nlbl_async_response(struct nlbl_handle *hndl,
+				struct nlmsghdr *nl_hdr)
+{
+	struct nlbl_async *async = hndl->async;
+	struct nlbl_async_slot *slot;
+	struct nlbl_async_req *req;
+	struct genlmsghdr *genl_hdr;
+	struct nlmsgerr *nl_err;
+
+	switch (nl_hdr->nlmsg_type) {
+	case NLMSG_ERROR:
+		slot = nlbl_async_find(async, nl_hdr->nlmsg_seq);
+		if (slot == NULL)
+			return;
+		nl_err = nlmsg_data(nl_hdr);
+		if (slot->req->cb == NULL || nl_err->error != 0)
+			nlbl_async_complete(hndl, slot, nl_err->error);
+		else
+			nlbl_async_complete(hndl, slot, -EBADMSG);
+		return;
+	case NLMSG_DONE:
+		slot = nlbl_async_find(async, nl_hdr->nlmsg_seq);
+		if (slot == NULL || slot->req != async->dump)
+			return;
+		req = slot->req;
+		nlbl_async_complete(hndl, slot,
+				    (req->rc_cb < 0 ? req->rc_cb : req->count));
+		return;
+	case NLMSG_NOOP:
+	case NLMSG_OVERRUN:
+		return;
+	}
+
+	req = async->dump;
+	if (req == NULL)
+		return;
+	slot = nlbl_async_find(async, req->seq);
+
+	if (nl_hdr->nlmsg_len < NLMSG_LENGTH(GENL_HDRLEN)) {
+		nlbl_async_complete(hndl, slot, -EBADMSG);
+		return;
+	}
+	genl_hdr = nlmsg_data(nl_hdr);
+	if (genl_hdr->cmd != req->cmd) {
+		nlbl_async_complete(hndl, slot, -EBADMSG);
+		return;
+	}
+
+	/* once the callback stops the dump we simply drain the rest of the
+	 * response */
+	if (req->rc_cb == 0) {
+		req->rc_cb = req->cb(genlmsg_attrdata(genl_hdr, 0),
+				     genlmsg_attrlen(genl_hdr, 0), req->arg);
+		req->count++;
+	}
+	if (!(nl_hdr->nlmsg_flags & NLM_F_MULTI)) {
+		/* the callback may have sent requests, find the slot again */
+		slot = nlbl_async_find(async, req->seq);
+		nlbl_async_complete(hndl, slot,
+				    (req->rc_cb < 0 ? req->rc_cb : req->count));
+	}
+}
+
+/**
+ * Fail all of the outstanding asynchronous requests
+ * @param hndl the NetLabel handle
+ * @param rc the request result
+ *
+ * Complete all of the outstanding requests on @hndl, including the queued
+ * dump requests, with @rc.  The requests are detached from the handle before
+ * any callback runs, so requests sent by the callbacks start afresh and are
+ * not failed with the others.
+ *
+ */
+static void nlbl_async_fail(struct nlbl_handle *hndl, int rc)
+{
+	struct nlbl_async *async = hndl->async;
+	struct nlbl_async_req *queue = async->dump_queue;
+	struct nlbl_async_req *req;
+	struct nlbl_async_slot *slots;
+	struct nlbl_vec sent = async->slots;
+	size_t iter;
+
+	async->dump_queue = NULL;
+	async->dump_queue_tail = NULL;
+	async->dump = NULL;
+	nlbl_vec_init(&async->slots, sizeof(struct nlbl_async_slot), 0);
+	slots = sent.array;
+	iter = async->head;
+	async->head = 0;
+
+	/* the queued dumps first, in the order they were requested */
+	while (queue != NULL) {
+		req = queue;
+		queue = req->next;
+		nlbl_async_finish(hndl, req, rc);
+	}
+
+	for (; iter < sent.count; iter++)
+		if (slots[iter].req != NULL)
+			nlbl_async_finish(hndl, slots[iter].req, rc);
+	nlbl_vec_free(&sent);
+}
+
+/**
+ * Allocate an asynchronous request
+ * @param hndl the NetLabel handle
+ *
+ * Returns a new request with the next request id on success, NULL on failure.
+ *
+ */
+static struct nlbl_async_req *nlbl_async_req_new(struct nlbl_handle *hndl)
+{
+	struct nlbl_async *async = hndl->async;
+	struct nlbl_async_req *req;
+
+	req = calloc(1, sizeof(*req));
+	if (req == NULL)
+		return NULL;
+	req->id = async->id_next;
+	async->id_next = (async->id_next == INT_MAX ? 1 : async->id_next + 1);
+
+	return req;
+}
+
+/*
+ * Internal Asynchronous Request Functions
+ */
+
+/**
+ * Determine if a NetLabel handle is in asynchronous mode
+ * @param hndl the NetLabel handle
+ *
+ * Returns true if @hndl is in asynchronous mode, false otherwise.
+ *
+ */
+int nlbl_async_active(struct nlbl_handle *hndl)
+{
+	return (hndl != NULL && hndl->async != NULL);
+}
+
+/**
+ * Send an asynchronous request which only returns an ack
+ * @param hndl the NetLabel handle
+ * @param msg the request
+ *
+ * Send @msg, requesting an ack, without waiting for the response.  The caller
+ * retains ownership of @msg.  Returns the request id on success, negative
+ * values on failure.
+ *
+ */
+int nlbl_async_request(struct nlbl_handle *hndl, nlbl_msg *msg)
+{
+	int rc;
+	struct nlbl_async_req *req;
+	struct nlmsghdr *nl_hdr;
+
+	if (!nlbl_async_active(hndl) || msg == NULL)
+		return -EINVAL;
+	if (hndl->async->ending)
+		return -EBUSY;
+	nl_hdr = nlbl_msg_nlhdr(msg);
+	if (nl_hdr == NULL)
+		return -EBADMSG;
+	nl_hdr->nlmsg_flags |= NLM_F_ACK;
+
+	req = nlbl_async_req_new(hndl);
+	if (req == NULL)
+		return -ENOMEM;
+	rc = nlbl_async_send(hndl, msg, req);
+	if (rc < 0) {
+		nlbl_async_req_free(req);
+		return rc;
+	}
+	hndl->async->pending++;
+
+	return req->id;
+}
+
+/**
+ * Send an asynchronous dump request
+ * @param hndl the NetLabel handle
+ * @param msg the dump request
+ * @param cmd the generic netlink command of the dump entries
+ * @param cb the entry callback
+ * @param arg the entry callback state
+ * @param arg_len the size of the entry callback state
+ * @param arg_free function to release the entry callback state, or NULL
+ *
+ * Send the dump request in @msg without waiting for the response; if another
+ * dump is running on @hndl the request is queued and sent once the other dump
+ * completes.  The entries are passed to @cb by nlbl_async_dispatch() as they
+ * arrive, the same way as nlbl_comm_dump().  A copy of the @arg_len bytes at
+ * @arg is passed to @cb and released, using @arg_free if it is not NULL, when
+ * the dump completes.  The caller retains ownership of @msg.  Returns the
+ * request id on success, negative values on failure.
+ *
+ */
+int nlbl_async_dump(struct nlbl_handle *hndl, nlbl_msg *msg, uint8_t cmd,
+		    nlbl_comm_dump_cb cb, const void *arg, size_t arg_len,
+		    void (*arg_free)(void *arg))
+{
+	int rc;
+	struct nlbl_async *async;
+	struct nlbl_async_req *req;
+
+	if (!nlbl_async_active(hndl) || msg == NULL || cb == NULL)
+		return -EINVAL;
+	async = hndl->async;
+	if (async->ending)
+		return -EBUSY;
+
+	req = nlbl_async_req_new(hndl);
+	if (req == NULL)
+		return -ENOMEM;
+	req->arg = malloc(arg_len);
+	if (req->arg == NULL) {
+		free(req);
+		return -ENOMEM;
+	}
+	memcpy(req->arg, arg, arg_len);
+	req->cmd = cmd;
+	req->cb = cb;
+	req->arg_free = arg_free;
+
+	if (async->dump != NULL) {
+		/* hold on to the request until the running dump completes */
+		nlmsg_get(msg);
+		req->msg = msg;
+		if (async->dump_queue_tail != NULL)
+			async->dump_queue_tail->next = req;
+		else
+			async->dump_queue = req;
+		async->dump_queue_tail = req;
+	} else {
+		rc = nlbl_async_send(hndl, msg, req);
+		if (rc < 0) {
+			nlbl_async_req_free(req);
+			return rc;
+		}
+		async->dump = req;
+	}
+	async->pending++;
+
+	return req->id;
+}
+
+/*
+ * Asynchronous Request Functions
+ */
+
+/**
+ * Put a NetLabel handle into asynchronous mode
+ * @param hndl the NetLabel handle
+ * @param cb the completion callback
+ * @param arg the completion callback argument
+ *
+ * Put @hndl into asynchronous mode and make its socket non-blocking.  Until
+ * nlbl_async_end() is called, the configuration operations which only return
+ * success or failure (e.g. nlbl_unlbl_staticadd() and nlbl_mgmt_add()) and the
+ * dump iterators (e.g. nlbl_unlbl_staticlist_iter()) send their request and
+ * return a positive request id without waiting for the kernel.  The caller
+ * waits for nlbl_comm_fd() to become readable, e.g. with epoll, and then calls
+ * nlbl_async_dispatch() which passes dump entries to the dump callbacks as
+ * they arrive and calls @cb once for each completed request.  All of the
+ * other operations fail with -EBUSY while the handle is in asynchronous mode.
+ * The kernel runs one dump at a time, so dumps are queued and sent in turn.
+ * Callers should bound the number of requests in flight; responses which
+ * overflow the socket's receive buffer are lost, see nlbl_async_dispatch().
+ * The socket buffers are raised to 1 MiB, if they are smaller, until
+ * nlbl_async_end() restores them.  Asynchronous mode requires an explicit
+ * handle, @hndl can not be NULL.  Returns zero on success, negative values on
+ * failure.
+ *
+ */
+int nlbl_async_begin(struct nlbl_handle *hndl, nlbl_async_cb cb, void *arg)
+{
+	int fd;
+
+	if (hndl == NULL || hndl->nl_sock == NULL)
+		return -EINVAL;
+	if (hndl->async != NULL || hndl->batch != NULL)
+		return -EBUSY;
+
+	hndl->async = calloc(1, sizeof(*hndl->async));
+	if (hndl->async == NULL)
+		return -ENOMEM;
+	hndl->async->cb = cb;
+	hndl->async->arg = arg;
+	hndl->async->id_next = 1;
+	nlbl_vec_init(&hndl->async->slots, sizeof(struct nlbl_async_slot), 0);
+
+	/* the kernel drops responses which don't fit in the socket buffer,
+	 * leave room for many requests in flight until nlbl_async_end() */
+	nlbl_comm_sockbuf_raise(hndl, NLBL_ASYNC_SOCKBUF,
+				&hndl->async->sockbuf);
+	fd = nlbl_comm_sock(hndl);
+	if (fd >= 0)
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	return 0;
+}
+
+/**
+ * Take a NetLabel handle out of asynchronous mode
+ * @param hndl the NetLabel handle
+ *
+ * Complete any outstanding requests on @hndl with -ECANCELED, without waiting
+ * for the kernel, and return the handle to blocking operation with the socket
+ * buffer sizes it had before nlbl_async_begin().  Requests sent by the
+ * completion callbacks while the requests are cancelled fail with -EBUSY.  Any
+ * responses to the cancelled requests which arrive later are ignored.
+ *
+ */
+void nlbl_async_end(struct nlbl_handle *hndl)
+{
+	int fd;
+
+	if (!nlbl_async_active(hndl))
+		return;
+
+	hndl->async->ending = 1;
+	nlbl_async_fail(hndl, -ECANCELED);
+	nlbl_comm_sockbuf_restore(hndl, &hndl->async->sockbuf);
+	nlbl_vec_free(&hndl->async->slots);
+	free(hndl->async);
+	hndl->async = NULL;
+
+	fd = nlbl_comm_sock(hndl);
+	if (fd >= 0)
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+}
+
+/**
+ * Get the number of outstanding asynchronous requests
+ * @param hndl the NetLabel handle
+ *
+ * Returns the number of requests on @hndl which have not completed, negative
+ * values on failure.
+ *
+ */
+int nlbl_async_pending(struct nlbl_handle *hndl)
+{
+	if (!nlbl_async_active(hndl))
+		return -EINVAL;
+
+	return hndl->async->pending;
+}
+
+/**
+ * Process the responses to asynchronous requests
+ * @param hndl the NetLabel handle
+ *
+ * Read all of the responses waiting on @hndl without blocking, passing dump
+ * entries to their dump callbacks and calling the completion callback for
+ * each request which completes.  The callbacks may send new asynchronous
+ * requests, but must not call nlbl_async_end() or nlbl_comm_close() on @hndl.
+ * If the kernel had to drop responses because the socket buffer was full, all
+ * of the outstanding requests are completed with -ENOBUFS as their outcome is
+ * unknown.  Returns the number of requests completed on success, negative
+ * values on failure.
+ *
+ */
+int nlbl_async_dispatch(struct nlbl_handle *hndl)
+{
+	int rc;
+	unsigned int completed;
+	struct nlbl_comm_dgram *dgrams;
+	struct nlmsghdr *nl_hdr;
+	int data_len;
+	int iter;
+
+	if (!nlbl_async_active(hndl))
+		return -EINVAL;
+	completed = hndl->async->completed;
+
+	for (;;) {
+		rc = nlbl_comm_recv_many(hndl, &dgrams);
+		if (rc == -EAGAIN) {
+			rc = 0;
+			break;
+		}
+		if (rc == -ENOBUFS) {
+			nlbl_async_fail(hndl, -ENOBUFS);
+			continue;
+		}
+		if (rc <= 0)
+			break;
+
+		for (iter = 0; iter < rc; iter++) {
+			data_len = dgrams[iter].len;
+			for (nl_hdr = (struct nlmsghdr *)dgrams[iter].data;
+			     nlmsg_ok(nl_hdr, data_len);
+			     nl_hdr = nlmsg_next(nl_hdr, &data_len))
+				nlbl_async_response(hndl, nl_hdr);
+		}
+	}
+
+	if (rc < 0)
+		return rc;
+	return hndl->async->completed - completed;
+}
@@ -0,0 +1,340 @@
+/** @file
+ * NetLabel Request Batching Functions
+ *
+ * Author: Paul Moore <paul@paul-moore.com>
+ *
+ */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <linux/types.h>
+
+#include <libnetlabel.h>
+
+#include "netlabel_internal.h"
+
+/* maximum number of requests sent to the kernel at once */
+#define NLBL_BATCH_WINDOW	128
+/* maximum number of bytes sent to the kernel at once */
+#define NLBL_BATCH_CHUNK	16384
+/* socket buffer size requested for batching handles */
+#define NLBL_BATCH_SOCKBUF	(1024 * 1024)
+
+/* NetLabel request batch */
+struct nlbl_batch {
+	unsigned char *buf;
+	size_t buf_len;
+	size_t buf_size;
+
+	unsigned int count;
+	uint32_t seq_first;
+
+	/* socket buffer sizes before batching */
+	struct nlbl_comm_sockbuf sockbuf;
+};
+
+/*
+ * Helper Functions
+ */
+
+/**
+ * Free a NetLabel request batch
+ * @param hndl the NetLabel handle
+ *
+ * Free any requests queued on @hndl, restore its socket buffer sizes and take
+ * the handle out of batch mode.
+ *
+ */
+static void nlbl_batch_free(struct nlbl_handle *hndl)
+{
+	if (hndl->batch == NULL)
+		return;
+
+	nlbl_comm_sockbuf_restore(hndl, &hndl->batch->sockbuf);
+	free(hndl->batch->buf);
+	free(hndl->batch);
+	hndl->batch = NULL;
+}
+
+/**
+ * Send a chunk of queued requests and wait for the responses
+ * @param hndl the NetLabel handle
+ * @param first index of the first request to send
+ * @param offset offset of the first request in the batch buffer
+ * @param results the request results
+ *
+ * Send as many of the queued requests, starting at index @first, as will fit
+ * into a single chunk using one write to the netlink socket.  Only the last
+ * request in the chunk asks for an ack, the kernel always sends an ack for a
+ * request which fails, so once the last ack arrives every request in the chunk
+ * has been processed.  The result of each request is recorded in @results.
+ * Returns the number of requests sent on success, negative values on failure.
+ *
+ */
+static int nlbl_batch_chunk(struct nlbl_handle *hndl,
+			    unsigned int first, size_t offset, int *results)
+{
+	int rc;
+	struct nlbl_batch *batch = hndl->batch;
+	unsigned int count = 0;
+	size_t len = 0;
+	struct nlmsghdr *nl_hdr;
+	struct nlmsghdr *nl_last = NULL;
+	struct nlmsgerr *nl_err;
+	unsigned char *data;
+	unsigned int iter;
+	int done = 0;
+
+	/* build the chunk */
+	while (first + count < batch->count && count < NLBL_BATCH_WINDOW) {
+		nl_hdr = (struct nlmsghdr *)(batch->buf + offset + len);
+		if (count > 0 && len + nl_hdr->nlmsg_len > NLBL_BATCH_CHUNK)
+			break;
+		nl_last = nl_hdr;
+		len += NLMSG_ALIGN(nl_hdr->nlmsg_len);
+		count++;
+	}
+	nl_last->nlmsg_flags |= NLM_F_ACK;
+
+	/* send the chunk */
+	hndl->seq_first = batch->seq_first + first;
+	hndl->seq = nl_last->nlmsg_seq;
+	nlbl_comm_deadline(hndl);
+	rc = nlbl_comm_write_buf(hndl, batch->buf + offset, len);
+	if (rc < 0)
+		return rc;
+	NLBL_PROBE3(batch_chunk, hndl, first, count);
+
+	/* match the responses to the requests */
+	while (!done) {
+		rc = nlbl_comm_recv_buf(hndl, &data);
+		if (rc <= 0) {
+			if (rc == 0)
+				rc = -ENODATA;
+			return rc;
+		}
+
+		nl_hdr = (struct nlmsghdr *)data;
+		while (nlmsg_ok(nl_hdr, rc)) {
+			iter = nl_hdr->nlmsg_seq - batch->seq_first;
+			if (nl_hdr->nlmsg_type == NLMSG_ERROR &&
+			    iter >= first && iter < first + count) {
+				nl_err = nlmsg_data(nl_hdr);
+				results[iter] = nl_err->error;
+				if (nl_hdr->nlmsg_seq == hndl->seq)
+					done = 1;
+			}
+			nl_hdr = nlmsg_next(nl_hdr, &rc);
+		}
+	}
+
+	return count;
+}
+
+/*
+ * Internal Batch Functions
+ */
+
+/**
+ * Determine if a NetLabel handle is batching requests
+ * @param hndl the NetLabel handle
+ *
+ * Returns true if @hndl is queuing requests for nlbl_batch_commit(), false
+ * otherwise.
+ *
+ */
+int nlbl_batch_active(struct nlbl_handle *hndl)
+{
+	return (hndl != NULL && hndl->batch != NULL);
+}
+
+/**
+ * Queue a request on a batching NetLabel handle
+ * @param hndl the NetLabel handle
+ * @param msg the request
+ *
+ * Assign the next sequence number to @msg and append a copy of it to the
+ * batch on @hndl.  The caller retains ownership of @msg.  Returns zero on
+ * success, negative values on failure.
+ *
+ */
+int nlbl_batch_queue(struct nlbl_handle *hndl, nlbl_msg *msg)
+{
+	struct nlbl_batch *batch;
+	struct nlmsghdr *nl_hdr;
+	unsigned char *buf;
+	size_t buf_size;
+	size_t len;
+
+	/* sanity checks */
+	if (!nlbl_batch_active(hndl) || msg == NULL)
+		return -EINVAL;
+	batch = hndl->batch;
+	nl_hdr = nlbl_msg_nlhdr(msg);
+	if (nl_hdr == NULL)
+		return -EBADMSG;
+
+	/* make sure there is room for the request */
+	len = NLMSG_ALIGN(nl_hdr->nlmsg_len);
+	if (batch->buf_len + len > batch->buf_size) {
+		buf_size = (batch->buf_size ? batch->buf_size * 2 : 4096);
+		while (batch->buf_len + len > buf_size)
+			buf_size *= 2;
+		buf = realloc(batch->buf, buf_size);
+		if (buf == NULL)
+			return -ENOMEM;
+		batch->buf = buf;
+		batch->buf_size = buf_size;
+	}
+
+	/* fill in the netlink header and add the request to the batch */
+	nl_hdr->nlmsg_flags |= NLM_F_REQUEST;
+	nl_hdr->nlmsg_flags &= ~NLM_F_ACK;
+	nl_hdr->nlmsg_pid = nl_socket_get_local_port(hndl->nl_sock);
+	nl_hdr->nlmsg_seq = nl_socket_use_seq(hndl->nl_sock);
+	if (batch->count == 0)
+		batch->seq_first = nl_hdr->nlmsg_seq;
+	memcpy(batch->buf + batch->buf_len, nl_hdr, nl_hdr->nlmsg_len);
+	memset(batch->buf + batch->buf_len + nl_hdr->nlmsg_len,
+	       0, len - nl_hdr->nlmsg_len);
+	batch->buf_len += len;
+	batch->count++;
+
+	return 0;
+}
+
+/*
+ * Batch Functions
+ */
+
+/**
+ * Start batching requests on a NetLabel handle
+ * @param hndl the NetLabel handle
+ *
+ * Put @hndl into batch mode.  Until nlbl_batch_commit() or nlbl_batch_abort()
+ * is called, the configuration operations which only return success or
+ * failure (e.g. nlbl_unlbl_staticadd() and nlbl_mgmt_add()) queue their
+ * requests on @hndl and return zero without contacting the kernel.  Query
+ * operations, and nlbl_comm_send(), fail with -EBUSY while the handle is in
+ * batch mode.  The socket buffers of @hndl are raised to 1 MiB, if they are
+ * smaller, until the batch is committed or aborted.  Batching requires an
+ * explicit handle, @hndl can not be NULL.  Returns zero on success, negative
+ * values on failure.
+ *
+ */
+int nlbl_batch_begin(struct nlbl_handle *hndl)
+{
+	if (hndl == NULL || hndl->nl_sock == NULL)
+		return -EINVAL;
+	if (hndl->batch != NULL || hndl->async != NULL)
+		return -EBUSY;
+
+	hndl->batch = calloc(1, sizeof(*hndl->batch));
+	if (hndl->batch == NULL)
+		return -ENOMEM;
+
+	/* the kernel queues an ack for every failed request in a chunk, make
+	 * room for them until the batch is done */
+	nlbl_comm_sockbuf_raise(hndl, NLBL_BATCH_SOCKBUF,
+				&hndl->batch->sockbuf);
+
+	return 0;
+}
+
+/**
+ * Send the batched requests on a NetLabel handle
+ * @param hndl the NetLabel handle
+ * @param results the request results
+ *
+ * Send all of the requests queued on @hndl to the kernel, using as few writes
+ * to the netlink socket as possible, and take the handle out of batch mode.
+ * The kernel's response to each request is matched to the request using the
+ * request's sequence number and stored in @results, in the order the
+ * requests were queued, as either zero or a negative error code.  The caller
+ * is responsible for freeing @results.  Returns the number of requests sent on
+ * success, negative values on failure.  On failure some of the requests may
+ * have been applied.
+ *
+ */
+int nlbl_batch_commit(struct nlbl_handle *hndl, int **results)
+{
+	int rc;
+	struct nlbl_batch *batch;
+	int *res_array = NULL;
+	unsigned int iter = 0;
+	size_t offset = 0;
+	struct nlmsghdr *nl_hdr;
+
+	/* sanity checks */
+	if (!nlbl_batch_active(hndl) || results == NULL)
+		return -EINVAL;
+	batch = hndl->batch;
+
+	if (batch->count == 0) {
+		*results = NULL;
+		rc = 0;
+		goto commit_return;
+	}
+
+	res_array = calloc(batch->count, sizeof(*res_array));
+	if (res_array == NULL) {
+		rc = -ENOMEM;
+		goto commit_return;
+	}
+
+	/* send the requests a chunk at a time */
+	while (iter < batch->count) {
+		rc = nlbl_batch_chunk(hndl, iter, offset, res_array);
+		if (rc < 0)
+			goto commit_return;
+		while (rc-- > 0) {
+			nl_hdr = (struct nlmsghdr *)(batch->buf + offset);
+			offset += NLMSG_ALIGN(nl_hdr->nlmsg_len);
+			iter++;
+		}
+	}
+
+	*results = res_array;
+	rc = batch->count;
+
+commit_return:
+	NLBL_PROBE2(batch_commit, hndl, rc);
+	if (rc < 0)
+		free(res_array);
+	nlbl_batch_free(hndl);
+	return rc;
+}
+
+/**
+ * Discard the batched requests on a NetLabel handle
+ * @param hndl the NetLabel handle
+ *
+ * Discard all of the requests queued on @hndl without sending them to the
+ * kernel and take the handle out of batch mode.
+ *
+ */
+void nlbl_batch_abort(struct nlbl_handle *hndl)
+{
+	if (hndl == NULL)
+		return;
+
+	nlbl_batch_free(hndl);
+}
@@ -23,8 +23,13 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <limits.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
 #include <linux/types.h>
 #include <sys/types.h>
 
@@ -40,9 +45,69 @@
 
 #include "netlabel_internal.h"
 
-/* Netlink read timeout (in seconds) */
+/*
+ * Each thread has its own default NetLabel handle, so threads which don't
+ * supply a handle never share a socket and run their requests concurrently.
+ * The settings for new and default handles are shared by every thread and
+ * accessed atomically, everything else shared between threads is protected
+ * by nlcomm_dflt_lock.
+ */
+
+/* Netlink read timeout of the handles without one of their own (in seconds) */
 static uint32_t nlcomm_read_timeout = 10;
 
+/* Size of the receive buffers; the kernel builds the dump messages to fit the
+ * reader's buffer, up to 32 KiB, and every other message fits in 8 KiB */
+#define NLCOMM_RBUF_DFLT	32768
+#define NLCOMM_RBUF_MIN		8192
+
+/* Number of datagrams read with a single recvmmsg() */
+#define NLCOMM_RING		16
+
+/* NetLabel receive ring */
+struct nlbl_comm_ring {
+	struct mmsghdr msgs[NLCOMM_RING];
+	struct iovec iov[NLCOMM_RING];
+	struct sockaddr_nl addr[NLCOMM_RING];
+	union {
+		struct cmsghdr hdr;
+		unsigned char buf[CMSG_SPACE(sizeof(struct ucred))];
+	} cmsg[NLCOMM_RING];
+
+	/* datagrams from the last read which haven't been consumed */
+	struct nlbl_comm_dgram dgrams[NLCOMM_RING];
+	unsigned int next;
+	unsigned int count;
+
+	unsigned char data[] __attribute__((aligned(NLMSG_ALIGNTO)));
+};
+
+/* Buffer sizes when using the default handle, zero for the defaults */
+static uint32_t nlcomm_dflt_rcvbuf = 0;
+static uint32_t nlcomm_dflt_msgbuf = 0;
+
+/* Expected number of dump entries when using the default handle */
+static uint32_t nlcomm_dflt_dump_hint = 0;
+
+/* Default NetLabel handle of this thread, shared by the thread's callers
+ * that don't supply a handle, and the process and generation it belongs to */
+static __thread struct nlbl_handle *nlcomm_dflt_hndl = NULL;
+static __thread pid_t nlcomm_dflt_pid = 0;
+static __thread unsigned int nlcomm_dflt_gen = 0;
+
+/* Current generation of the default handles, every thread recreates its
+ * default handle when this changes */
+static unsigned int nlcomm_dflt_gen_cur = 0;
+
+/* Key used to close a thread's default handle when the thread exits */
+static pthread_once_t nlcomm_dflt_once = PTHREAD_ONCE_INIT;
+static pthread_key_t nlcomm_dflt_key;
+static int nlcomm_dflt_key_ok = 0;
+
+/* Statistics of the default handles closed so far */
+static pthread_mutex_t nlcomm_dflt_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct nlbl_comm_stats nlcomm_dflt_stats;
+
 /*
  * Helper Functions
  */
@@ -59,6 +124,181 @@ static int nlbl_comm_hndl_valid(struct nlbl_handle *hndl)
 	return (hndl != NULL && hndl->nl_sock != NULL);
 }
 
+/**
+ * Record a write on a NetLabel handle
+ * @param hndl the NetLabel handle
+ * @param requests the number of requests written
+ * @param rc the result of the write
+ *
+ * Count the requests and bytes written and, if no earlier request is waiting
+ * for a response, start timing the response latency.
+ *
+ */
+static void nlbl_comm_stats_write(struct nlbl_handle *hndl,
+				  unsigned int requests, int rc)
+{
+	if (rc < 0)
+		return;
+
+	hndl->stats.requests += requests;
+	hndl->stats.writes++;
+	hndl->stats.bytes_sent += rc;
+	if (hndl->stats_sent.tv_sec == 0 && hndl->stats_sent.tv_nsec == 0)
+		clock_gettime(CLOCK_MONOTONIC, &hndl->stats_sent);
+}
+
+/**
+ * Record a response on a NetLabel handle
+ * @param hndl the NetLabel handle
+ *
+ * Record the response latency of the oldest request waiting for a response,
+ * if there is one, see nlbl_comm_stats_write().
+ *
+ */
+static void nlbl_comm_stats_response(struct nlbl_handle *hndl)
+{
+	struct nlbl_comm_stats *stats = &hndl->stats;
+	struct timespec now;
+	uint64_t lat;
+	uint64_t lat_us;
+	unsigned int bucket;
+
+	if (hndl->stats_sent.tv_sec == 0 && hndl->stats_sent.tv_nsec == 0)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	lat = (now.tv_sec - hndl->stats_sent.tv_sec) * 1000000000ULL +
+	      now.tv_nsec - hndl->stats_sent.tv_nsec;
+	memset(&hndl->stats_sent, 0, sizeof(hndl->stats_sent));
+	NLBL_PROBE2(latency, hndl, lat);
+
+	if (stats->lat_count == 0 || lat < stats->lat_min_ns)
+		stats->lat_min_ns = lat;
+	if (lat > stats->lat_max_ns)
+		stats->lat_max_ns = lat;
+	stats->lat_count++;
+	stats->lat_total_ns += lat;
+
+	bucket = 0;
+	for (lat_us = lat / 1000;
+	     lat_us > 0 && bucket < NLBL_COMM_LAT_BUCKETS - 1;
+	     lat_us >>= 1)
+		bucket++;
+	stats->lat_hist[bucket]++;
+}
+
+/**
+ * Add NetLabel handle statistics together
+ * @param total the statistics to add to
+ * @param stats the statistics to add
+ */
+static void nlbl_comm_stats_add(struct nlbl_comm_stats *total,
+				const struct nlbl_comm_stats *stats)
+{
+	unsigned int iter;
+
+	if (stats->lat_count > 0 &&
+	    (total->lat_count == 0 || stats->lat_min_ns < total->lat_min_ns))
+		total->lat_min_ns = stats->lat_min_ns;
+	if (stats->lat_max_ns > total->lat_max_ns)
+		total->lat_max_ns = stats->lat_max_ns;
+
+	total->requests += stats->requests;
+	total->writes += stats->writes;
+	total->bytes_sent += stats->bytes_sent;
+	total->reads += stats->reads;
+	total->dgrams_recv += stats->dgrams_recv;
+	total->bytes_recv += stats->bytes_recv;
+	total->dgrams_dropped += stats->dgrams_dropped;
+	total->timeouts += stats->timeouts;
+	total->lat_count += stats->lat_count;
+	total->lat_total_ns += stats->lat_total_ns;
+	for (iter = 0; iter < NLBL_COMM_LAT_BUCKETS; iter++)
+		total->lat_hist[iter] += stats->lat_hist[iter];
+}
+
+/**
+ * Close a default NetLabel handle
+ * @param hndl the NetLabel handle
+ *
+ * Fold the statistics of @hndl into those of the default handles closed so
+ * far and close it.
+ *
+ */
+static void nlbl_comm_dflt_close(struct nlbl_handle *hndl)
+{
+	pthread_mutex_lock(&nlcomm_dflt_lock);
+	nlbl_comm_stats_add(&nlcomm_dflt_stats, &hndl->stats);
+	pthread_mutex_unlock(&nlcomm_dflt_lock);
+	nlbl_comm_close(hndl);
+}
+
+/**
+ * Close the default NetLabel handle of an exiting thread
+ * @param arg the NetLabel handle
+ */
+static void nlbl_comm_dflt_exit(void *arg)
+{
+	nlbl_comm_dflt_close(arg);
+}
+
+/**
+ * Create the key used to close the default handles of exiting threads
+ */
+static void nlbl_comm_dflt_key_init(void)
+{
+	nlcomm_dflt_key_ok = (pthread_key_create(&nlcomm_dflt_key,
+						 nlbl_comm_dflt_exit) == 0);
+}
+
+/**
+ * Wait for a message on a NetLabel handle
+ * @param hndl the NetLabel handle
+ *
+ * Wait until there is data to read from @hndl or the deadline of the
+ * outstanding request passes, see nlbl_comm_deadline().  Returns zero if the
+ * data is ready, negative values on failure or timeout.
+ *
+ */
+static int nlbl_comm_wait(struct nlbl_handle *hndl)
+{
+	int rc;
+	struct pollfd pfd;
+	struct timespec now;
+	int64_t remaining;
+	int clamped;
+
+	/* a read without a request waits for the full timeout */
+	if (hndl->deadline.tv_sec == 0 && hndl->deadline.tv_nsec == 0)
+		nlbl_comm_deadline(hndl);
+
+	pfd.fd = nlbl_comm_sock(hndl);
+	pfd.events = POLLIN;
+	do {
+		/* round up so that we never wake up before the deadline */
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		remaining = (hndl->deadline.tv_sec - now.tv_sec) * 1000 +
+			    (hndl->deadline.tv_nsec - now.tv_nsec + 999999) /
+			    1000000;
+		if (remaining < 0)
+			remaining = 0;
+		/* poll() only takes an int, long timeouts wait in steps */
+		clamped = (remaining > INT_MAX);
+		if (clamped)
+			remaining = INT_MAX;
+		rc = poll(&pfd, 1, remaining);
+	} while ((rc < 0 && errno == EINTR) || (rc == 0 && clamped));
+	if (rc < 0)
+		return -errno;
+	else if (rc == 0) {
+		hndl->stats.timeouts++;
+		NLBL_PROBE2(timeout, hndl, hndl->timeout);
+		return -EAGAIN;
+	}
+
+	return 0;
+}
+
 /*
  * Control Functions
  */
@@ -67,12 +307,179 @@ static int nlbl_comm_hndl_valid(struct nlbl_handle *hndl)
  * Set the NetLabel timeout
  * @param seconds the timeout in seconds
  *
- * Set the timeout value used by the NetLabel communications layer.
+ * Set the timeout value used by every NetLabel handle, including the default
+ * NetLabel handles, from the next request on, except for the handles given a
+ * timeout of their own with nlbl_comm_hndl_timeout().
  *
  */
 void nlbl_comm_timeout(uint32_t seconds)
 {
-	nlcomm_read_timeout = seconds;
+	__atomic_store_n(&nlcomm_read_timeout, seconds, __ATOMIC_RELAXED);
+}
+
+/**
+ * Set the timeout of a NetLabel handle
+ * @param hndl the NetLabel handle
+ * @param seconds the timeout in seconds
+ *
+ * Set the timeout value used by @hndl.  The timeout covers a whole request,
+ * from sending the request until the last message of the response arrives,
+ * including every part of a multi-message dump.  Once set, @hndl keeps its
+ * timeout when nlbl_comm_timeout() is called.  If @hndl is NULL then the
+ * timeout is set for every handle without a timeout of its own, as with
+ * nlbl_comm_timeout().
+ *
+ */
+void nlbl_comm_hndl_timeout(struct nlbl_handle *hndl, uint32_t seconds)
+{
+	if (hndl == NULL)
+		nlbl_comm_timeout(seconds);
+	else {
+		hndl->timeout = seconds;
+		hndl->timeout_set = 1;
+	}
+}
+
+/**
+ * Set the expected size of the NetLabel dumps
+ * @param hndl the NetLabel handle
+ * @param entries the expected number of entries
+ *
+ * Set the number of entries the list operations on @hndl should make room for
+ * before reading a dump from the kernel, e.g. nlbl_unlbl_staticlist(); the
+ * result arrays are grown as needed and trimmed once the dump is complete.
+ * Callers which know the size of their configuration can use this to avoid
+ * growing the result arrays while reading large dumps.  If @hndl is NULL then
+ * the hint is used for the default NetLabel handles of every thread.  A value
+ * of zero restores the default behavior.
+ *
+ */
+void nlbl_comm_dump_hint(struct nlbl_handle *hndl, uint32_t entries)
+{
+	if (hndl == NULL)
+		__atomic_store_n(&nlcomm_dflt_dump_hint, entries,
+				 __ATOMIC_RELAXED);
+	else
+		hndl->dump_hint = entries;
+}
+
+/**
+ * Get the statistics of a NetLabel handle
+ * @param hndl the NetLabel handle
+ * @param stats the statistics
+ *
+ * Copy the counters kept by @hndl since it was opened, or since the last call
+ * to nlbl_comm_stats_reset(), to @stats.  If @hndl is NULL then the statistics
+ * of the library's default NetLabel handles are returned; these include every
+ * default handle the process has closed, as the default handle is recreated
+ * after a failed operation and closed when its thread exits, and the calling
+ * thread's current default handle.  Returns zero on success, negative values
+ * on failure.
+ *
+ */
+int nlbl_comm_stats(struct nlbl_handle *hndl, struct nlbl_comm_stats *stats)
+{
+	if (stats == NULL)
+		return -EINVAL;
+
+	if (hndl != NULL) {
+		if (!nlbl_comm_hndl_valid(hndl))
+			return -EINVAL;
+		*stats = hndl->stats;
+		return 0;
+	}
+
+	pthread_mutex_lock(&nlcomm_dflt_lock);
+	*stats = nlcomm_dflt_stats;
+	pthread_mutex_unlock(&nlcomm_dflt_lock);
+	if (nlcomm_dflt_hndl != NULL)
+		nlbl_comm_stats_add(stats, &nlcomm_dflt_hndl->stats);
+	return 0;
+}
+
+/**
+ * Reset the statistics of a NetLabel handle
+ * @param hndl the NetLabel handle
+ *
+ * Zero the counters kept by @hndl, see nlbl_comm_stats().  If @hndl is NULL
+ * then the statistics of the closed default NetLabel handles and of the
+ * calling thread's default NetLabel handle are reset.
+ *
+ */
+void nlbl_comm_stats_reset(struct nlbl_handle *hndl)
+{
+	if (hndl == NULL) {
+		pthread_mutex_lock(&nlcomm_dflt_lock);
+		memset(&nlcomm_dflt_stats, 0, sizeof(nlcomm_dflt_stats));
+		pthread_mutex_unlock(&nlcomm_dflt_lock);
+		hndl = nlcomm_dflt_hndl;
+		if (hndl == NULL)
+			return;
+	}
+
+	memset(&hndl->stats, 0, sizeof(hndl->stats));
+	memset(&hndl->stats_sent, 0, sizeof(hndl->stats_sent));
+}
+
+/**
+ * Set the buffer sizes of a NetLabel handle
+ * @param hndl the NetLabel handle
+ * @param rcvbuf the socket receive buffer size in bytes, zero to leave as is
+ * @param msgbuf the message receive buffer size in bytes, zero to leave as is
+ *
+ * Set the size of the kernel's socket receive buffer, SO_RCVBUF, for @hndl
+ * which limits how much of a response can be queued before it is read.  Also
+ * set the size of the buffers @hndl reads messages into; the kernel builds
+ * each part of a dump to fit these buffers, up to 32 KiB, so larger buffers
+ * mean fewer reads for a large dump.  The message buffers are 32 KiB by
+ * default and never smaller than 8 KiB.  If @hndl is NULL then the sizes are
+ * used for the calling thread's default NetLabel handle and for the default
+ * NetLabel handles created from now on.  Returns zero on success,
+ * negative values on failure.
+ *
+ */
+int nlbl_comm_hndl_bufsize(struct nlbl_handle *hndl,
+			   uint32_t rcvbuf, uint32_t msgbuf)
+{
+	int nl_fd;
+	int size;
+
+	if (hndl == NULL) {
+		__atomic_store_n(&nlcomm_dflt_rcvbuf, rcvbuf, __ATOMIC_RELAXED);
+		__atomic_store_n(&nlcomm_dflt_msgbuf, msgbuf, __ATOMIC_RELAXED);
+		if (nlcomm_dflt_hndl == NULL)
+			return 0;
+		hndl = nlcomm_dflt_hndl;
+	}
+
+	/* sanity checks */
+	if (!nlbl_comm_hndl_valid(hndl))
+		return -EINVAL;
+
+	/* privileged callers aren't limited by net.core.rmem_max */
+	if (rcvbuf > 0) {
+		nl_fd = nlbl_comm_sock(hndl);
+		size = (rcvbuf > INT_MAX ? INT_MAX : rcvbuf);
+		if (setsockopt(nl_fd, SOL_SOCKET, SO_RCVBUFFORCE,
+			       &size, sizeof(size)) < 0 &&
+		    setsockopt(nl_fd, SOL_SOCKET, SO_RCVBUF,
+			       &size, sizeof(size)) < 0)
+			return -errno;
+	}
+
+	/* the new buffers are allocated by the next read */
+	if (msgbuf > 0) {
+		if (msgbuf < NLCOMM_RBUF_MIN)
+			msgbuf = NLCOMM_RBUF_MIN;
+		msgbuf = NLMSG_ALIGN(msgbuf);
+		if (msgbuf != hndl->rbuf_size) {
+			free(hndl->ring);
+			hndl->ring = NULL;
+			hndl->rbuf_size = msgbuf;
+		}
+	}
+
+	return 0;
 }
 
 /*
@@ -80,14 +487,15 @@ void nlbl_comm_timeout(uint32_t seconds)
  */
 
 /**
- * Create and bind a NetLabel handle
+ * Create a NetLabel handle
+ * @param mock the mock kernel, NULL for the kernel
  *
- * Create a new NetLabel handle, bind it to the running process, and connect to
- * the Generic Netlink subsystem.  Returns a pointer to the NetLabel handle
- * structure.
+ * Create a new NetLabel handle and either connect it to the Generic Netlink
+ * subsystem or, if @mock is not NULL, attach it to the mock kernel in @mock.
+ * Returns a pointer to the NetLabel handle on success, NULL on failure.
  *
  */
-struct nlbl_handle *nlbl_comm_open(void)
+struct nlbl_handle *nlbl_comm_new(struct nlbl_mock *mock)
 {
 	struct nlbl_handle *hndl;
 
@@ -95,8 +503,10 @@ struct nlbl_handle *nlbl_comm_open(void)
 	hndl = calloc(1, sizeof(*hndl));
 	if (hndl == NULL)
 		return NULL;
+	hndl->rbuf_size = NLCOMM_RBUF_DFLT;
 
-	/* create a new netlink socket */
+	/* create a new netlink socket, a mock kernel still uses it for the
+	 * sequence numbers */
 	hndl->nl_sock = nl_socket_alloc();
 	if (hndl->nl_sock == NULL)
 		goto open_failure;
@@ -106,6 +516,12 @@ struct nlbl_handle *nlbl_comm_open(void)
 	nl_socket_disable_seq_check(hndl->nl_sock);
 	nl_socket_set_passcred(hndl->nl_sock, 1);
 
+	if (mock != NULL) {
+		if (nlbl_mock_attach(mock, hndl) < 0)
+			goto open_failure_handle;
+		return hndl;
+	}
+
 	/* connect to the generic netlink subsystem in the kernel */
 	if (nl_connect(hndl->nl_sock, NETLINK_GENERIC) != 0)
 		goto open_failure_handle;
@@ -120,6 +536,20 @@ open_failure:
 	return NULL;
 }
 
+/**
+ * Create and bind a NetLabel handle
+ *
+ * Create a new NetLabel handle, bind it to the running process, and connect to
+ * the Generic Netlink subsystem.  If a mock kernel is in use, see
+ * nlbl_mock_use(), the handle is attached to the mock kernel instead.
+ * Returns a pointer to the NetLabel handle structure.
+ *
+ */
+struct nlbl_handle *nlbl_comm_open(void)
+{
+	return nlbl_comm_new(nlbl_mock_dflt());
+}
+
 /**
  * Close and destroy a NetLabel handle
  * @param hndl the NetLabel handle
@@ -134,16 +564,500 @@ int nlbl_comm_close(struct nlbl_handle *hndl)
 	if (!nlbl_comm_hndl_valid(hndl))
 		return -EINVAL;
 
+	/* discard any batched requests, cancel any asynchronous requests, and
+	 * free the reusable request messages */
+	nlbl_batch_abort(hndl);
+	nlbl_async_end(hndl);
+	nlbl_msg_pool_free(hndl);
+	nlbl_mock_detach(hndl);
+
 	/* close and destroy the socket */
 	nl_close(hndl->nl_sock);
 	nl_socket_free(hndl->nl_sock);
 
 	/* free the memory */
+	free(hndl->ring);
 	free(hndl);
 
 	return 0;
 }
 
+/**
+ * Get the file descriptor of a NetLabel handle
+ * @param hndl the NetLabel handle
+ *
+ * Return the file descriptor of the netlink socket used by @hndl so that the
+ * caller can wait for responses with poll(), epoll, or a similar event loop,
+ * see nlbl_async_begin().  The caller must not read from, write to, or close
+ * the file descriptor.  Returns the file descriptor on success, negative
+ * values on failure.
+ *
+ */
+int nlbl_comm_fd(struct nlbl_handle *hndl)
+{
+	/* sanity checks */
+	if (!nlbl_comm_hndl_valid(hndl))
+		return -EINVAL;
+
+	return nlbl_comm_sock(hndl);
+}
+
+/**
+ * Get the file descriptor a NetLabel handle reads from
+ * @param hndl the NetLabel handle
+ *
+ * Return the file descriptor of the netlink socket used by @hndl, or of the
+ * socket the mock kernel writes its responses to if @hndl is attached to a
+ * mock kernel.
+ *
+ */
+int nlbl_comm_sock(struct nlbl_handle *hndl)
+{
+	if (hndl->mock != NULL)
+		return nlbl_mock_fd(hndl);
+	return nl_socket_get_fd(hndl->nl_sock);
+}
+
+/**
+ * Get the default NetLabel handle
+ *
+ * Return the calling thread's default NetLabel handle, creating it if it does
+ * not already exist.  The handle is recreated if the process has forked since
+ * the handle was created so that a parent and child never share a netlink
+ * socket, and after nlbl_comm_dflt_reset_all().  The default handle is used by
+ * all of the NetLabel operations when the caller passes a NULL handle, and is
+ * closed when the thread exits.  Returns a pointer to the handle on success,
+ * NULL on failure.
+ *
+ */
+struct nlbl_handle *nlbl_comm_dflt(void)
+{
+	pid_t pid = getpid();
+	unsigned int gen = __atomic_load_n(&nlcomm_dflt_gen_cur,
+					   __ATOMIC_ACQUIRE);
+	uint32_t rcvbuf;
+	uint32_t msgbuf;
+
+	/* drop a handle inherited across a fork(), or a stale one */
+	if (nlcomm_dflt_hndl != NULL &&
+	    (nlcomm_dflt_pid != pid || nlcomm_dflt_gen != gen))
+		nlbl_comm_dflt_reset();
+
+	if (nlcomm_dflt_hndl == NULL) {
+		pthread_once(&nlcomm_dflt_once, nlbl_comm_dflt_key_init);
+		nlcomm_dflt_hndl = nlbl_comm_open();
+		if (nlcomm_dflt_hndl == NULL)
+			return NULL;
+		nlcomm_dflt_pid = pid;
+		nlcomm_dflt_gen = gen;
+		if (nlcomm_dflt_key_ok)
+			pthread_setspecific(nlcomm_dflt_key, nlcomm_dflt_hndl);
+
+		rcvbuf = __atomic_load_n(&nlcomm_dflt_rcvbuf, __ATOMIC_RELAXED);
+		msgbuf = __atomic_load_n(&nlcomm_dflt_msgbuf, __ATOMIC_RELAXED);
+		if (rcvbuf > 0 || msgbuf > 0)
+			nlbl_comm_hndl_bufsize(nlcomm_dflt_hndl,
+					       rcvbuf, msgbuf);
+	}
+
+	return nlcomm_dflt_hndl;
+}
+
+/**
+ * Reset the default NetLabel handle
+ *
+ * Close the calling thread's default NetLabel handle, if it exists; the next
+ * call to nlbl_comm_dflt() will create a new handle.  This should be called
+ * when a read or write on the default handle fails, as the socket may still
+ * have unread messages queued from the failed operation, see
+ * nlbl_comm_dflt_done().
+ *
+ */
+void nlbl_comm_dflt_reset(void)
+{
+	if (nlcomm_dflt_hndl == NULL)
+		return;
+
+	if (nlcomm_dflt_key_ok)
+		pthread_setspecific(nlcomm_dflt_key, NULL);
+	nlbl_comm_dflt_close(nlcomm_dflt_hndl);
+	nlcomm_dflt_hndl = NULL;
+	nlcomm_dflt_pid = 0;
+}
+
+/**
+ * Finish an operation which may have used the default NetLabel handle
+ * @param hndl the handle passed to the operation
+ * @param rc the result of the operation
+ *
+ * If @hndl is NULL, so the operation used the calling thread's default
+ * handle, and the operation failed in a way which may leave part of a
+ * response on the socket, i.e. a failed read or write, a timeout, a missing
+ * response or a response which could not be parsed, reset the default handle.
+ * Requests which the kernel rejects, or which fail before they are sent,
+ * leave the handle ready for the next request so it is kept.
+ *
+ */
+void nlbl_comm_dflt_done(struct nlbl_handle *hndl, int rc)
+{
+	if (hndl != NULL || rc >= 0 || nlcomm_dflt_hndl == NULL)
+		return;
+
+	if (nlcomm_dflt_hndl->xfer_failed ||
+	    rc == -ETIMEDOUT || rc == -ENODATA || rc == -EBADMSG)
+		nlbl_comm_dflt_reset();
+}
+
+/**
+ * Reset the default NetLabel handles of every thread
+ *
+ * Close the calling thread's default NetLabel handle and make every other
+ * thread recreate its default handle the next time it is used, e.g. after
+ * switching between the kernel and a mock kernel.
+ *
+ */
+void nlbl_comm_dflt_reset_all(void)
+{
+	__atomic_add_fetch(&nlcomm_dflt_gen_cur, 1, __ATOMIC_RELEASE);
+	nlbl_comm_dflt_reset();
+}
+
+/**
+ * Start the deadline of a request
+ * @param hndl the NetLabel handle
+ *
+ * Set the deadline for the response to the request being sent on @hndl to the
+ * handle's timeout from now, or the library's timeout if the handle has none
+ * of its own.  Every read until the next request shares the same deadline, so
+ * a multi-message response can't take longer than the timeout in total.
+ *
+ */
+void nlbl_comm_deadline(struct nlbl_handle *hndl)
+{
+	if (!hndl->timeout_set)
+		hndl->timeout = __atomic_load_n(&nlcomm_read_timeout,
+						__ATOMIC_RELAXED);
+	clock_gettime(CLOCK_MONOTONIC, &hndl->deadline);
+	hndl->deadline.tv_sec += hndl->timeout;
+	hndl->xfer_failed = 0;
+
+	/* anything left in the receive ring belongs to an earlier request */
+	if (hndl->ring != NULL)
+		hndl->ring->next = hndl->ring->count;
+}
+
+/**
+ * Set one of the socket buffer sizes of a NetLabel handle
+ * @param fd the socket
+ * @param opt the socket option, SO_RCVBUF or SO_SNDBUF
+ * @param size the buffer size in bytes
+ *
+ * Privileged callers aren't limited by net.core.rmem_max or wmem_max, so try
+ * to force the size first.  Returns zero on success, negative values on
+ * failure.
+ *
+ */
+static int nlbl_comm_sockbuf_set(int fd, int opt, int size)
+{
+	int opt_force = (opt == SO_RCVBUF ? SO_RCVBUFFORCE : SO_SNDBUFFORCE);
+
+	if (setsockopt(fd, SOL_SOCKET, opt_force, &size, sizeof(size)) < 0 &&
+	    setsockopt(fd, SOL_SOCKET, opt, &size, sizeof(size)) < 0)
+		return -errno;
+	return 0;
+}
+
+/**
+ * Raise the socket buffer sizes of a NetLabel handle
+ * @param hndl the NetLabel handle
+ * @param size the buffer size in bytes
+ * @param saved the current buffer sizes
+ *
+ * Save the current socket buffer sizes of @hndl in @saved and raise both of
+ * them to at least @size bytes, leaving larger buffers alone.  This is only an
+ * optimization for handles with many requests in flight, so if the sizes can
+ * not be read or changed the handle carries on with its current buffers; the
+ * kernel caps the sizes for unprivileged callers.  The sizes are put back
+ * with nlbl_comm_sockbuf_restore().
+ *
+ */
+void nlbl_comm_sockbuf_raise(struct nlbl_handle *hndl, int size,
+			     struct nlbl_comm_sockbuf *saved)
+{
+	int fd = nlbl_comm_sock(hndl);
+	socklen_t len;
+
+	/* the kernel reports twice the size that was set */
+	len = sizeof(saved->rcvbuf);
+	if (getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &saved->rcvbuf, &len) < 0)
+		saved->rcvbuf = 0;
+	saved->rcvbuf /= 2;
+	len = sizeof(saved->sndbuf);
+	if (getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &saved->sndbuf, &len) < 0)
+		saved->sndbuf = 0;
+	saved->sndbuf /= 2;
+
+	if (saved->rcvbuf == 0 || saved->rcvbuf >= size)
+		saved->rcvbuf = 0;
+	else if (nlbl_comm_sockbuf_set(fd, SO_RCVBUF, size) < 0)
+		saved->rcvbuf = 0;
+	if (saved->sndbuf == 0 || saved->sndbuf >= size)
+		saved->sndbuf = 0;
+	else if (nlbl_comm_sockbuf_set(fd, SO_SNDBUF, size) < 0)
+		saved->sndbuf = 0;
+}
+
+/**
+ * Restore the socket buffer sizes of a NetLabel handle
+ * @param hndl the NetLabel handle
+ * @param saved the buffer sizes
+ *
+ * Put back the socket buffer sizes saved by nlbl_comm_sockbuf_raise(), a size
+ * of zero means the buffer was not changed.
+ *
+ */
+void nlbl_comm_sockbuf_restore(struct nlbl_handle *hndl,
+			       const struct nlbl_comm_sockbuf *saved)
+{
+	int fd = nlbl_comm_sock(hndl);
+
+	if (saved->rcvbuf > 0)
+		nlbl_comm_sockbuf_set(fd, SO_RCVBUF, saved->rcvbuf);
+	if (saved->sndbuf > 0)
+		nlbl_comm_sockbuf_set(fd, SO_SNDBUF, saved->sndbuf);
+}
+
+/**
+ * Get the expected size of the NetLabel dumps
+ * @param hndl the NetLabel handle
+ *
+ * Return the expected number of entries in a dump on @hndl, see
+ * nlbl_comm_dump_hint().  If @hndl is NULL then the hint for the library's
+ * default NetLabel handle is returned.
+ *
+ */
+uint32_t nlbl_comm_hint(struct nlbl_handle *hndl)
+{
+	if (hndl == NULL)
+		return __atomic_load_n(&nlcomm_dflt_dump_hint, __ATOMIC_RELAXED);
+	return hndl->dump_hint;
+}
+
+/**
+ * Fill the receive ring of a NetLabel handle
+ * @param hndl the NetLabel handle
+ *
+ * Read all of the datagrams waiting on @hndl, up to the size of the receive
+ * ring, with a single recvmmsg(); datagrams which did not come from the
+ * kernel, and stale responses to earlier requests, are dropped.  If no data
+ * is waiting, the read waits until the deadline of the last request sent on
+ * the handle and then fails with -EAGAIN; asynchronous handles fail with
+ * -EAGAIN immediately.  Returns the number of datagrams in the ring on
+ * success, negative values on failure.
+ *
+ */
+static int nlbl_comm_ring_fill(struct nlbl_handle *hndl)
+{
+	int rc;
+	struct nlbl_comm_ring *ring = hndl->ring;
+	struct msghdr *msg;
+	struct cmsghdr *cmsg;
+	struct ucred *creds;
+	struct nlmsghdr *nl_hdr;
+	unsigned int iter;
+	int kernel;
+
+	/* the ring is allocated on first use and kept for the life of the
+	 * handle */
+	if (ring == NULL) {
+		ring = malloc(sizeof(*ring) + NLCOMM_RING * hndl->rbuf_size);
+		if (ring == NULL)
+			return -ENOMEM;
+		for (iter = 0; iter < NLCOMM_RING; iter++) {
+			ring->iov[iter].iov_base = ring->data +
+						   iter * hndl->rbuf_size;
+			ring->iov[iter].iov_len = hndl->rbuf_size;
+		}
+		ring->next = 0;
+		ring->count = 0;
+		hndl->ring = ring;
+	}
+
+ring_fill_again:
+	/* give a mock kernel the chance to queue any responses it is holding
+	 * back, or to report the ones it dropped */
+	if (hndl->mock != NULL) {
+		rc = nlbl_mock_flush(hndl);
+		if (rc < 0) {
+			hndl->xfer_failed = 1;
+			return rc;
+		}
+	}
+
+	/* we use blocking sockets so do enforce the request's deadline using
+	 * poll() if no data is waiting to be read from the handle;
+	 * asynchronous handles are non-blocking and the caller does the
+	 * waiting */
+	if (!nlbl_async_active(hndl)) {
+		rc = nlbl_comm_wait(hndl);
+		if (rc < 0) {
+			hndl->xfer_failed = 1;
+			return rc;
+		}
+	}
+
+	/* perform the read operation, waiting for the first datagram only;
+	 * the kernel builds the dump messages to fit the buffers we read
+	 * with so MSG_TRUNC should never trigger */
+	for (iter = 0; iter < NLCOMM_RING; iter++) {
+		msg = &ring->msgs[iter].msg_hdr;
+		memset(msg, 0, sizeof(*msg));
+		msg->msg_name = &ring->addr[iter];
+		msg->msg_namelen = sizeof(ring->addr[iter]);
+		msg->msg_iov = &ring->iov[iter];
+		msg->msg_iovlen = 1;
+		msg->msg_control = ring->cmsg[iter].buf;
+		msg->msg_controllen = sizeof(ring->cmsg[iter].buf);
+	}
+	rc = recvmmsg(nlbl_comm_sock(hndl), ring->msgs, NLCOMM_RING,
+		      MSG_TRUNC | MSG_WAITFORONE, NULL);
+	if (rc < 0) {
+		if (errno == EINTR)
+			goto ring_fill_again;
+		if (errno == EWOULDBLOCK)
+			return -EAGAIN;
+		hndl->xfer_failed = 1;
+		return -errno;
+	}
+
+	hndl->stats.reads++;
+
+	ring->next = 0;
+	ring->count = 0;
+	for (iter = 0; iter < (unsigned int)rc; iter++) {
+		msg = &ring->msgs[iter].msg_hdr;
+		if (msg->msg_flags & MSG_TRUNC) {
+			/* grow the buffers so it doesn't happen again */
+			hndl->rbuf_size = NLMSG_ALIGN(ring->msgs[iter].msg_len);
+			free(ring);
+			hndl->ring = NULL;
+			hndl->xfer_failed = 1;
+			return -EMSGSIZE;
+		}
+
+		/* only accept messages from the kernel, or the mock kernel
+		 * which has the other end of the socket to itself */
+		kernel = (hndl->mock != NULL || ring->addr[iter].nl_pid == 0);
+		for (cmsg = CMSG_FIRSTHDR(msg);
+		     cmsg != NULL;
+		     cmsg = CMSG_NXTHDR(msg, cmsg)) {
+			if (cmsg->cmsg_level != SOL_SOCKET ||
+			    cmsg->cmsg_type != SCM_CREDENTIALS)
+				continue;
+			creds = (struct ucred *)CMSG_DATA(cmsg);
+			if (creds->pid != 0)
+				kernel = 0;
+		}
+		if (!kernel) {
+			hndl->stats.dgrams_dropped++;
+			continue;
+		}
+
+		/* discard any stale messages left over from an earlier
+		 * request, e.g. the ack which follows a reply; asynchronous
+		 * handles match the responses to their requests themselves */
+		nl_hdr = ring->iov[iter].iov_base;
+		if (!nlbl_async_active(hndl) &&
+		    ring->msgs[iter].msg_len >= sizeof(*nl_hdr) &&
+		    nl_hdr->nlmsg_seq - hndl->seq_first >
+		    hndl->seq - hndl->seq_first) {
+			hndl->stats.dgrams_dropped++;
+			continue;
+		}
+
+		ring->dgrams[ring->count].data = ring->iov[iter].iov_base;
+		ring->dgrams[ring->count].len = ring->msgs[iter].msg_len;
+		ring->count++;
+		hndl->stats.dgrams_recv++;
+		hndl->stats.bytes_recv += ring->msgs[iter].msg_len;
+	}
+	NLBL_PROBE3(response, hndl, rc, ring->count);
+	if (ring->count == 0)
+		goto ring_fill_again;
+	nlbl_comm_stats_response(hndl);
+
+	return ring->count;
+}
+
+/**
+ * Read a message into the receive ring of a NetLabel handle
+ * @param hndl the NetLabel handle
+ * @param data the message buffer
+ *
+ * Return the next datagram in the handle's receive ring, reading from the
+ * handle if the ring is empty, and set @data to point to it.  The datagram is
+ * only valid until the next read on the handle and must not be freed by the
+ * caller.  See nlbl_comm_ring_fill() for the details of the read.  Returns the
+ * number of bytes read on success, negative values on failure.
+ *
+ */
+int nlbl_comm_recv_buf(struct nlbl_handle *hndl, unsigned char **data)
+{
+	int rc;
+	struct nlbl_comm_dgram *dgram;
+
+	/* sanity checks */
+	if (!nlbl_comm_hndl_valid(hndl) || data == NULL)
+		return -EINVAL;
+
+	if (hndl->ring == NULL || hndl->ring->next == hndl->ring->count) {
+		rc = nlbl_comm_ring_fill(hndl);
+		if (rc < 0)
+			return rc;
+	}
+
+	dgram = &hndl->ring->dgrams[hndl->ring->next++];
+	*data = dgram->data;
+	return dgram->len;
+}
+
+/**
+ * Read all of the waiting messages from a NetLabel handle
+ * @param hndl the NetLabel handle
+ * @param dgrams the datagrams
+ *
+ * Return all of the datagrams in the handle's receive ring, reading from the
+ * handle if the ring is empty, and set @dgrams to point to them.  A single
+ * read returns as many datagrams as are waiting, up to the size of the ring,
+ * so draining a large dump or many acks takes far fewer system calls.  The
+ * datagrams are only valid until the next read on the handle and must not be
+ * freed by the caller.  See nlbl_comm_ring_fill() for the details of the read.
+ * Returns the number of datagrams on success, negative values on failure.
+ *
+ */
+int nlbl_comm_recv_many(struct nlbl_handle *hndl,
+			struct nlbl_comm_dgram **dgrams)
+{
+	int rc;
+	struct nlbl_comm_ring *ring;
+
+	/* sanity checks */
+	if (!nlbl_comm_hndl_valid(hndl) || dgrams == NULL)
+		return -EINVAL;
+
+	if (hndl->ring == NULL || hndl->ring->next == hndl->ring->count) {
+		rc = nlbl_comm_ring_fill(hndl);
+		if (rc < 0)
+			return rc;
+	}
+
+	ring = hndl->ring;
+	*dgrams = &ring->dgrams[ring->next];
+	rc = ring->count - ring->next;
+	ring->next = ring->count;
+	return rc;
+}
+
 /**
  * Read a message from a NetLabel handle
  * @param hndl the NetLabel handle
@@ -151,57 +1065,31 @@ int nlbl_comm_close(struct nlbl_handle *hndl)
  *
  * Reads a message from the NetLabel handle and stores it the pointer returned
  * in @msg.  This function allocates space for @msg, making the caller
- * responsibile for freeing @msg later.  Returns the number of bytes read on
- * success, zero on EOF, and negative values on failure.
+ * responsibile for freeing @msg later.  If no data is waiting, the read waits
+ * until the deadline of the last request sent on the handle and then fails
+ * with -EAGAIN.  Returns the number of bytes read on success, zero on EOF, and
+ * negative values on failure.
  *
  */
 int nlbl_comm_recv_raw(struct nlbl_handle *hndl, unsigned char **data)
 {
 	int rc;
-	struct sockaddr_nl peer_nladdr;
-	struct ucred *creds = NULL;
-	int nl_fd;
-	fd_set read_fds;
-	struct timeval timeout;
+	unsigned char *buf;
 
 	/* sanity checks */
-	if (!nlbl_comm_hndl_valid(hndl) || data == NULL)
+	if (data == NULL)
 		return -EINVAL;
 
-	/* we use blocking sockets so do enforce a timeout using select() if
-	 * no data is waiting to be read from the handle */
-	timeout.tv_sec = nlcomm_read_timeout;
-	timeout.tv_usec = 0;
-	nl_fd = nl_socket_get_fd(hndl->nl_sock);
-	FD_ZERO(&read_fds);
-	FD_SET(nl_fd, &read_fds);
-	rc = select(nl_fd + 1, &read_fds, NULL, NULL, &timeout);
-	if (rc < 0)
-		return -errno;
-	else if (rc == 0)
-		return -EAGAIN;
-
-	/* perform the read operation */
-	*data = NULL;
-	rc = nl_recv(hndl->nl_sock, &peer_nladdr, data, &creds);
+	rc = nlbl_comm_recv_buf(hndl, &buf);
 	if (rc < 0)
 		return rc;
 
-	/* if we are setup to receive credentials, only accept messages from
-	 * the kernel (ignore all others and send an -EAGAIN) */
-	if (creds != NULL && creds->pid != 0) {
-		rc = -EAGAIN;
-		goto recv_raw_failure;
-	}
+	*data = malloc(rc);
+	if (*data == NULL)
+		return -ENOMEM;
+	memcpy(*data, buf, rc);
 
 	return rc;
-
-recv_raw_failure:
-	if (*data != NULL) {
-		free(*data);
-		*data = NULL;
-	}
-	return rc;
 }
 
 /**
@@ -218,41 +1106,96 @@ recv_raw_failure:
 int nlbl_comm_recv(struct nlbl_handle *hndl, nlbl_msg **msg)
 {
 	int rc;
-	unsigned char *data = NULL;
+	unsigned char *data;
 	struct nlmsghdr *nl_hdr;
 
-	/* perform the raw read operation */
-	rc = nlbl_comm_recv_raw(hndl, &data);
+	/* perform the read operation */
+	rc = nlbl_comm_recv_buf(hndl, &data);
 	if (rc < 0)
 		return rc;
 	nl_hdr = (struct nlmsghdr *)data;
 
 	/* make sure the received buffer is the correct length */
-	if (!nlmsg_ok(nl_hdr, rc)) {
-		rc = -EBADMSG;
-		goto recv_failure;
-	}
+	if (!nlmsg_ok(nl_hdr, rc))
+		return -EBADMSG;
 
 	/* check to see if this is a netlink control message we don't care
 	 * about */
 	if (nl_hdr->nlmsg_type == NLMSG_NOOP ||
-	    nl_hdr->nlmsg_type == NLMSG_OVERRUN) {
-		rc = -EBADMSG;
-		goto recv_failure;
-	}
+	    nl_hdr->nlmsg_type == NLMSG_OVERRUN)
+		return -EBADMSG;
+
+	/* copy the received message into a nlbl_msg */
+	*msg = nlmsg_convert(nl_hdr);
+	if (*msg == NULL)
+		return -EBADMSG;
+
+	return rc;
+}
+
+/**
+ * Transmit a message on a NetLabel handle
+ * @param hndl the NetLabel handle
+ * @param msg the message
+ *
+ * Complete the header of @msg and send it to the kernel, or to the mock kernel
+ * if @hndl is attached to one, without any of the checks or bookkeeping done
+ * by nlbl_comm_send().  Returns the number of bytes written on success,
+ * negative values on failure.
+ *
+ */
+int nlbl_comm_write(struct nlbl_handle *hndl, nlbl_msg *msg)
+{
+	int rc;
+	struct nlmsghdr *nl_hdr;
 
-	/* convert the received buffer into a nlbl_msg */
-	*msg = nlmsg_convert((struct nlmsghdr *)data);
-	if (*msg == NULL) {
-		rc = -EBADMSG;
-		goto recv_failure;
+	if (hndl->mock == NULL)
+		rc = nl_send_auto(hndl->nl_sock, msg);
+	else {
+		nl_complete_msg(hndl->nl_sock, msg);
+		nl_hdr = nlmsg_hdr(msg);
+		rc = nlbl_mock_input(hndl, nl_hdr, nl_hdr->nlmsg_len);
 	}
+	if (rc < 0)
+		hndl->xfer_failed = 1;
+	NLBL_PROBE4(request, hndl, nlmsg_hdr(msg)->nlmsg_type,
+		    nlmsg_hdr(msg)->nlmsg_seq, rc);
+	nlbl_comm_stats_write(hndl, 1, rc);
 
 	return rc;
+}
+
+/**
+ * Transmit a buffer of messages on a NetLabel handle
+ * @param hndl the NetLabel handle
+ * @param buf the messages
+ * @param len the length of the messages
+ *
+ * Send the complete messages in @buf to the kernel, or to the mock kernel if
+ * @hndl is attached to one, using a single write.  Returns the number of bytes
+ * written on success, negative values on failure.
+ *
+ */
+int nlbl_comm_write_buf(struct nlbl_handle *hndl, void *buf, size_t len)
+{
+	int rc;
+	struct nlmsghdr *nl_hdr;
+	int rem = len;
+	unsigned int requests = 0;
+
+	if (hndl->mock == NULL)
+		rc = nl_sendto(hndl->nl_sock, buf, len);
+	else
+		rc = nlbl_mock_input(hndl, buf, len);
+	if (rc < 0)
+		hndl->xfer_failed = 1;
+
+	for (nl_hdr = buf; nlmsg_ok(nl_hdr, rem);
+	     nl_hdr = nlmsg_next(nl_hdr, &rem))
+		requests++;
+	NLBL_PROBE3(request_buf, hndl, requests, rc);
+	nlbl_comm_stats_write(hndl, requests, rc);
 
-recv_failure:
-	if (data != NULL)
-		free(data);
 	return rc;
 }
 
@@ -267,11 +1210,14 @@ recv_failure:
  */
 int nlbl_comm_send(struct nlbl_handle *hndl, nlbl_msg *msg)
 {
+	int rc;
 	struct nlmsghdr *nl_hdr;
 
 	/* sanity checks */
 	if (!nlbl_comm_hndl_valid(hndl) || msg == NULL)
 		return -EINVAL;
+	if (nlbl_batch_active(hndl) || nlbl_async_active(hndl))
+		return -EBUSY;
 
 	/* request a netlink ack message */
 	nl_hdr = nlbl_msg_nlhdr(msg);
@@ -279,6 +1225,132 @@ int nlbl_comm_send(struct nlbl_handle *hndl, nlbl_msg *msg)
 		return -EBADMSG;
 	nl_hdr->nlmsg_flags |= NLM_F_ACK;
 
-	/* send the message */
-	return nl_send_auto(hndl->nl_sock, msg);
+	/* send the message, remembering the sequence number so that we can
+	 * match the kernel's response */
+	nlbl_comm_deadline(hndl);
+	rc = nlbl_comm_write(hndl, msg);
+	if (rc >= 0) {
+		hndl->seq_first = nl_hdr->nlmsg_seq;
+		hndl->seq = nl_hdr->nlmsg_seq;
+	}
+	return rc;
+}
+
+/**
+ * Process a datagram of a dump response
+ * @param data the datagram
+ * @param data_len the length of the datagram
+ * @param cmd the generic netlink command of the dump entries
+ * @param cb the callback
+ * @param arg the callback argument
+ * @param rc_cb the return value of the last callback
+ * @param count the number of callbacks made
+ *
+ * Call @cb for each dump entry in the datagram, see nlbl_comm_dump().  Returns
+ * one if the datagram ends the dump, zero if more datagrams follow, and
+ * negative values on failure.
+ *
+ */
+static int nlbl_comm_dump_dgram(unsigned char *data, int data_len,
+				uint8_t cmd, nlbl_comm_dump_cb cb, void *arg,
+				int *rc_cb, unsigned int *count)
+{
+	struct nlmsghdr *nl_hdr;
+	struct genlmsghdr *genl_hdr;
+	struct nlmsgerr *nl_err;
+	int done = 0;
+
+	/* loop through the messages */
+	for (nl_hdr = (struct nlmsghdr *)data;
+	     nlmsg_ok(nl_hdr, data_len);
+	     nl_hdr = nlmsg_next(nl_hdr, &data_len)) {
+		switch (nl_hdr->nlmsg_type) {
+		case NLMSG_DONE:
+			done = 1;
+			continue;
+		case NLMSG_ERROR:
+			nl_err = nlmsg_data(nl_hdr);
+			return (nl_err->error ? nl_err->error : -EBADMSG);
+		case NLMSG_NOOP:
+		case NLMSG_OVERRUN:
+			return -EBADMSG;
+		}
+		if (!(nl_hdr->nlmsg_flags & NLM_F_MULTI))
+			done = 1;
+
+		/* get the header pointers */
+		genl_hdr = (struct genlmsghdr *)nlmsg_data(nl_hdr);
+		if (genl_hdr->cmd != cmd)
+			return -EBADMSG;
+
+		/* once the callback stops the dump we simply drain the rest
+		 * of the response */
+		if (*rc_cb != 0)
+			continue;
+		*rc_cb = cb(genlmsg_attrdata(genl_hdr, 0),
+			    genlmsg_attrlen(genl_hdr, 0), arg);
+		(*count)++;
+	}
+
+	return done;
+}
+
+/**
+ * Perform a dump operation on a NetLabel handle
+ * @param hndl the NetLabel handle
+ * @param msg the dump request
+ * @param cmd the generic netlink command of the dump entries
+ * @param cb the callback
+ * @param arg the callback argument
+ *
+ * Send the dump request in @msg and call @cb once for each entry in the
+ * kernel's multi-message response, passing the entry's attributes and @arg.
+ * The attributes point directly into the receive buffer and are only valid
+ * until @cb returns.  If @cb returns a non-zero value no further callbacks are
+ * made, but the rest of the response is still read from the handle.  Returns
+ * the number of callbacks made on success, the return value of @cb if it is
+ * negative, and negative values on failure.
+ *
+ */
+int nlbl_comm_dump(struct nlbl_handle *hndl, nlbl_msg *msg, uint8_t cmd,
+		   nlbl_comm_dump_cb cb, void *arg)
+{
+	int rc;
+	int rc_cb = 0;
+	unsigned int count = 0;
+	struct nlbl_comm_dgram *dgrams;
+	int dgram_cnt;
+	int iter;
+	int done = 0;
+
+	/* send the request */
+	rc = nlbl_comm_send(hndl, msg);
+	if (rc <= 0) {
+		if (rc == 0)
+			rc = -ENODATA;
+		return rc;
+	}
+
+	/* read all of the messages (multi-message response), taking as many
+	 * datagrams from the handle at once as possible */
+	while (!done) {
+		rc = nlbl_comm_recv_many(hndl, &dgrams);
+		if (rc <= 0) {
+			if (rc == 0)
+				rc = -ENODATA;
+			return rc;
+		}
+		dgram_cnt = rc;
+
+		for (iter = 0; iter < dgram_cnt && !done; iter++) {
+			rc = nlbl_comm_dump_dgram(dgrams[iter].data,
+						  dgrams[iter].len, cmd,
+						  cb, arg, &rc_cb, &count);
+			if (rc < 0)
+				return rc;
+			done = rc;
+		}
+	}
+
+	return (rc_cb < 0 ? rc_cb : (int)count);
 }
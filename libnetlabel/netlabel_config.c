@@ -0,0 +1,2377 @@
+/** @file
+ * NetLabel Configuration Reconciliation Functions
+ *
+ * Author: Paul Moore <paul@paul-moore.com>
+ *
+ */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <linux/types.h>
+
+#include <libnetlabel.h>
+
+#include "netlabel_internal.h"
+
+/* a range of a configuration array */
+struct nlbl_config_range {
+	size_t start;
+	size_t end;
+};
+
+/*
+ * Helper Functions
+ */
+
+/**
+ * Return an element of a growable array
+ * @param vec the growable array
+ * @param idx the element index
+ */
+static inline void *nlbl_config_elem(const struct nlbl_vec *vec, size_t idx)
+{
+	return (unsigned char *)vec->array + idx * vec->elem_size;
+}
+
+/**
+ * Find the position of a key in a sorted array
+ * @param vec the sorted array
+ * @param key an element holding the key
+ * @param cmp the element comparison function
+ * @param pos the position of the key
+ *
+ * Search @vec for the first element not ordered before @key and store its
+ * position in @pos.  Returns true if the element matches @key, false
+ * otherwise.
+ *
+ */
+static int nlbl_config_find(const struct nlbl_vec *vec, const void *key,
+			    int (*cmp)(const void *, const void *),
+			    size_t *pos)
+{
+	size_t low = 0;
+	size_t high = vec->count;
+	size_t mid;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (cmp(nlbl_config_elem(vec, mid), key) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	*pos = low;
+	return (low < vec->count && cmp(nlbl_config_elem(vec, low), key) == 0);
+}
+
+/**
+ * Insert an element into a sorted array
+ * @param vec the sorted array
+ * @param pos the position of the new element
+ *
+ * Returns a pointer to the new, zeroed, element on success, NULL on failure.
+ *
+ */
+static void *nlbl_config_insert(struct nlbl_vec *vec, size_t pos)
+{
+	void *elem;
+
+	if (nlbl_vec_add(vec) == NULL)
+		return NULL;
+	elem = nlbl_config_elem(vec, pos);
+	memmove(nlbl_config_elem(vec, pos + 1), elem,
+		(vec->count - pos - 1) * vec->elem_size);
+	memset(elem, 0, vec->elem_size);
+
+	return elem;
+}
+
+/**
+ * Remove an element from a sorted array
+ * @param vec the sorted array
+ * @param pos the position of the element
+ */
+static void nlbl_config_remove(struct nlbl_vec *vec, size_t pos)
+{
+	memmove(nlbl_config_elem(vec, pos), nlbl_config_elem(vec, pos + 1),
+		(vec->count - pos - 1) * vec->elem_size);
+	vec->count--;
+}
+
+/**
+ * Compare two strings, either of which may be NULL
+ * @param a the first string
+ * @param b the second string
+ *
+ * NULL, which stands for the default entries, is ordered first.
+ *
+ */
+static int nlbl_config_strcmp(const char *a, const char *b)
+{
+	if (a == NULL || b == NULL)
+		return (a != NULL) - (b != NULL);
+	return strcmp(a, b);
+}
+
+/**
+ * Normalize a network address
+ * @param addr the network address
+ * @param norm the normalized network address
+ *
+ * Copy @addr into @norm, clearing the bits outside of the mask as the kernel
+ * does so that addresses can be compared with memcmp().  Returns zero on
+ * success, negative values on failure.
+ *
+ */
+static int nlbl_config_addr_norm(const struct nlbl_netaddr *addr,
+				 struct nlbl_netaddr *norm)
+{
+	unsigned int iter;
+
+	memset(norm, 0, sizeof(*norm));
+	norm->type = addr->type;
+	switch (addr->type) {
+	case AF_INET:
+		norm->mask.v4 = addr->mask.v4;
+		norm->addr.v4.s_addr = addr->addr.v4.s_addr &
+				       addr->mask.v4.s_addr;
+		return 0;
+	case AF_INET6:
+		for (iter = 0; iter < 4; iter++) {
+			norm->mask.v6.s6_addr32[iter] =
+				addr->mask.v6.s6_addr32[iter];
+			norm->addr.v6.s6_addr32[iter] =
+				addr->addr.v6.s6_addr32[iter] &
+				addr->mask.v6.s6_addr32[iter];
+		}
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+/**
+ * Compare two normalized network addresses
+ * @param a the first network address
+ * @param b the second network address
+ */
+static int nlbl_config_addr_cmp(const struct nlbl_netaddr *a,
+				const struct nlbl_netaddr *b)
+{
+	int rc;
+
+	if (a->type != b->type)
+		return (a->type < b->type ? -1 : 1);
+	rc = memcmp(&a->addr, &b->addr, sizeof(a->addr));
+	if (rc != 0)
+		return rc;
+	return memcmp(&a->mask, &b->mask, sizeof(a->mask));
+}
+
+/**
+ * Compare two DOIs
+ * @param a the first DOI
+ * @param b the second DOI
+ *
+ * The CIPSO and CALIPSO DOI configurations both start with the DOI.
+ *
+ */
+static int nlbl_config_doi_cmp(const void *a, const void *b)
+{
+	uint32_t doi_a = *(const uint32_t *)a;
+	uint32_t doi_b = *(const uint32_t *)b;
+
+	return (doi_a > doi_b) - (doi_a < doi_b);
+}
+
+/**
+ * Compare two domain mappings by domain and address family
+ * @param a the first domain mapping
+ * @param b the second domain mapping
+ */
+static int nlbl_config_map_cmp(const void *a, const void *b)
+{
+	const struct nlbl_config_map *map_a = a;
+	const struct nlbl_config_map *map_b = b;
+	int rc;
+
+	rc = nlbl_config_strcmp(map_a->domain, map_b->domain);
+	if (rc != 0)
+		return rc;
+	return (map_a->family > map_b->family) -
+	       (map_a->family < map_b->family);
+}
+
+/**
+ * Compare two address selectors by address
+ * @param a the first address selector
+ * @param b the second address selector
+ */
+static int nlbl_config_addrsel_cmp(const void *a, const void *b)
+{
+	const struct nlbl_dommap_addr *addrsel_a = a;
+	const struct nlbl_dommap_addr *addrsel_b = b;
+
+	return nlbl_config_addr_cmp(&addrsel_a->addr, &addrsel_b->addr);
+}
+
+/**
+ * Compare two static labels by network interface and address
+ * @param a the first static label
+ * @param b the second static label
+ */
+static int nlbl_config_addrmap_cmp(const void *a, const void *b)
+{
+	const struct nlbl_addrmap *addr_a = a;
+	const struct nlbl_addrmap *addr_b = b;
+	int rc;
+
+	rc = nlbl_config_strcmp(addr_a->dev, addr_b->dev);
+	if (rc != 0)
+		return rc;
+	return nlbl_config_addr_cmp(&addr_a->addr, &addr_b->addr);
+}
+
+/**
+ * Compare two CIPSO level or category mappings by local value
+ * @param a the first mapping
+ * @param b the second mapping
+ */
+static int nlbl_config_pair_cmp(const void *a, const void *b)
+{
+	return nlbl_config_doi_cmp(a, b);
+}
+
+/**
+ * Copy an array into a result set
+ * @param result the result set
+ * @param array the array
+ * @param len the size of the array in bytes
+ *
+ * Returns a pointer to the copy on success, NULL on failure; an empty array is
+ * copied as NULL.
+ *
+ */
+static void *nlbl_config_memdup(struct nlbl_result *result,
+				const void *array, size_t len)
+{
+	void *copy;
+
+	if (len == 0)
+		return NULL;
+	copy = nlbl_result_alloc(result, len);
+	if (copy != NULL)
+		memcpy(copy, array, len);
+	return copy;
+}
+
+/**
+ * Return the DOI of an address selector
+ * @param addrsel the address selector
+ */
+static uint32_t nlbl_config_addrsel_doi(const struct nlbl_dommap_addr *addrsel)
+{
+	switch (addrsel->proto_type) {
+	case NETLBL_NLTYPE_CIPSOV4:
+		return addrsel->proto.cip_doi;
+	case NETLBL_NLTYPE_CALIPSO:
+		return addrsel->proto.clp_doi;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * Find the domain mappings of a domain
+ * @param cfg the configuration
+ * @param domain the domain, NULL for the default mapping
+ * @param range the domain's mappings
+ *
+ * Returns the number of mappings the domain has, one for each address family
+ * or a single mapping for both.
+ *
+ */
+static size_t nlbl_config_map_range(const struct nlbl_config *cfg,
+				    const char *domain,
+				    struct nlbl_config_range *range)
+{
+	struct nlbl_config_map key;
+	const struct nlbl_config_map *map;
+
+	memset(&key, 0, sizeof(key));
+	key.domain = domain;
+	key.family = AF_UNSPEC;
+	nlbl_config_find(&cfg->maps, &key, nlbl_config_map_cmp, &range->start);
+	for (range->end = range->start; range->end < cfg->maps.count;
+	     range->end++) {
+		map = nlbl_config_elem(&cfg->maps, range->end);
+		if (nlbl_config_strcmp(map->domain, domain) != 0)
+			break;
+	}
+
+	return range->end - range->start;
+}
+
+/**
+ * Remove a domain mapping from a configuration
+ * @param cfg the configuration
+ * @param pos the position of the domain mapping
+ */
+static void nlbl_config_map_remove(struct nlbl_config *cfg, size_t pos)
+{
+	struct nlbl_config_map *map = nlbl_config_elem(&cfg->maps, pos);
+
+	nlbl_vec_free(&map->addrsel);
+	nlbl_config_remove(&cfg->maps, pos);
+}
+
+/**
+ * Add a domain mapping to a configuration
+ * @param cfg the configuration
+ * @param domain the domain, NULL for the default mapping
+ * @param family the address family
+ * @param proto_type the labeling protocol
+ * @param doi the DOI
+ *
+ * Add a new, empty, domain mapping to @cfg.  Returns a pointer to the domain
+ * mapping on success, NULL on failure.
+ *
+ */
+static struct nlbl_config_map *nlbl_config_map_new(struct nlbl_config *cfg,
+						   const char *domain,
+						   uint16_t family,
+						   nlbl_proto proto_type,
+						   uint32_t doi)
+{
+	struct nlbl_config_map key;
+	struct nlbl_config_map *map;
+	size_t pos;
+
+	memset(&key, 0, sizeof(key));
+	key.domain = domain;
+	key.family = family;
+	nlbl_config_find(&cfg->maps, &key, nlbl_config_map_cmp, &pos);
+
+	if (domain != NULL) {
+		key.domain = nlbl_result_strdup(cfg->result, domain);
+		if (key.domain == NULL)
+			return NULL;
+	}
+	map = nlbl_config_insert(&cfg->maps, pos);
+	if (map == NULL)
+		return NULL;
+	map->domain = key.domain;
+	map->family = family;
+	map->proto_type = proto_type;
+	map->doi = doi;
+	nlbl_vec_init(&map->addrsel, sizeof(struct nlbl_dommap_addr), 0);
+
+	return map;
+}
+
+/**
+ * Add an address selector to a domain mapping
+ * @param map the domain mapping
+ * @param addrsel the address selector
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_config_addrsel_add(struct nlbl_config_map *map,
+				   const struct nlbl_dommap_addr *addrsel)
+{
+	int rc;
+	struct nlbl_dommap_addr key;
+	struct nlbl_dommap_addr *entry;
+	size_t pos;
+
+	memset(&key, 0, sizeof(key));
+	rc = nlbl_config_addr_norm(&addrsel->addr, &key.addr);
+	if (rc < 0)
+		return rc;
+	if (nlbl_config_find(&map->addrsel, &key,
+			     nlbl_config_addrsel_cmp, &pos))
+		return -EEXIST;
+
+	entry = nlbl_config_insert(&map->addrsel, pos);
+	if (entry == NULL)
+		return -ENOMEM;
+	entry->addr = key.addr;
+	entry->proto_type = addrsel->proto_type;
+	entry->proto = addrsel->proto;
+	entry->next = NULL;
+
+	return 0;
+}
+
+/**
+ * Add a domain mapping entry as listed by the kernel
+ * @param cfg the configuration
+ * @param domain the domain mapping
+ * @param family the address family the entry applies to
+ *
+ * Add @domain to @cfg without applying the kernel's rules for adding domain
+ * mappings; only the address selectors of @family are added unless @family is
+ * AF_UNSPEC.  Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_config_map_load(struct nlbl_config *cfg,
+				const struct nlbl_dommap *domain,
+				uint16_t family)
+{
+	int rc;
+	struct nlbl_config_map *map;
+	const struct nlbl_dommap_addr *iter;
+	uint32_t doi = 0;
+
+	switch (domain->proto_type) {
+	case NETLBL_NLTYPE_CIPSOV4:
+		doi = domain->proto.cip_doi;
+		break;
+	case NETLBL_NLTYPE_CALIPSO:
+		doi = domain->proto.clp_doi;
+		break;
+	}
+	map = nlbl_config_map_new(cfg, domain->domain, family,
+				  domain->proto_type, doi);
+	if (map == NULL)
+		return -ENOMEM;
+	if (domain->proto_type != NETLBL_NLTYPE_ADDRSELECT)
+		return 0;
+
+	for (iter = domain->proto.addrsel; iter != NULL; iter = iter->next) {
+		if (family != AF_UNSPEC && iter->addr.type != family)
+			continue;
+		rc = nlbl_config_addrsel_add(map, iter);
+		if (rc < 0)
+			return rc;
+	}
+
+	return 0;
+}
+
+/**
+ * Add a domain mapping entry as listed by the kernel
+ * @param domain the domain mapping
+ * @param arg the configuration
+ *
+ * Dump callback for nlbl_config_map_load().  Returns zero on success,
+ * negative values on failure.
+ *
+ */
+static int nlbl_config_map_load_cb(const struct nlbl_dommap *domain,
+				   void *arg)
+{
+	if (domain->domain == NULL)
+		return -EBADMSG;
+	return nlbl_config_map_load(arg, domain, domain->family);
+}
+
+/**
+ * Add a static label entry as listed by the kernel
+ * @param addr the static label
+ * @param arg the configuration
+ *
+ * Dump callback for nlbl_config_unlbl_staticadd().  Returns zero on success,
+ * negative values on failure.
+ *
+ */
+static int nlbl_config_addrmap_load_cb(const struct nlbl_addrmap *addr,
+				       void *arg)
+{
+	return nlbl_config_unlbl_staticadd(arg, addr->dev,
+					   &addr->addr, addr->label);
+}
+
+/**
+ * Add a default static label entry as listed by the kernel
+ * @param addr the static label
+ * @param arg the configuration
+ *
+ * Dump callback for nlbl_config_unlbl_staticadddef().  Returns zero on
+ * success, negative values on failure.
+ *
+ */
+static int nlbl_config_addrmapdef_load_cb(const struct nlbl_addrmap *addr,
+					  void *arg)
+{
+	return nlbl_config_unlbl_staticadddef(arg, &addr->addr, addr->label);
+}
+
+/**
+ * Load the CIPSO DOIs from the kernel
+ * @param hndl the NetLabel handle
+ * @param cfg the configuration
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_config_cipso_load(struct nlbl_handle *hndl,
+				  struct nlbl_config *cfg)
+{
+	int rc;
+	nlbl_cip_doi *dois = NULL;
+	nlbl_cip_mtype *mtypes = NULL;
+	nlbl_cip_mtype mtype;
+	struct nlbl_cip_tag_a tags;
+	struct nlbl_cip_lvl_a lvls;
+	struct nlbl_cip_cat_a cats;
+	size_t count;
+	size_t iter;
+
+	rc = nlbl_cipso_listall(hndl, &dois, &mtypes);
+	if (rc < 0)
+		return (rc == -ENOPROTOOPT ? 0 : rc);
+	count = rc;
+
+	for (iter = 0; iter < count; iter++) {
+		memset(&tags, 0, sizeof(tags));
+		memset(&lvls, 0, sizeof(lvls));
+		memset(&cats, 0, sizeof(cats));
+		rc = nlbl_cipso_list(hndl, dois[iter], &mtype,
+				     &tags, &lvls, &cats);
+		if (rc == 0) {
+			switch (mtype) {
+			case CIPSO_V4_MAP_TRANS:
+				rc = nlbl_config_cipso_add_trans(cfg,
+								 dois[iter],
+								 &tags,
+								 &lvls, &cats);
+				break;
+			case CIPSO_V4_MAP_PASS:
+				rc = nlbl_config_cipso_add_pass(cfg,
+								dois[iter],
+								&tags);
+				break;
+			case CIPSO_V4_MAP_LOCAL:
+				rc = nlbl_config_cipso_add_local(cfg,
+								 dois[iter]);
+				break;
+			default:
+				rc = -EBADMSG;
+			}
+		}
+		free(tags.array);
+		free(lvls.array);
+		free(cats.array);
+		if (rc < 0)
+			goto load_return;
+	}
+	rc = 0;
+
+load_return:
+	free(dois);
+	free(mtypes);
+	return rc;
+}
+
+/**
+ * Load the CALIPSO DOIs from the kernel
+ * @param hndl the NetLabel handle
+ * @param cfg the configuration
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_config_calipso_load(struct nlbl_handle *hndl,
+				    struct nlbl_config *cfg)
+{
+	int rc;
+	nlbl_clp_doi *dois = NULL;
+	nlbl_clp_mtype *mtypes = NULL;
+	size_t count;
+	size_t iter;
+
+	rc = nlbl_calipso_listall(hndl, &dois, &mtypes);
+	if (rc < 0)
+		return (rc == -ENOPROTOOPT ? 0 : rc);
+	count = rc;
+
+	for (iter = 0; iter < count; iter++) {
+		if (mtypes[iter] != CALIPSO_MAP_PASS) {
+			rc = -EBADMSG;
+			goto load_return;
+		}
+		rc = nlbl_config_calipso_add_pass(cfg, dois[iter]);
+		if (rc < 0)
+			goto load_return;
+	}
+	rc = 0;
+
+load_return:
+	free(dois);
+	free(mtypes);
+	return rc;
+}
+
+/**
+ * Load the default domain mappings from the kernel
+ * @param hndl the NetLabel handle
+ * @param cfg the configuration
+ *
+ * The kernel lists the default mappings one address family at a time, a
+ * default mapping for both families is listed for each of them.  Returns zero
+ * on success, negative values on failure.
+ *
+ */
+static int nlbl_config_mapdef_load(struct nlbl_handle *hndl,
+				   struct nlbl_config *cfg)
+{
+	int rc = 0;
+	struct nlbl_dommap def;
+	uint16_t families[] = { AF_INET, AF_INET6 };
+	unsigned int iter;
+	int unspec = 0;
+
+	for (iter = 0; iter < sizeof(families) / sizeof(*families); iter++) {
+		memset(&def, 0, sizeof(def));
+		rc = nlbl_mgmt_listdef(hndl, families[iter], &def);
+		if (rc == -ENOENT) {
+			rc = 0;
+			continue;
+		} else if (rc < 0)
+			return rc;
+
+		def.domain = NULL;
+		if (def.family != AF_UNSPEC)
+			rc = nlbl_config_map_load(cfg, &def, families[iter]);
+		else if (!unspec++)
+			rc = nlbl_config_map_load(cfg, &def, AF_UNSPEC);
+		if (def.proto_type == NETLBL_NLTYPE_ADDRSELECT)
+			free(def.proto.addrsel);
+		if (rc < 0)
+			return rc;
+	}
+
+	return rc;
+}
+
+/**
+ * Allocate an empty configuration
+ *
+ * Returns a pointer to a configuration with no entries at all, not even the
+ * default domain mapping, on success, NULL on failure.
+ *
+ */
+struct nlbl_config *nlbl_config_alloc(void)
+{
+	struct nlbl_config *cfg;
+
+	cfg = calloc(1, sizeof(*cfg));
+	if (cfg == NULL)
+		return NULL;
+	cfg->result = nlbl_result_new();
+	if (cfg->result == NULL) {
+		free(cfg);
+		return NULL;
+	}
+	nlbl_vec_init(&cfg->cipso, sizeof(struct nlbl_config_cipso), 0);
+	nlbl_vec_init(&cfg->calipso, sizeof(struct nlbl_config_calipso), 0);
+	nlbl_vec_init(&cfg->maps, sizeof(struct nlbl_config_map), 0);
+	nlbl_vec_init(&cfg->addrs, sizeof(struct nlbl_addrmap), 0);
+
+	return cfg;
+}
+
+/**
+ * Add a CIPSO DOI to a configuration
+ * @param cfg the configuration
+ * @param doi the CIPSO DOI
+ * @param mtype the DOI mapping type
+ * @param tags the tags
+ * @param lvls the level mappings
+ * @param cats the category mappings
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_config_cipso_add(struct nlbl_config *cfg,
+				 nlbl_cip_doi doi, nlbl_cip_mtype mtype,
+				 const struct nlbl_cip_tag_a *tags,
+				 const struct nlbl_cip_lvl_a *lvls,
+				 const struct nlbl_cip_cat_a *cats)
+{
+	struct nlbl_config_cipso key;
+	struct nlbl_config_cipso *entry;
+	size_t pos;
+
+	/* sanity checks */
+	if (cfg == NULL || doi == 0)
+		return -EINVAL;
+
+	memset(&key, 0, sizeof(key));
+	key.doi = doi;
+	key.mtype = mtype;
+	if (nlbl_config_find(&cfg->cipso, &key, nlbl_config_doi_cmp, &pos))
+		return -EEXIST;
+
+	/* copy the arrays, the mappings are sorted as the kernel lists them */
+	if (tags != NULL && tags->size > 0) {
+		key.tags.array = nlbl_config_memdup(cfg->result, tags->array,
+						    tags->size *
+						    sizeof(*tags->array));
+		if (key.tags.array == NULL)
+			return -ENOMEM;
+		key.tags.size = tags->size;
+	}
+	if (lvls != NULL && lvls->size > 0) {
+		key.lvls.array = nlbl_config_memdup(cfg->result, lvls->array,
+						    lvls->size * 2 *
+						    sizeof(*lvls->array));
+		if (key.lvls.array == NULL)
+			return -ENOMEM;
+		key.lvls.size = lvls->size;
+		qsort(key.lvls.array, key.lvls.size,
+		      2 * sizeof(*key.lvls.array), nlbl_config_pair_cmp);
+	}
+	if (cats != NULL && cats->size > 0) {
+		key.cats.array = nlbl_config_memdup(cfg->result, cats->array,
+						    cats->size * 2 *
+						    sizeof(*cats->array));
+		if (key.cats.array == NULL)
+			return -ENOMEM;
+		key.cats.size = cats->size;
+		qsort(key.cats.array, key.cats.size,
+		      2 * sizeof(*key.cats.array), nlbl_config_pair_cmp);
+	}
+
+	entry = nlbl_config_insert(&cfg->cipso, pos);
+	if (entry == NULL)
+		return -ENOMEM;
+	*entry = key;
+
+	return 0;
+}
+
+/**
+ * Remove a DOI from a configuration
+ * @param cfg the configuration
+ * @param dois the DOI array
+ * @param proto_type the labeling protocol of the DOIs
+ * @param doi the DOI
+ *
+ * Like the kernel, remove the domain mappings using the DOI directly and fail
+ * if an address selector still uses it.  Returns zero on success, negative
+ * values on failure.
+ *
+ */
+static int nlbl_config_doi_del(struct nlbl_config *cfg, struct nlbl_vec *dois,
+			       nlbl_proto proto_type, uint32_t doi)
+{
+	struct nlbl_config_map *map;
+	const struct nlbl_dommap_addr *addrsel;
+	size_t pos;
+	size_t iter;
+	size_t iter_s;
+
+	/* sanity checks */
+	if (cfg == NULL)
+		return -EINVAL;
+
+	if (!nlbl_config_find(dois, &doi, nlbl_config_doi_cmp, &pos))
+		return -ENOENT;
+
+	for (iter = 0; iter < cfg->maps.count; iter++) {
+		map = nlbl_config_elem(&cfg->maps, iter);
+		for (iter_s = 0; iter_s < map->addrsel.count; iter_s++) {
+			addrsel = nlbl_config_elem(&map->addrsel, iter_s);
+			if (addrsel->proto_type == proto_type &&
+			    nlbl_config_addrsel_doi(addrsel) == doi)
+				return -EBUSY;
+		}
+	}
+	for (iter = cfg->maps.count; iter > 0; iter--) {
+		map = nlbl_config_elem(&cfg->maps, iter - 1);
+		if (map->proto_type == proto_type && map->doi == doi)
+			nlbl_config_map_remove(cfg, iter - 1);
+	}
+	nlbl_config_remove(dois, pos);
+
+	return 0;
+}
+
+/**
+ * Check that the DOI used by a domain mapping exists
+ * @param cfg the configuration
+ * @param proto_type the labeling protocol
+ * @param doi the DOI
+ *
+ * Returns zero if the DOI exists or isn't needed, negative values otherwise.
+ *
+ */
+static int nlbl_config_doi_check(const struct nlbl_config *cfg,
+				 nlbl_proto proto_type, uint32_t doi)
+{
+	size_t pos;
+
+	switch (proto_type) {
+	case NETLBL_NLTYPE_UNLABELED:
+		return 0;
+	case NETLBL_NLTYPE_CIPSOV4:
+		if (nlbl_config_find(&cfg->cipso, &doi,
+				     nlbl_config_doi_cmp, &pos))
+			return 0;
+		return -EINVAL;
+	case NETLBL_NLTYPE_CALIPSO:
+		if (nlbl_config_find(&cfg->calipso, &doi,
+				     nlbl_config_doi_cmp, &pos))
+			return 0;
+		return -EINVAL;
+	default:
+		return -EINVAL;
+	}
+}
+
+/**
+ * Add a domain mapping to a configuration
+ * @param cfg the configuration
+ * @param name the domain, NULL for the default mapping
+ * @param domain the domain mapping
+ * @param addr the network address, NULL or AF_UNSPEC for none
+ *
+ * Add the mapping to @cfg following the kernel's rules: a domain has at most
+ * one mapping for each address family, and adding an address selector to a
+ * domain which already has address selectors for the address family adds the
+ * selector to the existing mapping.  Returns zero on success, negative values
+ * on failure.
+ *
+ */
+static int nlbl_config_map_add(struct nlbl_config *cfg, const char *name,
+			       const struct nlbl_dommap *domain,
+			       const struct nlbl_netaddr *addr)
+{
+	int rc;
+	struct nlbl_config_range range;
+	struct nlbl_config_map *map;
+	struct nlbl_config_map *existing = NULL;
+	struct nlbl_dommap_addr addrsel;
+	uint16_t family;
+	uint32_t doi = 0;
+	size_t iter;
+
+	/* sanity checks */
+	if (cfg == NULL || domain == NULL)
+		return -EINVAL;
+
+	switch (domain->proto_type) {
+	case NETLBL_NLTYPE_CIPSOV4:
+		doi = domain->proto.cip_doi;
+		break;
+	case NETLBL_NLTYPE_CALIPSO:
+		doi = domain->proto.clp_doi;
+		break;
+	}
+	rc = nlbl_config_doi_check(cfg, domain->proto_type, doi);
+	if (rc < 0)
+		return rc;
+
+	family = (addr != NULL && addr->type != AF_UNSPEC ?
+		  addr->type : domain->family);
+	nlbl_config_map_range(cfg, name, &range);
+	for (iter = range.start; iter < range.end; iter++) {
+		map = nlbl_config_elem(&cfg->maps, iter);
+		if (map->family == family || map->family == AF_UNSPEC ||
+		    family == AF_UNSPEC) {
+			existing = map;
+			break;
+		}
+	}
+
+	/* mappings without an address selector */
+	if (addr == NULL || addr->type == AF_UNSPEC) {
+		if (existing != NULL)
+			return -EEXIST;
+		map = nlbl_config_map_new(cfg, name, family,
+					  domain->proto_type, doi);
+		return (map != NULL ? 0 : -ENOMEM);
+	}
+
+	/* address selectors */
+	memset(&addrsel, 0, sizeof(addrsel));
+	addrsel.addr = *addr;
+	addrsel.proto_type = domain->proto_type;
+	addrsel.proto.cip_doi = doi;
+	if (existing != NULL) {
+		if (existing->proto_type != NETLBL_NLTYPE_ADDRSELECT ||
+		    existing->family != family)
+			return -EEXIST;
+		return nlbl_config_addrsel_add(existing, &addrsel);
+	}
+	map = nlbl_config_map_new(cfg, name, family,
+				  NETLBL_NLTYPE_ADDRSELECT, 0);
+	if (map == NULL)
+		return -ENOMEM;
+	return nlbl_config_addrsel_add(map, &addrsel);
+}
+
+/**
+ * Remove the domain mappings of a domain from a configuration
+ * @param cfg the configuration
+ * @param name the domain, NULL for the default mapping
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_config_map_del(struct nlbl_config *cfg, const char *name)
+{
+	struct nlbl_config_range range;
+
+	/* sanity checks */
+	if (cfg == NULL)
+		return -EINVAL;
+
+	if (nlbl_config_map_range(cfg, name, &range) == 0)
+		return -ENOENT;
+	while (range.end-- > range.start)
+		nlbl_config_map_remove(cfg, range.end);
+
+	return 0;
+}
+
+/**
+ * Add a static label to a configuration
+ * @param cfg the configuration
+ * @param dev the network interface, NULL for the default static labels
+ * @param addr the network address
+ * @param label the security label
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_config_addrmap_add(struct nlbl_config *cfg,
+				   const char *dev,
+				   const struct nlbl_netaddr *addr,
+				   const char *label)
+{
+	int rc;
+	struct nlbl_addrmap key;
+	struct nlbl_addrmap *entry;
+	size_t pos;
+
+	/* sanity checks */
+	if (cfg == NULL || addr == NULL || label == NULL)
+		return -EINVAL;
+
+	memset(&key, 0, sizeof(key));
+	key.dev = (nlbl_netdev)dev;
+	rc = nlbl_config_addr_norm(addr, &key.addr);
+	if (rc < 0)
+		return rc;
+	if (nlbl_config_find(&cfg->addrs, &key, nlbl_config_addrmap_cmp, &pos))
+		return -EEXIST;
+
+	if (dev != NULL) {
+		key.dev = nlbl_result_strdup(cfg->result, dev);
+		if (key.dev == NULL)
+			return -ENOMEM;
+	}
+	key.label = nlbl_result_strdup(cfg->result, label);
+	if (key.label == NULL)
+		return -ENOMEM;
+	entry = nlbl_config_insert(&cfg->addrs, pos);
+	if (entry == NULL)
+		return -ENOMEM;
+	*entry = key;
+
+	return 0;
+}
+
+/**
+ * Remove a static label from a configuration
+ * @param cfg the configuration
+ * @param dev the network interface, NULL for the default static labels
+ * @param addr the network address
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_config_addrmap_del(struct nlbl_config *cfg,
+				   const char *dev,
+				   const struct nlbl_netaddr *addr)
+{
+	int rc;
+	struct nlbl_addrmap key;
+	size_t pos;
+
+	/* sanity checks */
+	if (cfg == NULL || addr == NULL)
+		return -EINVAL;
+
+	memset(&key, 0, sizeof(key));
+	key.dev = (nlbl_netdev)dev;
+	rc = nlbl_config_addr_norm(addr, &key.addr);
+	if (rc < 0)
+		return rc;
+	if (!nlbl_config_find(&cfg->addrs, &key,
+			      nlbl_config_addrmap_cmp, &pos))
+		return -ENOENT;
+	nlbl_config_remove(&cfg->addrs, pos);
+
+	return 0;
+}
+
+/*
+ * Plan Helper Functions
+ */
+
+/* configuration plan being built */
+struct nlbl_config_planner {
+	const struct nlbl_config *cur;
+	const struct nlbl_config *want;
+
+	/* operations, one array for each type so they come out in order */
+	struct nlbl_vec ops[NLBL_CONFIG_C_MAX];
+	struct nlbl_result *result;
+
+	/* DOIs removed by the plan, sorted */
+	struct nlbl_vec cip_del;
+	struct nlbl_vec clp_del;
+};
+
+/**
+ * Add an operation to a plan
+ * @param plan the plan
+ * @param cmd the operation type
+ *
+ * Returns a pointer to the new, zeroed, operation on success, NULL on
+ * failure.
+ *
+ */
+static struct nlbl_config_op *nlbl_config_op_new(
+					struct nlbl_config_planner *plan,
+					unsigned int cmd)
+{
+	struct nlbl_config_op *op;
+
+	op = nlbl_vec_add(&plan->ops[cmd]);
+	if (op != NULL)
+		op->cmd = cmd;
+	return op;
+}
+
+/**
+ * Copy a string into a plan
+ * @param plan the plan
+ * @param str the string, may be NULL
+ * @param copy the copy
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_config_op_strdup(struct nlbl_config_planner *plan,
+				 const char *str, char **copy)
+{
+	*copy = NULL;
+	if (str == NULL)
+		return 0;
+	*copy = nlbl_result_strdup(plan->result, str);
+	return (*copy != NULL ? 0 : -ENOMEM);
+}
+
+/**
+ * Compare the CIPSO configuration of two DOIs
+ * @param a the first CIPSO DOI
+ * @param b the second CIPSO DOI
+ *
+ * Returns true if the configurations are the same, false otherwise.
+ *
+ */
+static int nlbl_config_cipso_equal(const struct nlbl_config_cipso *a,
+				   const struct nlbl_config_cipso *b)
+{
+	return (a->mtype == b->mtype &&
+		a->tags.size == b->tags.size &&
+		a->lvls.size == b->lvls.size &&
+		a->cats.size == b->cats.size &&
+		(a->tags.size == 0 ||
+		 memcmp(a->tags.array, b->tags.array,
+			a->tags.size * sizeof(*a->tags.array)) == 0) &&
+		(a->lvls.size == 0 ||
+		 memcmp(a->lvls.array, b->lvls.array,
+			a->lvls.size * 2 * sizeof(*a->lvls.array)) == 0) &&
+		(a->cats.size == 0 ||
+		 memcmp(a->cats.array, b->cats.array,
+			a->cats.size * 2 * sizeof(*a->cats.array)) == 0));
+}
+
+/**
+ * Plan the CIPSO DOI changes
+ * @param plan the plan
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_config_plan_cipso(struct nlbl_config_planner *plan)
+{
+	const struct nlbl_vec *cur = &plan->cur->cipso;
+	const struct nlbl_vec *want = &plan->want->cipso;
+	const struct nlbl_config_cipso *c;
+	const struct nlbl_config_cipso *w;
+	struct nlbl_config_op *op;
+	nlbl_cip_doi *doi;
+	size_t iter_c = 0;
+	size_t iter_w = 0;
+	int cmp;
+
+	while (iter_c < cur->count || iter_w < want->count) {
+		c = (iter_c < cur->count ?
+		     nlbl_config_elem(cur, iter_c) : NULL);
+		w = (iter_w < want->count ?
+		     nlbl_config_elem(want, iter_w) : NULL);
+		if (c == NULL)
+			cmp = 1;
+		else if (w == NULL)
+			cmp = -1;
+		else
+			cmp = nlbl_config_doi_cmp(c, w);
+
+		if (cmp == 0 && nlbl_config_cipso_equal(c, w)) {
+			iter_c++;
+			iter_w++;
+			continue;
+		}
+		if (cmp <= 0) {
+			/* the DOI is removed or changed, the removed DOIs are
+			 * recorded in order */
+			op = nlbl_config_op_new(plan, NLBL_CONFIG_C_CIPSODEL);
+			doi = nlbl_vec_add(&plan->cip_del);
+			if (op == NULL || doi == NULL)
+				return -ENOMEM;
+			op->doi = c->doi;
+			*doi = c->doi;
+			iter_c++;
+		}
+		if (cmp >= 0) {
+			/* the DOI is added or changed */
+			op = nlbl_config_op_new(plan, NLBL_CONFIG_C_CIPSOADD);
+			if (op == NULL)
+				return -ENOMEM;
+			op->doi = w->doi;
+			op->mtype = w->mtype;
+			op->tags.size = w->tags.size;
+			op->tags.array = nlbl_config_memdup(plan->result,
+						w->tags.array,
+						w->tags.size *
+						sizeof(*w->tags.array));
+			op->lvls.size = w->lvls.size;
+			op->lvls.array = nlbl_config_memdup(plan->result,
+						w->lvls.array,
+						w->lvls.size * 2 *
+						sizeof(*w->lvls.array));
+			op->cats.size = w->cats.size;
+			op->cats.array = nlbl_config_memdup(plan->result,
+						w->cats.array,
+						w->cats.size * 2 *
+						sizeof(*w->cats.array));
+			if ((op->tags.size > 0 && op->tags.array == NULL) ||
+			    (op->lvls.size > 0 && op->lvls.array == NULL) ||
+			    (op->cats.size > 0 && op->cats.array == NULL))
+				return -ENOMEM;
+			iter_w++;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Plan the CALIPSO DOI changes
+ * @param plan the plan
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_config_plan_calipso(struct nlbl_config_planner *plan)
+{
+	const struct nlbl_vec *cur = &plan->cur->calipso;
+	const struct nlbl_vec *want = &plan->want->calipso;
+	const struct nlbl_config_calipso *c;
+	const struct nlbl_config_calipso *w;
+	struct nlbl_config_op *op;
+	nlbl_clp_doi *doi;
+	size_t iter_c = 0;
+	size_t iter_w = 0;
+	int cmp;
+
+	while (iter_c < cur->count || iter_w < want->count) {
+		c = (iter_c < cur->count ?
+		     nlbl_config_elem(cur, iter_c) : NULL);
+		w = (iter_w < want->count ?
+		     nlbl_config_elem(want, iter_w) : NULL);
+		if (c == NULL)
+			cmp = 1;
+		else if (w == NULL)
+			cmp = -1;
+		else
+			cmp = nlbl_config_doi_cmp(c, w);
+
+		if (cmp == 0 && c->mtype == w->mtype) {
+			iter_c++;
+			iter_w++;
+			continue;
+		}
+		if (cmp <= 0) {
+			op = nlbl_config_op_new(plan,
+						NLBL_CONFIG_C_CALIPSODEL);
+			doi = nlbl_vec_add(&plan->clp_del);
+			if (op == NULL || doi == NULL)
+				return -ENOMEM;
+			op->doi = c->doi;
+			*doi = c->doi;
+			iter_c++;
+		}
+		if (cmp >= 0) {
+			op = nlbl_config_op_new(plan,
+						NLBL_CONFIG_C_CALIPSOADD);
+			if (op == NULL)
+				return -ENOMEM;
+			op->doi = w->doi;
+			op->mtype = w->mtype;
+			iter_w++;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Determine if a plan removes a DOI
+ * @param plan the plan
+ * @param proto_type the labeling protocol of the DOI
+ * @param doi the DOI
+ */
+static int nlbl_config_doi_removed(const struct nlbl_config_planner *plan,
+				   nlbl_proto proto_type, uint32_t doi)
+{
+	size_t pos;
+
+	switch (proto_type) {
+	case NETLBL_NLTYPE_CIPSOV4:
+		return nlbl_config_find(&plan->cip_del, &doi,
+					nlbl_config_doi_cmp, &pos);
+	case NETLBL_NLTYPE_CALIPSO:
+		return nlbl_config_find(&plan->clp_del, &doi,
+					nlbl_config_doi_cmp, &pos);
+	default:
+		return 0;
+	}
+}
+
+/**
+ * Determine if a domain mapping uses a DOI removed by a plan
+ * @param plan the plan
+ * @param map the domain mapping
+ */
+static int nlbl_config_map_dirty(const struct nlbl_config_planner *plan,
+				 const struct nlbl_config_map *map)
+{
+	const struct nlbl_dommap_addr *addrsel;
+	size_t iter;
+
+	for (iter = 0; iter < map->addrsel.count; iter++) {
+		addrsel = nlbl_config_elem(&map->addrsel, iter);
+		if (nlbl_config_doi_removed(plan, addrsel->proto_type,
+					    nlbl_config_addrsel_doi(addrsel)))
+			return 1;
+	}
+
+	return nlbl_config_doi_removed(plan, map->proto_type, map->doi);
+}
+
+/**
+ * Compare the address selectors of two domain mappings
+ * @param a the first domain mapping
+ * @param b the second domain mapping
+ *
+ * Returns true if every address selector of @a is also in @b, false
+ * otherwise.
+ *
+ */
+static int nlbl_config_addrsel_subset(const struct nlbl_config_map *a,
+				      const struct nlbl_config_map *b)
+{
+	const struct nlbl_dommap_addr *sel_a;
+	const struct nlbl_dommap_addr *sel_b;
+	size_t iter_a;
+	size_t iter_b = 0;
+
+	for (iter_a = 0; iter_a < a->addrsel.count; iter_a++) {
+		sel_a = nlbl_config_elem(&a->addrsel, iter_a);
+		for (; iter_b < b->addrsel.count; iter_b++) {
+			sel_b = nlbl_config_elem(&b->addrsel, iter_b);
+			if (nlbl_config_addrsel_cmp(sel_a, sel_b) <= 0)
+				break;
+		}
+		if (iter_b == b->addrsel.count)
+			return 0;
+		sel_b = nlbl_config_elem(&b->addrsel, iter_b);
+		if (nlbl_config_addrsel_cmp(sel_a, sel_b) != 0 ||
+		    sel_a->proto_type != sel_b->proto_type ||
+		    nlbl_config_addrsel_doi(sel_a) !=
+		    nlbl_config_addrsel_doi(sel_b))
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Determine if a domain mapping can be reached by only adding to another
+ * @param c the current domain mapping
+ * @param w the wanted domain mapping
+ *
+ * Returns true if @w is @c with zero or more address selectors added, false
+ * otherwise.
+ *
+ */
+static int nlbl_config_map_grows(const struct nlbl_config_map *c,
+				 const struct nlbl_config_map *w)
+{
+	if (c->family != w->family || c->proto_type != w->proto_type)
+		return 0;
+	if (c->proto_type != NETLBL_NLTYPE_ADDRSELECT)
+		return (c->doi == w->doi);
+	return nlbl_config_addrsel_subset(c, w);
+}
+
+/**
+ * Add the operations which add a domain mapping to a plan
+ * @param plan the plan
+ * @param w the wanted domain mapping
+ * @param c the current domain mapping, or NULL
+ *
+ * Add the operations needed to turn @c into @w, @c must be NULL or a mapping
+ * which @w grows from, see nlbl_config_map_grows().  Returns zero on success,
+ * negative values on failure.
+ *
+ */
+static int nlbl_config_plan_map_add(struct nlbl_config_planner *plan,
+				    const struct nlbl_config_map *w,
+				    const struct nlbl_config_map *c)
+{
+	int rc;
+	struct nlbl_config_op *op;
+	const struct nlbl_dommap_addr *addrsel;
+	char *domain;
+	size_t pos;
+	size_t iter;
+
+	rc = nlbl_config_op_strdup(plan, w->domain, &domain);
+	if (rc < 0)
+		return rc;
+
+	if (w->proto_type != NETLBL_NLTYPE_ADDRSELECT) {
+		if (c != NULL)
+			return 0;
+		op = nlbl_config_op_new(plan, NLBL_CONFIG_C_MAPADD);
+		if (op == NULL)
+			return -ENOMEM;
+		op->domain.domain = domain;
+		op->domain.family = w->family;
+		op->domain.proto_type = w->proto_type;
+		op->domain.proto.cip_doi = w->doi;
+		return 0;
+	}
+
+	for (iter = 0; iter < w->addrsel.count; iter++) {
+		addrsel = nlbl_config_elem(&w->addrsel, iter);
+		if (c != NULL && nlbl_config_find(&c->addrsel, addrsel,
+						  nlbl_config_addrsel_cmp,
+						  &pos))
+			continue;
+		op = nlbl_config_op_new(plan, NLBL_CONFIG_C_MAPADD);
+		if (op == NULL)
+			return -ENOMEM;
+		op->domain.domain = domain;
+		op->domain.family = w->family;
+		op->domain.proto_type = addrsel->proto_type;
+		op->domain.proto.cip_doi = nlbl_config_addrsel_doi(addrsel);
+		op->addr.addr = addrsel->addr;
+	}
+
+	return 0;
+}
+
+/**
+ * Plan the domain mapping changes of a single domain
+ * @param plan the plan
+ * @param cur the domain's current mappings
+ * @param want the domain's wanted mappings
+ *
+ * The kernel can only remove every mapping of a domain at once, and can only
+ * add address selectors to an existing mapping.  If the wanted mappings can be
+ * reached by adding to the current mappings only the additions are planned,
+ * otherwise the domain is removed and added again.  Returns zero on success,
+ * negative values on failure.
+ *
+ */
+static int nlbl_config_plan_domain(struct nlbl_config_planner *plan,
+				   const struct nlbl_config_range *cur,
+				   const struct nlbl_config_range *want)
+{
+	int rc;
+	const struct nlbl_config_map *c;
+	const struct nlbl_config_map *w;
+	struct nlbl_config_op *op;
+	int grows = 1;
+	int same;
+	size_t iter_c;
+	size_t iter_w;
+
+	/* every current mapping must grow into a wanted mapping */
+	for (iter_c = cur->start; grows && iter_c < cur->end; iter_c++) {
+		c = nlbl_config_elem(&plan->cur->maps, iter_c);
+		if (nlbl_config_map_dirty(plan, c)) {
+			grows = 0;
+			break;
+		}
+		same = 0;
+		for (iter_w = want->start; iter_w < want->end; iter_w++) {
+			w = nlbl_config_elem(&plan->want->maps, iter_w);
+			if (nlbl_config_map_grows(c, w)) {
+				same = 1;
+				break;
+			}
+		}
+		grows = same;
+	}
+
+	if (!grows) {
+		c = nlbl_config_elem(&plan->cur->maps, cur->start);
+		op = nlbl_config_op_new(plan, NLBL_CONFIG_C_MAPDEL);
+		if (op == NULL)
+			return -ENOMEM;
+		rc = nlbl_config_op_strdup(plan, c->domain,
+					   &op->domain.domain);
+		if (rc < 0)
+			return rc;
+	}
+
+	for (iter_w = want->start; iter_w < want->end; iter_w++) {
+		w = nlbl_config_elem(&plan->want->maps, iter_w);
+		c = NULL;
+		for (iter_c = cur->start; grows && iter_c < cur->end;
+		     iter_c++) {
+			c = nlbl_config_elem(&plan->cur->maps, iter_c);
+			if (c->family == w->family)
+				break;
+			c = NULL;
+		}
+		rc = nlbl_config_plan_map_add(plan, w, c);
+		if (rc < 0)
+			return rc;
+	}
+
+	return 0;
+}
+
+/**
+ * Plan the domain mapping changes
+ * @param plan the plan
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_config_plan_maps(struct nlbl_config_planner *plan)
+{
+	int rc;
+	const struct nlbl_vec *cur = &plan->cur->maps;
+	const struct nlbl_vec *want = &plan->want->maps;
+	const struct nlbl_config_map *c;
+	const struct nlbl_config_map *w;
+	struct nlbl_config_range range_c = { 0, 0 };
+	struct nlbl_config_range range_w = { 0, 0 };
+	int cmp;
+
+	while (range_c.end < cur->count || range_w.end < want->count) {
+		c = (range_c.end < cur->count ?
+		     nlbl_config_elem(cur, range_c.end) : NULL);
+		w = (range_w.end < want->count ?
+		     nlbl_config_elem(want, range_w.end) : NULL);
+		if (c == NULL)
+			cmp = 1;
+		else if (w == NULL)
+			cmp = -1;
+		else
+			cmp = nlbl_config_strcmp(c->domain, w->domain);
+
+		/* find the mappings of the next domain on each side */
+		range_c.start = range_c.end;
+		range_w.start = range_w.end;
+		if (cmp <= 0)
+			nlbl_config_map_range(plan->cur, c->domain, &range_c);
+		if (cmp >= 0)
+			nlbl_config_map_range(plan->want, w->domain,
+					      &range_w);
+
+		rc = nlbl_config_plan_domain(plan, &range_c, &range_w);
+		if (rc < 0)
+			return rc;
+	}
+
+	return 0;
+}
+
+/**
+ * Plan the static label changes
+ * @param plan the plan
+ *
+ * The kernel can't change the label of a static label, a changed label is
+ * removed and added again.  Returns zero on success, negative values on
+ * failure.
+ *
+ */
+static int nlbl_config_plan_addrs(struct nlbl_config_planner *plan)
+{
+	int rc;
+	const struct nlbl_vec *cur = &plan->cur->addrs;
+	const struct nlbl_vec *want = &plan->want->addrs;
+	const struct nlbl_addrmap *c;
+	const struct nlbl_addrmap *w;
+	struct nlbl_config_op *op;
+	size_t iter_c = 0;
+	size_t iter_w = 0;
+	int cmp;
+
+	while (iter_c < cur->count || iter_w < want->count) {
+		c = (iter_c < cur->count ?
+		     nlbl_config_elem(cur, iter_c) : NULL);
+		w = (iter_w < want->count ?
+		     nlbl_config_elem(want, iter_w) : NULL);
+		if (c == NULL)
+			cmp = 1;
+		else if (w == NULL)
+			cmp = -1;
+		else
+			cmp = nlbl_config_addrmap_cmp(c, w);
+
+		if (cmp == 0 && strcmp(c->label, w->label) == 0) {
+			iter_c++;
+			iter_w++;
+			continue;
+		}
+		if (cmp <= 0) {
+			op = nlbl_config_op_new(plan,
+						NLBL_CONFIG_C_STATICDEL);
+			if (op == NULL)
+				return -ENOMEM;
+			op->addr.addr = c->addr;
+			rc = nlbl_config_op_strdup(plan, c->dev, &op->addr.dev);
+			if (rc < 0)
+				return rc;
+			iter_c++;
+		}
+		if (cmp >= 0) {
+			op = nlbl_config_op_new(plan,
+						NLBL_CONFIG_C_STATICADD);
+			if (op == NULL)
+				return -ENOMEM;
+			op->addr.addr = w->addr;
+			rc = nlbl_config_op_strdup(plan, w->dev, &op->addr.dev);
+			if (rc < 0)
+				return rc;
+			rc = nlbl_config_op_strdup(plan, w->label,
+						   &op->addr.label);
+			if (rc < 0)
+				return rc;
+			iter_w++;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Queue a configuration operation on a batching NetLabel handle
+ * @param hndl the NetLabel handle
+ * @param op the operation
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_config_op_queue(struct nlbl_handle *hndl,
+				const struct nlbl_config_op *op)
+{
+	struct nlbl_dommap domain = op->domain;
+	struct nlbl_addrmap addr = op->addr;
+	struct nlbl_cip_tag_a tags = op->tags;
+	struct nlbl_cip_lvl_a lvls = op->lvls;
+	struct nlbl_cip_cat_a cats = op->cats;
+
+	switch (op->cmd) {
+	case NLBL_CONFIG_C_MAPDEL:
+		if (domain.domain == NULL)
+			return nlbl_mgmt_deldef(hndl);
+		return nlbl_mgmt_del(hndl, domain.domain);
+	case NLBL_CONFIG_C_STATICDEL:
+		if (addr.dev == NULL)
+			return nlbl_unlbl_staticdeldef(hndl, &addr.addr);
+		return nlbl_unlbl_staticdel(hndl, addr.dev, &addr.addr);
+	case NLBL_CONFIG_C_CIPSODEL:
+		return nlbl_cipso_del(hndl, op->doi);
+	case NLBL_CONFIG_C_CALIPSODEL:
+		return nlbl_calipso_del(hndl, op->doi);
+	case NLBL_CONFIG_C_CIPSOADD:
+		switch (op->mtype) {
+		case CIPSO_V4_MAP_TRANS:
+			return nlbl_cipso_add_trans(hndl, op->doi,
+						    &tags, &lvls, &cats);
+		case CIPSO_V4_MAP_PASS:
+			return nlbl_cipso_add_pass(hndl, op->doi, &tags);
+		case CIPSO_V4_MAP_LOCAL:
+			return nlbl_cipso_add_local(hndl, op->doi);
+		}
+		return -EINVAL;
+	case NLBL_CONFIG_C_CALIPSOADD:
+		return nlbl_calipso_add_pass(hndl, op->doi);
+	case NLBL_CONFIG_C_MAPADD:
+		if (domain.domain == NULL)
+			return nlbl_mgmt_adddef(hndl, &domain, &addr.addr);
+		return nlbl_mgmt_add(hndl, &domain, &addr.addr);
+	case NLBL_CONFIG_C_STATICADD:
+		if (addr.dev == NULL)
+			return nlbl_unlbl_staticadddef(hndl, &addr.addr,
+						       addr.label);
+		return nlbl_unlbl_staticadd(hndl, addr.dev, &addr.addr,
+					    addr.label);
+	case NLBL_CONFIG_C_ACCEPT:
+		return nlbl_unlbl_accept(hndl, op->accept);
+	default:
+		return -EINVAL;
+	}
+}
+
+/*
+ * Fingerprint Helper Functions
+ */
+
+/**
+ * Add bytes to a configuration fingerprint
+ * @param fp the fingerprint
+ * @param data the bytes
+ * @param len the number of bytes
+ */
+static void nlbl_config_fp_bytes(uint64_t *fp, const void *data, size_t len)
+{
+	const unsigned char *iter = data;
+
+	/* FNV-1a */
+	while (len-- > 0) {
+		*fp ^= *iter++;
+		*fp *= 1099511628211ull;
+	}
+}
+
+/**
+ * Add a number to a configuration fingerprint
+ * @param fp the fingerprint
+ * @param val the number
+ *
+ * The number is added least significant byte first so that the fingerprint
+ * doesn't depend on the byte order of the system.
+ *
+ */
+static void nlbl_config_fp_u32(uint64_t *fp, uint32_t val)
+{
+	unsigned char bytes[4];
+
+	bytes[0] = val;
+	bytes[1] = val >> 8;
+	bytes[2] = val >> 16;
+	bytes[3] = val >> 24;
+	nlbl_config_fp_bytes(fp, bytes, sizeof(bytes));
+}
+
+/**
+ * Add a string to a configuration fingerprint
+ * @param fp the fingerprint
+ * @param str the string, may be NULL
+ */
+static void nlbl_config_fp_str(uint64_t *fp, const char *str)
+{
+	if (str == NULL) {
+		nlbl_config_fp_u32(fp, UINT32_MAX);
+		return;
+	}
+	nlbl_config_fp_u32(fp, strlen(str));
+	nlbl_config_fp_bytes(fp, str, strlen(str));
+}
+
+/**
+ * Add a network address to a configuration fingerprint
+ * @param fp the fingerprint
+ * @param addr the normalized network address
+ */
+static void nlbl_config_fp_addr(uint64_t *fp, const struct nlbl_netaddr *addr)
+{
+	nlbl_config_fp_u32(fp, addr->type);
+	if (addr->type == AF_INET) {
+		nlbl_config_fp_bytes(fp, &addr->addr.v4, sizeof(addr->addr.v4));
+		nlbl_config_fp_bytes(fp, &addr->mask.v4, sizeof(addr->mask.v4));
+	} else {
+		nlbl_config_fp_bytes(fp, &addr->addr.v6, sizeof(addr->addr.v6));
+		nlbl_config_fp_bytes(fp, &addr->mask.v6, sizeof(addr->mask.v6));
+	}
+}
+
+/*
+ * Configuration Functions
+ */
+
+/**
+ * Create a new configuration
+ *
+ * Create a new configuration matching the configuration the kernel starts
+ * with: unlabeled traffic is accepted, and the default domain mapping sends
+ * all traffic unlabeled.  The configuration is changed with the
+ * nlbl_config_*() operations, which mirror the NetLabel operations of the
+ * same name and follow the kernel's rules, so that running a NetLabel
+ * configuration file against it produces the same configuration as running
+ * it against a freshly booted kernel.  The caller is responsible for freeing
+ * the configuration with nlbl_config_free().  Returns a pointer to the
+ * configuration on success, NULL on failure.
+ *
+ */
+struct nlbl_config *nlbl_config_new(void)
+{
+	struct nlbl_config *cfg;
+	struct nlbl_dommap def;
+
+	cfg = nlbl_config_alloc();
+	if (cfg == NULL)
+		return NULL;
+
+	cfg->accept = 1;
+	memset(&def, 0, sizeof(def));
+	def.family = AF_UNSPEC;
+	def.proto_type = NETLBL_NLTYPE_UNLABELED;
+	if (nlbl_config_mgmt_adddef(cfg, &def, NULL) < 0) {
+		nlbl_config_free(cfg);
+		return NULL;
+	}
+
+	return cfg;
+}
+
+/**
+ * Snapshot the kernel's configuration
+ * @param hndl the NetLabel handle
+ * @param cfg the configuration
+ *
+ * Read the kernel's entire NetLabel configuration, using the existing list
+ * operations, into a new configuration.  If @hndl is NULL then the library's
+ * default NetLabel handle is used.  The caller is responsible for freeing the
+ * configuration with nlbl_config_free().  Returns zero on success, negative
+ * values on failure.
+ *
+ */
+int nlbl_config_load(struct nlbl_handle *hndl, struct nlbl_config **cfg)
+{
+	int rc;
+	struct nlbl_config *config;
+
+	/* sanity checks */
+	if (cfg == NULL)
+		return -EINVAL;
+	/* the configuration must be complete before we return */
+	if (nlbl_async_active(hndl))
+		return -EBUSY;
+
+	config = nlbl_config_alloc();
+	if (config == NULL)
+		return -ENOMEM;
+
+	/* the DOIs first, the domain mappings refer to them */
+	rc = nlbl_config_cipso_load(hndl, config);
+	if (rc < 0)
+		goto load_return;
+	rc = nlbl_config_calipso_load(hndl, config);
+	if (rc < 0)
+		goto load_return;
+	rc = nlbl_mgmt_listall_iter(hndl, nlbl_config_map_load_cb, config);
+	if (rc < 0)
+		goto load_return;
+	rc = nlbl_config_mapdef_load(hndl, config);
+	if (rc < 0)
+		goto load_return;
+	rc = nlbl_unlbl_staticlist_iter(hndl,
+					nlbl_config_addrmap_load_cb, config);
+	if (rc < 0)
+		goto load_return;
+	rc = nlbl_unlbl_staticlistdef_iter(hndl,
+					   nlbl_config_addrmapdef_load_cb,
+					   config);
+	if (rc < 0)
+		goto load_return;
+	rc = nlbl_unlbl_list(hndl, &config->accept);
+	if (rc < 0)
+		goto load_return;
+	rc = 0;
+
+	*cfg = config;
+
+load_return:
+	if (rc < 0)
+		nlbl_config_free(config);
+	return rc;
+}
+
+/**
+ * Free a configuration
+ * @param cfg the configuration
+ *
+ * Free @cfg along with every entry and string in it.
+ *
+ */
+void nlbl_config_free(struct nlbl_config *cfg)
+{
+	size_t iter;
+
+	if (cfg == NULL)
+		return;
+
+	for (iter = 0; iter < cfg->maps.count; iter++)
+		nlbl_vec_free(&((struct nlbl_config_map *)
+				nlbl_config_elem(&cfg->maps, iter))->addrsel);
+	nlbl_vec_free(&cfg->maps);
+	nlbl_vec_free(&cfg->cipso);
+	nlbl_vec_free(&cfg->calipso);
+	nlbl_vec_free(&cfg->addrs);
+	nlbl_result_free(cfg->result);
+	free(cfg);
+}
+
+/**
+ * Add a domain mapping to a configuration
+ * @param cfg the configuration
+ * @param domain the NetLabel domain map
+ * @param addr the network IP address, may be NULL
+ *
+ * Same as nlbl_mgmt_add() but changes @cfg instead of the kernel.  Returns
+ * zero on success, negative values on failure.
+ *
+ */
+int nlbl_config_mgmt_add(struct nlbl_config *cfg,
+			 const struct nlbl_dommap *domain,
+			 const struct nlbl_netaddr *addr)
+{
+	if (domain == NULL || domain->domain == NULL)
+		return -EINVAL;
+	return nlbl_config_map_add(cfg, domain->domain, domain, addr);
+}
+
+/**
+ * Add the default domain mapping to a configuration
+ * @param cfg the configuration
+ * @param domain the NetLabel domain map
+ * @param addr the network IP address, may be NULL
+ *
+ * Same as nlbl_mgmt_adddef() but changes @cfg instead of the kernel.  Returns
+ * zero on success, negative values on failure.
+ *
+ */
+int nlbl_config_mgmt_adddef(struct nlbl_config *cfg,
+			    const struct nlbl_dommap *domain,
+			    const struct nlbl_netaddr *addr)
+{
+	return nlbl_config_map_add(cfg, NULL, domain, addr);
+}
+
+/**
+ * Remove a domain mapping from a configuration
+ * @param cfg the configuration
+ * @param domain the domain
+ *
+ * Same as nlbl_mgmt_del() but changes @cfg instead of the kernel.  Returns
+ * zero on success, negative values on failure.
+ *
+ */
+int nlbl_config_mgmt_del(struct nlbl_config *cfg, const char *domain)
+{
+	if (domain == NULL)
+		return -EINVAL;
+	return nlbl_config_map_del(cfg, domain);
+}
+
+/**
+ * Remove the default domain mapping from a configuration
+ * @param cfg the configuration
+ *
+ * Same as nlbl_mgmt_deldef() but changes @cfg instead of the kernel.  Returns
+ * zero on success, negative values on failure.
+ *
+ */
+int nlbl_config_mgmt_deldef(struct nlbl_config *cfg)
+{
+	return nlbl_config_map_del(cfg, NULL);
+}
+
+/**
+ * Set the unlabeled accept flag of a configuration
+ * @param cfg the configuration
+ * @param allow_flag the desired accept flag setting
+ *
+ * Same as nlbl_unlbl_accept() but changes @cfg instead of the kernel.
+ * Returns zero on success, negative values on failure.
+ *
+ */
+int nlbl_config_unlbl_accept(struct nlbl_config *cfg, uint8_t allow_flag)
+{
+	if (cfg == NULL)
+		return -EINVAL;
+	cfg->accept = (allow_flag ? 1 : 0);
+	return 0;
+}
+
+/**
+ * Add a static label to a configuration
+ * @param cfg the configuration
+ * @param dev the network interface
+ * @param addr the network IP address
+ * @param label the security label
+ *
+ * Same as nlbl_unlbl_staticadd() but changes @cfg instead of the kernel.
+ * Returns zero on success, negative values on failure.
+ *
+ */
+int nlbl_config_unlbl_staticadd(struct nlbl_config *cfg,
+				const char *dev,
+				const struct nlbl_netaddr *addr,
+				const char *label)
+{
+	if (dev == NULL)
+		return -EINVAL;
+	return nlbl_config_addrmap_add(cfg, dev, addr, label);
+}
+
+/**
+ * Add a default static label to a configuration
+ * @param cfg the configuration
+ * @param addr the network IP address
+ * @param label the security label
+ *
+ * Same as nlbl_unlbl_staticadddef() but changes @cfg instead of the kernel.
+ * Returns zero on success, negative values on failure.
+ *
+ */
+int nlbl_config_unlbl_staticadddef(struct nlbl_config *cfg,
+				   const struct nlbl_netaddr *addr,
+				   const char *label)
+{
+	return nlbl_config_addrmap_add(cfg, NULL, addr, label);
+}
+
+/**
+ * Remove a static label from a configuration
+ * @param cfg the configuration
+ * @param dev the network interface
+ * @param addr the network IP address
+ *
+ * Same as nlbl_unlbl_staticdel() but changes @cfg instead of the kernel.
+ * Returns zero on success, negative values on failure.
+ *
+ */
+int nlbl_config_unlbl_staticdel(struct nlbl_config *cfg,
+				const char *dev,
+				const struct nlbl_netaddr *addr)
+{
+	if (dev == NULL)
+		return -EINVAL;
+	return nlbl_config_addrmap_del(cfg, dev, addr);
+}
+
+/**
+ * Remove a default static label from a configuration
+ * @param cfg the configuration
+ * @param addr the network IP address
+ *
+ * Same as nlbl_unlbl_staticdeldef() but changes @cfg instead of the kernel.
+ * Returns zero on success, negative values on failure.
+ *
+ */
+int nlbl_config_unlbl_staticdeldef(struct nlbl_config *cfg,
+				   const struct nlbl_netaddr *addr)
+{
+	return nlbl_config_addrmap_del(cfg, NULL, addr);
+}
+
+/**
+ * Add a translated CIPSO DOI to a configuration
+ * @param cfg the configuration
+ * @param doi the CIPSO DOI number
+ * @param tags array of tags
+ * @param lvls array of level mappings
+ * @param cats array of category mappings, may be NULL
+ *
+ * Same as nlbl_cipso_add_trans() but changes @cfg instead of the kernel.
+ * Returns zero on success, negative values on failure.
+ *
+ */
+int nlbl_config_cipso_add_trans(struct nlbl_config *cfg,
+				nlbl_cip_doi doi,
+				const struct nlbl_cip_tag_a *tags,
+				const struct nlbl_cip_lvl_a *lvls,
+				const struct nlbl_cip_cat_a *cats)
+{
+	if (tags == NULL || tags->size == 0 || lvls == NULL || lvls->size == 0)
+		return -EINVAL;
+	return nlbl_config_cipso_add(cfg, doi, CIPSO_V4_MAP_TRANS,
+				     tags, lvls, cats);
+}
+
+/**
+ * Add a pass-through CIPSO DOI to a configuration
+ * @param cfg the configuration
+ * @param doi the CIPSO DOI number
+ * @param tags array of tags
+ *
+ * Same as nlbl_cipso_add_pass() but changes @cfg instead of the kernel.
+ * Returns zero on success, negative values on failure.
+ *
+ */
+int nlbl_config_cipso_add_pass(struct nlbl_config *cfg,
+			       nlbl_cip_doi doi,
+			       const struct nlbl_cip_tag_a *tags)
+{
+	if (tags == NULL || tags->size == 0)
+		return -EINVAL;
+	return nlbl_config_cipso_add(cfg, doi, CIPSO_V4_MAP_PASS,
+				     tags, NULL, NULL);
+}
+
+/**
+ * Add a local CIPSO DOI to a configuration
+ * @param cfg the configuration
+ * @param doi the CIPSO DOI number
+ *
+ * Same as nlbl_cipso_add_local() but changes @cfg instead of the kernel.
+ * Returns zero on success, negative values on failure.
+ *
+ */
+int nlbl_config_cipso_add_local(struct nlbl_config *cfg, nlbl_cip_doi doi)
+{
+	/* the kernel lists the local tag for local DOIs */
+	nlbl_cip_tag tag = 128;
+	struct nlbl_cip_tag_a tags = { .array = &tag, .size = 1 };
+
+	return nlbl_config_cipso_add(cfg, doi, CIPSO_V4_MAP_LOCAL,
+				     &tags, NULL, NULL);
+}
+
+/**
+ * Remove a CIPSO DOI from a configuration
+ * @param cfg the configuration
+ * @param doi the CIPSO DOI number
+ *
+ * Same as nlbl_cipso_del() but changes @cfg instead of the kernel.  Returns
+ * zero on success, negative values on failure.
+ *
+ */
+int nlbl_config_cipso_del(struct nlbl_config *cfg, nlbl_cip_doi doi)
+{
+	if (cfg == NULL)
+		return -EINVAL;
+	return nlbl_config_doi_del(cfg, &cfg->cipso,
+				   NETLBL_NLTYPE_CIPSOV4, doi);
+}
+
+/**
+ * Add a pass-through CALIPSO DOI to a configuration
+ * @param cfg the configuration
+ * @param doi the CALIPSO DOI number
+ *
+ * Same as nlbl_calipso_add_pass() but changes @cfg instead of the kernel.
+ * Returns zero on success, negative values on failure.
+ *
+ */
+int nlbl_config_calipso_add_pass(struct nlbl_config *cfg, nlbl_clp_doi doi)
+{
+	struct nlbl_config_calipso key;
+	struct nlbl_config_calipso *entry;
+	size_t pos;
+
+	/* sanity checks */
+	if (cfg == NULL || doi == 0)
+		return -EINVAL;
+
+	key.doi = doi;
+	key.mtype = CALIPSO_MAP_PASS;
+	if (nlbl_config_find(&cfg->calipso, &key, nlbl_config_doi_cmp, &pos))
+		return -EEXIST;
+	entry = nlbl_config_insert(&cfg->calipso, pos);
+	if (entry == NULL)
+		return -ENOMEM;
+	*entry = key;
+
+	return 0;
+}
+
+/**
+ * Remove a CALIPSO DOI from a configuration
+ * @param cfg the configuration
+ * @param doi the CALIPSO DOI number
+ *
+ * Same as nlbl_calipso_del() but changes @cfg instead of the kernel.  Returns
+ * zero on success, negative values on failure.
+ *
+ */
+int nlbl_config_calipso_del(struct nlbl_config *cfg, nlbl_clp_doi doi)
+{
+	if (cfg == NULL)
+		return -EINVAL;
+	return nlbl_config_doi_del(cfg, &cfg->calipso,
+				   NETLBL_NLTYPE_CALIPSO, doi);
+}
+
+/**
+ * Plan the changes needed to reach a configuration
+ * @param cur the current configuration
+ * @param want the wanted configuration
+ * @param ops the operations
+ * @param result the result set
+ *
+ * Compare @cur, usually a snapshot from nlbl_config_load(), with @want and
+ * build the shortest list of operations which turns @cur into @want.  The
+ * operations are ordered so that the kernel accepts them: domain mappings and
+ * static labels are removed first, then the DOIs are removed, the DOIs are
+ * added, and the domain mappings and static labels are added last.  A domain
+ * mapping which uses a removed or changed DOI is removed and added again.  The
+ * operations, and their strings and arrays, are stored in @result, which the
+ * caller must free with nlbl_result_free().  Returns the number of operations
+ * on success, zero if the configurations are the same, and negative values on
+ * failure.
+ *
+ */
+int nlbl_config_plan(const struct nlbl_config *cur,
+		     const struct nlbl_config *want,
+		     struct nlbl_config_op **ops,
+		     struct nlbl_result **result)
+{
+	int rc;
+	struct nlbl_config_planner plan;
+	struct nlbl_vec all;
+	struct nlbl_config_op *op;
+	unsigned int cmd;
+	size_t iter;
+
+	/* sanity checks */
+	if (cur == NULL || want == NULL || ops == NULL || result == NULL)
+		return -EINVAL;
+
+	memset(&plan, 0, sizeof(plan));
+	plan.cur = cur;
+	plan.want = want;
+	for (cmd = 0; cmd < NLBL_CONFIG_C_MAX; cmd++)
+		nlbl_vec_init(&plan.ops[cmd], sizeof(struct nlbl_config_op), 0);
+	nlbl_vec_init(&plan.cip_del, sizeof(nlbl_cip_doi), 0);
+	nlbl_vec_init(&plan.clp_del, sizeof(nlbl_clp_doi), 0);
+	nlbl_vec_init(&all, sizeof(struct nlbl_config_op), 0);
+	plan.result = nlbl_result_new();
+	if (plan.result == NULL)
+		return -ENOMEM;
+
+	/* the DOIs first, the domain mappings depend on them */
+	rc = nlbl_config_plan_cipso(&plan);
+	if (rc < 0)
+		goto plan_return;
+	rc = nlbl_config_plan_calipso(&plan);
+	if (rc < 0)
+		goto plan_return;
+	rc = nlbl_config_plan_maps(&plan);
+	if (rc < 0)
+		goto plan_return;
+	rc = nlbl_config_plan_addrs(&plan);
+	if (rc < 0)
+		goto plan_return;
+	if (cur->accept != want->accept) {
+		op = nlbl_config_op_new(&plan, NLBL_CONFIG_C_ACCEPT);
+		if (op == NULL) {
+			rc = -ENOMEM;
+			goto plan_return;
+		}
+		op->accept = want->accept;
+	}
+
+	/* the operation types are numbered in the order they must run */
+	for (cmd = 0; cmd < NLBL_CONFIG_C_MAX; cmd++) {
+		for (iter = 0; iter < plan.ops[cmd].count; iter++) {
+			op = nlbl_vec_add(&all);
+			if (op == NULL) {
+				rc = -ENOMEM;
+				goto plan_return;
+			}
+			*op = *(struct nlbl_config_op *)
+				nlbl_config_elem(&plan.ops[cmd], iter);
+		}
+	}
+	rc = all.count;
+	*ops = nlbl_vec_finish(&all);
+	nlbl_result_adopt(plan.result, *ops);
+	*result = plan.result;
+	plan.result = NULL;
+
+plan_return:
+	for (cmd = 0; cmd < NLBL_CONFIG_C_MAX; cmd++)
+		nlbl_vec_free(&plan.ops[cmd]);
+	nlbl_vec_free(&plan.cip_del);
+	nlbl_vec_free(&plan.clp_del);
+	nlbl_vec_free(&all);
+	nlbl_result_free(plan.result);
+	return rc;
+}
+
+/**
+ * Apply a list of configuration operations
+ * @param hndl the NetLabel handle
+ * @param ops the operations
+ * @param count the number of operations
+ * @param results the operation results
+ *
+ * Send the operations in @ops, usually from nlbl_config_plan(), to the kernel
+ * in a single batch, see nlbl_batch_begin().  The result of each operation is
+ * stored in @results, in the same order as @ops, as either zero or a negative
+ * error code; the caller is responsible for freeing @results.  If @hndl is
+ * NULL then a temporary NetLabel handle is used.  Returns the number of
+ * operations sent on success, negative values on failure.  On failure some of
+ * the operations may have been applied.
+ *
+ */
+int nlbl_config_apply(struct nlbl_handle *hndl,
+		      const struct nlbl_config_op *ops, size_t count,
+		      int **results)
+{
+	int rc;
+	struct nlbl_handle *p_hndl = hndl;
+	size_t iter;
+
+	/* sanity checks */
+	if ((ops == NULL && count > 0) || results == NULL)
+		return -EINVAL;
+
+	/* batching needs a handle of its own */
+	if (p_hndl == NULL) {
+		p_hndl = nlbl_comm_open();
+		if (p_hndl == NULL)
+			return -ENOMEM;
+	}
+
+	rc = nlbl_batch_begin(p_hndl);
+	if (rc < 0)
+		goto apply_return;
+	for (iter = 0; iter < count; iter++) {
+		rc = nlbl_config_op_queue(p_hndl, &ops[iter]);
+		if (rc < 0) {
+			nlbl_batch_abort(p_hndl);
+			goto apply_return;
+		}
+	}
+	rc = nlbl_batch_commit(p_hndl, results);
+
+apply_return:
+	if (hndl == NULL)
+		nlbl_comm_close(p_hndl);
+	return rc;
+}
+
+/**
+ * Compute the fingerprint of a configuration
+ * @param cfg the configuration
+ * @param fingerprint the fingerprint
+ *
+ * Compute a 64 bit FNV-1a hash of every entry in @cfg.  The entries are kept
+ * sorted and normalized, so two configurations have the same fingerprint
+ * whenever nlbl_config_plan() finds no changes between them, whatever order
+ * the entries were added in and on whatever system.  Comparing the
+ * fingerprint of the kernel's configuration with a stored fingerprint is a
+ * cheap way to detect changes.  Returns zero on success, negative values on
+ * failure.
+ *
+ */
+int nlbl_config_fingerprint(const struct nlbl_config *cfg,
+			    uint64_t *fingerprint)
+{
+	const struct nlbl_config_cipso *cipso;
+	const struct nlbl_config_calipso *calipso;
+	const struct nlbl_config_map *map;
+	const struct nlbl_dommap_addr *addrsel;
+	const struct nlbl_addrmap *addr;
+	uint64_t fp = 14695981039346656037ull;
+	size_t iter;
+	size_t iter_a;
+
+	/* sanity checks */
+	if (cfg == NULL || fingerprint == NULL)
+		return -EINVAL;
+
+	nlbl_config_fp_u32(&fp, cfg->accept);
+
+	nlbl_config_fp_u32(&fp, cfg->cipso.count);
+	for (iter = 0; iter < cfg->cipso.count; iter++) {
+		cipso = nlbl_config_elem(&cfg->cipso, iter);
+		nlbl_config_fp_u32(&fp, cipso->doi);
+		nlbl_config_fp_u32(&fp, cipso->mtype);
+		nlbl_config_fp_u32(&fp, cipso->tags.size);
+		nlbl_config_fp_bytes(&fp, cipso->tags.array, cipso->tags.size);
+		nlbl_config_fp_u32(&fp, cipso->lvls.size);
+		for (iter_a = 0; iter_a < cipso->lvls.size * 2; iter_a++)
+			nlbl_config_fp_u32(&fp, cipso->lvls.array[iter_a]);
+		nlbl_config_fp_u32(&fp, cipso->cats.size);
+		for (iter_a = 0; iter_a < cipso->cats.size * 2; iter_a++)
+			nlbl_config_fp_u32(&fp, cipso->cats.array[iter_a]);
+	}
+
+	nlbl_config_fp_u32(&fp, cfg->calipso.count);
+	for (iter = 0; iter < cfg->calipso.count; iter++) {
+		calipso = nlbl_config_elem(&cfg->calipso, iter);
+		nlbl_config_fp_u32(&fp, calipso->doi);
+		nlbl_config_fp_u32(&fp, calipso->mtype);
+	}
+
+	nlbl_config_fp_u32(&fp, cfg->maps.count);
+	for (iter = 0; iter < cfg->maps.count; iter++) {
+		map = nlbl_config_elem(&cfg->maps, iter);
+		nlbl_config_fp_str(&fp, map->domain);
+		nlbl_config_fp_u32(&fp, map->family);
+		nlbl_config_fp_u32(&fp, map->proto_type);
+		nlbl_config_fp_u32(&fp, map->doi);
+		nlbl_config_fp_u32(&fp, map->addrsel.count);
+		for (iter_a = 0; iter_a < map->addrsel.count; iter_a++) {
+			addrsel = nlbl_config_elem(&map->addrsel, iter_a);
+			nlbl_config_fp_addr(&fp, &addrsel->addr);
+			nlbl_config_fp_u32(&fp, addrsel->proto_type);
+			nlbl_config_fp_u32(&fp,
+					   nlbl_config_addrsel_doi(addrsel));
+		}
+	}
+
+	nlbl_config_fp_u32(&fp, cfg->addrs.count);
+	for (iter = 0; iter < cfg->addrs.count; iter++) {
+		addr = nlbl_config_elem(&cfg->addrs, iter);
+		nlbl_config_fp_str(&fp, addr->dev);
+		nlbl_config_fp_addr(&fp, &addr->addr);
+		nlbl_config_fp_str(&fp, addr->label);
+	}
+
+	*fingerprint = fp;
+	return 0;
+}
@@ -23,7 +23,9 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <linux/types.h>
@@ -31,39 +33,239 @@
 #include <libnetlabel.h>
 
 #include "netlabel_internal.h"
-#include "mod_mgmt.h"
-#include "mod_unlabeled.h"
-#include "mod_cipso.h"
-#include "mod_calipso.h"
+
+/* Generic netlink family names, indexed by enum nlbl_family */
+static const char *nlbl_family_names[NLBL_FAMILY_MAX] = {
+	[NLBL_FAMILY_MGMT] = NETLBL_NLTYPE_MGMT_NAME,
+	[NLBL_FAMILY_CIPSO] = NETLBL_NLTYPE_CIPSOV4_NAME,
+	[NLBL_FAMILY_UNLBL] = NETLBL_NLTYPE_UNLABELED_NAME,
+	[NLBL_FAMILY_CALIPSO] = NETLBL_NLTYPE_CALIPSO_NAME,
+};
+
+/* Generic netlink family ids of the kernel and of the mock kernels, zero if
+ * the family is not available; the ids and the request templates are only
+ * written with nlbl_family_lock held and are published to other threads by
+ * setting nlbl_family_resolved */
+static uint16_t nlbl_family_ids[NLBL_FAMILY_SRC_MAX][NLBL_FAMILY_MAX];
+static int nlbl_family_resolved[NLBL_FAMILY_SRC_MAX];
+static pthread_mutex_t nlbl_family_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Generic netlink controller attribute policy, only the attributes we use */
+static const struct nla_policy nlbl_family_policy[CTRL_ATTR_FAMILY_NAME + 1] = {
+	[CTRL_ATTR_FAMILY_ID] = { .type = NLA_U16 },
+	[CTRL_ATTR_FAMILY_NAME] = { .type = NLA_STRING },
+};
+
+/*
+ * Helper Functions
+ */
 
 /**
- * Handle any NetLabel setup needed
+ * Record a generic netlink family
+ * @param nla_head the CTRL_CMD_NEWFAMILY attributes
+ * @param attrlen the length of the attributes
+ * @param arg the family ids
  *
- * Initialize the NetLabel communication link, but do not open any general use
- * NetLabel handles.  Returns zero on success, negative values on failure.
+ * Record the family id from a CTRL_CMD_NEWFAMILY message in @arg if it is one
+ * of the NetLabel families.  Returns zero.
  *
  */
-int nlbl_init(void)
+static int nlbl_family_record(struct nlattr *nla_head, int attrlen, void *arg)
 {
-	int rc;
+	uint16_t *ids = arg;
+	struct nlattr *tb[CTRL_ATTR_FAMILY_NAME + 1];
+	struct nlattr *nla_name;
+	struct nlattr *nla_id;
+	unsigned int iter;
 
-	nlmsg_set_default_size(8192);
+	if (nlbl_attr_parse(tb, CTRL_ATTR_FAMILY_NAME,
+			    nla_head, attrlen, nlbl_family_policy) < 0)
+		return 0;
+	nla_name = tb[CTRL_ATTR_FAMILY_NAME];
+	nla_id = tb[CTRL_ATTR_FAMILY_ID];
+	if (nla_name == NULL || nla_id == NULL)
+		return 0;
 
-	rc = nlbl_mgmt_init();
-	if (rc < 0)
-		return rc;
+	for (iter = 0; iter < NLBL_FAMILY_MAX; iter++)
+		if (nla_strcmp(nla_name, nlbl_family_names[iter]) == 0)
+			ids[iter] = nla_get_u16(nla_id);
+
+	return 0;
+}
 
-	rc = nlbl_cipso_init();
+/**
+ * Resolve the NetLabel generic netlink families
+ * @param src the family id source
+ *
+ * Resolve all of the NetLabel generic netlink families of the kernel using a
+ * single dump of the kernel's generic netlink families.  The dump is sent on
+ * a kernel handle of its own, as the default handle may be attached to a mock
+ * kernel, and the handle is closed afterwards so a failed dump leaves no
+ * stale responses on any handle in use.  Families which the kernel does not
+ * support are left with an id of zero, the mock kernels support every family
+ * with fixed ids.  The request templates of every family are rebuilt to
+ * match.  The caller must hold nlbl_family_lock.  Returns zero on success,
+ * negative values on failure.
+ *
+ */
+static int nlbl_family_resolve(enum nlbl_family_src src)
+{
+	int rc = -ENOMEM;
+	struct nlbl_handle *hndl = NULL;
+	nlbl_msg *msg = NULL;
+	uint16_t ids[NLBL_FAMILY_MAX];
+	unsigned int iter;
+
+	if (src == NLBL_FAMILY_SRC_MOCK) {
+		for (iter = 0; iter < NLBL_FAMILY_MAX; iter++)
+			ids[iter] = NLBL_MOCK_ID_BASE + iter;
+		rc = 0;
+		goto resolve_record;
+	}
+
+	hndl = nlbl_comm_new(NULL);
+	if (hndl == NULL)
+		goto resolve_return;
+
+	/* create a new message */
+	msg = nlmsg_alloc();
+	if (msg == NULL)
+		goto resolve_return;
+	if (genlmsg_put(msg, NL_AUTO_PORT, NL_AUTO_SEQ, GENL_ID_CTRL,
+			0, NLM_F_DUMP, CTRL_CMD_GETFAMILY, 1) == NULL)
+		goto resolve_return;
+
+	/* dump the families */
+	memset(ids, 0, sizeof(ids));
+	rc = nlbl_comm_dump(hndl, msg, CTRL_CMD_NEWFAMILY,
+			    nlbl_family_record, ids);
 	if (rc < 0)
-		return rc;
+		goto resolve_return;
+	rc = 0;
+
+resolve_record:
+	for (iter = 0; iter < NLBL_FAMILY_MAX; iter++) {
+		nlbl_family_ids[src][iter] = ids[iter];
+		nlbl_msg_tmpl_init(src, iter, ids[iter]);
+	}
+	__atomic_store_n(&nlbl_family_resolved[src], 1, __ATOMIC_RELEASE);
+
+resolve_return:
+	nlbl_msg_free(msg);
+	if (hndl != NULL)
+		nlbl_comm_close(hndl);
+	return rc;
+}
+
+/*
+ * Family Functions
+ */
+
+/**
+ * Get the source of a handle's NetLabel generic netlink family ids
+ * @param hndl the NetLabel handle, NULL for the default handle
+ *
+ * Returns NLBL_FAMILY_SRC_MOCK if @hndl is attached to a mock kernel,
+ * NLBL_FAMILY_SRC_KERNEL if it is connected to the kernel.
+ *
+ */
+enum nlbl_family_src nlbl_family_src(struct nlbl_handle *hndl)
+{
+	if (hndl != NULL ? hndl->mock != NULL : nlbl_mock_dflt() != NULL)
+		return NLBL_FAMILY_SRC_MOCK;
+	return NLBL_FAMILY_SRC_KERNEL;
+}
 
-	rc = nlbl_unlbl_init();
+/**
+ * Get the id of a NetLabel generic netlink family
+ * @param hndl the NetLabel handle, NULL for the default handle
+ * @param family the NetLabel family
+ *
+ * Return the generic netlink family id of @family as understood by the
+ * kernel, or the mock kernel, behind @hndl, resolving all of the NetLabel
+ * families the first time any of them are needed.  If several threads need
+ * the families at once only one of them resolves the families and the others
+ * wait for it.  Returns the family id on success, zero if the family is not
+ * available, negative values if the families could not be resolved.
+ *
+ */
+int nlbl_family_id(struct nlbl_handle *hndl, enum nlbl_family family)
+{
+	int rc = 0;
+	enum nlbl_family_src src = nlbl_family_src(hndl);
+
+	if (family >= NLBL_FAMILY_MAX)
+		return 0;
+	if (!__atomic_load_n(&nlbl_family_resolved[src], __ATOMIC_ACQUIRE)) {
+		pthread_mutex_lock(&nlbl_family_lock);
+		if (!__atomic_load_n(&nlbl_family_resolved[src],
+				     __ATOMIC_RELAXED))
+			rc = nlbl_family_resolve(src);
+		pthread_mutex_unlock(&nlbl_family_lock);
+		if (rc < 0)
+			return rc;
+	}
+
+	return nlbl_family_ids[src][family];
+}
+
+/**
+ * Check that a NetLabel generic netlink family is available
+ * @param hndl the NetLabel handle, NULL for the default handle
+ * @param family the NetLabel family
+ *
+ * Check that @family is available on the kernel, or the mock kernel, behind
+ * @hndl.  Returns zero if the family is available, -ENOPROTOOPT if it is not,
+ * other negative values if the families could not be resolved.
+ *
+ */
+int nlbl_family_check(struct nlbl_handle *hndl, enum nlbl_family family)
+{
+	int rc;
+
+	rc = nlbl_family_id(hndl, family);
 	if (rc < 0)
 		return rc;
+	if (rc == 0)
+		return -ENOPROTOOPT;
 
-	/* CALISPO support may not exist in the kernel so
-	   don't return an error if it doesn't. */
-	nlbl_calipso_init();
+	return 0;
+}
+
+/**
+ * Forget the NetLabel generic netlink families
+ *
+ * Discard the resolved family ids so that the families are resolved again the
+ * next time they are needed, e.g. after the NetLabel kernel modules are
+ * loaded.  No other thread may be sending requests at the time.
+ *
+ */
+void nlbl_family_reset(void)
+{
+	unsigned int iter;
+
+	pthread_mutex_lock(&nlbl_family_lock);
+	for (iter = 0; iter < NLBL_FAMILY_SRC_MAX; iter++)
+		__atomic_store_n(&nlbl_family_resolved[iter], 0,
+				 __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&nlbl_family_lock);
+}
+
+/*
+ * Init/Exit Functions
+ */
+
+/**
+ * Handle any NetLabel setup needed
+ *
+ * Initialize the NetLabel communication link, but do not open any general use
+ * NetLabel handles.  The NetLabel generic netlink families are resolved when
+ * they are first used.  Returns zero on success, negative values on failure.
+ *
+ */
+int nlbl_init(void)
+{
+	nlmsg_set_default_size(8192);
 
 	return 0;
 }
@@ -71,11 +273,14 @@ int nlbl_init(void)
 /**
  * Handle any NetLabel cleanup
  *
- * Perform any cleanup duties for the NetLabel communication link, does not
- * close any handles.
+ * Perform any cleanup duties for the NetLabel communication link, including
+ * closing the calling thread's default handle; the default handles of other
+ * threads are closed when the threads exit, or recreated if they are used
+ * again.  Does not close any handles opened by the caller.
  *
  */
 void nlbl_exit(void)
 {
-	return;
+	nlbl_comm_dflt_reset_all();
+	nlbl_family_reset();
 }
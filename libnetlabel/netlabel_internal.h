@@ -25,18 +25,267 @@
 #ifndef _NETLINK_COMM_H_
 #define _NETLINK_COMM_H_
 
+#include <configure.h>
+
+#include <time.h>
+
 #include <netlink/netlink.h>
 #include <netlink/genl/genl.h>
 #include <netlink/genl/ctrl.h>
 
+#ifdef ENABLE_USDT
+#include <sys/sdt.h>
+#endif
+
+struct nlbl_batch;
+struct nlbl_async;
+struct nlbl_comm_ring;
+struct nlbl_mock_link;
+
+/* USDT probes, all in the "libnetlabel" provider; without USDT support the
+ * probes compile away to nothing */
+#ifdef ENABLE_USDT
+#define NLBL_PROBE1(name, a1) \
+	DTRACE_PROBE1(libnetlabel, name, a1)
+#define NLBL_PROBE2(name, a1, a2) \
+	DTRACE_PROBE2(libnetlabel, name, a1, a2)
+#define NLBL_PROBE3(name, a1, a2, a3) \
+	DTRACE_PROBE3(libnetlabel, name, a1, a2, a3)
+#define NLBL_PROBE4(name, a1, a2, a3, a4) \
+	DTRACE_PROBE4(libnetlabel, name, a1, a2, a3, a4)
+#else
+#define NLBL_PROBE1(name, a1)			do { } while (0)
+#define NLBL_PROBE2(name, a1, a2)		do { } while (0)
+#define NLBL_PROBE3(name, a1, a2, a3)		do { } while (0)
+#define NLBL_PROBE4(name, a1, a2, a3, a4)	do { } while (0)
+#endif
+
+/* number of request messages kept for reuse by each handle */
+#define NLBL_MSG_POOL		4
+
 /* NetLabel communication handle */
 struct nlbl_handle {
 	struct nl_sock *nl_sock;
+
+	/* sequence numbers of the outstanding requests */
+	uint32_t seq_first;
+	uint32_t seq;
+
+	/* read timeout (in seconds), set if the handle has a timeout of its
+	 * own, and the CLOCK_MONOTONIC deadline of the outstanding request */
+	uint32_t timeout;
+	int timeout_set;
+	struct timespec deadline;
+
+	/* set when a read or write for the outstanding request fails, the
+	 * socket may then hold the rest of a response */
+	int xfer_failed;
+
+	/* receive ring and the size of each of its buffers, reused for every
+	 * read */
+	struct nlbl_comm_ring *ring;
+	size_t rbuf_size;
+
+	/* queued requests, NULL if not batching */
+	struct nlbl_batch *batch;
+
+	/* expected number of entries in a dump, zero if unknown */
+	uint32_t dump_hint;
+
+	/* outstanding requests, NULL if not in asynchronous mode */
+	struct nlbl_async *async;
+
+	/* request messages released for reuse */
+	nlbl_msg *msg_pool[NLBL_MSG_POOL];
+	unsigned int msg_pool_len;
+
+	/* mock kernel connection, NULL if connected to the kernel */
+	struct nlbl_mock_link *mock;
+
+	/* statistics and the time the oldest request still waiting for a
+	 * response was written, zero if there is none */
+	struct nlbl_comm_stats stats;
+	struct timespec stats_sent;
+};
+
+/* NetLabel generic netlink families */
+enum nlbl_family {
+	NLBL_FAMILY_MGMT,
+	NLBL_FAMILY_CIPSO,
+	NLBL_FAMILY_UNLBL,
+	NLBL_FAMILY_CALIPSO,
+	NLBL_FAMILY_MAX,
+};
+/* the family ids are kept separately for the kernel and the mock kernels */
+enum nlbl_family_src {
+	NLBL_FAMILY_SRC_KERNEL,
+	NLBL_FAMILY_SRC_MOCK,
+	NLBL_FAMILY_SRC_MAX,
 };
+enum nlbl_family_src nlbl_family_src(struct nlbl_handle *hndl);
+int nlbl_family_id(struct nlbl_handle *hndl, enum nlbl_family family);
+int nlbl_family_check(struct nlbl_handle *hndl, enum nlbl_family family);
+void nlbl_family_reset(void);
+
+/* Request messages */
+void nlbl_msg_tmpl_init(enum nlbl_family_src src,
+			enum nlbl_family family, uint16_t id);
+nlbl_msg *nlbl_msg_request(struct nlbl_handle *hndl,
+			   enum nlbl_family family, uint8_t cmd, int flags);
+void nlbl_msg_release(struct nlbl_handle *hndl, nlbl_msg *msg);
+void nlbl_msg_pool_free(struct nlbl_handle *hndl);
+
+/* Handle creation and transmission */
+struct nlbl_handle *nlbl_comm_new(struct nlbl_mock *mock);
+int nlbl_comm_sock(struct nlbl_handle *hndl);
+int nlbl_comm_write(struct nlbl_handle *hndl, nlbl_msg *msg);
+int nlbl_comm_write_buf(struct nlbl_handle *hndl, void *buf, size_t len);
+
+/* Request deadlines */
+void nlbl_comm_deadline(struct nlbl_handle *hndl);
+
+/* Socket buffer sizes, saved while a handle is batching or asynchronous */
+struct nlbl_comm_sockbuf {
+	int rcvbuf;
+	int sndbuf;
+};
+void nlbl_comm_sockbuf_raise(struct nlbl_handle *hndl, int size,
+			     struct nlbl_comm_sockbuf *saved);
+void nlbl_comm_sockbuf_restore(struct nlbl_handle *hndl,
+			       const struct nlbl_comm_sockbuf *saved);
+
+/* Default NetLabel handle */
+struct nlbl_handle *nlbl_comm_dflt(void);
+void nlbl_comm_dflt_reset(void);
+void nlbl_comm_dflt_reset_all(void);
+void nlbl_comm_dflt_done(struct nlbl_handle *hndl, int rc);
+
+/* Growable arrays */
+struct nlbl_vec {
+	void *array;
+	size_t count;
+	size_t size;
+	size_t elem_size;
+	size_t hint;
+};
+void nlbl_vec_init(struct nlbl_vec *vec, size_t elem_size, size_t hint);
+void *nlbl_vec_add(struct nlbl_vec *vec);
+void *nlbl_vec_finish(struct nlbl_vec *vec);
+void nlbl_vec_free(struct nlbl_vec *vec);
+
+/* Longest prefix match tries */
+#define NLBL_TRIE_NONE		UINT32_MAX
+enum {
+	NLBL_TRIE_V4,
+	NLBL_TRIE_V6,
+	NLBL_TRIE_AF_MAX,
+};
+struct nlbl_trie {
+	struct nlbl_vec nodes;
+};
+void nlbl_trie_init(struct nlbl_trie *trie);
+void nlbl_trie_free(struct nlbl_trie *trie);
+void nlbl_trie_root_init(uint32_t *root);
+int nlbl_trie_insert(struct nlbl_trie *trie, uint32_t *root,
+		     const struct nlbl_netaddr *addr, uint32_t value);
+uint32_t nlbl_trie_search(const struct nlbl_trie *trie, const uint32_t *root,
+			  const struct nlbl_netaddr *addr);
+void nlbl_trie_search_batch(const struct nlbl_trie *trie, const uint32_t *root,
+			    const struct nlbl_netaddr *addrs, size_t count,
+			    uint32_t *values);
+
+/* Result sets */
+struct nlbl_result *nlbl_result_new(void);
+void *nlbl_result_alloc(struct nlbl_result *result, size_t len);
+char *nlbl_result_strdup(struct nlbl_result *result, const char *str);
+void nlbl_result_adopt(struct nlbl_result *result, void *array);
+
+/* Configurations, CIPSO DOI configuration */
+struct nlbl_config_cipso {
+	nlbl_cip_doi doi;
+	nlbl_cip_mtype mtype;
+	struct nlbl_cip_tag_a tags;
+	struct nlbl_cip_lvl_a lvls;
+	struct nlbl_cip_cat_a cats;
+};
+
+/* CALIPSO DOI configuration */
+struct nlbl_config_calipso {
+	nlbl_clp_doi doi;
+	nlbl_clp_mtype mtype;
+};
+
+/* domain mapping of a single domain and address family, the domain is NULL
+ * for the default mapping */
+struct nlbl_config_map {
+	const char *domain;
+	uint16_t family;
+	nlbl_proto proto_type;
+	uint32_t doi;
+	struct nlbl_vec addrsel;
+};
+
+/* NetLabel configuration; every array is kept sorted by its key so that two
+ * configurations can be compared with a single merge pass, the strings and
+ * the CIPSO arrays belong to the result set */
+struct nlbl_config {
+	struct nlbl_result *result;
+
+	struct nlbl_vec cipso;
+	struct nlbl_vec calipso;
+	struct nlbl_vec maps;
+	struct nlbl_vec addrs;
+	uint8_t accept;
+};
+struct nlbl_config *nlbl_config_alloc(void);
+
+/* Attribute handling */
+int nlbl_attr_parse(struct nlattr **tb, int maxtype,
+		    struct nlattr *nla_head, int attrlen,
+		    const struct nla_policy *policy);
+
+/* Attribute policies */
+#define NLBL_POLICY_LEN(len)	{ .minlen = (len), .maxlen = (len) }
+extern const struct nla_policy nlbl_mgmt_policy[];
+extern const struct nla_policy nlbl_cipso_policy[];
+extern const struct nla_policy nlbl_calipso_policy[];
+extern const struct nla_policy nlbl_unlbl_policy[];
+
+/* Message reception */
+struct nlbl_comm_dgram {
+	unsigned char *data;
+	int len;
+};
+int nlbl_comm_recv_buf(struct nlbl_handle *hndl, unsigned char **data);
+int nlbl_comm_recv_many(struct nlbl_handle *hndl,
+			struct nlbl_comm_dgram **dgrams);
+
+/* Dump operations */
+uint32_t nlbl_comm_hint(struct nlbl_handle *hndl);
+typedef int (*nlbl_comm_dump_cb)(struct nlattr *nla_head, int attrlen,
+				 void *arg);
+int nlbl_comm_dump(struct nlbl_handle *hndl, nlbl_msg *msg, uint8_t cmd,
+		   nlbl_comm_dump_cb cb, void *arg);
+
+/* Request batching */
+int nlbl_batch_active(struct nlbl_handle *hndl);
+int nlbl_batch_queue(struct nlbl_handle *hndl, nlbl_msg *msg);
+
+/* Mock kernel, its generic netlink family ids are fixed, the first NetLabel
+ * family has NLBL_MOCK_ID_BASE and the rest follow in enum nlbl_family order */
+#define NLBL_MOCK_ID_BASE	0x20
+struct nlbl_mock *nlbl_mock_dflt(void);
+int nlbl_mock_attach(struct nlbl_mock *mock, struct nlbl_handle *hndl);
+void nlbl_mock_detach(struct nlbl_handle *hndl);
+int nlbl_mock_fd(struct nlbl_handle *hndl);
+int nlbl_mock_input(struct nlbl_handle *hndl, const void *buf, size_t len);
+int nlbl_mock_flush(struct nlbl_handle *hndl);
 
-#define NL_MULTI_CONTINUE(hdr) \
-	(((hdr)->nlmsg_type == 0) || \
-	 (((hdr)->nlmsg_flags & NLM_F_MULTI) && \
-	  ((hdr)->nlmsg_type != NLMSG_DONE)))
+/* Asynchronous requests */
+int nlbl_async_active(struct nlbl_handle *hndl);
+int nlbl_async_request(struct nlbl_handle *hndl, nlbl_msg *msg);
+int nlbl_async_dump(struct nlbl_handle *hndl, nlbl_msg *msg, uint8_t cmd,
+		    nlbl_comm_dump_cb cb, const void *arg, size_t arg_len,
+		    void (*arg_free)(void *arg));
 
 #endif
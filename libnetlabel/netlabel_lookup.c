@@ -0,0 +1,473 @@
+/** @file
+ * NetLabel Static Label Lookup Functions
+ *
+ * Author: Paul Moore <paul@paul-moore.com>
+ *
+ */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <linux/types.h>
+
+#include <libnetlabel.h>
+
+#include "netlabel_internal.h"
+
+/* number of addresses searched for at once in a batch lookup */
+#define NLBL_LOOKUP_CHUNK	256
+
+/* static labels of a single interface, or the default static labels */
+struct nlbl_lookup_tree {
+	const char *dev;
+	uint32_t root[NLBL_TRIE_AF_MAX];
+};
+
+/* NetLabel static label table */
+struct nlbl_unlbl_table {
+	/* the static labels, the strings belong to the result set */
+	struct nlbl_vec entries;
+	struct nlbl_result *result;
+
+	/* trie nodes shared by all of the trees */
+	struct nlbl_trie trie;
+
+	/* interface trees sorted by name, and the default tree */
+	struct nlbl_vec trees;
+	struct nlbl_lookup_tree def;
+};
+
+/*
+ * Helper Functions
+ */
+
+/**
+ * Find the tree of a network interface
+ * @param table the static label table
+ * @param dev the network interface
+ * @param pos the position the tree belongs at if it doesn't exist
+ *
+ * Search the sorted interface trees of @table for @dev.  Returns a pointer to
+ * the tree if found, NULL otherwise.
+ *
+ */
+static struct nlbl_lookup_tree *nlbl_lookup_tree_find(
+					const struct nlbl_unlbl_table *table,
+					const char *dev, size_t *pos)
+{
+	struct nlbl_lookup_tree *trees = table->trees.array;
+	size_t low = 0;
+	size_t high = table->trees.count;
+	size_t mid;
+	int cmp;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		cmp = strcmp(dev, trees[mid].dev);
+		if (cmp == 0)
+			return &trees[mid];
+		if (cmp < 0)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+
+	if (pos != NULL)
+		*pos = low;
+	return NULL;
+}
+
+/**
+ * Find the tree used for traffic on a network interface
+ * @param table the static label table
+ * @param dev the network interface
+ *
+ * Like the kernel, use the interface's own static labels if it has any and
+ * fall back to the default static labels otherwise.
+ *
+ */
+static const struct nlbl_lookup_tree *nlbl_lookup_tree(
+					const struct nlbl_unlbl_table *table,
+					nlbl_netdev dev)
+{
+	const struct nlbl_lookup_tree *tree = NULL;
+
+	if (dev != NULL)
+		tree = nlbl_lookup_tree_find(table, dev, NULL);
+	return (tree != NULL ? tree : &table->def);
+}
+
+/**
+ * Add a static label to a static label table
+ * @param addr the static label address mapping
+ * @param arg the static label table
+ *
+ * Copy @addr, including its strings, to the end of the static label entries.
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_lookup_entry_add(const struct nlbl_addrmap *addr, void *arg)
+{
+	struct nlbl_unlbl_table *table = arg;
+	struct nlbl_addrmap *entry;
+
+	if (addr->label == NULL)
+		return -EINVAL;
+
+	entry = nlbl_vec_add(&table->entries);
+	if (entry == NULL)
+		return -ENOMEM;
+
+	entry->addr = addr->addr;
+	if (addr->dev != NULL) {
+		entry->dev = nlbl_result_strdup(table->result, addr->dev);
+		if (entry->dev == NULL)
+			return -ENOMEM;
+	}
+	entry->label = nlbl_result_strdup(table->result, addr->label);
+	if (entry->label == NULL)
+		return -ENOMEM;
+
+	return 0;
+}
+
+/**
+ * Add a default static label to a static label table
+ * @param addr the static label address mapping
+ * @param arg the static label table
+ *
+ * Same as nlbl_lookup_entry_add() but any network interface in @addr is
+ * ignored.  Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_lookup_entry_adddef(const struct nlbl_addrmap *addr,
+				    void *arg)
+{
+	struct nlbl_addrmap entry;
+
+	entry = *addr;
+	entry.dev = NULL;
+	return nlbl_lookup_entry_add(&entry, arg);
+}
+
+/**
+ * Build the tries of a static label table
+ * @param table the static label table
+ *
+ * Add every static label entry in @table to the trie of its interface and
+ * address family.  Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_lookup_index(struct nlbl_unlbl_table *table)
+{
+	int rc;
+	struct nlbl_addrmap *entries = table->entries.array;
+	struct nlbl_lookup_tree *tree;
+	struct nlbl_lookup_tree *trees;
+	size_t pos;
+	uint32_t iter;
+
+	if (table->entries.count >= NLBL_TRIE_NONE)
+		return -E2BIG;
+
+	for (iter = 0; iter < table->entries.count; iter++) {
+		/* find or create the interface's tree */
+		if (entries[iter].dev == NULL)
+			tree = &table->def;
+		else {
+			tree = nlbl_lookup_tree_find(table,
+						     entries[iter].dev, &pos);
+			if (tree == NULL) {
+				if (nlbl_vec_add(&table->trees) == NULL)
+					return -ENOMEM;
+				trees = table->trees.array;
+				memmove(&trees[pos + 1], &trees[pos],
+					(table->trees.count - pos - 1) *
+					sizeof(*trees));
+				tree = &trees[pos];
+				tree->dev = entries[iter].dev;
+				nlbl_trie_root_init(tree->root);
+			}
+		}
+
+		rc = nlbl_trie_insert(&table->trie, tree->root,
+				      &entries[iter].addr, iter);
+		if (rc < 0)
+			return rc;
+	}
+
+	return 0;
+}
+
+/**
+ * Allocate an empty static label table
+ */
+static struct nlbl_unlbl_table *nlbl_lookup_table_new(void)
+{
+	struct nlbl_unlbl_table *table;
+
+	table = calloc(1, sizeof(*table));
+	if (table == NULL)
+		return NULL;
+	table->result = nlbl_result_new();
+	if (table->result == NULL) {
+		free(table);
+		return NULL;
+	}
+	nlbl_vec_init(&table->entries, sizeof(struct nlbl_addrmap), 0);
+	nlbl_trie_init(&table->trie);
+	nlbl_vec_init(&table->trees, sizeof(struct nlbl_lookup_tree), 0);
+	nlbl_trie_root_init(table->def.root);
+
+	return table;
+}
+
+/*
+ * Static Label Table Functions
+ */
+
+/**
+ * Build a static label table from static label arrays
+ * @param addrs the static labels
+ * @param addr_count the number of static labels
+ * @param addrdefs the default static labels
+ * @param addrdef_count the number of default static labels
+ * @param table the static label table
+ *
+ * Build a static label table for nlbl_unlbl_lookup() from a snapshot of the
+ * static labels and default static labels, such as the arrays returned by
+ * nlbl_unlbl_staticlist() and nlbl_unlbl_staticlistdef().  The entries and
+ * strings are copied, the arrays are not needed once the table is built.  The
+ * address masks must be prefixes.  The caller is responsible for freeing the
+ * table with nlbl_unlbl_table_free().  Returns zero on success, negative
+ * values on failure.
+ *
+ */
+int nlbl_unlbl_table_build(const struct nlbl_addrmap *addrs,
+			   size_t addr_count,
+			   const struct nlbl_addrmap *addrdefs,
+			   size_t addrdef_count,
+			   struct nlbl_unlbl_table **table)
+{
+	int rc;
+	struct nlbl_unlbl_table *tbl;
+	size_t iter;
+
+	/* sanity checks */
+	if (table == NULL || (addrs == NULL && addr_count > 0) ||
+	    (addrdefs == NULL && addrdef_count > 0))
+		return -EINVAL;
+
+	tbl = nlbl_lookup_table_new();
+	if (tbl == NULL)
+		return -ENOMEM;
+
+	for (iter = 0; iter < addr_count; iter++) {
+		if (addrs[iter].dev == NULL) {
+			rc = -EINVAL;
+			goto build_return;
+		}
+		rc = nlbl_lookup_entry_add(&addrs[iter], tbl);
+		if (rc < 0)
+			goto build_return;
+	}
+	for (iter = 0; iter < addrdef_count; iter++) {
+		rc = nlbl_lookup_entry_adddef(&addrdefs[iter], tbl);
+		if (rc < 0)
+			goto build_return;
+	}
+	rc = nlbl_lookup_index(tbl);
+	if (rc < 0)
+		goto build_return;
+
+	*table = tbl;
+
+build_return:
+	if (rc < 0)
+		nlbl_unlbl_table_free(tbl);
+	return rc;
+}
+
+/**
+ * Build a static label table from the kernel's static labels
+ * @param hndl the NetLabel handle
+ * @param table the static label table
+ *
+ * Dump the static labels and default static labels from the kernel directly
+ * into a new static label table for nlbl_unlbl_lookup().  The table is a
+ * snapshot, later changes to the kernel's configuration are not reflected in
+ * it.  If @hndl is NULL then the library's default NetLabel handle is used.
+ * The caller is responsible for freeing the table with
+ * nlbl_unlbl_table_free().  Returns zero on success, negative values on
+ * failure.
+ *
+ */
+int nlbl_unlbl_table_load(struct nlbl_handle *hndl,
+			  struct nlbl_unlbl_table **table)
+{
+	int rc;
+	struct nlbl_unlbl_table *tbl;
+
+	/* sanity checks */
+	if (table == NULL)
+		return -EINVAL;
+	/* the table must be complete before we return */
+	if (nlbl_async_active(hndl))
+		return -EBUSY;
+
+	tbl = nlbl_lookup_table_new();
+	if (tbl == NULL)
+		return -ENOMEM;
+
+	rc = nlbl_unlbl_staticlist_iter(hndl, nlbl_lookup_entry_add, tbl);
+	if (rc < 0)
+		goto load_return;
+	rc = nlbl_unlbl_staticlistdef_iter(hndl, nlbl_lookup_entry_adddef, tbl);
+	if (rc < 0)
+		goto load_return;
+	rc = nlbl_lookup_index(tbl);
+	if (rc < 0)
+		goto load_return;
+
+	*table = tbl;
+
+load_return:
+	if (rc < 0)
+		nlbl_unlbl_table_free(tbl);
+	return rc;
+}
+
+/**
+ * Free a static label table
+ * @param table the static label table
+ *
+ * Free @table along with every static label entry and string in it.
+ *
+ */
+void nlbl_unlbl_table_free(struct nlbl_unlbl_table *table)
+{
+	if (table == NULL)
+		return;
+
+	nlbl_vec_free(&table->entries);
+	nlbl_trie_free(&table->trie);
+	nlbl_vec_free(&table->trees);
+	nlbl_result_free(table->result);
+	free(table);
+}
+
+/**
+ * Find the static label applied to traffic
+ * @param table the static label table
+ * @param dev the inbound network interface
+ * @param addr the source address
+ *
+ * Find the static label the kernel would apply to unlabeled traffic from
+ * @addr arriving on @dev, the mask in @addr is ignored.  As in the kernel, if
+ * @dev has any static labels then only its static labels are searched,
+ * otherwise the default static labels are searched; the static label with the
+ * longest matching prefix wins.  If @dev is NULL only the default static
+ * labels are searched.  Returns a pointer to the matching static label entry,
+ * which belongs to @table, or NULL if no static label applies.
+ *
+ */
+const struct nlbl_addrmap *nlbl_unlbl_lookup(
+					const struct nlbl_unlbl_table *table,
+					nlbl_netdev dev,
+					const struct nlbl_netaddr *addr)
+{
+	const struct nlbl_lookup_tree *tree;
+	const struct nlbl_addrmap *entries;
+	const struct nlbl_addrmap *label = NULL;
+	uint32_t entry;
+
+	/* sanity checks */
+	if (table == NULL || addr == NULL)
+		return NULL;
+
+	tree = nlbl_lookup_tree(table, dev);
+	entry = nlbl_trie_search(&table->trie, tree->root, addr);
+	if (entry != NLBL_TRIE_NONE) {
+		entries = table->entries.array;
+		label = &entries[entry];
+	}
+	NLBL_PROBE3(unlbl_lookup, table, addr, label);
+
+	return label;
+}
+
+/**
+ * Find the static labels applied to traffic from many addresses
+ * @param table the static label table
+ * @param dev the inbound network interface
+ * @param addrs the source addresses
+ * @param count the number of source addresses
+ * @param labels the matching static label entries
+ *
+ * Perform a nlbl_unlbl_lookup() for each of the @count addresses in @addrs,
+ * all arriving on @dev, storing the results in the caller allocated array
+ * @labels.  The addresses are walked through the tries several at a time, see
+ * nlbl_trie_search_batch(), so that the memory accesses of one lookup overlap
+ * with those of the others.  Returns the number of addresses with a static
+ * label on success, negative values on failure.
+ *
+ */
+int nlbl_unlbl_lookup_batch(const struct nlbl_unlbl_table *table,
+			    nlbl_netdev dev,
+			    const struct nlbl_netaddr *addrs, size_t count,
+			    const struct nlbl_addrmap **labels)
+{
+	const struct nlbl_lookup_tree *tree;
+	const struct nlbl_addrmap *entries;
+	uint32_t values[NLBL_LOOKUP_CHUNK];
+	size_t chunk;
+	size_t base;
+	size_t iter;
+	int matched = 0;
+
+	/* sanity checks */
+	if (table == NULL || (count > 0 && (addrs == NULL || labels == NULL)))
+		return -EINVAL;
+	if (count > INT_MAX)
+		return -E2BIG;
+
+	tree = nlbl_lookup_tree(table, dev);
+	entries = table->entries.array;
+
+	for (base = 0; base < count; base += chunk) {
+		chunk = (count - base < NLBL_LOOKUP_CHUNK ?
+			 count - base : NLBL_LOOKUP_CHUNK);
+		nlbl_trie_search_batch(&table->trie, tree->root,
+				       &addrs[base], chunk, values);
+		for (iter = 0; iter < chunk; iter++) {
+			if (values[iter] == NLBL_TRIE_NONE)
+				labels[base + iter] = NULL;
+			else {
+				labels[base + iter] = &entries[values[iter]];
+				matched++;
+			}
+		}
+	}
+	NLBL_PROBE3(unlbl_lookup_batch, table, count, matched);
+
+	return matched;
+}
@@ -0,0 +1,1990 @@
+/** @file
+ * NetLabel Mock Kernel Functions
+ *
+ * Author: Paul Moore <paul@paul-moore.com>
+ *
+ */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * The mock kernel answers the generic netlink requests sent on a NetLabel
+ * handle the way the kernel's NetLabel subsystem does, but from a
+ * configuration held in memory which is changed with the nlbl_config_*()
+ * operations, so the kernel's rules for the configuration only exist once.
+ * Requests are processed as soon as they are written to the handle and the
+ * responses are written to a socket pair, so the handle reads, and waits
+ * for, them exactly as it does the kernel's responses.  Dump responses which
+ * do not fit in the socket are held back until the handle reads again, see
+ * nlbl_mock_flush(), while replies and acks which do not fit are dropped and
+ * the next read fails with -ENOBUFS, as with the kernel.  Handles in
+ * different threads may share a mock kernel, each request is processed with
+ * the mock kernel's lock held.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <linux/types.h>
+
+#include <libnetlabel.h>
+
+#include "netlabel_internal.h"
+
+/* size of the response messages; the dump entries are small and use the
+ * library's default message size */
+#define NLBL_MOCK_MSG_SIZE	32768
+
+/* largest datagram built for a dump, the dumps are also limited to the size
+ * of the handle's receive buffers like the kernel does */
+#define NLBL_MOCK_DGRAM_MAX	32768
+
+/* large enough for the attributes of any of the NetLabel families */
+#define NLBL_MOCK_A_MAX		16
+
+/* NetLabel mock kernel */
+struct nlbl_mock {
+	pthread_mutex_t lock;
+	struct nlbl_config *cfg;
+};
+
+/* connection between a NetLabel handle and the mock kernel */
+struct nlbl_mock_link {
+	struct nlbl_mock *mock;
+
+	/* the handle reads from sock[0], the mock kernel writes to sock[1] */
+	int sock[2];
+
+	/* datagrams waiting for room in the socket */
+	struct nlbl_vec backlog;
+	size_t backlog_next;
+
+	/* set when a reply or an ack was dropped for lack of room */
+	int overrun;
+
+	/* dump datagram being built */
+	unsigned char *dgram;
+	size_t dgram_len;
+	size_t dgram_max;
+};
+
+/* request being processed by the mock kernel */
+struct nlbl_mock_req {
+	struct nlbl_mock_link *link;
+	struct nlbl_config *cfg;
+	const struct nlmsghdr *nl_hdr;
+	uint16_t family_id;
+	uint8_t cmd;
+	struct nlattr *tb[NLBL_MOCK_A_MAX + 1];
+};
+
+/* mock kernel request handler */
+typedef int (*nlbl_mock_fn)(struct nlbl_mock_req *req);
+
+/* generic netlink operation, either a request or a dump */
+struct nlbl_mock_op {
+	nlbl_mock_fn doit;
+	nlbl_mock_fn dumpit;
+};
+
+/* generic netlink family */
+struct nlbl_mock_family {
+	const char *name;
+	int maxtype;
+	const struct nla_policy *policy;
+	const struct nlbl_mock_op *ops;
+	unsigned int ops_len;
+};
+
+/* mock kernel used by new handles, NULL for the kernel */
+static struct nlbl_mock *nlbl_mock_active = NULL;
+
+/*
+ * Helper Functions
+ */
+
+/**
+ * Return an element of a growable array
+ * @param vec the growable array
+ * @param idx the index of the element
+ */
+static inline void *nlbl_mock_elem(const struct nlbl_vec *vec, size_t idx)
+{
+	return (unsigned char *)vec->array + idx * vec->elem_size;
+}
+
+/**
+ * Compare two DOIs
+ * @param a the first DOI configuration
+ * @param b the second DOI configuration
+ *
+ * The CIPSO and CALIPSO DOI configurations both start with the DOI.
+ *
+ */
+static int nlbl_mock_doi_cmp(const void *a, const void *b)
+{
+	uint32_t doi_a = *(const uint32_t *)a;
+	uint32_t doi_b = *(const uint32_t *)b;
+
+	return (doi_a > doi_b) - (doi_a < doi_b);
+}
+
+/**
+ * Find a DOI configuration
+ * @param dois the sorted DOI array
+ * @param doi the DOI
+ *
+ * Returns a pointer to the DOI configuration on success, NULL if the DOI does
+ * not exist.
+ *
+ */
+static void *nlbl_mock_doi_find(const struct nlbl_vec *dois, uint32_t doi)
+{
+	if (dois->count == 0)
+		return NULL;
+	return bsearch(&doi, dois->array, dois->count, dois->elem_size,
+		       nlbl_mock_doi_cmp);
+}
+
+/**
+ * Start a nested attribute
+ * @param msg the message
+ * @param type the attribute type
+ *
+ * Same as nla_nest_start() but without the NLA_F_NESTED flag, which the
+ * kernel does not set on the NetLabel attributes and the library does not
+ * expect.  Returns a pointer to the attribute on success, NULL on failure.
+ *
+ */
+static struct nlattr *nlbl_mock_nest_start(nlbl_msg *msg, int type)
+{
+	struct nlattr *nla;
+
+	nla = nla_nest_start(msg, type);
+	if (nla != NULL)
+		nla->nla_type &= ~NLA_F_NESTED;
+	return nla;
+}
+
+/**
+ * Parse a network address from the request attributes
+ * @param req the request
+ * @param a_v4addr the IPv4 address attribute
+ * @param a_v4mask the IPv4 mask attribute
+ * @param a_v6addr the IPv6 address attribute
+ * @param a_v6mask the IPv6 mask attribute
+ * @param addr the network address
+ *
+ * Parse the optional network address in the request into @addr, the address
+ * type is AF_UNSPEC if there is no address.  Returns zero on success,
+ * negative values on failure.
+ *
+ */
+static int nlbl_mock_addr_get(const struct nlbl_mock_req *req,
+			      int a_v4addr, int a_v4mask,
+			      int a_v6addr, int a_v6mask,
+			      struct nlbl_netaddr *addr)
+{
+	struct nlattr *const *tb = req->tb;
+
+	memset(addr, 0, sizeof(*addr));
+	if (tb[a_v4addr] != NULL && tb[a_v6addr] != NULL)
+		return -EINVAL;
+
+	if (tb[a_v4addr] != NULL) {
+		if (tb[a_v4mask] == NULL)
+			return -EINVAL;
+		addr->type = AF_INET;
+		memcpy(&addr->addr.v4, nla_data(tb[a_v4addr]),
+		       sizeof(addr->addr.v4));
+		memcpy(&addr->mask.v4, nla_data(tb[a_v4mask]),
+		       sizeof(addr->mask.v4));
+	} else if (tb[a_v6addr] != NULL) {
+		if (tb[a_v6mask] == NULL)
+			return -EINVAL;
+		addr->type = AF_INET6;
+		memcpy(&addr->addr.v6, nla_data(tb[a_v6addr]),
+		       sizeof(addr->addr.v6));
+		memcpy(&addr->mask.v6, nla_data(tb[a_v6mask]),
+		       sizeof(addr->mask.v6));
+	}
+
+	return 0;
+}
+
+/**
+ * Add a network address to a message
+ * @param msg the message
+ * @param addr the network address
+ * @param a_v4addr the IPv4 address attribute
+ * @param a_v4mask the IPv4 mask attribute
+ * @param a_v6addr the IPv6 address attribute
+ * @param a_v6mask the IPv6 mask attribute
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_addr_put(nlbl_msg *msg, const struct nlbl_netaddr *addr,
+			      int a_v4addr, int a_v4mask,
+			      int a_v6addr, int a_v6mask)
+{
+	switch (addr->type) {
+	case AF_INET:
+		if (nla_put(msg, a_v4addr,
+			    sizeof(addr->addr.v4), &addr->addr.v4) < 0 ||
+		    nla_put(msg, a_v4mask,
+			    sizeof(addr->mask.v4), &addr->mask.v4) < 0)
+			return -ENOMEM;
+		return 0;
+	case AF_INET6:
+		if (nla_put(msg, a_v6addr,
+			    sizeof(addr->addr.v6), &addr->addr.v6) < 0 ||
+		    nla_put(msg, a_v6mask,
+			    sizeof(addr->mask.v6), &addr->mask.v6) < 0)
+			return -ENOMEM;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+/*
+ * Response Functions
+ */
+
+/**
+ * Write a datagram to a handle
+ * @param link the mock kernel connection
+ * @param data the datagram
+ * @param len the length of the datagram
+ *
+ * Write the datagram to the handle's socket, or hold it back if there is no
+ * room in the socket or earlier datagrams are already held back.  Returns
+ * zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_xmit(struct nlbl_mock_link *link,
+			  const void *data, size_t len)
+{
+	struct nlbl_comm_dgram *dgram;
+
+	if (link->backlog_next == link->backlog.count) {
+		if (send(link->sock[1], data, len, MSG_DONTWAIT) >= 0)
+			return 0;
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			return -errno;
+	}
+
+	dgram = nlbl_vec_add(&link->backlog);
+	if (dgram == NULL)
+		return -ENOMEM;
+	dgram->data = malloc(len);
+	if (dgram->data == NULL) {
+		link->backlog.count--;
+		return -ENOMEM;
+	}
+	memcpy(dgram->data, data, len);
+	dgram->len = len;
+
+	return 0;
+}
+
+/**
+ * Write a reply or an ack to a handle
+ * @param link the mock kernel connection
+ * @param data the datagram
+ * @param len the length of the datagram
+ *
+ * Write the datagram to the handle's socket like nlbl_mock_xmit(), but drop it
+ * if there is no room in the socket, as the kernel does, so that the handle's
+ * next read fails with -ENOBUFS.  Returns zero on success, negative values on
+ * failure.
+ *
+ */
+static int nlbl_mock_unicast(struct nlbl_mock_link *link,
+			     const void *data, size_t len)
+{
+	if (link->backlog_next < link->backlog.count)
+		return nlbl_mock_xmit(link, data, len);
+
+	if (send(link->sock[1], data, len, MSG_DONTWAIT) >= 0)
+		return 0;
+	if (errno != EAGAIN && errno != EWOULDBLOCK)
+		return -errno;
+	link->overrun = 1;
+	return 0;
+}
+
+/**
+ * Send the dump datagram being built
+ * @param link the mock kernel connection
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_dgram_send(struct nlbl_mock_link *link)
+{
+	int rc;
+
+	if (link->dgram_len == 0)
+		return 0;
+	rc = nlbl_mock_xmit(link, link->dgram, link->dgram_len);
+	link->dgram_len = 0;
+	return rc;
+}
+
+/**
+ * Add a message to the dump datagram being built
+ * @param link the mock kernel connection
+ * @param nl_hdr the message
+ *
+ * Pack as many dump messages as fit into each datagram, like the kernel does.
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_dgram_add(struct nlbl_mock_link *link,
+			       const struct nlmsghdr *nl_hdr)
+{
+	int rc;
+	size_t len = NLMSG_ALIGN(nl_hdr->nlmsg_len);
+
+	if (link->dgram_len > 0 && link->dgram_len + len > link->dgram_max) {
+		rc = nlbl_mock_dgram_send(link);
+		if (rc < 0)
+			return rc;
+	}
+	if (len > link->dgram_max)
+		return -EMSGSIZE;
+
+	memcpy(link->dgram + link->dgram_len, nl_hdr, nl_hdr->nlmsg_len);
+	memset(link->dgram + link->dgram_len + nl_hdr->nlmsg_len, 0,
+	       len - nl_hdr->nlmsg_len);
+	link->dgram_len += len;
+
+	return 0;
+}
+
+/**
+ * Create a response message
+ * @param req the request
+ * @param size the size of the message
+ * @param flags the message flags
+ *
+ * Returns a pointer to a message for the response to @req on success, NULL on
+ * failure.
+ *
+ */
+static nlbl_msg *nlbl_mock_msg_new(const struct nlbl_mock_req *req,
+				   size_t size, int flags)
+{
+	nlbl_msg *msg;
+
+	msg = (size > 0 ? nlmsg_alloc_size(size) : nlmsg_alloc());
+	if (msg == NULL)
+		return NULL;
+	if (genlmsg_put(msg, req->nl_hdr->nlmsg_pid, req->nl_hdr->nlmsg_seq,
+			req->family_id, 0, flags, req->cmd,
+			NETLBL_PROTO_VERSION) == NULL) {
+		nlmsg_free(msg);
+		return NULL;
+	}
+
+	return msg;
+}
+
+/**
+ * Create a reply to a request
+ * @param req the request
+ *
+ * Returns a pointer to the reply message on success, NULL on failure.
+ *
+ */
+static nlbl_msg *nlbl_mock_reply_new(const struct nlbl_mock_req *req)
+{
+	return nlbl_mock_msg_new(req, NLBL_MOCK_MSG_SIZE, 0);
+}
+
+/**
+ * Send a reply to a request
+ * @param req the request
+ * @param msg the reply message
+ *
+ * Send the reply in its own datagram and free @msg.  Returns zero on success,
+ * negative values on failure.
+ *
+ */
+static int nlbl_mock_reply(const struct nlbl_mock_req *req, nlbl_msg *msg)
+{
+	int rc;
+	struct nlmsghdr *nl_hdr = nlmsg_hdr(msg);
+
+	rc = nlbl_mock_unicast(req->link, nl_hdr, nl_hdr->nlmsg_len);
+	nlmsg_free(msg);
+	return rc;
+}
+
+/**
+ * Create a dump entry
+ * @param req the dump request
+ *
+ * Returns a pointer to the dump entry message on success, NULL on failure.
+ *
+ */
+static nlbl_msg *nlbl_mock_entry_new(const struct nlbl_mock_req *req)
+{
+	return nlbl_mock_msg_new(req, 0, NLM_F_MULTI);
+}
+
+/**
+ * Add an entry to a dump
+ * @param req the dump request
+ * @param msg the dump entry
+ *
+ * Add the entry to the dump datagram being built and free @msg.  Returns zero
+ * on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_entry(const struct nlbl_mock_req *req, nlbl_msg *msg)
+{
+	int rc;
+
+	rc = nlbl_mock_dgram_add(req->link, nlmsg_hdr(msg));
+	nlmsg_free(msg);
+	return rc;
+}
+
+/**
+ * Send an ack for a request
+ * @param link the mock kernel connection
+ * @param nl_hdr the request
+ * @param error the result of the request
+ *
+ * Send a NLMSG_ERROR message carrying @error and the request's header.
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_ack(struct nlbl_mock_link *link,
+			 const struct nlmsghdr *nl_hdr, int error)
+{
+	struct {
+		struct nlmsghdr hdr;
+		struct nlmsgerr err;
+	} ack;
+
+	memset(&ack, 0, sizeof(ack));
+	ack.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(ack.err));
+	ack.hdr.nlmsg_type = NLMSG_ERROR;
+	ack.hdr.nlmsg_seq = nl_hdr->nlmsg_seq;
+	ack.hdr.nlmsg_pid = nl_hdr->nlmsg_pid;
+	ack.err.error = error;
+	ack.err.msg = *nl_hdr;
+
+	return nlbl_mock_unicast(link, &ack, ack.hdr.nlmsg_len);
+}
+
+/**
+ * Finish a dump
+ * @param link the mock kernel connection
+ * @param nl_hdr the dump request
+ *
+ * Add the NLMSG_DONE message to the dump and send the last datagram.  Returns
+ * zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_done(struct nlbl_mock_link *link,
+			  const struct nlmsghdr *nl_hdr)
+{
+	int rc;
+	struct {
+		struct nlmsghdr hdr;
+		int error;
+	} done;
+
+	memset(&done, 0, sizeof(done));
+	done.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(done.error));
+	done.hdr.nlmsg_type = NLMSG_DONE;
+	done.hdr.nlmsg_flags = NLM_F_MULTI;
+	done.hdr.nlmsg_seq = nl_hdr->nlmsg_seq;
+	done.hdr.nlmsg_pid = nl_hdr->nlmsg_pid;
+
+	rc = nlbl_mock_dgram_add(link, &done.hdr);
+	if (rc < 0)
+		return rc;
+	return nlbl_mock_dgram_send(link);
+}
+
+/*
+ * Generic Netlink Controller
+ */
+
+/**
+ * Dump the generic netlink families
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_ctrl_getfamily(struct nlbl_mock_req *req);
+
+/* generic netlink controller operations */
+static const struct nlbl_mock_op nlbl_mock_ctrl_ops[] = {
+	[CTRL_CMD_GETFAMILY] = { .dumpit = nlbl_mock_ctrl_getfamily },
+};
+
+/*
+ * Management Family
+ */
+
+/**
+ * Parse a domain mapping request
+ * @param req the request
+ * @param domain the domain mapping
+ * @param addr the network address
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_mgmt_parse(const struct nlbl_mock_req *req,
+				struct nlbl_dommap *domain,
+				struct nlbl_netaddr *addr)
+{
+	int rc;
+	struct nlattr *const *tb = req->tb;
+
+	memset(domain, 0, sizeof(*domain));
+	if (tb[NLBL_MGMT_A_PROTOCOL] == NULL)
+		return -EINVAL;
+	if (tb[NLBL_MGMT_A_DOMAIN] != NULL)
+		domain->domain = nla_get_string(tb[NLBL_MGMT_A_DOMAIN]);
+	if (tb[NLBL_MGMT_A_FAMILY] != NULL)
+		domain->family = nla_get_u16(tb[NLBL_MGMT_A_FAMILY]);
+	domain->proto_type = nla_get_u32(tb[NLBL_MGMT_A_PROTOCOL]);
+
+	rc = nlbl_mock_addr_get(req,
+				NLBL_MGMT_A_IPV4ADDR, NLBL_MGMT_A_IPV4MASK,
+				NLBL_MGMT_A_IPV6ADDR, NLBL_MGMT_A_IPV6MASK,
+				addr);
+	if (rc < 0)
+		return rc;
+
+	/* CIPSO only labels IPv4 and CALIPSO only labels IPv6 */
+	switch (domain->proto_type) {
+	case NETLBL_NLTYPE_UNLABELED:
+		break;
+	case NETLBL_NLTYPE_CIPSOV4:
+		if (tb[NLBL_MGMT_A_CV4DOI] == NULL || addr->type == AF_INET6)
+			return -EINVAL;
+		domain->proto.cip_doi = nla_get_u32(tb[NLBL_MGMT_A_CV4DOI]);
+		break;
+	case NETLBL_NLTYPE_CALIPSO:
+		if (tb[NLBL_MGMT_A_CLPDOI] == NULL || addr->type == AF_INET)
+			return -EINVAL;
+		domain->proto.clp_doi = nla_get_u32(tb[NLBL_MGMT_A_CLPDOI]);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/**
+ * Add the labeling protocol of a mapping to a message
+ * @param msg the message
+ * @param proto_type the labeling protocol
+ * @param doi the DOI
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_mgmt_proto_put(nlbl_msg *msg,
+				    nlbl_proto proto_type, uint32_t doi)
+{
+	if (nla_put_u32(msg, NLBL_MGMT_A_PROTOCOL, proto_type) < 0)
+		return -ENOMEM;
+	switch (proto_type) {
+	case NETLBL_NLTYPE_CIPSOV4:
+		if (nla_put_u32(msg, NLBL_MGMT_A_CV4DOI, doi) < 0)
+			return -ENOMEM;
+		break;
+	case NETLBL_NLTYPE_CALIPSO:
+		if (nla_put_u32(msg, NLBL_MGMT_A_CLPDOI, doi) < 0)
+			return -ENOMEM;
+		break;
+	}
+
+	return 0;
+}
+
+/**
+ * Add a domain mapping to a message
+ * @param msg the message
+ * @param map the domain mapping
+ *
+ * Add the attributes of @map in the same form as the kernel lists them.
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_mgmt_map_put(nlbl_msg *msg,
+				  const struct nlbl_config_map *map)
+{
+	int rc;
+	struct nlattr *nla_list;
+	struct nlattr *nla_sel;
+	const struct nlbl_dommap_addr *addrsel;
+	size_t iter;
+
+	if (map->domain != NULL &&
+	    nla_put_string(msg, NLBL_MGMT_A_DOMAIN, map->domain) < 0)
+		return -ENOMEM;
+	if (nla_put_u16(msg, NLBL_MGMT_A_FAMILY, map->family) < 0)
+		return -ENOMEM;
+	if (map->proto_type != NETLBL_NLTYPE_ADDRSELECT)
+		return nlbl_mock_mgmt_proto_put(msg, map->proto_type, map->doi);
+
+	nla_list = nlbl_mock_nest_start(msg, NLBL_MGMT_A_SELECTORLIST);
+	if (nla_list == NULL)
+		return -ENOMEM;
+	for (iter = 0; iter < map->addrsel.count; iter++) {
+		addrsel = nlbl_mock_elem(&map->addrsel, iter);
+		nla_sel = nlbl_mock_nest_start(msg, NLBL_MGMT_A_ADDRSELECTOR);
+		if (nla_sel == NULL)
+			return -ENOMEM;
+		rc = nlbl_mock_addr_put(msg, &addrsel->addr,
+					NLBL_MGMT_A_IPV4ADDR,
+					NLBL_MGMT_A_IPV4MASK,
+					NLBL_MGMT_A_IPV6ADDR,
+					NLBL_MGMT_A_IPV6MASK);
+		if (rc < 0)
+			return rc;
+		rc = nlbl_mock_mgmt_proto_put(msg, addrsel->proto_type,
+					      addrsel->proto_type ==
+					      NETLBL_NLTYPE_CALIPSO ?
+					      addrsel->proto.clp_doi :
+					      addrsel->proto.cip_doi);
+		if (rc < 0)
+			return rc;
+		nla_nest_end(msg, nla_sel);
+	}
+	nla_nest_end(msg, nla_list);
+
+	return 0;
+}
+
+/**
+ * Handle a NLBL_MGMT_C_ADD request
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_mgmt_add(struct nlbl_mock_req *req)
+{
+	int rc;
+	struct nlbl_dommap domain;
+	struct nlbl_netaddr addr;
+
+	rc = nlbl_mock_mgmt_parse(req, &domain, &addr);
+	if (rc < 0)
+		return rc;
+	if (domain.domain == NULL)
+		return -EINVAL;
+
+	return nlbl_config_mgmt_add(req->cfg, &domain, &addr);
+}
+
+/**
+ * Handle a NLBL_MGMT_C_REMOVE request
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_mgmt_remove(struct nlbl_mock_req *req)
+{
+	if (req->tb[NLBL_MGMT_A_DOMAIN] == NULL)
+		return -EINVAL;
+
+	return nlbl_config_mgmt_del(req->cfg,
+				    nla_get_string(req->tb[NLBL_MGMT_A_DOMAIN]));
+}
+
+/**
+ * Handle a NLBL_MGMT_C_LISTALL dump
+ * @param req the request
+ *
+ * List the domain mappings, the default mappings are not part of the dump.
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_mgmt_listall(struct nlbl_mock_req *req)
+{
+	int rc;
+	nlbl_msg *msg;
+	const struct nlbl_config_map *map;
+	size_t iter;
+
+	for (iter = 0; iter < req->cfg->maps.count; iter++) {
+		map = nlbl_mock_elem(&req->cfg->maps, iter);
+		if (map->domain == NULL)
+			continue;
+
+		msg = nlbl_mock_entry_new(req);
+		if (msg == NULL)
+			return -ENOMEM;
+		rc = nlbl_mock_mgmt_map_put(msg, map);
+		if (rc < 0) {
+			nlmsg_free(msg);
+			return rc;
+		}
+		rc = nlbl_mock_entry(req, msg);
+		if (rc < 0)
+			return rc;
+	}
+
+	return 0;
+}
+
+/**
+ * Handle a NLBL_MGMT_C_ADDDEF request
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_mgmt_adddef(struct nlbl_mock_req *req)
+{
+	int rc;
+	struct nlbl_dommap domain;
+	struct nlbl_netaddr addr;
+
+	rc = nlbl_mock_mgmt_parse(req, &domain, &addr);
+	if (rc < 0)
+		return rc;
+
+	return nlbl_config_mgmt_adddef(req->cfg, &domain, &addr);
+}
+
+/**
+ * Handle a NLBL_MGMT_C_REMOVEDEF request
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_mgmt_removedef(struct nlbl_mock_req *req)
+{
+	return nlbl_config_mgmt_deldef(req->cfg);
+}
+
+/**
+ * Handle a NLBL_MGMT_C_LISTDEF request
+ * @param req the request
+ *
+ * Reply with the default mapping of the requested address family, IPv4 if
+ * no family is given; a default mapping for both families is returned for
+ * either of them.  Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_mgmt_listdef(struct nlbl_mock_req *req)
+{
+	int rc;
+	nlbl_msg *msg;
+	const struct nlbl_config_map *map;
+	uint16_t family = AF_INET;
+	size_t iter;
+
+	if (req->tb[NLBL_MGMT_A_FAMILY] != NULL)
+		family = nla_get_u16(req->tb[NLBL_MGMT_A_FAMILY]);
+
+	/* the default mappings sort first */
+	for (iter = 0; iter < req->cfg->maps.count; iter++) {
+		map = nlbl_mock_elem(&req->cfg->maps, iter);
+		if (map->domain != NULL)
+			return -ENOENT;
+		if (map->family == family || map->family == AF_UNSPEC)
+			break;
+	}
+	if (iter == req->cfg->maps.count)
+		return -ENOENT;
+
+	msg = nlbl_mock_reply_new(req);
+	if (msg == NULL)
+		return -ENOMEM;
+	rc = nlbl_mock_mgmt_map_put(msg, map);
+	if (rc < 0) {
+		nlmsg_free(msg);
+		return rc;
+	}
+	return nlbl_mock_reply(req, msg);
+}
+
+/**
+ * Handle a NLBL_MGMT_C_PROTOCOLS dump
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_mgmt_protocols(struct nlbl_mock_req *req)
+{
+	int rc;
+	nlbl_msg *msg;
+	static const nlbl_proto protos[] = {
+		NETLBL_NLTYPE_UNLABELED,
+		NETLBL_NLTYPE_CIPSOV4,
+		NETLBL_NLTYPE_CALIPSO,
+	};
+	unsigned int iter;
+
+	for (iter = 0; iter < sizeof(protos) / sizeof(*protos); iter++) {
+		msg = nlbl_mock_entry_new(req);
+		if (msg == NULL)
+			return -ENOMEM;
+		if (nla_put_u32(msg, NLBL_MGMT_A_PROTOCOL, protos[iter]) < 0) {
+			nlmsg_free(msg);
+			return -ENOMEM;
+		}
+		rc = nlbl_mock_entry(req, msg);
+		if (rc < 0)
+			return rc;
+	}
+
+	return 0;
+}
+
+/**
+ * Handle a NLBL_MGMT_C_VERSION request
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_mgmt_version(struct nlbl_mock_req *req)
+{
+	nlbl_msg *msg;
+
+	msg = nlbl_mock_reply_new(req);
+	if (msg == NULL)
+		return -ENOMEM;
+	if (nla_put_u32(msg, NLBL_MGMT_A_VERSION, NETLBL_PROTO_VERSION) < 0) {
+		nlmsg_free(msg);
+		return -ENOMEM;
+	}
+	return nlbl_mock_reply(req, msg);
+}
+
+/* management operations */
+static const struct nlbl_mock_op nlbl_mock_mgmt_ops[NLBL_MGMT_C_MAX + 1] = {
+	[NLBL_MGMT_C_ADD] = { .doit = nlbl_mock_mgmt_add },
+	[NLBL_MGMT_C_REMOVE] = { .doit = nlbl_mock_mgmt_remove },
+	[NLBL_MGMT_C_LISTALL] = { .dumpit = nlbl_mock_mgmt_listall },
+	[NLBL_MGMT_C_ADDDEF] = { .doit = nlbl_mock_mgmt_adddef },
+	[NLBL_MGMT_C_REMOVEDEF] = { .doit = nlbl_mock_mgmt_removedef },
+	[NLBL_MGMT_C_LISTDEF] = { .doit = nlbl_mock_mgmt_listdef },
+	[NLBL_MGMT_C_PROTOCOLS] = { .dumpit = nlbl_mock_mgmt_protocols },
+	[NLBL_MGMT_C_VERSION] = { .doit = nlbl_mock_mgmt_version },
+};
+
+/*
+ * CIPSO Family
+ */
+
+/**
+ * Parse a CIPSO level or category mapping list
+ * @param nla_list the list attribute
+ * @param a_entry the entry attribute
+ * @param a_loc the local value attribute
+ * @param a_rem the remote value attribute
+ * @param array the mapping array
+ *
+ * Parse the local and remote value pairs in @nla_list into a new array stored
+ * in @array, which the caller must free.  Returns the number of mappings on
+ * success, negative values on failure.
+ *
+ */
+static int nlbl_mock_cipso_map_get(const struct nlattr *nla_list,
+				   int a_entry, int a_loc, int a_rem,
+				   uint32_t **array)
+{
+	struct nlattr *nla_entry;
+	struct nlattr *nla_loc;
+	struct nlattr *nla_rem;
+	int rem;
+	int count = 0;
+
+	*array = NULL;
+	nla_for_each_attr(nla_entry, nla_data(nla_list), nla_len(nla_list), rem)
+		if (nla_type(nla_entry) == a_entry)
+			count++;
+	if (count == 0)
+		return 0;
+
+	*array = malloc(count * 2 * sizeof(**array));
+	if (*array == NULL)
+		return -ENOMEM;
+	count = 0;
+	nla_for_each_attr(nla_entry, nla_data(nla_list), nla_len(nla_list),
+			  rem) {
+		if (nla_type(nla_entry) != a_entry)
+			continue;
+		nla_loc = nla_find(nla_data(nla_entry), nla_len(nla_entry),
+				   a_loc);
+		nla_rem = nla_find(nla_data(nla_entry), nla_len(nla_entry),
+				   a_rem);
+		if (nla_loc == NULL || nla_rem == NULL) {
+			free(*array);
+			*array = NULL;
+			return -EINVAL;
+		}
+		(*array)[count * 2] = nla_get_u32(nla_loc);
+		(*array)[count * 2 + 1] = nla_get_u32(nla_rem);
+		count++;
+	}
+
+	return count;
+}
+
+/**
+ * Add a CIPSO level or category mapping list to a message
+ * @param msg the message
+ * @param array the mapping array
+ * @param count the number of mappings
+ * @param a_list the list attribute
+ * @param a_entry the entry attribute
+ * @param a_loc the local value attribute
+ * @param a_rem the remote value attribute
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_cipso_map_put(nlbl_msg *msg,
+				   const uint32_t *array, size_t count,
+				   int a_list, int a_entry, int a_loc, int a_rem)
+{
+	struct nlattr *nla_list;
+	struct nlattr *nla_entry;
+	size_t iter;
+
+	nla_list = nlbl_mock_nest_start(msg, a_list);
+	if (nla_list == NULL)
+		return -ENOMEM;
+	for (iter = 0; iter < count; iter++) {
+		nla_entry = nlbl_mock_nest_start(msg, a_entry);
+		if (nla_entry == NULL ||
+		    nla_put_u32(msg, a_loc, array[iter * 2]) < 0 ||
+		    nla_put_u32(msg, a_rem, array[iter * 2 + 1]) < 0)
+			return -ENOMEM;
+		nla_nest_end(msg, nla_entry);
+	}
+	nla_nest_end(msg, nla_list);
+
+	return 0;
+}
+
+/**
+ * Handle a NLBL_CIPSOV4_C_ADD request
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_cipso_add(struct nlbl_mock_req *req)
+{
+	int rc;
+	struct nlattr *const *tb = req->tb;
+	struct nlattr *nla;
+	int rem;
+	nlbl_cip_doi doi;
+	nlbl_cip_tag tag_array[NLBL_MOCK_A_MAX];
+	struct nlbl_cip_tag_a tags = { .array = tag_array, .size = 0 };
+	struct nlbl_cip_lvl_a lvls = { .array = NULL, .size = 0 };
+	struct nlbl_cip_cat_a cats = { .array = NULL, .size = 0 };
+
+	if (tb[NLBL_CIPSOV4_A_DOI] == NULL ||
+	    tb[NLBL_CIPSOV4_A_MTYPE] == NULL ||
+	    tb[NLBL_CIPSOV4_A_TAGLST] == NULL)
+		return -EINVAL;
+	doi = nla_get_u32(tb[NLBL_CIPSOV4_A_DOI]);
+
+	nla_for_each_attr(nla, nla_data(tb[NLBL_CIPSOV4_A_TAGLST]),
+			  nla_len(tb[NLBL_CIPSOV4_A_TAGLST]), rem) {
+		if (nla_type(nla) != NLBL_CIPSOV4_A_TAG)
+			continue;
+		if (tags.size == NLBL_MOCK_A_MAX)
+			return -E2BIG;
+		tag_array[tags.size++] = nla_get_u8(nla);
+	}
+	if (tags.size == 0)
+		return -EINVAL;
+
+	switch (nla_get_u32(tb[NLBL_CIPSOV4_A_MTYPE])) {
+	case CIPSO_V4_MAP_TRANS:
+		if (tb[NLBL_CIPSOV4_A_MLSLVLLST] == NULL)
+			return -EINVAL;
+		rc = nlbl_mock_cipso_map_get(tb[NLBL_CIPSOV4_A_MLSLVLLST],
+					     NLBL_CIPSOV4_A_MLSLVL,
+					     NLBL_CIPSOV4_A_MLSLVLLOC,
+					     NLBL_CIPSOV4_A_MLSLVLREM,
+					     &lvls.array);
+		if (rc < 0)
+			return rc;
+		lvls.size = rc;
+		if (tb[NLBL_CIPSOV4_A_MLSCATLST] != NULL) {
+			rc = nlbl_mock_cipso_map_get(
+					tb[NLBL_CIPSOV4_A_MLSCATLST],
+					NLBL_CIPSOV4_A_MLSCAT,
+					NLBL_CIPSOV4_A_MLSCATLOC,
+					NLBL_CIPSOV4_A_MLSCATREM,
+					&cats.array);
+			if (rc < 0) {
+				free(lvls.array);
+				return rc;
+			}
+			cats.size = rc;
+		}
+		rc = nlbl_config_cipso_add_trans(req->cfg, doi,
+						 &tags, &lvls, &cats);
+		free(lvls.array);
+		free(cats.array);
+		return rc;
+	case CIPSO_V4_MAP_PASS:
+		return nlbl_config_cipso_add_pass(req->cfg, doi, &tags);
+	case CIPSO_V4_MAP_LOCAL:
+		return nlbl_config_cipso_add_local(req->cfg, doi);
+	default:
+		return -EINVAL;
+	}
+}
+
+/**
+ * Handle a NLBL_CIPSOV4_C_REMOVE request
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_cipso_remove(struct nlbl_mock_req *req)
+{
+	if (req->tb[NLBL_CIPSOV4_A_DOI] == NULL)
+		return -EINVAL;
+
+	return nlbl_config_cipso_del(req->cfg,
+				     nla_get_u32(req->tb[NLBL_CIPSOV4_A_DOI]));
+}
+
+/**
+ * Handle a NLBL_CIPSOV4_C_LIST request
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_cipso_list(struct nlbl_mock_req *req)
+{
+	int rc = -ENOMEM;
+	nlbl_msg *msg;
+	const struct nlbl_config_cipso *cipso;
+	struct nlattr *nla_list;
+	size_t iter;
+
+	if (req->tb[NLBL_CIPSOV4_A_DOI] == NULL)
+		return -EINVAL;
+	cipso = nlbl_mock_doi_find(&req->cfg->cipso,
+				   nla_get_u32(req->tb[NLBL_CIPSOV4_A_DOI]));
+	if (cipso == NULL)
+		return -EINVAL;
+
+	msg = nlbl_mock_reply_new(req);
+	if (msg == NULL)
+		return -ENOMEM;
+	if (nla_put_u32(msg, NLBL_CIPSOV4_A_MTYPE, cipso->mtype) < 0)
+		goto list_failure;
+
+	nla_list = nlbl_mock_nest_start(msg, NLBL_CIPSOV4_A_TAGLST);
+	if (nla_list == NULL)
+		goto list_failure;
+	for (iter = 0; iter < cipso->tags.size; iter++)
+		if (nla_put_u8(msg, NLBL_CIPSOV4_A_TAG,
+			       cipso->tags.array[iter]) < 0)
+			goto list_failure;
+	nla_nest_end(msg, nla_list);
+
+	if (cipso->mtype == CIPSO_V4_MAP_TRANS) {
+		rc = nlbl_mock_cipso_map_put(msg, cipso->lvls.array,
+					     cipso->lvls.size,
+					     NLBL_CIPSOV4_A_MLSLVLLST,
+					     NLBL_CIPSOV4_A_MLSLVL,
+					     NLBL_CIPSOV4_A_MLSLVLLOC,
+					     NLBL_CIPSOV4_A_MLSLVLREM);
+		if (rc < 0)
+			goto list_failure;
+		rc = nlbl_mock_cipso_map_put(msg, cipso->cats.array,
+					     cipso->cats.size,
+					     NLBL_CIPSOV4_A_MLSCATLST,
+					     NLBL_CIPSOV4_A_MLSCAT,
+					     NLBL_CIPSOV4_A_MLSCATLOC,
+					     NLBL_CIPSOV4_A_MLSCATREM);
+		if (rc < 0)
+			goto list_failure;
+	}
+
+	return nlbl_mock_reply(req, msg);
+
+list_failure:
+	nlmsg_free(msg);
+	return rc;
+}
+
+/**
+ * Handle a NLBL_CIPSOV4_C_LISTALL dump
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_cipso_listall(struct nlbl_mock_req *req)
+{
+	int rc;
+	nlbl_msg *msg;
+	const struct nlbl_config_cipso *cipso;
+	size_t iter;
+
+	for (iter = 0; iter < req->cfg->cipso.count; iter++) {
+		cipso = nlbl_mock_elem(&req->cfg->cipso, iter);
+		msg = nlbl_mock_entry_new(req);
+		if (msg == NULL)
+			return -ENOMEM;
+		if (nla_put_u32(msg, NLBL_CIPSOV4_A_DOI, cipso->doi) < 0 ||
+		    nla_put_u32(msg, NLBL_CIPSOV4_A_MTYPE, cipso->mtype) < 0) {
+			nlmsg_free(msg);
+			return -ENOMEM;
+		}
+		rc = nlbl_mock_entry(req, msg);
+		if (rc < 0)
+			return rc;
+	}
+
+	return 0;
+}
+
+/* CIPSO operations */
+static const struct nlbl_mock_op nlbl_mock_cipso_ops[NLBL_CIPSOV4_C_MAX + 1] = {
+	[NLBL_CIPSOV4_C_ADD] = { .doit = nlbl_mock_cipso_add },
+	[NLBL_CIPSOV4_C_REMOVE] = { .doit = nlbl_mock_cipso_remove },
+	[NLBL_CIPSOV4_C_LIST] = { .doit = nlbl_mock_cipso_list },
+	[NLBL_CIPSOV4_C_LISTALL] = { .dumpit = nlbl_mock_cipso_listall },
+};
+
+/*
+ * Unlabeled Family
+ */
+
+/**
+ * Parse a static label request
+ * @param req the request
+ * @param addr the network address
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_unlbl_addr_get(const struct nlbl_mock_req *req,
+				    struct nlbl_netaddr *addr)
+{
+	int rc;
+
+	rc = nlbl_mock_addr_get(req,
+				NLBL_UNLABEL_A_IPV4ADDR,
+				NLBL_UNLABEL_A_IPV4MASK,
+				NLBL_UNLABEL_A_IPV6ADDR,
+				NLBL_UNLABEL_A_IPV6MASK,
+				addr);
+	if (rc < 0)
+		return rc;
+	if (addr->type == AF_UNSPEC)
+		return -EINVAL;
+
+	return 0;
+}
+
+/**
+ * Handle a NLBL_UNLABEL_C_ACCEPT request
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_unlbl_accept(struct nlbl_mock_req *req)
+{
+	uint8_t value;
+
+	if (req->tb[NLBL_UNLABEL_A_ACPTFLG] == NULL)
+		return -EINVAL;
+	value = nla_get_u8(req->tb[NLBL_UNLABEL_A_ACPTFLG]);
+	if (value != 0 && value != 1)
+		return -EINVAL;
+
+	return nlbl_config_unlbl_accept(req->cfg, value);
+}
+
+/**
+ * Handle a NLBL_UNLABEL_C_LIST request
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_unlbl_list(struct nlbl_mock_req *req)
+{
+	nlbl_msg *msg;
+
+	msg = nlbl_mock_reply_new(req);
+	if (msg == NULL)
+		return -ENOMEM;
+	if (nla_put_u8(msg, NLBL_UNLABEL_A_ACPTFLG, req->cfg->accept) < 0) {
+		nlmsg_free(msg);
+		return -ENOMEM;
+	}
+	return nlbl_mock_reply(req, msg);
+}
+
+/**
+ * Handle a NLBL_UNLABEL_C_STATICADD request
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_unlbl_staticadd(struct nlbl_mock_req *req)
+{
+	int rc;
+	struct nlbl_netaddr addr;
+
+	if (req->tb[NLBL_UNLABEL_A_IFACE] == NULL ||
+	    req->tb[NLBL_UNLABEL_A_SECCTX] == NULL)
+		return -EINVAL;
+	rc = nlbl_mock_unlbl_addr_get(req, &addr);
+	if (rc < 0)
+		return rc;
+
+	return nlbl_config_unlbl_staticadd(req->cfg,
+			nla_get_string(req->tb[NLBL_UNLABEL_A_IFACE]),
+			&addr,
+			nla_get_string(req->tb[NLBL_UNLABEL_A_SECCTX]));
+}
+
+/**
+ * Handle a NLBL_UNLABEL_C_STATICREMOVE request
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_unlbl_staticremove(struct nlbl_mock_req *req)
+{
+	int rc;
+	struct nlbl_netaddr addr;
+
+	if (req->tb[NLBL_UNLABEL_A_IFACE] == NULL)
+		return -EINVAL;
+	rc = nlbl_mock_unlbl_addr_get(req, &addr);
+	if (rc < 0)
+		return rc;
+
+	return nlbl_config_unlbl_staticdel(req->cfg,
+			nla_get_string(req->tb[NLBL_UNLABEL_A_IFACE]),
+			&addr);
+}
+
+/**
+ * Handle a NLBL_UNLABEL_C_STATICADDDEF request
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_unlbl_staticadddef(struct nlbl_mock_req *req)
+{
+	int rc;
+	struct nlbl_netaddr addr;
+
+	if (req->tb[NLBL_UNLABEL_A_SECCTX] == NULL)
+		return -EINVAL;
+	rc = nlbl_mock_unlbl_addr_get(req, &addr);
+	if (rc < 0)
+		return rc;
+
+	return nlbl_config_unlbl_staticadddef(req->cfg, &addr,
+			nla_get_string(req->tb[NLBL_UNLABEL_A_SECCTX]));
+}
+
+/**
+ * Handle a NLBL_UNLABEL_C_STATICREMOVEDEF request
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_unlbl_staticremovedef(struct nlbl_mock_req *req)
+{
+	int rc;
+	struct nlbl_netaddr addr;
+
+	rc = nlbl_mock_unlbl_addr_get(req, &addr);
+	if (rc < 0)
+		return rc;
+
+	return nlbl_config_unlbl_staticdeldef(req->cfg, &addr);
+}
+
+/**
+ * Dump the static labels
+ * @param req the request
+ * @param def true for the default static labels, false for the others
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_unlbl_staticdump(struct nlbl_mock_req *req, int def)
+{
+	int rc;
+	nlbl_msg *msg;
+	const struct nlbl_addrmap *addrmap;
+	size_t iter;
+
+	for (iter = 0; iter < req->cfg->addrs.count; iter++) {
+		addrmap = nlbl_mock_elem(&req->cfg->addrs, iter);
+		if ((addrmap->dev == NULL) != def)
+			continue;
+
+		msg = nlbl_mock_entry_new(req);
+		if (msg == NULL)
+			return -ENOMEM;
+		rc = -ENOMEM;
+		if (addrmap->dev != NULL &&
+		    nla_put_string(msg, NLBL_UNLABEL_A_IFACE,
+				   addrmap->dev) < 0)
+			goto dump_failure;
+		rc = nlbl_mock_addr_put(msg, &addrmap->addr,
+					NLBL_UNLABEL_A_IPV4ADDR,
+					NLBL_UNLABEL_A_IPV4MASK,
+					NLBL_UNLABEL_A_IPV6ADDR,
+					NLBL_UNLABEL_A_IPV6MASK);
+		if (rc < 0)
+			goto dump_failure;
+		if (nla_put_string(msg, NLBL_UNLABEL_A_SECCTX,
+				   addrmap->label) < 0) {
+			rc = -ENOMEM;
+			goto dump_failure;
+		}
+		rc = nlbl_mock_entry(req, msg);
+		if (rc < 0)
+			return rc;
+	}
+
+	return 0;
+
+dump_failure:
+	nlmsg_free(msg);
+	return rc;
+}
+
+/**
+ * Handle a NLBL_UNLABEL_C_STATICLIST dump
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_unlbl_staticlist(struct nlbl_mock_req *req)
+{
+	return nlbl_mock_unlbl_staticdump(req, 0);
+}
+
+/**
+ * Handle a NLBL_UNLABEL_C_STATICLISTDEF dump
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_unlbl_staticlistdef(struct nlbl_mock_req *req)
+{
+	return nlbl_mock_unlbl_staticdump(req, 1);
+}
+
+/* unlabeled operations */
+static const struct nlbl_mock_op nlbl_mock_unlbl_ops[NLBL_UNLABEL_C_MAX + 1] = {
+	[NLBL_UNLABEL_C_ACCEPT] = { .doit = nlbl_mock_unlbl_accept },
+	[NLBL_UNLABEL_C_LIST] = { .doit = nlbl_mock_unlbl_list },
+	[NLBL_UNLABEL_C_STATICADD] = { .doit = nlbl_mock_unlbl_staticadd },
+	[NLBL_UNLABEL_C_STATICREMOVE] = {
+		.doit = nlbl_mock_unlbl_staticremove },
+	[NLBL_UNLABEL_C_STATICLIST] = {
+		.dumpit = nlbl_mock_unlbl_staticlist },
+	[NLBL_UNLABEL_C_STATICADDDEF] = {
+		.doit = nlbl_mock_unlbl_staticadddef },
+	[NLBL_UNLABEL_C_STATICREMOVEDEF] = {
+		.doit = nlbl_mock_unlbl_staticremovedef },
+	[NLBL_UNLABEL_C_STATICLISTDEF] = {
+		.dumpit = nlbl_mock_unlbl_staticlistdef },
+};
+
+/*
+ * CALIPSO Family
+ */
+
+/**
+ * Handle a NLBL_CALIPSO_C_ADD request
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_calipso_add(struct nlbl_mock_req *req)
+{
+	if (req->tb[NLBL_CALIPSO_A_DOI] == NULL ||
+	    req->tb[NLBL_CALIPSO_A_MTYPE] == NULL)
+		return -EINVAL;
+	if (nla_get_u32(req->tb[NLBL_CALIPSO_A_MTYPE]) != CALIPSO_MAP_PASS)
+		return -EINVAL;
+
+	return nlbl_config_calipso_add_pass(req->cfg,
+				nla_get_u32(req->tb[NLBL_CALIPSO_A_DOI]));
+}
+
+/**
+ * Handle a NLBL_CALIPSO_C_REMOVE request
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_calipso_remove(struct nlbl_mock_req *req)
+{
+	if (req->tb[NLBL_CALIPSO_A_DOI] == NULL)
+		return -EINVAL;
+
+	return nlbl_config_calipso_del(req->cfg,
+				nla_get_u32(req->tb[NLBL_CALIPSO_A_DOI]));
+}
+
+/**
+ * Handle a NLBL_CALIPSO_C_LIST request
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_calipso_list(struct nlbl_mock_req *req)
+{
+	nlbl_msg *msg;
+	const struct nlbl_config_calipso *calipso;
+
+	if (req->tb[NLBL_CALIPSO_A_DOI] == NULL)
+		return -EINVAL;
+	calipso = nlbl_mock_doi_find(&req->cfg->calipso,
+				     nla_get_u32(req->tb[NLBL_CALIPSO_A_DOI]));
+	if (calipso == NULL)
+		return -EINVAL;
+
+	msg = nlbl_mock_reply_new(req);
+	if (msg == NULL)
+		return -ENOMEM;
+	if (nla_put_u32(msg, NLBL_CALIPSO_A_MTYPE, calipso->mtype) < 0) {
+		nlmsg_free(msg);
+		return -ENOMEM;
+	}
+	return nlbl_mock_reply(req, msg);
+}
+
+/**
+ * Handle a NLBL_CALIPSO_C_LISTALL dump
+ * @param req the request
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_calipso_listall(struct nlbl_mock_req *req)
+{
+	int rc;
+	nlbl_msg *msg;
+	const struct nlbl_config_calipso *calipso;
+	size_t iter;
+
+	for (iter = 0; iter < req->cfg->calipso.count; iter++) {
+		calipso = nlbl_mock_elem(&req->cfg->calipso, iter);
+		msg = nlbl_mock_entry_new(req);
+		if (msg == NULL)
+			return -ENOMEM;
+		if (nla_put_u32(msg, NLBL_CALIPSO_A_DOI, calipso->doi) < 0 ||
+		    nla_put_u32(msg, NLBL_CALIPSO_A_MTYPE,
+				calipso->mtype) < 0) {
+			nlmsg_free(msg);
+			return -ENOMEM;
+		}
+		rc = nlbl_mock_entry(req, msg);
+		if (rc < 0)
+			return rc;
+	}
+
+	return 0;
+}
+
+/* CALIPSO operations */
+static const struct nlbl_mock_op nlbl_mock_calipso_ops[NLBL_CALIPSO_C_MAX + 1] = {
+	[NLBL_CALIPSO_C_ADD] = { .doit = nlbl_mock_calipso_add },
+	[NLBL_CALIPSO_C_REMOVE] = { .doit = nlbl_mock_calipso_remove },
+	[NLBL_CALIPSO_C_LIST] = { .doit = nlbl_mock_calipso_list },
+	[NLBL_CALIPSO_C_LISTALL] = { .dumpit = nlbl_mock_calipso_listall },
+};
+
+/*
+ * Request Processing
+ */
+
+/* NetLabel families, in the order of enum nlbl_family */
+static const struct nlbl_mock_family nlbl_mock_families[NLBL_FAMILY_MAX] = {
+	[NLBL_FAMILY_MGMT] = {
+		.name = NETLBL_NLTYPE_MGMT_NAME,
+		.maxtype = NLBL_MGMT_A_MAX,
+		.policy = nlbl_mgmt_policy,
+		.ops = nlbl_mock_mgmt_ops,
+		.ops_len = NLBL_MGMT_C_MAX + 1,
+	},
+	[NLBL_FAMILY_CIPSO] = {
+		.name = NETLBL_NLTYPE_CIPSOV4_NAME,
+		.maxtype = NLBL_CIPSOV4_A_MAX,
+		.policy = nlbl_cipso_policy,
+		.ops = nlbl_mock_cipso_ops,
+		.ops_len = NLBL_CIPSOV4_C_MAX + 1,
+	},
+	[NLBL_FAMILY_UNLBL] = {
+		.name = NETLBL_NLTYPE_UNLABELED_NAME,
+		.maxtype = NLBL_UNLABEL_A_MAX,
+		.policy = nlbl_unlbl_policy,
+		.ops = nlbl_mock_unlbl_ops,
+		.ops_len = NLBL_UNLABEL_C_MAX + 1,
+	},
+	[NLBL_FAMILY_CALIPSO] = {
+		.name = NETLBL_NLTYPE_CALIPSO_NAME,
+		.maxtype = NLBL_CALIPSO_A_MAX,
+		.policy = nlbl_calipso_policy,
+		.ops = nlbl_mock_calipso_ops,
+		.ops_len = NLBL_CALIPSO_C_MAX + 1,
+	},
+};
+
+/* generic netlink controller family */
+static const struct nlbl_mock_family nlbl_mock_ctrl = {
+	.name = "nlctrl",
+	.maxtype = 0,
+	.policy = NULL,
+	.ops = nlbl_mock_ctrl_ops,
+	.ops_len = sizeof(nlbl_mock_ctrl_ops) / sizeof(*nlbl_mock_ctrl_ops),
+};
+
+/**
+ * Add a generic netlink family to a family dump
+ * @param req the request
+ * @param id the family id
+ * @param name the family name
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_mock_ctrl_family_put(struct nlbl_mock_req *req,
+				     uint16_t id, const char *name)
+{
+	nlbl_msg *msg;
+
+	msg = nlbl_mock_entry_new(req);
+	if (msg == NULL)
+		return -ENOMEM;
+	if (nla_put_string(msg, CTRL_ATTR_FAMILY_NAME, name) < 0 ||
+	    nla_put_u16(msg, CTRL_ATTR_FAMILY_ID, id) < 0) {
+		nlmsg_free(msg);
+		return -ENOMEM;
+	}
+	return nlbl_mock_entry(req, msg);
+}
+
+static int nlbl_mock_ctrl_getfamily(struct nlbl_mock_req *req)
+{
+	int rc;
+	unsigned int iter;
+
+	/* the entries describe new families */
+	req->cmd = CTRL_CMD_NEWFAMILY;
+
+	rc = nlbl_mock_ctrl_family_put(req, GENL_ID_CTRL, nlbl_mock_ctrl.name);
+	if (rc < 0)
+		return rc;
+	for (iter = 0; iter < NLBL_FAMILY_MAX; iter++) {
+		rc = nlbl_mock_ctrl_family_put(req, NLBL_MOCK_ID_BASE + iter,
+					       nlbl_mock_families[iter].name);
+		if (rc < 0)
+			return rc;
+	}
+
+	return 0;
+}
+
+/**
+ * Process a request
+ * @param link the mock kernel connection
+ * @param nl_hdr the request
+ *
+ * Find the family and operation of the request, parse its attributes, and
+ * either run the request or the dump.  Returns zero if the request succeeded,
+ * one if the request was a dump, negative values on failure.
+ *
+ */
+static int nlbl_mock_request(struct nlbl_mock_link *link,
+			     const struct nlmsghdr *nl_hdr)
+{
+	int rc;
+	struct nlbl_mock_req req;
+	const struct nlbl_mock_family *family;
+	const struct nlbl_mock_op *op;
+	struct genlmsghdr *genl_hdr;
+
+	if (nl_hdr->nlmsg_len < NLMSG_LENGTH(GENL_HDRLEN))
+		return -EINVAL;
+	genl_hdr = nlmsg_data(nl_hdr);
+
+	if (nl_hdr->nlmsg_type == GENL_ID_CTRL)
+		family = &nlbl_mock_ctrl;
+	else if (nl_hdr->nlmsg_type >= NLBL_MOCK_ID_BASE &&
+		 nl_hdr->nlmsg_type < NLBL_MOCK_ID_BASE + NLBL_FAMILY_MAX)
+		family = &nlbl_mock_families[nl_hdr->nlmsg_type -
+					     NLBL_MOCK_ID_BASE];
+	else
+		return -ENOENT;
+	if (genl_hdr->cmd >= family->ops_len)
+		return -EOPNOTSUPP;
+	op = &family->ops[genl_hdr->cmd];
+
+	memset(&req, 0, sizeof(req));
+	req.link = link;
+	req.cfg = link->mock->cfg;
+	req.nl_hdr = nl_hdr;
+	req.family_id = nl_hdr->nlmsg_type;
+	req.cmd = genl_hdr->cmd;
+	if (family->policy != NULL) {
+		rc = nlbl_attr_parse(req.tb, family->maxtype,
+				     genlmsg_attrdata(genl_hdr, 0),
+				     genlmsg_attrlen(genl_hdr, 0),
+				     family->policy);
+		if (rc < 0)
+			return -EINVAL;
+	}
+
+	if ((nl_hdr->nlmsg_flags & NLM_F_DUMP) == NLM_F_DUMP) {
+		if (op->dumpit == NULL)
+			return -EOPNOTSUPP;
+		rc = op->dumpit(&req);
+		if (rc < 0) {
+			link->dgram_len = 0;
+			return rc;
+		}
+		rc = nlbl_mock_done(link, nl_hdr);
+		return (rc < 0 ? rc : 1);
+	}
+
+	if (op->doit == NULL)
+		return -EOPNOTSUPP;
+	return op->doit(&req);
+}
+
+/*
+ * Internal Mock Kernel Functions
+ */
+
+/**
+ * Get the mock kernel used by new handles
+ *
+ * Returns the mock kernel set with nlbl_mock_use(), NULL if new handles
+ * connect to the kernel.
+ *
+ */
+struct nlbl_mock *nlbl_mock_dflt(void)
+{
+	return __atomic_load_n(&nlbl_mock_active, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Attach a NetLabel handle to a mock kernel
+ * @param mock the mock kernel
+ * @param hndl the NetLabel handle
+ *
+ * Create the socket pair the mock kernel sends its responses to @hndl on.
+ * Returns zero on success, negative values on failure.
+ *
+ */
+int nlbl_mock_attach(struct nlbl_mock *mock, struct nlbl_handle *hndl)
+{
+	struct nlbl_mock_link *link;
+
+	link = calloc(1, sizeof(*link));
+	if (link == NULL)
+		return -ENOMEM;
+	if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, link->sock) < 0) {
+		free(link);
+		return -errno;
+	}
+	link->mock = mock;
+	nlbl_vec_init(&link->backlog, sizeof(struct nlbl_comm_dgram), 0);
+
+	hndl->mock = link;
+	return 0;
+}
+
+/**
+ * Detach a NetLabel handle from its mock kernel
+ * @param hndl the NetLabel handle
+ *
+ * Close the handle's socket pair and discard any responses held back.  Does
+ * nothing if @hndl is not attached to a mock kernel.
+ *
+ */
+void nlbl_mock_detach(struct nlbl_handle *hndl)
+{
+	struct nlbl_mock_link *link = hndl->mock;
+	struct nlbl_comm_dgram *dgram;
+	size_t iter;
+
+	if (link == NULL)
+		return;
+
+	for (iter = link->backlog_next; iter < link->backlog.count; iter++) {
+		dgram = nlbl_mock_elem(&link->backlog, iter);
+		free(dgram->data);
+	}
+	nlbl_vec_free(&link->backlog);
+	close(link->sock[0]);
+	close(link->sock[1]);
+	free(link->dgram);
+	free(link);
+	hndl->mock = NULL;
+}
+
+/**
+ * Get the file descriptor a mock kernel handle reads from
+ * @param hndl the NetLabel handle
+ */
+int nlbl_mock_fd(struct nlbl_handle *hndl)
+{
+	return hndl->mock->sock[0];
+}
+
+/**
+ * Send requests to a mock kernel
+ * @param hndl the NetLabel handle
+ * @param buf the requests
+ * @param len the length of the requests
+ *
+ * Process each of the requests in @buf, in order, and queue the responses on
+ * the handle.  As with the kernel, an ack is sent for a request which fails
+ * or asks for one, and none for a dump.  Returns @len on success, negative
+ * values on failure.
+ *
+ */
+int nlbl_mock_input(struct nlbl_handle *hndl, const void *buf, size_t len)
+{
+	int rc = 0;
+	struct nlbl_mock_link *link = hndl->mock;
+	const struct nlmsghdr *nl_hdr;
+	int rem = len;
+
+	/* dumps are sized to the handle's receive buffers */
+	if (link->dgram == NULL) {
+		link->dgram = malloc(NLBL_MOCK_DGRAM_MAX);
+		if (link->dgram == NULL)
+			return -ENOMEM;
+	}
+	link->dgram_max = (hndl->rbuf_size < NLBL_MOCK_DGRAM_MAX ?
+			   hndl->rbuf_size : NLBL_MOCK_DGRAM_MAX);
+
+	pthread_mutex_lock(&link->mock->lock);
+	for (nl_hdr = buf; nlmsg_ok(nl_hdr, rem);
+	     nl_hdr = nlmsg_next((struct nlmsghdr *)nl_hdr, &rem)) {
+		if (!(nl_hdr->nlmsg_flags & NLM_F_REQUEST))
+			continue;
+		rc = nlbl_mock_request(link, nl_hdr);
+		if (rc < 0 || (rc == 0 && (nl_hdr->nlmsg_flags & NLM_F_ACK))) {
+			rc = nlbl_mock_ack(link, nl_hdr, rc);
+			if (rc < 0)
+				break;
+		}
+		rc = 0;
+	}
+	pthread_mutex_unlock(&link->mock->lock);
+
+	return (rc < 0 ? rc : (int)len);
+}
+
+/**
+ * Write the held back responses of a mock kernel
+ * @param hndl the NetLabel handle
+ *
+ * Write as many of the responses held back for @hndl as fit in the handle's
+ * socket.  Returns zero on success, -ENOBUFS if a reply or an ack was dropped
+ * since the last call.
+ *
+ */
+int nlbl_mock_flush(struct nlbl_handle *hndl)
+{
+	struct nlbl_mock_link *link = hndl->mock;
+	struct nlbl_comm_dgram *dgram;
+
+	if (link->overrun) {
+		link->overrun = 0;
+		return -ENOBUFS;
+	}
+
+	while (link->backlog_next < link->backlog.count) {
+		dgram = nlbl_mock_elem(&link->backlog, link->backlog_next);
+		if (send(link->sock[1], dgram->data, dgram->len,
+			 MSG_DONTWAIT) < 0)
+			return 0;
+		free(dgram->data);
+		link->backlog_next++;
+	}
+	link->backlog.count = 0;
+	link->backlog_next = 0;
+
+	return 0;
+}
+
+/*
+ * Mock Kernel Functions
+ */
+
+/**
+ * Create a mock kernel
+ * @param cfg the initial configuration
+ *
+ * Create a mock kernel whose NetLabel configuration starts out as @cfg, or
+ * as a freshly booted kernel's configuration, see nlbl_config_new(), if @cfg
+ * is NULL.  The mock kernel takes over @cfg on success and changes it as it
+ * processes requests.  Handles are attached to the mock kernel with
+ * nlbl_mock_open() or nlbl_mock_use().  The caller is responsible for
+ * freeing the mock kernel with nlbl_mock_free().  Returns a pointer to the
+ * mock kernel on success, NULL on failure.
+ *
+ */
+struct nlbl_mock *nlbl_mock_new(struct nlbl_config *cfg)
+{
+	struct nlbl_mock *mock;
+
+	mock = calloc(1, sizeof(*mock));
+	if (mock == NULL)
+		return NULL;
+	if (cfg == NULL) {
+		cfg = nlbl_config_new();
+		if (cfg == NULL) {
+			free(mock);
+			return NULL;
+		}
+	}
+	pthread_mutex_init(&mock->lock, NULL);
+	mock->cfg = cfg;
+
+	return mock;
+}
+
+/**
+ * Free a mock kernel
+ * @param mock the mock kernel
+ *
+ * Free the mock kernel and its configuration.  If new handles are using the
+ * mock kernel, see nlbl_mock_use(), they go back to using the kernel.  All of
+ * the other handles attached to the mock kernel must be closed first.
+ *
+ */
+void nlbl_mock_free(struct nlbl_mock *mock)
+{
+	if (mock == NULL)
+		return;
+
+	if (nlbl_mock_dflt() == mock)
+		nlbl_mock_use(NULL);
+	nlbl_config_free(mock->cfg);
+	pthread_mutex_destroy(&mock->lock);
+	free(mock);
+}
+
+/**
+ * Get the configuration of a mock kernel
+ * @param mock the mock kernel
+ *
+ * Return the mock kernel's current NetLabel configuration, e.g. to check the
+ * result of a test or to save it with nlbl_config_export().  The
+ * configuration belongs to the mock kernel and is only valid until the next
+ * request sent to it, so no other thread may be sending requests to the mock
+ * kernel while it is in use.  Returns a pointer to the configuration on
+ * success, NULL on failure.
+ *
+ */
+const struct nlbl_config *nlbl_mock_config(const struct nlbl_mock *mock)
+{
+	return (mock != NULL ? mock->cfg : NULL);
+}
+
+/**
+ * Create a NetLabel handle attached to a mock kernel
+ * @param mock the mock kernel
+ *
+ * Create a new NetLabel handle which sends its requests to @mock instead of
+ * the kernel.  The handle supports every operation a kernel handle does,
+ * including batching and asynchronous mode, and is closed with
+ * nlbl_comm_close().  The handle uses the mock kernel's generic netlink
+ * family ids whether or not the library's default handle uses a mock kernel,
+ * see nlbl_mock_use().  Returns a pointer to the handle on success, NULL on
+ * failure.
+ *
+ */
+struct nlbl_handle *nlbl_mock_open(struct nlbl_mock *mock)
+{
+	if (mock == NULL)
+		return NULL;
+
+	return nlbl_comm_new(mock);
+}
+
+/**
+ * Use a mock kernel in place of the kernel
+ * @param mock the mock kernel, NULL for the kernel
+ *
+ * Attach the library's default NetLabel handle, and every handle created
+ * with nlbl_comm_open() from now on, to @mock so that an unmodified program
+ * runs against the mock kernel; if @mock is NULL they connect to the kernel
+ * again.  The default handle of every thread is recreated the next time it is
+ * needed.  Handles opened earlier are not affected.  No other thread may be
+ * sending requests at the time.
+ *
+ */
+void nlbl_mock_use(struct nlbl_mock *mock)
+{
+	__atomic_store_n(&nlbl_mock_active, mock, __ATOMIC_RELEASE);
+	nlbl_comm_dflt_reset_all();
+}
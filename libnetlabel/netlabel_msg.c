@@ -23,6 +23,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -32,6 +33,21 @@
 
 #include "netlabel_internal.h"
 
+/* number of commands with a request template in each family, every NetLabel
+ * family has fewer commands than this */
+#define NLBL_MSG_CMDS		16
+
+/* request header template */
+struct nlbl_msg_tmpl {
+	struct nlmsghdr nl_hdr;
+	struct genlmsghdr genl_hdr;
+};
+
+/* request header templates, indexed by family id source, family and
+ * command */
+static struct nlbl_msg_tmpl
+	nlbl_msg_tmpls[NLBL_FAMILY_SRC_MAX][NLBL_FAMILY_MAX][NLBL_MSG_CMDS];
+
 /*
  * Allocation Functions
  */
@@ -77,6 +93,118 @@ msg_new_failure:
 	return NULL;
 }
 
+/*
+ * Request Message Functions
+ */
+
+/**
+ * Build the request templates for a NetLabel family
+ * @param src the family id source
+ * @param family the NetLabel family
+ * @param id the generic netlink family id
+ *
+ * Build the Netlink and Generic Netlink headers of a request for every
+ * command in @family, as sent to the kernel or to a mock kernel, so that
+ * nlbl_msg_request() only needs to copy them.  This must be called whenever
+ * the family id changes.
+ *
+ */
+void nlbl_msg_tmpl_init(enum nlbl_family_src src,
+			enum nlbl_family family, uint16_t id)
+{
+	struct nlbl_msg_tmpl *tmpl;
+	unsigned int iter;
+
+	for (iter = 0; iter < NLBL_MSG_CMDS; iter++) {
+		tmpl = &nlbl_msg_tmpls[src][family][iter];
+		memset(tmpl, 0, sizeof(*tmpl));
+		tmpl->nl_hdr.nlmsg_len = NLMSG_HDRLEN + GENL_HDRLEN;
+		tmpl->nl_hdr.nlmsg_type = id;
+		tmpl->genl_hdr.cmd = iter;
+	}
+}
+
+/**
+ * Get a NetLabel request message
+ * @param hndl the NetLabel handle
+ * @param family the NetLabel family
+ * @param cmd the command
+ * @param flags the Netlink message flags
+ *
+ * Return a NetLabel message for a @cmd request to @family, reusing one of the
+ * messages released back to @hndl if possible, and fill in its headers from
+ * the family's request template for the kernel, or the mock kernel, behind
+ * @hndl.  The message should be released with
+ * nlbl_msg_release() once the request is complete.  Returns a pointer to the
+ * message on success, NULL on failure.
+ *
+ */
+nlbl_msg *nlbl_msg_request(struct nlbl_handle *hndl,
+			   enum nlbl_family family, uint8_t cmd, int flags)
+{
+	nlbl_msg *msg;
+	struct nlmsghdr *nl_hdr;
+	struct nlbl_msg_tmpl *tmpl;
+
+	/* sanity checks */
+	if (family >= NLBL_FAMILY_MAX || cmd >= NLBL_MSG_CMDS)
+		return NULL;
+	tmpl = &nlbl_msg_tmpls[nlbl_family_src(hndl)][family][cmd];
+
+	if (hndl != NULL && hndl->msg_pool_len > 0)
+		msg = hndl->msg_pool[--hndl->msg_pool_len];
+	else {
+		msg = nlmsg_alloc();
+		if (msg == NULL)
+			return NULL;
+	}
+
+	/* NOTE: libnl tracks the length of the message only in the header */
+	nl_hdr = nlmsg_hdr(msg);
+	memcpy(nl_hdr, tmpl, sizeof(*tmpl));
+	nl_hdr->nlmsg_flags = flags;
+
+	return msg;
+}
+
+/**
+ * Release a NetLabel request message
+ * @param hndl the NetLabel handle
+ * @param msg the NetLabel message
+ *
+ * Return @msg, which must have come from nlbl_msg_request(), to the message
+ * pool of @hndl so that it can be reused by a later request, or free it if
+ * the pool is full.  Asynchronous dumps may hold a reference to their request
+ * until they are sent, so those are always freed.
+ *
+ */
+void nlbl_msg_release(struct nlbl_handle *hndl, nlbl_msg *msg)
+{
+	if (msg == NULL)
+		return;
+
+	if (hndl == NULL || hndl->msg_pool_len >= NLBL_MSG_POOL ||
+	    (nlbl_async_active(hndl) &&
+	     nlmsg_hdr(msg)->nlmsg_flags & NLM_F_DUMP)) {
+		nlmsg_free(msg);
+		return;
+	}
+	hndl->msg_pool[hndl->msg_pool_len++] = msg;
+}
+
+/**
+ * Free the message pool of a NetLabel handle
+ * @param hndl the NetLabel handle
+ *
+ * Free all of the messages released back to @hndl.
+ *
+ */
+void nlbl_msg_pool_free(struct nlbl_handle *hndl)
+{
+	while (hndl->msg_pool_len > 0)
+		nlmsg_free(hndl->msg_pool[--hndl->msg_pool_len]);
+}
+
 /*
  * Netlink Header Functions
  */
@@ -186,3 +314,27 @@ struct nlattr *nlbl_attr_find(nlbl_msg *msg, int nla_type)
 
 	return nla_find(nla_head, genlmsg_attrlen(genl_hdr, 0), nla_type);
 }
+
+/**
+ * Parse the attributes of a NetLabel message
+ * @param tb the attribute table
+ * @param maxtype the highest attribute type in @tb
+ * @param nla_head the attributes
+ * @param attrlen the length of the attributes
+ * @param policy the attribute policy
+ *
+ * Walk the attributes in @nla_head once, validating each one against @policy,
+ * and store them in @tb indexed by attribute type; @tb must have room for
+ * @maxtype + 1 entries.  Attribute types which are not present are set to
+ * NULL and attribute types greater than @maxtype are ignored.  Returns zero
+ * on success, negative values on failure.
+ *
+ */
+int nlbl_attr_parse(struct nlattr **tb, int maxtype,
+		    struct nlattr *nla_head, int attrlen,
+		    const struct nla_policy *policy)
+{
+	if (nla_parse(tb, maxtype, nla_head, attrlen, policy) < 0)
+		return -EBADMSG;
+	return 0;
+}
@@ -0,0 +1,678 @@
+/** @file
+ * NetLabel Domain Mapping Resolution Functions
+ *
+ * Author: Paul Moore <paul@paul-moore.com>
+ *
+ */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <linux/types.h>
+
+#include <libnetlabel.h>
+
+#include "netlabel_internal.h"
+
+/* number of addresses resolved at once in a batch resolution */
+#define NLBL_RESOLVE_CHUNK	256
+
+/* domain mapping of a single domain, or the default domain mapping; the
+ * mappings of each address family are configured separately, as they are in
+ * the kernel, and a protocol mapping is stored as a single zero length prefix
+ * so that every lookup is a trie search */
+struct nlbl_resolve_dom {
+	const char *domain;
+	uint32_t hash;
+	unsigned int families;
+	uint32_t root[NLBL_TRIE_AF_MAX];
+};
+
+/* NetLabel domain mapping table */
+struct nlbl_mgmt_table {
+	/* the resolution targets, the strings belong to the result set */
+	struct nlbl_vec targets;
+	struct nlbl_result *result;
+
+	/* trie nodes shared by all of the domains */
+	struct nlbl_trie trie;
+
+	/* domains, the open addressing hash of the domains, and the default */
+	struct nlbl_vec doms;
+	uint32_t *slots;
+	uint32_t slot_mask;
+	struct nlbl_resolve_dom def;
+};
+
+/*
+ * Helper Functions
+ */
+
+/**
+ * Hash a domain name
+ * @param domain the domain name
+ */
+static uint32_t nlbl_resolve_hash(const char *domain)
+{
+	const unsigned char *iter;
+	uint32_t hash = 2166136261u;
+
+	/* FNV-1a */
+	for (iter = (const unsigned char *)domain; *iter != '\0'; iter++) {
+		hash ^= *iter;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/**
+ * Find a domain in a domain mapping table
+ * @param table the domain mapping table
+ * @param domain the domain name
+ * @param hash the hash of the domain name
+ * @param slot the empty hash slot the domain belongs in if it doesn't exist
+ *
+ * Search the domain hash of @table for @domain.  Returns a pointer to the
+ * domain if found, NULL otherwise.
+ *
+ */
+static struct nlbl_resolve_dom *nlbl_resolve_dom_find(
+					const struct nlbl_mgmt_table *table,
+					const char *domain, uint32_t hash,
+					uint32_t *slot)
+{
+	struct nlbl_resolve_dom *doms = table->doms.array;
+	uint32_t iter;
+
+	for (iter = hash & table->slot_mask;
+	     table->slots[iter] != NLBL_TRIE_NONE;
+	     iter = (iter + 1) & table->slot_mask) {
+		if (doms[table->slots[iter]].hash == hash &&
+		    strcmp(doms[table->slots[iter]].domain, domain) == 0)
+			return &doms[table->slots[iter]];
+	}
+
+	if (slot != NULL)
+		*slot = iter;
+	return NULL;
+}
+
+/**
+ * Find the domain used for traffic from a LSM domain
+ * @param table the domain mapping table
+ * @param domain the LSM domain
+ * @param af the trie index of the address family
+ *
+ * Like the kernel, use the domain's own mapping if it has one for the address
+ * family and fall back to the default mapping otherwise.
+ *
+ */
+static const struct nlbl_resolve_dom *nlbl_resolve_dom(
+					const struct nlbl_mgmt_table *table,
+					const char *domain, unsigned int af)
+{
+	const struct nlbl_resolve_dom *dom = NULL;
+
+	if (domain != NULL && table->doms.count > 0)
+		dom = nlbl_resolve_dom_find(table, domain,
+					    nlbl_resolve_hash(domain), NULL);
+	if (dom != NULL && (dom->families & (1 << af)))
+		return dom;
+	return &table->def;
+}
+
+/**
+ * Return the trie index of an address family
+ * @param family the address family
+ */
+static int nlbl_resolve_af(uint16_t family)
+{
+	switch (family) {
+	case AF_INET:
+		return NLBL_TRIE_V4;
+	case AF_INET6:
+		return NLBL_TRIE_V6;
+	default:
+		return -EINVAL;
+	}
+}
+
+/**
+ * Add a resolution target to a domain
+ * @param table the domain mapping table
+ * @param dom the domain
+ * @param target the resolution target
+ *
+ * Copy @target to the end of the resolution targets and add its address to
+ * the trie of @dom.  Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_resolve_target_add(struct nlbl_mgmt_table *table,
+				   struct nlbl_resolve_dom *dom,
+				   const struct nlbl_dommap_addr *target)
+{
+	struct nlbl_dommap_addr *entry;
+
+	if (table->targets.count >= NLBL_TRIE_NONE)
+		return -E2BIG;
+	entry = nlbl_vec_add(&table->targets);
+	if (entry == NULL)
+		return -ENOMEM;
+	*entry = *target;
+	entry->next = NULL;
+
+	return nlbl_trie_insert(&table->trie, dom->root,
+				&entry->addr, table->targets.count - 1);
+}
+
+/**
+ * Add a domain mapping to a domain
+ * @param table the domain mapping table
+ * @param dom the domain
+ * @param domain the domain mapping
+ * @param family the address family of the mapping
+ *
+ * Add the protocol configuration, or address selectors, of @domain to @dom
+ * for the address family @family, AF_UNSPEC for both families.  Returns zero
+ * on success, negative values on failure.
+ *
+ */
+static int nlbl_resolve_dom_add(struct nlbl_mgmt_table *table,
+				struct nlbl_resolve_dom *dom,
+				const struct nlbl_dommap *domain,
+				uint16_t family)
+{
+	int rc;
+	const struct nlbl_dommap_addr *iter;
+	struct nlbl_dommap_addr target;
+	unsigned int families;
+	int af;
+
+	if (family == AF_UNSPEC)
+		families = (1 << NLBL_TRIE_V4) | (1 << NLBL_TRIE_V6);
+	else {
+		af = nlbl_resolve_af(family);
+		if (af < 0)
+			return af;
+		families = 1 << af;
+	}
+	/* the kernel only allows one mapping per domain and family */
+	if (dom->families & families)
+		return -EEXIST;
+	dom->families |= families;
+
+	if (domain->proto_type == NETLBL_NLTYPE_ADDRSELECT) {
+		for (iter = domain->proto.addrsel; iter != NULL;
+		     iter = iter->next) {
+			af = nlbl_resolve_af(iter->addr.type);
+			if (af < 0)
+				return -EINVAL;
+			/* a default mapping listed for one family carries the
+			 * selectors of both families */
+			if (!(families & (1 << af)))
+				continue;
+			rc = nlbl_resolve_target_add(table, dom, iter);
+			if (rc < 0)
+				return rc;
+		}
+		return 0;
+	}
+
+	/* a protocol mapping applies to every address of its families */
+	memset(&target, 0, sizeof(target));
+	target.proto_type = domain->proto_type;
+	switch (domain->proto_type) {
+	case NETLBL_NLTYPE_CIPSOV4:
+		target.proto.cip_doi = domain->proto.cip_doi;
+		break;
+	case NETLBL_NLTYPE_CALIPSO:
+		target.proto.clp_doi = domain->proto.clp_doi;
+		break;
+	}
+	if (families & (1 << NLBL_TRIE_V4)) {
+		target.addr.type = AF_INET;
+		rc = nlbl_resolve_target_add(table, dom, &target);
+		if (rc < 0)
+			return rc;
+	}
+	if (families & (1 << NLBL_TRIE_V6)) {
+		target.addr.type = AF_INET6;
+		rc = nlbl_resolve_target_add(table, dom, &target);
+		if (rc < 0)
+			return rc;
+	}
+
+	return 0;
+}
+
+/**
+ * Add a domain mapping to a domain mapping table
+ * @param domain the domain mapping
+ * @param arg the domain mapping table
+ *
+ * Add @domain, including its domain name, to the domain it belongs to,
+ * creating the domain if needed.  Returns zero on success, negative values on
+ * failure.
+ *
+ */
+static int nlbl_resolve_entry_add(const struct nlbl_dommap *domain, void *arg)
+{
+	struct nlbl_mgmt_table *table = arg;
+	struct nlbl_resolve_dom *dom;
+	uint32_t hash;
+	uint32_t slot;
+
+	if (domain->domain == NULL)
+		return -EINVAL;
+
+	hash = nlbl_resolve_hash(domain->domain);
+	dom = nlbl_resolve_dom_find(table, domain->domain, hash, &slot);
+	if (dom == NULL) {
+		/* keep the hash at most half full */
+		if (table->doms.count >= table->slot_mask / 2)
+			return -E2BIG;
+		dom = nlbl_vec_add(&table->doms);
+		if (dom == NULL)
+			return -ENOMEM;
+		dom->domain = nlbl_result_strdup(table->result, domain->domain);
+		if (dom->domain == NULL)
+			return -ENOMEM;
+		dom->hash = hash;
+		dom->families = 0;
+		nlbl_trie_root_init(dom->root);
+		table->slots[slot] = table->doms.count - 1;
+	}
+
+	return nlbl_resolve_dom_add(table, dom, domain, domain->family);
+}
+
+/**
+ * Size the domain hash of a domain mapping table
+ * @param table the domain mapping table
+ * @param count the expected number of domain mappings
+ *
+ * Allocate an empty domain hash with room for @count domains.  Returns zero
+ * on success, negative values on failure.
+ *
+ */
+static int nlbl_resolve_slots_init(struct nlbl_mgmt_table *table,
+				   size_t count)
+{
+	size_t size = 16;
+
+	while (size < count * 2 + 2) {
+		if (size > UINT32_MAX / 4)
+			return -E2BIG;
+		size *= 2;
+	}
+
+	free(table->slots);
+	table->slots = malloc(size * sizeof(*table->slots));
+	if (table->slots == NULL)
+		return -ENOMEM;
+	memset(table->slots, 0xff, size * sizeof(*table->slots));
+	table->slot_mask = size - 1;
+
+	return 0;
+}
+
+/**
+ * Grow the domain hash of a domain mapping table
+ * @param table the domain mapping table
+ *
+ * Double the size of the domain hash and reinsert every domain.  Returns zero
+ * on success, negative values on failure.
+ *
+ */
+static int nlbl_resolve_slots_grow(struct nlbl_mgmt_table *table)
+{
+	int rc;
+	const struct nlbl_resolve_dom *doms;
+	uint32_t slot;
+	uint32_t iter;
+
+	rc = nlbl_resolve_slots_init(table, table->slot_mask + 1);
+	if (rc < 0)
+		return rc;
+
+	doms = table->doms.array;
+	for (iter = 0; iter < table->doms.count; iter++) {
+		nlbl_resolve_dom_find(table, doms[iter].domain,
+				      doms[iter].hash, &slot);
+		table->slots[slot] = iter;
+	}
+
+	return 0;
+}
+
+/**
+ * Add a domain mapping to a domain mapping table, growing it as needed
+ * @param domain the domain mapping
+ * @param arg the domain mapping table
+ *
+ * Same as nlbl_resolve_entry_add() but the domain hash is grown when it is
+ * full, for use when the number of domain mappings isn't known in advance.
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_resolve_entry_load(const struct nlbl_dommap *domain,
+				   void *arg)
+{
+	int rc;
+
+	rc = nlbl_resolve_entry_add(domain, arg);
+	if (rc == -E2BIG) {
+		rc = nlbl_resolve_slots_grow(arg);
+		if (rc < 0)
+			return rc;
+		rc = nlbl_resolve_entry_add(domain, arg);
+	}
+
+	return rc;
+}
+
+/**
+ * Allocate an empty domain mapping table
+ */
+static struct nlbl_mgmt_table *nlbl_resolve_table_new(void)
+{
+	struct nlbl_mgmt_table *table;
+
+	table = calloc(1, sizeof(*table));
+	if (table == NULL)
+		return NULL;
+	table->result = nlbl_result_new();
+	if (table->result == NULL) {
+		free(table);
+		return NULL;
+	}
+	nlbl_vec_init(&table->targets, sizeof(struct nlbl_dommap_addr), 0);
+	nlbl_trie_init(&table->trie);
+	nlbl_vec_init(&table->doms, sizeof(struct nlbl_resolve_dom), 0);
+	nlbl_trie_root_init(table->def.root);
+
+	return table;
+}
+
+/**
+ * Return the resolution target of a trie value
+ * @param table the domain mapping table
+ * @param value the trie value
+ */
+static inline const struct nlbl_dommap_addr *nlbl_resolve_target(
+					const struct nlbl_mgmt_table *table,
+					uint32_t value)
+{
+	const struct nlbl_dommap_addr *targets = table->targets.array;
+
+	return (value == NLBL_TRIE_NONE ? NULL : &targets[value]);
+}
+
+/*
+ * Domain Mapping Table Functions
+ */
+
+/**
+ * Build a domain mapping table from domain mapping arrays
+ * @param domains the domain mappings
+ * @param domain_count the number of domain mappings
+ * @param defs the default domain mappings
+ * @param def_count the number of default domain mappings
+ * @param table the domain mapping table
+ *
+ * Build a domain mapping table for nlbl_mgmt_resolve() from a snapshot of the
+ * domain mappings and default domain mappings, such as those returned by
+ * nlbl_mgmt_listall() and nlbl_mgmt_listdef().  A default domain mapping with
+ * a family of AF_UNSPEC is the default for both address families.  The
+ * entries, address selectors and strings are copied, the arrays are not
+ * needed once the table is built.  The address masks must be prefixes.  The
+ * caller is responsible for freeing the table with nlbl_mgmt_table_free().
+ * Returns zero on success, negative values on failure.
+ *
+ */
+int nlbl_mgmt_table_build(const struct nlbl_dommap *domains,
+			  size_t domain_count,
+			  const struct nlbl_dommap *defs,
+			  size_t def_count,
+			  struct nlbl_mgmt_table **table)
+{
+	int rc;
+	struct nlbl_mgmt_table *tbl;
+	size_t iter;
+
+	/* sanity checks */
+	if (table == NULL || (domains == NULL && domain_count > 0) ||
+	    (defs == NULL && def_count > 0))
+		return -EINVAL;
+
+	tbl = nlbl_resolve_table_new();
+	if (tbl == NULL)
+		return -ENOMEM;
+
+	rc = nlbl_resolve_slots_init(tbl, domain_count);
+	if (rc < 0)
+		goto build_return;
+	for (iter = 0; iter < domain_count; iter++) {
+		rc = nlbl_resolve_entry_add(&domains[iter], tbl);
+		if (rc < 0)
+			goto build_return;
+	}
+	for (iter = 0; iter < def_count; iter++) {
+		rc = nlbl_resolve_dom_add(tbl, &tbl->def,
+					  &defs[iter], defs[iter].family);
+		if (rc < 0)
+			goto build_return;
+	}
+
+	*table = tbl;
+
+build_return:
+	if (rc < 0)
+		nlbl_mgmt_table_free(tbl);
+	return rc;
+}
+
+/**
+ * Build a domain mapping table from the kernel's domain mappings
+ * @param hndl the NetLabel handle
+ * @param table the domain mapping table
+ *
+ * Dump the domain mappings and default domain mappings from the kernel
+ * directly into a new domain mapping table for nlbl_mgmt_resolve().  The
+ * table is a snapshot, later changes to the kernel's configuration are not
+ * reflected in it.  If @hndl is NULL then the library's default NetLabel
+ * handle is used.  The caller is responsible for freeing the table with
+ * nlbl_mgmt_table_free().  Returns zero on success, negative values on
+ * failure.
+ *
+ */
+int nlbl_mgmt_table_load(struct nlbl_handle *hndl,
+			 struct nlbl_mgmt_table **table)
+{
+	int rc;
+	struct nlbl_mgmt_table *tbl;
+	struct nlbl_dommap def;
+	uint16_t families[] = { AF_INET, AF_INET6 };
+	unsigned int iter;
+
+	/* sanity checks */
+	if (table == NULL)
+		return -EINVAL;
+	/* the table must be complete before we return */
+	if (nlbl_async_active(hndl))
+		return -EBUSY;
+
+	tbl = nlbl_resolve_table_new();
+	if (tbl == NULL)
+		return -ENOMEM;
+
+	rc = nlbl_resolve_slots_init(tbl, 0);
+	if (rc < 0)
+		goto load_return;
+	rc = nlbl_mgmt_listall_iter(hndl, nlbl_resolve_entry_load, tbl);
+	if (rc < 0)
+		goto load_return;
+
+	/* the default mappings are listed one address family at a time */
+	for (iter = 0; iter < sizeof(families) / sizeof(*families); iter++) {
+		memset(&def, 0, sizeof(def));
+		rc = nlbl_mgmt_listdef(hndl, families[iter], &def);
+		if (rc == -ENOENT) {
+			rc = 0;
+			continue;
+		} else if (rc < 0)
+			goto load_return;
+		rc = nlbl_resolve_dom_add(tbl, &tbl->def, &def, families[iter]);
+		if (def.proto_type == NETLBL_NLTYPE_ADDRSELECT)
+			free(def.proto.addrsel);
+		if (rc < 0)
+			goto load_return;
+	}
+
+	*table = tbl;
+
+load_return:
+	if (rc < 0)
+		nlbl_mgmt_table_free(tbl);
+	return rc;
+}
+
+/**
+ * Free a domain mapping table
+ * @param table the domain mapping table
+ *
+ * Free @table along with every domain mapping and string in it.
+ *
+ */
+void nlbl_mgmt_table_free(struct nlbl_mgmt_table *table)
+{
+	if (table == NULL)
+		return;
+
+	nlbl_vec_free(&table->targets);
+	nlbl_trie_free(&table->trie);
+	nlbl_vec_free(&table->doms);
+	free(table->slots);
+	nlbl_result_free(table->result);
+	free(table);
+}
+
+/**
+ * Resolve the labeling applied to outbound traffic
+ * @param table the domain mapping table
+ * @param domain the LSM domain
+ * @param addr the destination address
+ *
+ * Find the labeling the kernel would apply to traffic from the LSM domain
+ * @domain sent to @addr, the mask in @addr is ignored.  As in the kernel, the
+ * domain's own mapping for the address family of @addr is used if it has one,
+ * otherwise the default mapping is used; if the mapping has address selectors
+ * the selector with the longest matching prefix wins.  If @domain is NULL only
+ * the default mapping is used.  Returns a pointer to the matching address
+ * selector, which belongs to @table, or NULL if no mapping applies.  Mappings
+ * without address selectors are returned as a single selector matching every
+ * address of the family.
+ *
+ */
+const struct nlbl_dommap_addr *nlbl_mgmt_resolve(
+					const struct nlbl_mgmt_table *table,
+					const char *domain,
+					const struct nlbl_netaddr *addr)
+{
+	const struct nlbl_resolve_dom *dom;
+	const struct nlbl_dommap_addr *target;
+	int af;
+
+	/* sanity checks */
+	if (table == NULL || addr == NULL)
+		return NULL;
+	af = nlbl_resolve_af(addr->type);
+	if (af < 0)
+		return NULL;
+
+	dom = nlbl_resolve_dom(table, domain, af);
+	target = nlbl_resolve_target(table,
+				     nlbl_trie_search(&table->trie,
+						      dom->root, addr));
+	NLBL_PROBE4(mgmt_resolve, table, domain, addr, target);
+
+	return target;
+}
+
+/**
+ * Resolve the labeling applied to outbound traffic to many addresses
+ * @param table the domain mapping table
+ * @param domain the LSM domain
+ * @param addrs the destination addresses
+ * @param count the number of destination addresses
+ * @param targets the matching address selectors
+ *
+ * Perform a nlbl_mgmt_resolve() for each of the @count addresses in @addrs,
+ * all sent from @domain, storing the results in the caller allocated array
+ * @targets.  The domain is only looked up once for each address family and
+ * the addresses are walked through the tries several at a time, see
+ * nlbl_trie_search_batch().  Returns the number of addresses with a mapping
+ * on success, negative values on failure.
+ *
+ */
+int nlbl_mgmt_resolve_batch(const struct nlbl_mgmt_table *table,
+			    const char *domain,
+			    const struct nlbl_netaddr *addrs, size_t count,
+			    const struct nlbl_dommap_addr **targets)
+{
+	const struct nlbl_dommap_addr *target;
+	uint32_t root[NLBL_TRIE_AF_MAX];
+	uint32_t values[NLBL_RESOLVE_CHUNK];
+	size_t chunk;
+	size_t base;
+	size_t iter;
+	int matched = 0;
+	int af;
+
+	/* sanity checks */
+	if (table == NULL || (count > 0 && (addrs == NULL || targets == NULL)))
+		return -EINVAL;
+	if (count > INT_MAX)
+		return -E2BIG;
+
+	/* the domain and the default may each supply one of the families, so
+	 * build a set of roots taking each family from the right place */
+	for (af = 0; af < NLBL_TRIE_AF_MAX; af++)
+		root[af] = nlbl_resolve_dom(table, domain, af)->root[af];
+
+	for (base = 0; base < count; base += chunk) {
+		chunk = (count - base < NLBL_RESOLVE_CHUNK ?
+			 count - base : NLBL_RESOLVE_CHUNK);
+		nlbl_trie_search_batch(&table->trie, root,
+				       &addrs[base], chunk, values);
+		for (iter = 0; iter < chunk; iter++) {
+			target = nlbl_resolve_target(table, values[iter]);
+			if (target != NULL)
+				matched++;
+			targets[base + iter] = target;
+		}
+	}
+	NLBL_PROBE4(mgmt_resolve_batch, table, domain, count, matched);
+
+	return matched;
+}
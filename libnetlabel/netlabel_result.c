@@ -0,0 +1,179 @@
+/** @file
+ * NetLabel Result Set Functions
+ *
+ * Author: Paul Moore <paul@paul-moore.com>
+ *
+ */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libnetlabel.h>
+
+#include "netlabel_internal.h"
+
+/* size of the first slab, later slabs double in size up to the maximum */
+#define NLBL_RESULT_SLAB_MIN	4096
+#define NLBL_RESULT_SLAB_MAX	(1024 * 1024)
+/* alignment of the allocations within a slab */
+#define NLBL_RESULT_ALIGN	16
+
+/* result set slab */
+struct nlbl_result_slab {
+	struct nlbl_result_slab *next;
+	size_t len;
+	size_t size;
+	unsigned char data[] __attribute__((aligned(NLBL_RESULT_ALIGN)));
+};
+
+/* NetLabel result set */
+struct nlbl_result {
+	struct nlbl_result_slab *slabs;
+	void *array;
+};
+
+/*
+ * Internal Result Set Functions
+ */
+
+/**
+ * Create a new result set
+ *
+ * Create a new, empty, result set.  Returns a pointer to the result set on
+ * success, NULL on failure.
+ *
+ */
+struct nlbl_result *nlbl_result_new(void)
+{
+	return calloc(1, sizeof(struct nlbl_result));
+}
+
+/**
+ * Allocate memory from a result set
+ * @param result the result set
+ * @param len the number of bytes
+ *
+ * Allocate @len bytes of zeroed memory which is released along with @result.
+ * If @result is NULL the memory is allocated with calloc() and must be freed
+ * by the caller.  Returns a pointer to the memory on success, NULL on failure.
+ *
+ */
+void *nlbl_result_alloc(struct nlbl_result *result, size_t len)
+{
+	struct nlbl_result_slab *slab;
+	size_t size;
+	void *ptr;
+
+	if (result == NULL)
+		return calloc(1, len);
+
+	len = (len + NLBL_RESULT_ALIGN - 1) & ~(size_t)(NLBL_RESULT_ALIGN - 1);
+	slab = result->slabs;
+	if (slab == NULL || slab->size - slab->len < len) {
+		/* grow the slabs geometrically so a large result set only
+		 * needs a handful of them */
+		size = (slab != NULL ? slab->size * 2 : NLBL_RESULT_SLAB_MIN);
+		if (size > NLBL_RESULT_SLAB_MAX)
+			size = NLBL_RESULT_SLAB_MAX;
+		if (size < len)
+			size = len;
+		slab = malloc(sizeof(*slab) + size);
+		if (slab == NULL)
+			return NULL;
+		slab->len = 0;
+		slab->size = size;
+		slab->next = result->slabs;
+		result->slabs = slab;
+	}
+
+	ptr = slab->data + slab->len;
+	slab->len += len;
+	memset(ptr, 0, len);
+
+	return ptr;
+}
+
+/**
+ * Copy a string into a result set
+ * @param result the result set
+ * @param str the string
+ *
+ * Copy @str into memory which is released along with @result.  If @result is
+ * NULL the string is copied with strdup() and must be freed by the caller.
+ * Returns a pointer to the copy on success, NULL on failure.
+ *
+ */
+char *nlbl_result_strdup(struct nlbl_result *result, const char *str)
+{
+	size_t len;
+	char *copy;
+
+	if (result == NULL)
+		return strdup(str);
+
+	len = strlen(str) + 1;
+	copy = nlbl_result_alloc(result, len);
+	if (copy == NULL)
+		return NULL;
+	memcpy(copy, str, len);
+
+	return copy;
+}
+
+/**
+ * Attach an array to a result set
+ * @param result the result set
+ * @param array the array
+ *
+ * Make @result responsible for freeing @array, which must have been allocated
+ * with malloc().  A result set holds at most one array.
+ *
+ */
+void nlbl_result_adopt(struct nlbl_result *result, void *array)
+{
+	free(result->array);
+	result->array = array;
+}
+
+/*
+ * Result Set Functions
+ */
+
+/**
+ * Free a result set
+ * @param result the result set
+ *
+ * Free @result along with all of the entries, strings and address selectors
+ * returned with it.
+ *
+ */
+void nlbl_result_free(struct nlbl_result *result)
+{
+	struct nlbl_result_slab *slab;
+
+	if (result == NULL)
+		return;
+
+	while (result->slabs != NULL) {
+		slab = result->slabs;
+		result->slabs = slab->next;
+		free(slab);
+	}
+	free(result->array);
+	free(result);
+}
@@ -0,0 +1,1057 @@
+/** @file
+ * NetLabel Configuration Snapshot Functions
+ *
+ * Author: Paul Moore <paul@paul-moore.com>
+ *
+ */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <linux/types.h>
+
+#include <libnetlabel.h>
+
+#include "netlabel_internal.h"
+
+/* snapshot magic, "NLBL" on a little endian system; a snapshot written with
+ * the other byte order doesn't match */
+#define NLBL_SNAP_MAGIC		0x4c424c4e
+#define NLBL_SNAP_VERSION	1
+
+/* string offset standing for a NULL string */
+#define NLBL_SNAP_NONE		UINT32_MAX
+
+/* snapshot sections, in file order */
+enum {
+	NLBL_SNAP_S_CIPSO,
+	NLBL_SNAP_S_CALIPSO,
+	NLBL_SNAP_S_MAP,
+	NLBL_SNAP_S_ADDRSEL,
+	NLBL_SNAP_S_ADDR,
+	NLBL_SNAP_S_DATA,
+	NLBL_SNAP_S_STR,
+	NLBL_SNAP_S_MAX,
+};
+
+/* snapshot section, the length is in entries, or bytes for the data and
+ * string sections */
+struct nlbl_snap_sect {
+	uint32_t off;
+	uint32_t len;
+};
+
+/* snapshot header; every field of the snapshot is in host byte order and
+ * every section is 4 byte aligned so the file can be used in place */
+struct nlbl_snap_hdr {
+	uint32_t magic;
+	uint16_t version;
+	uint8_t accept;
+	uint8_t pad;
+	uint32_t size;
+	struct nlbl_snap_sect sect[NLBL_SNAP_S_MAX];
+};
+
+/* network address, the addresses are in network byte order */
+struct nlbl_snap_addr {
+	uint32_t type;
+	uint32_t addr[4];
+	uint32_t mask[4];
+};
+
+/* CIPSO DOI, the arrays are data section offsets and entry counts */
+struct nlbl_snap_cipso {
+	uint32_t doi;
+	uint32_t mtype;
+	uint32_t tags;
+	uint32_t tags_cnt;
+	uint32_t lvls;
+	uint32_t lvls_cnt;
+	uint32_t cats;
+	uint32_t cats_cnt;
+};
+
+/* CALIPSO DOI */
+struct nlbl_snap_calipso {
+	uint32_t doi;
+	uint32_t mtype;
+};
+
+/* domain mapping, the address selectors are a range of the address selector
+ * section */
+struct nlbl_snap_map {
+	uint32_t domain;
+	uint32_t family;
+	uint32_t proto_type;
+	uint32_t doi;
+	uint32_t addrsel;
+	uint32_t addrsel_cnt;
+};
+
+/* address selector */
+struct nlbl_snap_addrsel {
+	struct nlbl_snap_addr addr;
+	uint32_t proto_type;
+	uint32_t doi;
+};
+
+/* static label */
+struct nlbl_snap_addrmap {
+	uint32_t dev;
+	uint32_t label;
+	struct nlbl_snap_addr addr;
+};
+
+/* size of a single entry of each section */
+static const size_t nlbl_snap_elem_size[NLBL_SNAP_S_MAX] = {
+	[NLBL_SNAP_S_CIPSO] = sizeof(struct nlbl_snap_cipso),
+	[NLBL_SNAP_S_CALIPSO] = sizeof(struct nlbl_snap_calipso),
+	[NLBL_SNAP_S_MAP] = sizeof(struct nlbl_snap_map),
+	[NLBL_SNAP_S_ADDRSEL] = sizeof(struct nlbl_snap_addrsel),
+	[NLBL_SNAP_S_ADDR] = sizeof(struct nlbl_snap_addrmap),
+	[NLBL_SNAP_S_DATA] = 1,
+	[NLBL_SNAP_S_STR] = 1,
+};
+
+/* NetLabel configuration snapshot */
+struct nlbl_snapshot {
+	const unsigned char *base;
+	size_t size;
+
+	const struct nlbl_snap_hdr *hdr;
+	const struct nlbl_snap_cipso *cipso;
+	const struct nlbl_snap_calipso *calipso;
+	const struct nlbl_snap_map *maps;
+	const struct nlbl_snap_addrsel *addrsel;
+	const struct nlbl_snap_addrmap *addrs;
+	const unsigned char *data;
+	const char *str;
+
+	/* largest number of address selectors in a single domain mapping */
+	uint32_t addrsel_max;
+};
+
+/* snapshot being written */
+struct nlbl_snap_writer {
+	unsigned char *base;
+	struct nlbl_snap_hdr *hdr;
+	uint32_t pos[NLBL_SNAP_S_MAX];
+};
+
+/*
+ * Helper Functions
+ */
+
+/**
+ * Round a length up to the snapshot alignment
+ * @param len the length
+ */
+static inline size_t nlbl_snap_align(size_t len)
+{
+	return (len + 3) & ~(size_t)3;
+}
+
+/**
+ * Return a pointer to a section of a snapshot being written
+ * @param wr the snapshot writer
+ * @param sect the section
+ */
+static inline void *nlbl_snap_sect_ptr(struct nlbl_snap_writer *wr,
+				       unsigned int sect)
+{
+	return wr->base + wr->hdr->sect[sect].off;
+}
+
+/**
+ * Copy a network address into a snapshot
+ * @param addr the network address
+ * @param snap_addr the snapshot network address
+ */
+static void nlbl_snap_addr_put(const struct nlbl_netaddr *addr,
+			       struct nlbl_snap_addr *snap_addr)
+{
+	snap_addr->type = addr->type;
+	if (addr->type == AF_INET) {
+		snap_addr->addr[0] = addr->addr.v4.s_addr;
+		snap_addr->mask[0] = addr->mask.v4.s_addr;
+	} else {
+		memcpy(snap_addr->addr, &addr->addr.v6,
+		       sizeof(snap_addr->addr));
+		memcpy(snap_addr->mask, &addr->mask.v6,
+		       sizeof(snap_addr->mask));
+	}
+}
+
+/**
+ * Copy a network address out of a snapshot
+ * @param snap_addr the snapshot network address
+ * @param addr the network address
+ */
+static void nlbl_snap_addr_get(const struct nlbl_snap_addr *snap_addr,
+			       struct nlbl_netaddr *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->type = snap_addr->type;
+	if (addr->type == AF_INET) {
+		addr->addr.v4.s_addr = snap_addr->addr[0];
+		addr->mask.v4.s_addr = snap_addr->mask[0];
+	} else {
+		memcpy(&addr->addr.v6, snap_addr->addr,
+		       sizeof(snap_addr->addr));
+		memcpy(&addr->mask.v6, snap_addr->mask,
+		       sizeof(snap_addr->mask));
+	}
+}
+
+/**
+ * Copy an array into the data section of a snapshot
+ * @param wr the snapshot writer
+ * @param array the array
+ * @param len the size of the array in bytes
+ *
+ * Returns the data section offset of the copy.
+ *
+ */
+static uint32_t nlbl_snap_data_put(struct nlbl_snap_writer *wr,
+				   const void *array, size_t len)
+{
+	unsigned char *data = nlbl_snap_sect_ptr(wr, NLBL_SNAP_S_DATA);
+	uint32_t off = wr->pos[NLBL_SNAP_S_DATA];
+
+	if (len > 0)
+		memcpy(data + off, array, len);
+	wr->pos[NLBL_SNAP_S_DATA] += nlbl_snap_align(len);
+
+	return off;
+}
+
+/**
+ * Copy a string into the string section of a snapshot
+ * @param wr the snapshot writer
+ * @param str the string, may be NULL
+ *
+ * Returns the string section offset of the copy.
+ *
+ */
+static uint32_t nlbl_snap_str_put(struct nlbl_snap_writer *wr,
+				  const char *str)
+{
+	char *strs = nlbl_snap_sect_ptr(wr, NLBL_SNAP_S_STR);
+	uint32_t off = wr->pos[NLBL_SNAP_S_STR];
+	size_t len;
+
+	if (str == NULL)
+		return NLBL_SNAP_NONE;
+	len = strlen(str) + 1;
+	memcpy(strs + off, str, len);
+	wr->pos[NLBL_SNAP_S_STR] += len;
+
+	return off;
+}
+
+/**
+ * Determine the size of a snapshot of a configuration
+ * @param cfg the configuration
+ * @param hdr the snapshot header
+ *
+ * Fill in the section table of @hdr for a snapshot of @cfg.  Returns the size
+ * of the snapshot on success, zero if it is too large.
+ *
+ */
+static size_t nlbl_snap_layout(const struct nlbl_config *cfg,
+			       struct nlbl_snap_hdr *hdr)
+{
+	const struct nlbl_config_cipso *cipso = cfg->cipso.array;
+	const struct nlbl_config_map *maps = cfg->maps.array;
+	const struct nlbl_addrmap *addrs = cfg->addrs.array;
+	size_t len[NLBL_SNAP_S_MAX];
+	size_t size;
+	size_t iter;
+	unsigned int sect;
+
+	memset(len, 0, sizeof(len));
+	len[NLBL_SNAP_S_CIPSO] = cfg->cipso.count;
+	len[NLBL_SNAP_S_CALIPSO] = cfg->calipso.count;
+	len[NLBL_SNAP_S_MAP] = cfg->maps.count;
+	len[NLBL_SNAP_S_ADDR] = cfg->addrs.count;
+	for (iter = 0; iter < cfg->cipso.count; iter++) {
+		len[NLBL_SNAP_S_DATA] +=
+			nlbl_snap_align(cipso[iter].tags.size *
+					sizeof(*cipso[iter].tags.array)) +
+			cipso[iter].lvls.size * 2 *
+			sizeof(*cipso[iter].lvls.array) +
+			cipso[iter].cats.size * 2 *
+			sizeof(*cipso[iter].cats.array);
+	}
+	for (iter = 0; iter < cfg->maps.count; iter++) {
+		len[NLBL_SNAP_S_ADDRSEL] += maps[iter].addrsel.count;
+		if (maps[iter].domain != NULL)
+			len[NLBL_SNAP_S_STR] += strlen(maps[iter].domain) + 1;
+	}
+	for (iter = 0; iter < cfg->addrs.count; iter++) {
+		if (addrs[iter].dev != NULL)
+			len[NLBL_SNAP_S_STR] += strlen(addrs[iter].dev) + 1;
+		len[NLBL_SNAP_S_STR] += strlen(addrs[iter].label) + 1;
+	}
+
+	size = nlbl_snap_align(sizeof(*hdr));
+	for (sect = 0; sect < NLBL_SNAP_S_MAX; sect++) {
+		if (len[sect] > UINT32_MAX)
+			return 0;
+		hdr->sect[sect].off = size;
+		hdr->sect[sect].len = len[sect];
+		size += nlbl_snap_align(len[sect] * nlbl_snap_elem_size[sect]);
+		if (size > UINT32_MAX)
+			return 0;
+	}
+
+	return size;
+}
+
+/**
+ * Write a snapshot of a configuration into a buffer
+ * @param cfg the configuration
+ * @param wr the snapshot writer, with the section table filled in
+ */
+static void nlbl_snap_fill(const struct nlbl_config *cfg,
+			   struct nlbl_snap_writer *wr)
+{
+	const struct nlbl_config_cipso *cipso = cfg->cipso.array;
+	const struct nlbl_config_calipso *calipso = cfg->calipso.array;
+	const struct nlbl_config_map *maps = cfg->maps.array;
+	const struct nlbl_addrmap *addrs = cfg->addrs.array;
+	const struct nlbl_dommap_addr *addrsel;
+	struct nlbl_snap_cipso *snap_cipso;
+	struct nlbl_snap_calipso *snap_calipso;
+	struct nlbl_snap_map *snap_map;
+	struct nlbl_snap_addrsel *snap_addrsel;
+	struct nlbl_snap_addrmap *snap_addr;
+	size_t iter;
+	size_t iter_s;
+
+	snap_cipso = nlbl_snap_sect_ptr(wr, NLBL_SNAP_S_CIPSO);
+	for (iter = 0; iter < cfg->cipso.count; iter++) {
+		snap_cipso[iter].doi = cipso[iter].doi;
+		snap_cipso[iter].mtype = cipso[iter].mtype;
+		snap_cipso[iter].tags_cnt = cipso[iter].tags.size;
+		snap_cipso[iter].tags = nlbl_snap_data_put(wr,
+					cipso[iter].tags.array,
+					cipso[iter].tags.size *
+					sizeof(*cipso[iter].tags.array));
+		snap_cipso[iter].lvls_cnt = cipso[iter].lvls.size;
+		snap_cipso[iter].lvls = nlbl_snap_data_put(wr,
+					cipso[iter].lvls.array,
+					cipso[iter].lvls.size * 2 *
+					sizeof(*cipso[iter].lvls.array));
+		snap_cipso[iter].cats_cnt = cipso[iter].cats.size;
+		snap_cipso[iter].cats = nlbl_snap_data_put(wr,
+					cipso[iter].cats.array,
+					cipso[iter].cats.size * 2 *
+					sizeof(*cipso[iter].cats.array));
+	}
+
+	snap_calipso = nlbl_snap_sect_ptr(wr, NLBL_SNAP_S_CALIPSO);
+	for (iter = 0; iter < cfg->calipso.count; iter++) {
+		snap_calipso[iter].doi = calipso[iter].doi;
+		snap_calipso[iter].mtype = calipso[iter].mtype;
+	}
+
+	snap_map = nlbl_snap_sect_ptr(wr, NLBL_SNAP_S_MAP);
+	snap_addrsel = nlbl_snap_sect_ptr(wr, NLBL_SNAP_S_ADDRSEL);
+	for (iter = 0; iter < cfg->maps.count; iter++) {
+		snap_map[iter].domain = nlbl_snap_str_put(wr,
+							  maps[iter].domain);
+		snap_map[iter].family = maps[iter].family;
+		snap_map[iter].proto_type = maps[iter].proto_type;
+		snap_map[iter].doi = maps[iter].doi;
+		snap_map[iter].addrsel = wr->pos[NLBL_SNAP_S_ADDRSEL];
+		snap_map[iter].addrsel_cnt = maps[iter].addrsel.count;
+		addrsel = maps[iter].addrsel.array;
+		for (iter_s = 0; iter_s < maps[iter].addrsel.count; iter_s++) {
+			nlbl_snap_addr_put(&addrsel[iter_s].addr,
+					   &snap_addrsel->addr);
+			snap_addrsel->proto_type = addrsel[iter_s].proto_type;
+			snap_addrsel->doi = addrsel[iter_s].proto.cip_doi;
+			snap_addrsel++;
+		}
+		wr->pos[NLBL_SNAP_S_ADDRSEL] += maps[iter].addrsel.count;
+	}
+
+	snap_addr = nlbl_snap_sect_ptr(wr, NLBL_SNAP_S_ADDR);
+	for (iter = 0; iter < cfg->addrs.count; iter++) {
+		snap_addr[iter].dev = nlbl_snap_str_put(wr, addrs[iter].dev);
+		snap_addr[iter].label = nlbl_snap_str_put(wr,
+							  addrs[iter].label);
+		nlbl_snap_addr_put(&addrs[iter].addr, &snap_addr[iter].addr);
+	}
+}
+
+/**
+ * Check a string offset of a snapshot
+ * @param snap the snapshot
+ * @param off the string offset
+ * @param none_ok true if the string may be NULL
+ */
+static int nlbl_snap_str_check(const struct nlbl_snapshot *snap,
+			       uint32_t off, int none_ok)
+{
+	if (off == NLBL_SNAP_NONE)
+		return none_ok;
+	return (off < snap->hdr->sect[NLBL_SNAP_S_STR].len);
+}
+
+/**
+ * Check a data section range of a snapshot
+ * @param snap the snapshot
+ * @param off the data section offset
+ * @param len the length of the range in bytes
+ */
+static int nlbl_snap_data_check(const struct nlbl_snapshot *snap,
+				uint32_t off, uint64_t len)
+{
+	return ((off & 3) == 0 &&
+		off + len <= snap->hdr->sect[NLBL_SNAP_S_DATA].len);
+}
+
+/**
+ * Check that a snapshot is well formed
+ * @param snap the snapshot
+ *
+ * Check every offset and count in @snap so that the entries can be used
+ * without any further checks.  Returns zero on success, negative values on
+ * failure.
+ *
+ */
+static int nlbl_snap_check(struct nlbl_snapshot *snap)
+{
+	const struct nlbl_snap_hdr *hdr = snap->hdr;
+	const struct nlbl_snap_sect *sect;
+	const struct nlbl_snap_cipso *cipso;
+	const struct nlbl_snap_map *map;
+	const struct nlbl_snap_addrmap *addr;
+	uint64_t end;
+	uint32_t addrsel_next = 0;
+	uint32_t iter;
+
+	if (hdr->magic != NLBL_SNAP_MAGIC ||
+	    hdr->version != NLBL_SNAP_VERSION || hdr->size != snap->size)
+		return -EBADMSG;
+	for (iter = 0; iter < NLBL_SNAP_S_MAX; iter++) {
+		sect = &hdr->sect[iter];
+		end = sect->off +
+		      (uint64_t)sect->len * nlbl_snap_elem_size[iter];
+		if ((sect->off & 3) != 0 || sect->off < sizeof(*hdr) ||
+		    end > snap->size)
+			return -EBADMSG;
+	}
+	sect = &hdr->sect[NLBL_SNAP_S_STR];
+	if (sect->len > 0 && snap->base[sect->off + sect->len - 1] != '\0')
+		return -EBADMSG;
+
+	snap->cipso = (const void *)(snap->base +
+				     hdr->sect[NLBL_SNAP_S_CIPSO].off);
+	snap->calipso = (const void *)(snap->base +
+				       hdr->sect[NLBL_SNAP_S_CALIPSO].off);
+	snap->maps = (const void *)(snap->base +
+				    hdr->sect[NLBL_SNAP_S_MAP].off);
+	snap->addrsel = (const void *)(snap->base +
+				       hdr->sect[NLBL_SNAP_S_ADDRSEL].off);
+	snap->addrs = (const void *)(snap->base +
+				     hdr->sect[NLBL_SNAP_S_ADDR].off);
+	snap->data = snap->base + hdr->sect[NLBL_SNAP_S_DATA].off;
+	snap->str = (const char *)snap->base + hdr->sect[NLBL_SNAP_S_STR].off;
+
+	/* the DOIs must be sorted for nlbl_snapshot_cipso() */
+	for (iter = 0; iter < hdr->sect[NLBL_SNAP_S_CIPSO].len; iter++) {
+		cipso = &snap->cipso[iter];
+		if ((iter > 0 && cipso->doi <= snap->cipso[iter - 1].doi) ||
+		    !nlbl_snap_data_check(snap, cipso->tags,
+					  cipso->tags_cnt) ||
+		    !nlbl_snap_data_check(snap, cipso->lvls,
+					  (uint64_t)cipso->lvls_cnt * 8) ||
+		    !nlbl_snap_data_check(snap, cipso->cats,
+					  (uint64_t)cipso->cats_cnt * 8))
+			return -EBADMSG;
+	}
+
+	/* the address selectors must be used in order, once each */
+	for (iter = 0; iter < hdr->sect[NLBL_SNAP_S_MAP].len; iter++) {
+		map = &snap->maps[iter];
+		if (!nlbl_snap_str_check(snap, map->domain, 1) ||
+		    map->addrsel != addrsel_next ||
+		    map->addrsel_cnt > hdr->sect[NLBL_SNAP_S_ADDRSEL].len -
+				       addrsel_next)
+			return -EBADMSG;
+		addrsel_next += map->addrsel_cnt;
+		if (map->addrsel_cnt > snap->addrsel_max)
+			snap->addrsel_max = map->addrsel_cnt;
+	}
+	if (addrsel_next != hdr->sect[NLBL_SNAP_S_ADDRSEL].len)
+		return -EBADMSG;
+
+	for (iter = 0; iter < hdr->sect[NLBL_SNAP_S_ADDR].len; iter++) {
+		addr = &snap->addrs[iter];
+		if (!nlbl_snap_str_check(snap, addr->dev, 1) ||
+		    !nlbl_snap_str_check(snap, addr->label, 0))
+			return -EBADMSG;
+	}
+
+	return 0;
+}
+
+/**
+ * Return a string from a snapshot
+ * @param snap the snapshot
+ * @param off the string offset
+ */
+static const char *nlbl_snap_str(const struct nlbl_snapshot *snap,
+				 uint32_t off)
+{
+	return (off == NLBL_SNAP_NONE ? NULL : snap->str + off);
+}
+
+/**
+ * Fill in the CIPSO arrays of a snapshot DOI
+ * @param snap the snapshot
+ * @param cipso the snapshot DOI
+ * @param tags the tags
+ * @param lvls the level mappings
+ * @param cats the category mappings
+ */
+static void nlbl_snap_cipso_get(const struct nlbl_snapshot *snap,
+				const struct nlbl_snap_cipso *cipso,
+				struct nlbl_cip_tag_a *tags,
+				struct nlbl_cip_lvl_a *lvls,
+				struct nlbl_cip_cat_a *cats)
+{
+	tags->size = cipso->tags_cnt;
+	tags->array = (tags->size > 0 ?
+		       (nlbl_cip_tag *)(snap->data + cipso->tags) : NULL);
+	lvls->size = cipso->lvls_cnt;
+	lvls->array = (lvls->size > 0 ?
+		       (nlbl_cip_lvl *)(snap->data + cipso->lvls) : NULL);
+	cats->size = cipso->cats_cnt;
+	cats->array = (cats->size > 0 ?
+		       (nlbl_cip_cat *)(snap->data + cipso->cats) : NULL);
+}
+
+/**
+ * Add a snapshot domain mapping to a configuration
+ * @param snap the snapshot
+ * @param map the snapshot domain mapping
+ * @param cfg the configuration
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int nlbl_snap_map_load(const struct nlbl_snapshot *snap,
+			      const struct nlbl_snap_map *map,
+			      struct nlbl_config *cfg)
+{
+	int rc;
+	const struct nlbl_snap_addrsel *addrsel;
+	struct nlbl_dommap domain;
+	struct nlbl_netaddr addr;
+	uint32_t iter;
+
+	memset(&domain, 0, sizeof(domain));
+	domain.domain = (char *)nlbl_snap_str(snap, map->domain);
+	domain.family = map->family;
+	if (map->proto_type != NETLBL_NLTYPE_ADDRSELECT) {
+		domain.proto_type = map->proto_type;
+		domain.proto.cip_doi = map->doi;
+		if (domain.domain == NULL)
+			return nlbl_config_mgmt_adddef(cfg, &domain, NULL);
+		return nlbl_config_mgmt_add(cfg, &domain, NULL);
+	}
+
+	for (iter = 0; iter < map->addrsel_cnt; iter++) {
+		addrsel = &snap->addrsel[map->addrsel + iter];
+		domain.proto_type = addrsel->proto_type;
+		domain.proto.cip_doi = addrsel->doi;
+		nlbl_snap_addr_get(&addrsel->addr, &addr);
+		if (domain.domain == NULL)
+			rc = nlbl_config_mgmt_adddef(cfg, &domain, &addr);
+		else
+			rc = nlbl_config_mgmt_add(cfg, &domain, &addr);
+		if (rc < 0)
+			return rc;
+	}
+
+	return 0;
+}
+
+/*
+ * Snapshot Functions
+ */
+
+/**
+ * Write a snapshot of a configuration
+ * @param cfg the configuration
+ * @param fd the file descriptor
+ *
+ * Write @cfg to @fd in the compact binary snapshot format read by
+ * nlbl_snapshot_open().  The snapshot is written in host byte order and can
+ * only be read on systems with the same byte order.  Returns the size of the
+ * snapshot on success, negative values on failure.
+ *
+ */
+int nlbl_config_export(const struct nlbl_config *cfg, int fd)
+{
+	int rc;
+	struct nlbl_snap_hdr hdr;
+	struct nlbl_snap_writer wr;
+	size_t size;
+	size_t off;
+	ssize_t len;
+
+	/* sanity checks */
+	if (cfg == NULL || fd < 0)
+		return -EINVAL;
+
+	memset(&hdr, 0, sizeof(hdr));
+	size = nlbl_snap_layout(cfg, &hdr);
+	if (size == 0 || size > INT32_MAX)
+		return -EFBIG;
+	hdr.magic = NLBL_SNAP_MAGIC;
+	hdr.version = NLBL_SNAP_VERSION;
+	hdr.accept = cfg->accept;
+	hdr.size = size;
+
+	memset(&wr, 0, sizeof(wr));
+	wr.base = calloc(1, size);
+	if (wr.base == NULL)
+		return -ENOMEM;
+	wr.hdr = (struct nlbl_snap_hdr *)wr.base;
+	*wr.hdr = hdr;
+	nlbl_snap_fill(cfg, &wr);
+
+	for (off = 0; off < size; off += len) {
+		len = write(fd, wr.base + off, size - off);
+		if (len < 0 && errno != EINTR) {
+			rc = -errno;
+			goto export_return;
+		} else if (len < 0)
+			len = 0;
+	}
+	rc = size;
+
+export_return:
+	free(wr.base);
+	return rc;
+}
+
+/**
+ * Open a configuration snapshot
+ * @param path the snapshot file
+ * @param snap the snapshot
+ *
+ * Map the snapshot written by nlbl_config_export() to @path into memory and
+ * check that it is well formed.  The entries are read directly from the
+ * mapping, nothing is copied until the snapshot is turned into a
+ * configuration with nlbl_snapshot_config().  The snapshot file must not be
+ * changed while it is open, a new snapshot should be written to a new file
+ * and renamed over the old one.  The caller is responsible for closing the
+ * snapshot with nlbl_snapshot_close().  Returns zero on success, -EBADMSG if
+ * the file is not a valid snapshot, and other negative values on failure.
+ *
+ */
+int nlbl_snapshot_open(const char *path, struct nlbl_snapshot **snap)
+{
+	int rc;
+	int fd;
+	struct stat st;
+	struct nlbl_snapshot *snapshot;
+	void *base;
+
+	/* sanity checks */
+	if (path == NULL || snap == NULL)
+		return -EINVAL;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	if (fstat(fd, &st) < 0) {
+		rc = -errno;
+		close(fd);
+		return rc;
+	}
+	if (st.st_size < (off_t)sizeof(struct nlbl_snap_hdr) ||
+	    st.st_size > INT32_MAX) {
+		close(fd);
+		return -EBADMSG;
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	rc = -errno;
+	close(fd);
+	if (base == MAP_FAILED)
+		return rc;
+
+	snapshot = calloc(1, sizeof(*snapshot));
+	if (snapshot == NULL) {
+		munmap(base, st.st_size);
+		return -ENOMEM;
+	}
+	snapshot->base = base;
+	snapshot->size = st.st_size;
+	snapshot->hdr = base;
+	rc = nlbl_snap_check(snapshot);
+	if (rc < 0) {
+		nlbl_snapshot_close(snapshot);
+		return rc;
+	}
+
+	*snap = snapshot;
+	return 0;
+}
+
+/**
+ * Close a configuration snapshot
+ * @param snap the snapshot
+ *
+ * Unmap @snap, any pointers returned by the snapshot functions are no longer
+ * valid.
+ *
+ */
+void nlbl_snapshot_close(struct nlbl_snapshot *snap)
+{
+	if (snap == NULL)
+		return;
+
+	munmap((void *)snap->base, snap->size);
+	free(snap);
+}
+
+/**
+ * Turn a configuration snapshot into a configuration
+ * @param snap the snapshot
+ * @param cfg the configuration
+ *
+ * Copy the entries of @snap into a new configuration, such as the
+ * configuration wanted by nlbl_config_plan().  The caller is responsible for
+ * freeing the configuration with nlbl_config_free().  Returns zero on success,
+ * negative values on failure.
+ *
+ */
+int nlbl_snapshot_config(const struct nlbl_snapshot *snap,
+			 struct nlbl_config **cfg)
+{
+	int rc = 0;
+	const struct nlbl_snap_hdr *hdr;
+	const struct nlbl_snap_cipso *cipso;
+	const struct nlbl_snap_addrmap *addr;
+	struct nlbl_config *config;
+	struct nlbl_cip_tag_a tags;
+	struct nlbl_cip_lvl_a lvls;
+	struct nlbl_cip_cat_a cats;
+	struct nlbl_netaddr netaddr;
+	uint32_t iter;
+
+	/* sanity checks */
+	if (snap == NULL || cfg == NULL)
+		return -EINVAL;
+	hdr = snap->hdr;
+
+	config = nlbl_config_alloc();
+	if (config == NULL)
+		return -ENOMEM;
+	config->accept = hdr->accept;
+
+	/* the DOIs first, the domain mappings refer to them */
+	for (iter = 0; iter < hdr->sect[NLBL_SNAP_S_CIPSO].len; iter++) {
+		cipso = &snap->cipso[iter];
+		nlbl_snap_cipso_get(snap, cipso, &tags, &lvls, &cats);
+		switch (cipso->mtype) {
+		case CIPSO_V4_MAP_TRANS:
+			rc = nlbl_config_cipso_add_trans(config, cipso->doi,
+							 &tags, &lvls, &cats);
+			break;
+		case CIPSO_V4_MAP_PASS:
+			rc = nlbl_config_cipso_add_pass(config, cipso->doi,
+							&tags);
+			break;
+		case CIPSO_V4_MAP_LOCAL:
+			rc = nlbl_config_cipso_add_local(config, cipso->doi);
+			break;
+		default:
+			rc = -EBADMSG;
+		}
+		if (rc < 0)
+			goto config_return;
+	}
+	for (iter = 0; iter < hdr->sect[NLBL_SNAP_S_CALIPSO].len; iter++) {
+		if (snap->calipso[iter].mtype != CALIPSO_MAP_PASS) {
+			rc = -EBADMSG;
+			goto config_return;
+		}
+		rc = nlbl_config_calipso_add_pass(config,
+						  snap->calipso[iter].doi);
+		if (rc < 0)
+			goto config_return;
+	}
+	for (iter = 0; iter < hdr->sect[NLBL_SNAP_S_MAP].len; iter++) {
+		rc = nlbl_snap_map_load(snap, &snap->maps[iter], config);
+		if (rc < 0)
+			goto config_return;
+	}
+	for (iter = 0; iter < hdr->sect[NLBL_SNAP_S_ADDR].len; iter++) {
+		addr = &snap->addrs[iter];
+		nlbl_snap_addr_get(&addr->addr, &netaddr);
+		if (addr->dev == NLBL_SNAP_NONE)
+			rc = nlbl_config_unlbl_staticadddef(config, &netaddr,
+					nlbl_snap_str(snap, addr->label));
+		else
+			rc = nlbl_config_unlbl_staticadd(config,
+					nlbl_snap_str(snap, addr->dev),
+					&netaddr,
+					nlbl_snap_str(snap, addr->label));
+		if (rc < 0)
+			goto config_return;
+	}
+
+	*cfg = config;
+
+config_return:
+	if (rc < 0)
+		nlbl_config_free(config);
+	return rc;
+}
+
+/**
+ * Return the unlabeled accept flag of a configuration snapshot
+ * @param snap the snapshot
+ */
+uint8_t nlbl_snapshot_accept(const struct nlbl_snapshot *snap)
+{
+	return snap->hdr->accept;
+}
+
+/**
+ * Iterate over the domain mappings of a configuration snapshot
+ * @param snap the snapshot
+ * @param cb the callback
+ * @param arg the callback argument
+ *
+ * Same as nlbl_mgmt_listall_iter() but reads the domain mappings from @snap,
+ * the default domain mappings are included with a NULL domain.  The domain
+ * strings point into the snapshot.  Returns the number of domain mappings
+ * passed to @cb on success, negative values on failure.
+ *
+ */
+int nlbl_snapshot_mgmt_iter(const struct nlbl_snapshot *snap,
+			    nlbl_dommap_cb cb, void *arg)
+{
+	int rc = 0;
+	const struct nlbl_snap_map *map;
+	const struct nlbl_snap_addrsel *addrsel;
+	struct nlbl_dommap domain;
+	struct nlbl_dommap_addr *addrsels = NULL;
+	uint32_t iter;
+	uint32_t iter_s;
+
+	/* sanity checks */
+	if (snap == NULL || cb == NULL)
+		return -EINVAL;
+
+	if (snap->addrsel_max > 0) {
+		addrsels = calloc(snap->addrsel_max, sizeof(*addrsels));
+		if (addrsels == NULL)
+			return -ENOMEM;
+	}
+
+	for (iter = 0; rc == 0 &&
+	     iter < snap->hdr->sect[NLBL_SNAP_S_MAP].len; iter++) {
+		map = &snap->maps[iter];
+		memset(&domain, 0, sizeof(domain));
+		domain.domain = (char *)nlbl_snap_str(snap, map->domain);
+		domain.family = map->family;
+		domain.proto_type = map->proto_type;
+		if (map->proto_type == NETLBL_NLTYPE_ADDRSELECT) {
+			for (iter_s = 0; iter_s < map->addrsel_cnt; iter_s++) {
+				addrsel = &snap->addrsel[map->addrsel + iter_s];
+				nlbl_snap_addr_get(&addrsel->addr,
+						   &addrsels[iter_s].addr);
+				addrsels[iter_s].proto_type =
+							addrsel->proto_type;
+				addrsels[iter_s].proto.cip_doi = addrsel->doi;
+				addrsels[iter_s].next =
+					(iter_s + 1 < map->addrsel_cnt ?
+					 &addrsels[iter_s + 1] : NULL);
+			}
+			domain.proto.addrsel = (map->addrsel_cnt > 0 ?
+						addrsels : NULL);
+			domain.addrsel_count = map->addrsel_cnt;
+		} else
+			domain.proto.cip_doi = map->doi;
+
+		rc = cb(&domain, arg);
+	}
+
+	free(addrsels);
+	return (rc < 0 ? rc : (int)iter);
+}
+
+/**
+ * Iterate over the static labels of a configuration snapshot
+ * @param snap the snapshot
+ * @param cb the callback
+ * @param arg the callback argument
+ *
+ * Same as nlbl_unlbl_staticlist_iter() but reads the static labels from
+ * @snap, the default static labels are included with a NULL network
+ * interface.  The strings point into the snapshot.  Returns the number of
+ * static labels passed to @cb on success, negative values on failure.
+ *
+ */
+int nlbl_snapshot_unlbl_iter(const struct nlbl_snapshot *snap,
+			     nlbl_addrmap_cb cb, void *arg)
+{
+	int rc = 0;
+	const struct nlbl_snap_addrmap *addr;
+	struct nlbl_addrmap addrmap;
+	uint32_t iter;
+
+	/* sanity checks */
+	if (snap == NULL || cb == NULL)
+		return -EINVAL;
+
+	for (iter = 0; rc == 0 &&
+	     iter < snap->hdr->sect[NLBL_SNAP_S_ADDR].len; iter++) {
+		addr = &snap->addrs[iter];
+		addrmap.dev = (nlbl_netdev)nlbl_snap_str(snap, addr->dev);
+		addrmap.label = (nlbl_secctx)nlbl_snap_str(snap, addr->label);
+		nlbl_snap_addr_get(&addr->addr, &addrmap.addr);
+		rc = cb(&addrmap, arg);
+	}
+
+	return (rc < 0 ? rc : (int)iter);
+}
+
+/**
+ * Iterate over the CIPSO DOIs of a configuration snapshot
+ * @param snap the snapshot
+ * @param cb the callback
+ * @param arg the callback argument
+ *
+ * Same as nlbl_cipso_listall_iter() but reads the DOIs from @snap, in
+ * increasing order.  Returns the number of DOIs passed to @cb on success,
+ * negative values on failure.
+ *
+ */
+int nlbl_snapshot_cipso_iter(const struct nlbl_snapshot *snap,
+			     nlbl_cip_doi_cb cb, void *arg)
+{
+	int rc = 0;
+	uint32_t iter;
+
+	/* sanity checks */
+	if (snap == NULL || cb == NULL)
+		return -EINVAL;
+
+	for (iter = 0; rc == 0 &&
+	     iter < snap->hdr->sect[NLBL_SNAP_S_CIPSO].len; iter++) {
+		rc = cb(snap->cipso[iter].doi, snap->cipso[iter].mtype, arg);
+	}
+
+	return (rc < 0 ? rc : (int)iter);
+}
+
+/**
+ * Find a CIPSO DOI in a configuration snapshot
+ * @param snap the snapshot
+ * @param doi the DOI
+ * @param mtype the DOI mapping type
+ * @param tags the tags
+ * @param lvls the level mappings
+ * @param cats the category mappings
+ *
+ * Same as nlbl_cipso_list() but reads the DOI from @snap.  The arrays point
+ * into the snapshot, they must not be changed or freed.  Returns zero on
+ * success, -ENOENT if the DOI doesn't exist, and negative values on failure.
+ *
+ */
+int nlbl_snapshot_cipso(const struct nlbl_snapshot *snap,
+			nlbl_cip_doi doi,
+			nlbl_cip_mtype *mtype,
+			struct nlbl_cip_tag_a *tags,
+			struct nlbl_cip_lvl_a *lvls,
+			struct nlbl_cip_cat_a *cats)
+{
+	const struct nlbl_snap_cipso *cipso;
+	uint32_t low = 0;
+	uint32_t high;
+	uint32_t mid;
+
+	/* sanity checks */
+	if (snap == NULL || mtype == NULL ||
+	    tags == NULL || lvls == NULL || cats == NULL)
+		return -EINVAL;
+
+	high = snap->hdr->sect[NLBL_SNAP_S_CIPSO].len;
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		cipso = &snap->cipso[mid];
+		if (cipso->doi == doi) {
+			*mtype = cipso->mtype;
+			nlbl_snap_cipso_get(snap, cipso, tags, lvls, cats);
+			return 0;
+		} else if (cipso->doi < doi)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return -ENOENT;
+}
+
+/**
+ * Iterate over the CALIPSO DOIs of a configuration snapshot
+ * @param snap the snapshot
+ * @param cb the callback
+ * @param arg the callback argument
+ *
+ * Same as nlbl_calipso_listall_iter() but reads the DOIs from @snap, in
+ * increasing order.  Returns the number of DOIs passed to @cb on success,
+ * negative values on failure.
+ *
+ */
+int nlbl_snapshot_calipso_iter(const struct nlbl_snapshot *snap,
+			       nlbl_clp_doi_cb cb, void *arg)
+{
+	int rc = 0;
+	uint32_t iter;
+
+	/* sanity checks */
+	if (snap == NULL || cb == NULL)
+		return -EINVAL;
+
+	for (iter = 0; rc == 0 &&
+	     iter < snap->hdr->sect[NLBL_SNAP_S_CALIPSO].len; iter++) {
+		rc = cb(snap->calipso[iter].doi, snap->calipso[iter].mtype,
+			arg);
+	}
+
+	return (rc < 0 ? rc : (int)iter);
+}
@@ -0,0 +1,464 @@
+/** @file
+ * NetLabel Longest Prefix Match Functions
+ *
+ * Author: Paul Moore <paul@paul-moore.com>
+ *
+ */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <linux/types.h>
+
+#include <libnetlabel.h>
+
+#include "netlabel_internal.h"
+
+/* number of addresses walked through a trie together in a batch search */
+#define NLBL_TRIE_LANES		8
+
+/* path compressed binary trie node, the key is in host byte order and only
+ * the first @plen bits of it are significant */
+struct nlbl_trie_node {
+	uint32_t key[4];
+	uint32_t child[2];
+	uint32_t value;
+	uint8_t plen;
+};
+
+/*
+ * Helper Functions
+ */
+
+/**
+ * Convert a network address to a trie key
+ * @param addr the network address
+ * @param key the trie key
+ * @param af the trie index of the address family
+ *
+ * Convert the address in @addr to a host byte order trie key.  Returns the
+ * number of bits in the key on success, negative values on failure.
+ *
+ */
+static int nlbl_trie_key(const struct nlbl_netaddr *addr,
+			 uint32_t *key, unsigned int *af)
+{
+	unsigned int iter;
+
+	switch (addr->type) {
+	case AF_INET:
+		key[0] = ntohl(addr->addr.v4.s_addr);
+		*af = NLBL_TRIE_V4;
+		return 32;
+	case AF_INET6:
+		for (iter = 0; iter < 4; iter++)
+			key[iter] = ntohl(addr->addr.v6.s6_addr32[iter]);
+		*af = NLBL_TRIE_V6;
+		return 128;
+	default:
+		return -EINVAL;
+	}
+}
+
+/**
+ * Convert a network address mask to a prefix length
+ * @param addr the network address
+ *
+ * The kernel and the trie both need the mask to be a prefix.  Returns the
+ * prefix length of the mask in @addr on success, negative values on failure.
+ *
+ */
+static int nlbl_trie_plen(const struct nlbl_netaddr *addr)
+{
+	uint32_t mask[4];
+	unsigned int words;
+	unsigned int iter;
+	int plen = 0;
+
+	switch (addr->type) {
+	case AF_INET:
+		mask[0] = ntohl(addr->mask.v4.s_addr);
+		words = 1;
+		break;
+	case AF_INET6:
+		for (iter = 0; iter < 4; iter++)
+			mask[iter] = ntohl(addr->mask.v6.s6_addr32[iter]);
+		words = 4;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	for (iter = 0; iter < words && mask[iter] == 0xffffffff; iter++)
+		plen += 32;
+	if (iter == words)
+		return plen;
+	/* the rest of the mask must be a run of ones followed by zeros */
+	if ((~mask[iter] & (~mask[iter] + 1)) != 0)
+		return -EINVAL;
+	plen += __builtin_clz(~mask[iter]);
+	for (iter++; iter < words; iter++)
+		if (mask[iter] != 0)
+			return -EINVAL;
+
+	return plen;
+}
+
+/**
+ * Return a bit of a trie key
+ * @param key the trie key
+ * @param pos the bit position, zero is the most significant bit
+ */
+static inline unsigned int nlbl_trie_bit(const uint32_t *key, unsigned int pos)
+{
+	return (key[pos >> 5] >> (31 - (pos & 31))) & 1;
+}
+
+/**
+ * Determine if a trie node's prefix matches a key
+ * @param node the trie node
+ * @param key the trie key
+ */
+static inline int nlbl_trie_match(const struct nlbl_trie_node *node,
+				  const uint32_t *key)
+{
+	unsigned int plen = node->plen;
+	unsigned int iter = 0;
+
+	for (; plen >= 32; plen -= 32, iter++)
+		if (key[iter] != node->key[iter])
+			return 0;
+	if (plen > 0 && ((key[iter] ^ node->key[iter]) >> (32 - plen)) != 0)
+		return 0;
+
+	return 1;
+}
+
+/**
+ * Return the length of the common prefix of two trie keys
+ * @param a the first trie key
+ * @param b the second trie key
+ * @param max the maximum length
+ */
+static unsigned int nlbl_trie_common(const uint32_t *a, const uint32_t *b,
+				     unsigned int max)
+{
+	unsigned int len;
+	unsigned int iter;
+	uint32_t diff;
+
+	for (iter = 0; iter * 32 < max; iter++) {
+		diff = a[iter] ^ b[iter];
+		if (diff != 0) {
+			len = iter * 32 + __builtin_clz(diff);
+			return (len < max ? len : max);
+		}
+	}
+
+	return max;
+}
+
+/**
+ * Return a trie node
+ * @param trie the trie
+ * @param idx the node index
+ */
+static inline struct nlbl_trie_node *nlbl_trie_node(
+					const struct nlbl_trie *trie,
+					uint32_t idx)
+{
+	return &((struct nlbl_trie_node *)trie->nodes.array)[idx];
+}
+
+/**
+ * Add a node to a trie's node array
+ * @param trie the trie
+ * @param key the trie key
+ * @param plen the prefix length
+ * @param value the value
+ *
+ * Add a new node for the first @plen bits of @key to the node array of
+ * @trie.  Returns the index of the new node on success, NLBL_TRIE_NONE on
+ * failure.
+ *
+ */
+static uint32_t nlbl_trie_node_new(struct nlbl_trie *trie,
+				   const uint32_t *key, unsigned int plen,
+				   uint32_t value)
+{
+	struct nlbl_trie_node *node;
+	unsigned int iter;
+
+	if (trie->nodes.count >= NLBL_TRIE_NONE)
+		return NLBL_TRIE_NONE;
+	node = nlbl_vec_add(&trie->nodes);
+	if (node == NULL)
+		return NLBL_TRIE_NONE;
+
+	for (iter = 0; iter * 32 < plen; iter++)
+		node->key[iter] = key[iter];
+	if (plen % 32)
+		node->key[plen / 32] &= ~(0xffffffff >> (plen % 32));
+	node->plen = plen;
+	node->child[0] = NLBL_TRIE_NONE;
+	node->child[1] = NLBL_TRIE_NONE;
+	node->value = value;
+
+	return trie->nodes.count - 1;
+}
+
+/*
+ * Trie Functions
+ */
+
+/**
+ * Initialize a trie
+ * @param trie the trie
+ *
+ * Initialize the shared node array @trie.  Any number of tries, each of them
+ * identified by its roots, can share the same node array.
+ *
+ */
+void nlbl_trie_init(struct nlbl_trie *trie)
+{
+	nlbl_vec_init(&trie->nodes, sizeof(struct nlbl_trie_node), 0);
+}
+
+/**
+ * Free a trie
+ * @param trie the trie
+ *
+ * Free the shared node array @trie and every trie using it.
+ *
+ */
+void nlbl_trie_free(struct nlbl_trie *trie)
+{
+	nlbl_vec_free(&trie->nodes);
+}
+
+/**
+ * Initialize the roots of an empty trie
+ * @param root the trie roots, one for each address family
+ */
+void nlbl_trie_root_init(uint32_t *root)
+{
+	unsigned int iter;
+
+	for (iter = 0; iter < NLBL_TRIE_AF_MAX; iter++)
+		root[iter] = NLBL_TRIE_NONE;
+}
+
+/**
+ * Add a network address to a trie
+ * @param trie the trie
+ * @param root the trie roots, one for each address family
+ * @param addr the network address
+ * @param value the value
+ *
+ * Add the network address, and mask, in @addr to the trie at @root, storing
+ * @value with it.  The mask must be a prefix.  Returns zero on success,
+ * negative values on failure.
+ *
+ */
+int nlbl_trie_insert(struct nlbl_trie *trie, uint32_t *root,
+		     const struct nlbl_netaddr *addr, uint32_t value)
+{
+	struct nlbl_trie_node *node;
+	uint32_t key[4];
+	unsigned int af;
+	int plen;
+	uint32_t parent = NLBL_TRIE_NONE;
+	unsigned int side = 0;
+	uint32_t iter;
+	uint32_t new, glue;
+	unsigned int common = 0;
+	unsigned int bit;
+
+	if (value == NLBL_TRIE_NONE || nlbl_trie_key(addr, key, &af) < 0)
+		return -EINVAL;
+	plen = nlbl_trie_plen(addr);
+	if (plen < 0)
+		return plen;
+
+	/* find where the prefix belongs */
+	iter = root[af];
+	while (iter != NLBL_TRIE_NONE) {
+		node = nlbl_trie_node(trie, iter);
+		common = nlbl_trie_common(key, node->key,
+					  (plen < node->plen ?
+					   plen : node->plen));
+		if (common < node->plen)
+			break;
+		if (node->plen == plen) {
+			/* the kernel doesn't allow duplicate prefixes */
+			if (node->value != NLBL_TRIE_NONE)
+				return -EEXIST;
+			node->value = value;
+			return 0;
+		}
+		parent = iter;
+		side = nlbl_trie_bit(key, node->plen);
+		iter = node->child[side];
+	}
+
+	/* NOTE: adding nodes may move the node array */
+	new = nlbl_trie_node_new(trie, key, plen, value);
+	if (new == NLBL_TRIE_NONE)
+		return -ENOMEM;
+	if (iter != NLBL_TRIE_NONE && common == plen) {
+		/* the new prefix contains the existing node */
+		bit = nlbl_trie_bit(nlbl_trie_node(trie, iter)->key, plen);
+		nlbl_trie_node(trie, new)->child[bit] = iter;
+	} else if (iter != NLBL_TRIE_NONE) {
+		/* the prefixes diverge, join them with a glue node */
+		glue = nlbl_trie_node_new(trie, key, common, NLBL_TRIE_NONE);
+		if (glue == NLBL_TRIE_NONE)
+			return -ENOMEM;
+		bit = nlbl_trie_bit(key, common);
+		node = nlbl_trie_node(trie, glue);
+		node->child[bit] = new;
+		node->child[!bit] = iter;
+		new = glue;
+	}
+
+	/* link the new node into the trie */
+	if (parent == NLBL_TRIE_NONE)
+		root[af] = new;
+	else
+		nlbl_trie_node(trie, parent)->child[side] = new;
+
+	return 0;
+}
+
+/**
+ * Find the longest matching prefix of a network address in a trie
+ * @param trie the trie
+ * @param root the trie roots, one for each address family
+ * @param addr the network address
+ *
+ * Search the trie at @root for the longest prefix matching the address in
+ * @addr, the mask in @addr is ignored.  Returns the value stored with the
+ * prefix, or NLBL_TRIE_NONE if no prefix matches.
+ *
+ */
+uint32_t nlbl_trie_search(const struct nlbl_trie *trie, const uint32_t *root,
+			  const struct nlbl_netaddr *addr)
+{
+	const struct nlbl_trie_node *nodes = trie->nodes.array;
+	const struct nlbl_trie_node *node;
+	uint32_t best = NLBL_TRIE_NONE;
+	uint32_t key[4];
+	unsigned int af;
+	uint32_t iter;
+	int bits;
+
+	bits = nlbl_trie_key(addr, key, &af);
+	if (bits < 0)
+		return NLBL_TRIE_NONE;
+
+	iter = root[af];
+	while (iter != NLBL_TRIE_NONE) {
+		node = &nodes[iter];
+		if (!nlbl_trie_match(node, key))
+			break;
+		if (node->value != NLBL_TRIE_NONE)
+			best = node->value;
+		if (node->plen >= bits)
+			break;
+		iter = node->child[nlbl_trie_bit(key, node->plen)];
+	}
+
+	return best;
+}
+
+/**
+ * Find the longest matching prefixes of many network addresses in a trie
+ * @param trie the trie
+ * @param root the trie roots, one for each address family
+ * @param addrs the network addresses
+ * @param count the number of network addresses
+ * @param values the values
+ *
+ * Perform a nlbl_trie_search() for each of the @count addresses in @addrs,
+ * storing the results in @values.  The addresses are walked through the trie
+ * several at a time, prefetching the next node of each, so that the memory
+ * accesses of one search overlap with those of the others.
+ *
+ */
+void nlbl_trie_search_batch(const struct nlbl_trie *trie, const uint32_t *root,
+			    const struct nlbl_netaddr *addrs, size_t count,
+			    uint32_t *values)
+{
+	const struct nlbl_trie_node *nodes = trie->nodes.array;
+	const struct nlbl_trie_node *node;
+	uint32_t key[NLBL_TRIE_LANES][4];
+	uint32_t iter[NLBL_TRIE_LANES];
+	int bits[NLBL_TRIE_LANES];
+	unsigned int lanes, lane, active;
+	unsigned int af;
+	uint32_t *best;
+	size_t base;
+
+	for (base = 0; base < count; base += lanes) {
+		lanes = (count - base < NLBL_TRIE_LANES ?
+			 count - base : NLBL_TRIE_LANES);
+		best = &values[base];
+
+		/* start every lane at the root of its trie */
+		active = 0;
+		for (lane = 0; lane < lanes; lane++) {
+			best[lane] = NLBL_TRIE_NONE;
+			bits[lane] = nlbl_trie_key(&addrs[base + lane],
+						   key[lane], &af);
+			iter[lane] = (bits[lane] < 0 ?
+				      NLBL_TRIE_NONE : root[af]);
+			if (iter[lane] != NLBL_TRIE_NONE)
+				active++;
+		}
+
+		/* take one step down the trie in each lane until all are done,
+		 * prefetching the next node of each lane as we go */
+		while (active > 0) {
+			for (lane = 0; lane < lanes; lane++) {
+				if (iter[lane] == NLBL_TRIE_NONE)
+					continue;
+				node = &nodes[iter[lane]];
+				if (!nlbl_trie_match(node, key[lane])) {
+					iter[lane] = NLBL_TRIE_NONE;
+					active--;
+					continue;
+				}
+				if (node->value != NLBL_TRIE_NONE)
+					best[lane] = node->value;
+				if (node->plen >= bits[lane])
+					iter[lane] = NLBL_TRIE_NONE;
+				else
+					iter[lane] = node->child[
+						nlbl_trie_bit(key[lane],
+							      node->plen)];
+				if (iter[lane] == NLBL_TRIE_NONE)
+					active--;
+				else
+					__builtin_prefetch(&nodes[iter[lane]]);
+			}
+		}
+	}
+}
@@ -0,0 +1,135 @@
+/** @file
+ * NetLabel Growable Array Functions
+ *
+ * Author: Paul Moore <paul@paul-moore.com>
+ *
+ */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <libnetlabel.h>
+
+#include "netlabel_internal.h"
+
+/* initial number of elements if the caller doesn't provide a hint */
+#define NLBL_VEC_SIZE_MIN	16
+
+/**
+ * Initialize a growable array
+ * @param vec the growable array
+ * @param elem_size the size of each element
+ * @param hint the expected number of elements, zero if unknown
+ *
+ * Initialize @vec as an empty array of @elem_size byte elements.  No memory
+ * is allocated until the first element is added, at which point room is
+ * made for @hint elements.
+ *
+ */
+void nlbl_vec_init(struct nlbl_vec *vec, size_t elem_size, size_t hint)
+{
+	vec->array = NULL;
+	vec->count = 0;
+	vec->size = 0;
+	vec->elem_size = elem_size;
+	vec->hint = hint;
+}
+
+/**
+ * Add an element to a growable array
+ * @param vec the growable array
+ *
+ * Append a new zeroed element to @vec, doubling the size of the array if it is
+ * full so that building an array of N elements only copies O(N) elements.
+ * Returns a pointer to the new element on success, NULL on failure.
+ *
+ */
+void *nlbl_vec_add(struct nlbl_vec *vec)
+{
+	void *array;
+	void *elem;
+	size_t size;
+
+	if (vec->count == vec->size) {
+		if (vec->size > 0)
+			size = vec->size * 2;
+		else if (vec->hint > 0)
+			size = vec->hint;
+		else
+			size = NLBL_VEC_SIZE_MIN;
+		if (size <= vec->size || size > SIZE_MAX / vec->elem_size)
+			return NULL;
+		array = realloc(vec->array, size * vec->elem_size);
+		if (array == NULL)
+			return NULL;
+		vec->array = array;
+		vec->size = size;
+	}
+
+	elem = (unsigned char *)vec->array + vec->count * vec->elem_size;
+	memset(elem, 0, vec->elem_size);
+	vec->count++;
+
+	return elem;
+}
+
+/**
+ * Take the array from a growable array
+ * @param vec the growable array
+ *
+ * Shrink the array in @vec to fit its elements and return it, the caller is
+ * responsible for freeing the array.  @vec is left empty.  Returns NULL if
+ * @vec is empty.
+ *
+ */
+void *nlbl_vec_finish(struct nlbl_vec *vec)
+{
+	void *array;
+
+	if (vec->count == 0) {
+		nlbl_vec_free(vec);
+		return NULL;
+	}
+
+	/* a failure to shrink the array is harmless */
+	array = realloc(vec->array, vec->count * vec->elem_size);
+	if (array == NULL)
+		array = vec->array;
+
+	vec->array = NULL;
+	vec->count = 0;
+	vec->size = 0;
+	return array;
+}
+
+/**
+ * Free a growable array
+ * @param vec the growable array
+ *
+ * Free the array in @vec, but not anything referenced by its elements, and
+ * leave @vec empty.
+ *
+ */
+void nlbl_vec_free(struct nlbl_vec *vec)
+{
+	free(vec->array);
+	vec->array = NULL;
+	vec->count = 0;
+	vec->size = 0;
+}
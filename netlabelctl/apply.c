@@ -0,0 +1,347 @@
+/*
+ * Configuration Reconciliation Functions
+ *
+ * Author: Paul Moore <paul@paul-moore.com>
+ *
+ */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <libnetlabel.h>
+
+#include "netlabelctl.h"
+
+/**
+ * Display a domain mapping's protocol
+ * @param fp the output file pointer
+ * @param op the domain mapping operation
+ */
+static void apply_proto_print(FILE *fp, const struct nlbl_config_op *op)
+{
+	switch (op->domain.proto_type) {
+	case NETLBL_NLTYPE_UNLABELED:
+		fprintf(fp, "protocol:unlbl");
+		/* address selectors take the family of their address */
+		if (op->addr.addr.type != AF_UNSPEC)
+			break;
+		if (op->domain.family == AF_INET)
+			fprintf(fp, ",4");
+		else if (op->domain.family == AF_INET6)
+			fprintf(fp, ",6");
+		break;
+	case NETLBL_NLTYPE_CIPSOV4:
+		fprintf(fp, "protocol:cipso,%u", op->domain.proto.cip_doi);
+		break;
+	case NETLBL_NLTYPE_CALIPSO:
+		fprintf(fp, "protocol:calipso,%u", op->domain.proto.clp_doi);
+		break;
+	default:
+		fprintf(fp, "protocol:UNKNOWN(%u)", op->domain.proto_type);
+		break;
+	}
+}
+
+/**
+ * Display a CIPSO DOI definition
+ * @param fp the output file pointer
+ * @param op the CIPSO DOI operation
+ */
+static void apply_cipso_print(FILE *fp, const struct nlbl_config_op *op)
+{
+	size_t iter;
+
+	switch (op->mtype) {
+	case CIPSO_V4_MAP_TRANS:
+		fprintf(fp, "cipso add trans doi:%u", op->doi);
+		break;
+	case CIPSO_V4_MAP_PASS:
+		fprintf(fp, "cipso add pass doi:%u", op->doi);
+		break;
+	case CIPSO_V4_MAP_LOCAL:
+		/* local DOIs always use the local tag */
+		fprintf(fp, "cipso add local doi:%u", op->doi);
+		return;
+	default:
+		fprintf(fp, "cipso add UNKNOWN(%u) doi:%u", op->mtype, op->doi);
+		return;
+	}
+
+	for (iter = 0; iter < op->tags.size; iter++)
+		fprintf(fp, "%s%u", (iter == 0 ? " tags:" : ","),
+			op->tags.array[iter]);
+	for (iter = 0; iter < op->lvls.size; iter++)
+		fprintf(fp, "%s%u=%u", (iter == 0 ? " levels:" : ","),
+			op->lvls.array[iter * 2], op->lvls.array[iter * 2 + 1]);
+	for (iter = 0; iter < op->cats.size; iter++)
+		fprintf(fp, "%s%u=%u", (iter == 0 ? " categories:" : ","),
+			op->cats.array[iter * 2], op->cats.array[iter * 2 + 1]);
+}
+
+/**
+ * Display a configuration operation
+ * @param fp the output file pointer
+ * @param op the operation
+ *
+ * Print @op as the netlabelctl command which performs it, so that a list of
+ * operations can be run again as a batch file.
+ *
+ */
+static void apply_op_print(FILE *fp, const struct nlbl_config_op *op)
+{
+	switch (op->cmd) {
+	case NLBL_CONFIG_C_MAPDEL:
+		if (op->domain.domain == NULL)
+			fprintf(fp, "map del default");
+		else
+			fprintf(fp, "map del domain:%s", op->domain.domain);
+		break;
+	case NLBL_CONFIG_C_MAPADD:
+		if (op->domain.domain == NULL)
+			fprintf(fp, "map add default ");
+		else
+			fprintf(fp, "map add domain:%s ", op->domain.domain);
+		if (op->addr.addr.type != AF_UNSPEC) {
+			fprintf(fp, "address:");
+			nlctl_addr_fprint(fp, &op->addr.addr);
+			fprintf(fp, " ");
+		}
+		apply_proto_print(fp, op);
+		break;
+	case NLBL_CONFIG_C_STATICDEL:
+	case NLBL_CONFIG_C_STATICADD:
+		fprintf(fp, "unlbl %s ",
+			(op->cmd == NLBL_CONFIG_C_STATICADD ? "add" : "del"));
+		if (op->addr.dev == NULL)
+			fprintf(fp, "default");
+		else
+			fprintf(fp, "interface:%s", op->addr.dev);
+		fprintf(fp, " address:");
+		nlctl_addr_fprint(fp, &op->addr.addr);
+		if (op->cmd == NLBL_CONFIG_C_STATICADD)
+			fprintf(fp, " label:%s", op->addr.label);
+		break;
+	case NLBL_CONFIG_C_CIPSODEL:
+		fprintf(fp, "cipso del doi:%u", op->doi);
+		break;
+	case NLBL_CONFIG_C_CIPSOADD:
+		apply_cipso_print(fp, op);
+		break;
+	case NLBL_CONFIG_C_CALIPSODEL:
+		fprintf(fp, "calipso del doi:%u", op->doi);
+		break;
+	case NLBL_CONFIG_C_CALIPSOADD:
+		fprintf(fp, "calipso add pass doi:%u", op->doi);
+		break;
+	case NLBL_CONFIG_C_ACCEPT:
+		fprintf(fp, "unlbl accept %s", (op->accept ? "on" : "off"));
+		break;
+	default:
+		fprintf(fp, "UNKNOWN(%u)", op->cmd);
+		break;
+	}
+	fprintf(fp, "\n");
+}
+
+/**
+ * Read a configuration file
+ * @param path the configuration file
+ * @param cfg the configuration
+ *
+ * Read the configuration in the batch file @path, see nlctl_batch(), without
+ * sending it to the kernel; any failed commands are reported by line.  If
+ * @path is "snapshot:<file>" the configuration is read from a snapshot written
+ * by "mgmt snapshot" instead.  The caller is responsible for freeing the
+ * configuration.  Returns zero on success, negative values on failure.
+ *
+ */
+int apply_config_read(const char *path, struct nlbl_config **cfg)
+{
+	int rc;
+	struct nlbl_config *config;
+	struct nlbl_snapshot *snap;
+
+	/* configuration files can't read other configuration files */
+	if (nlctl_cfg != NULL)
+		return -EINVAL;
+
+	if (strncmp(path, "snapshot:", 9) == 0) {
+		rc = nlbl_snapshot_open(path + 9, &snap);
+		if (rc < 0)
+			return rc;
+		rc = nlbl_snapshot_config(snap, cfg);
+		nlbl_snapshot_close(snap);
+		return rc;
+	}
+
+	config = nlbl_config_new();
+	if (config == NULL)
+		return -ENOMEM;
+	nlctl_cfg = config;
+	rc = nlctl_batch(path);
+	nlctl_cfg = NULL;
+	if (rc < 0) {
+		nlbl_config_free(config);
+		return rc;
+	}
+
+	*cfg = config;
+	return 0;
+}
+
+/**
+ * Entry point for the NetLabel configuration reconciliation functions
+ * @param argc the number of arguments
+ * @param argv the argument list
+ *
+ * Read the configuration file named by the argument list, see
+ * apply_config_read(), compare it with the kernel's configuration, and make
+ * only the changes needed for the kernel to match it.  The file describes the
+ * complete configuration, starting from the configuration the kernel boots
+ * with, so anything not in the file is removed.  With the "plan" argument the
+ * changes are displayed instead of made.  Returns zero on success, negative
+ * values on failure.
+ *
+ */
+int apply_main(int argc, char *argv[])
+{
+	int rc;
+	int plan_flag = 0;
+	struct nlbl_config *cur = NULL;
+	struct nlbl_config *want = NULL;
+	struct nlbl_config_op *ops = NULL;
+	struct nlbl_result *result = NULL;
+	int *results = NULL;
+	size_t count;
+	size_t iter;
+
+	/* sanity checks */
+	if (argc <= 0 || argv == NULL || argv[0] == NULL)
+		return -EINVAL;
+	if (strcmp(argv[0], "plan") == 0) {
+		plan_flag = 1;
+		argc--;
+		argv++;
+	}
+	if (argc != 1 || argv[0] == NULL)
+		return -EINVAL;
+	/* configuration files can't apply other configuration files */
+	if (nlctl_cfg != NULL)
+		return -EINVAL;
+
+	rc = apply_config_read(argv[0], &want);
+	if (rc < 0)
+		goto apply_return;
+
+	/* compare it with the kernel */
+	rc = nlbl_config_load(NULL, &cur);
+	if (rc < 0)
+		goto apply_return;
+	rc = nlbl_config_plan(cur, want, &ops, &result);
+	if (rc < 0)
+		goto apply_return;
+	count = rc;
+
+	if (plan_flag) {
+		if (count == 0)
+			printf(MSG("No changes are needed\n"));
+		for (iter = 0; iter < count; iter++)
+			apply_op_print(stdout, &ops[iter]);
+		rc = 0;
+		goto apply_return;
+	}
+
+	/* make the changes, reporting every change that failed */
+	rc = nlbl_config_apply(NULL, ops, count, &results);
+	if (rc < 0)
+		goto apply_return;
+	rc = 0;
+	for (iter = 0; iter < count; iter++) {
+		if (opt_verbose)
+			apply_op_print(stdout, &ops[iter]);
+		if (results[iter] < 0) {
+			/* flush the output so the report follows it */
+			fflush(stdout);
+			fprintf(stderr, "error: ");
+			apply_op_print(stderr, &ops[iter]);
+			fprintf(stderr, MSG_ERR("%s\n"),
+				nlctl_strerror(-results[iter]));
+			rc = results[iter];
+		}
+	}
+
+apply_return:
+	free(results);
+	nlbl_result_free(result);
+	nlbl_config_free(cur);
+	nlbl_config_free(want);
+	return rc;
+}
+
+/**
+ * Entry point for the NetLabel configuration save functions
+ * @param argc the number of arguments
+ * @param argv the argument list
+ *
+ * Display the kernel's configuration as the netlabelctl commands which
+ * recreate it on a freshly booted kernel, in the format used by the NetLabel
+ * configuration file, so that it can be restored with "netlabelctl -b" or
+ * "netlabelctl apply".  Returns zero on success, negative values on failure.
+ *
+ */
+int save_main(int argc, char *argv[])
+{
+	int rc;
+	struct nlbl_config *cur = NULL;
+	struct nlbl_config *dflt = NULL;
+	struct nlbl_config_op *ops = NULL;
+	struct nlbl_result *result = NULL;
+	size_t count;
+	size_t iter;
+
+	/* sanity checks */
+	if (argc != 0)
+		return -EINVAL;
+	/* configuration files can't save the configuration */
+	if (nlctl_cfg != NULL)
+		return -EINVAL;
+
+	/* the changes from the default configuration recreate the kernel's */
+	dflt = nlbl_config_new();
+	if (dflt == NULL)
+		return -ENOMEM;
+	rc = nlbl_config_load(NULL, &cur);
+	if (rc < 0)
+		goto save_return;
+	rc = nlbl_config_plan(dflt, cur, &ops, &result);
+	if (rc < 0)
+		goto save_return;
+	count = rc;
+
+	for (iter = 0; iter < count; iter++)
+		apply_op_print(stdout, &ops[iter]);
+	rc = 0;
+
+save_return:
+	nlbl_result_free(result);
+	nlbl_config_free(cur);
+	nlbl_config_free(dflt);
+	return rc;
+}
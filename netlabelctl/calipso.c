@@ -69,7 +69,10 @@ static int calipso_add(int argc, char *argv[])
 	switch (calipso_type) {
 	case CALIPSO_MAP_PASS:
 		/* pass through mapping */
-		rc = nlbl_calipso_add_pass(NULL, doi);
+		if (nlctl_cfg != NULL)
+			rc = nlbl_config_calipso_add_pass(nlctl_cfg, doi);
+		else
+			rc = nlbl_calipso_add_pass(NULL, doi);
 		break;
 	default:
 		rc = -EINVAL;
@@ -106,6 +109,8 @@ static int calipso_del(int argc, char *argv[])
 	}
 
 	/* delete the mapping */
+	if (nlctl_cfg != NULL)
+		return nlbl_config_calipso_del(nlctl_cfg, doi);
 	return nlbl_calipso_del(NULL, doi);
 }
 
@@ -257,6 +262,10 @@ int calipso_main(int argc, char *argv[])
 	/* sanity checks */
 	if (argc <= 0 || argv == NULL || argv[0] == NULL)
 		return -EINVAL;
+	/* configuration files only hold configuration commands */
+	if (nlctl_cfg != NULL &&
+	    strcmp(argv[0], "add") != 0 && strcmp(argv[0], "del") != 0)
+		return -EINVAL;
 
 	/* handle the request */
 	if (strcmp(argv[0], "add") == 0) {
@@ -129,15 +129,26 @@ static int cipso_add(int argc, char *argv[])
 	switch (cipso_type) {
 	case CIPSO_V4_MAP_TRANS:
 		/* translated mapping */
-		rc = nlbl_cipso_add_trans(NULL, doi, &tags, &lvls, &cats);
+		if (nlctl_cfg != NULL)
+			rc = nlbl_config_cipso_add_trans(nlctl_cfg, doi,
+							 &tags, &lvls, &cats);
+		else
+			rc = nlbl_cipso_add_trans(NULL, doi,
+						  &tags, &lvls, &cats);
 		break;
 	case CIPSO_V4_MAP_PASS:
 		/* pass through mapping */
-		rc = nlbl_cipso_add_pass(NULL, doi, &tags);
+		if (nlctl_cfg != NULL)
+			rc = nlbl_config_cipso_add_pass(nlctl_cfg, doi, &tags);
+		else
+			rc = nlbl_cipso_add_pass(NULL, doi, &tags);
 		break;
 	case CIPSO_V4_MAP_LOCAL:
 		/* local mapping */
-		rc = nlbl_cipso_add_local(NULL, doi);
+		if (nlctl_cfg != NULL)
+			rc = nlbl_config_cipso_add_local(nlctl_cfg, doi);
+		else
+			rc = nlbl_cipso_add_local(NULL, doi);
 		break;
 	default:
 		rc = -EINVAL;
@@ -181,6 +192,8 @@ static int cipso_del(int argc, char *argv[])
 	}
 
 	/* delete the mapping */
+	if (nlctl_cfg != NULL)
+		return nlbl_config_cipso_del(nlctl_cfg, doi);
 	return nlbl_cipso_del(NULL, doi);
 }
 
@@ -411,6 +424,10 @@ int cipso_main(int argc, char *argv[])
 	/* sanity checks */
 	if (argc <= 0 || argv == NULL || argv[0] == NULL)
 		return -EINVAL;
+	/* configuration files only hold configuration commands */
+	if (nlctl_cfg != NULL &&
+	    strcmp(argv[0], "add") != 0 && strcmp(argv[0], "del") != 0)
+		return -EINVAL;
 
 	/* handle the request */
 	if (strcmp(argv[0], "add") == 0) {
@@ -30,6 +30,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <arpa/inet.h>
 
 #include <libnetlabel.h>
@@ -41,6 +42,9 @@
 #define RET_ERR		1
 #define RET_USAGE	2
 
+/* maximum number of arguments on a batch file line */
+#define BATCH_ARGS_MAX	64
+
 /* option variables */
 uint32_t opt_verbose = 0;
 uint32_t opt_timeout = 10;
@@ -49,6 +53,15 @@ uint32_t opt_pretty = 0;
 /* program name */
 char *nlctl_name = NULL;
 
+/* configuration being built, NULL when commands go to the kernel */
+struct nlbl_config *nlctl_cfg = NULL;
+
+/* mock kernel used in place of the kernel, see the -m flag */
+static struct nlbl_mock *nlctl_mock = NULL;
+/* fingerprint of the mock kernel's configuration when it was started */
+static uint64_t nlctl_mock_fp = 0;
+static int nlctl_mock_fp_valid = 0;
+
 /**
  * Display usage information
  * @param fp the output file pointer
@@ -58,7 +71,114 @@ char *nlctl_name = NULL;
  */
 static void nlctl_usage_print(FILE *fp)
 {
-	fprintf(fp, "usage: %s [<flags>] <module> [<commands>]\n", nlctl_name);
+	fprintf(fp,
+		"usage: %s [<flags>] <module> [<commands>]\n"
+		"       %s [<flags>] -b <file>\n", nlctl_name, nlctl_name);
+}
+
+/**
+ * Start a mock kernel
+ * @param path the mock kernel's snapshot file
+ *
+ * Start a mock kernel whose configuration is read from the snapshot in @path,
+ * or which starts out like a freshly booted kernel if @path does not exist,
+ * and send all of the commands to it instead of the kernel.  Returns zero on
+ * success, negative values on failure.
+ *
+ */
+static int nlctl_mock_start(const char *path)
+{
+	int rc;
+	struct nlbl_snapshot *snap;
+	struct nlbl_config *cfg = NULL;
+
+	rc = nlbl_snapshot_open(path, &snap);
+	if (rc == 0) {
+		rc = nlbl_snapshot_config(snap, &cfg);
+		nlbl_snapshot_close(snap);
+	} else if (rc == -ENOENT)
+		rc = 0;
+	if (rc < 0)
+		return rc;
+
+	nlctl_mock = nlbl_mock_new(cfg);
+	if (nlctl_mock == NULL) {
+		nlbl_config_free(cfg);
+		return -ENOMEM;
+	}
+	nlctl_mock_fp_valid = (nlbl_config_fingerprint(
+				       nlbl_mock_config(nlctl_mock),
+				       &nlctl_mock_fp) == 0);
+	nlbl_mock_use(nlctl_mock);
+
+	return 0;
+}
+
+/**
+ * Stop the mock kernel
+ * @param path the mock kernel's snapshot file
+ *
+ * If the commands changed the mock kernel's configuration, write it back to the
+ * snapshot in @path so the next command sees the changes, and free the mock
+ * kernel.  The snapshot is left alone after commands which only read the
+ * configuration or failed without changing it.  Returns zero on success,
+ * negative values on failure.
+ *
+ */
+static int nlctl_mock_stop(const char *path)
+{
+	int rc = 0;
+	uint64_t fp;
+	const struct nlbl_config *cfg = nlbl_mock_config(nlctl_mock);
+
+	if (!nlctl_mock_fp_valid || nlbl_config_fingerprint(cfg, &fp) < 0 ||
+	    fp != nlctl_mock_fp)
+		rc = mgmt_snapshot_write(cfg, path);
+	nlbl_mock_free(nlctl_mock);
+	nlctl_mock = NULL;
+
+	return rc;
+}
+
+/**
+ * Display the communication statistics
+ * @param fp the output file pointer
+ *
+ * Display the statistics of the NetLabel library's default handle, which is
+ * used for every command.
+ *
+ */
+static void nlctl_stats_print(FILE *fp)
+{
+	struct nlbl_comm_stats stats;
+	unsigned int iter;
+	unsigned int last;
+
+	if (nlbl_comm_stats(NULL, &stats) < 0)
+		return;
+
+	fprintf(fp, "requests:%" PRIu64 " writes:%" PRIu64
+		" bytes_sent:%" PRIu64 "\n",
+		stats.requests, stats.writes, stats.bytes_sent);
+	fprintf(fp, "reads:%" PRIu64 " dgrams:%" PRIu64
+		" bytes_recv:%" PRIu64 " dropped:%" PRIu64
+		" timeouts:%" PRIu64 "\n",
+		stats.reads, stats.dgrams_recv, stats.bytes_recv,
+		stats.dgrams_dropped, stats.timeouts);
+	if (stats.lat_count == 0)
+		return;
+	fprintf(fp, "latency_us: min:%" PRIu64 " avg:%" PRIu64
+		" max:%" PRIu64 "\n",
+		stats.lat_min_ns / 1000,
+		stats.lat_total_ns / stats.lat_count / 1000,
+		stats.lat_max_ns / 1000);
+	for (last = NLBL_COMM_LAT_BUCKETS - 1; last > 0; last--)
+		if (stats.lat_hist[last] > 0)
+			break;
+	fprintf(fp, "latency_hist:");
+	for (iter = 0; iter <= last; iter++)
+		fprintf(fp, " %" PRIu64, stats.lat_hist[iter]);
+	fprintf(fp, "\n");
 }
 
 /**
@@ -85,9 +205,12 @@ static void nlctl_help_print(FILE *fp)
 	nlctl_ver_print(fp);
 	fprintf(fp,
 		" Usage: %s [<flags>] <module> [<commands>]\n"
+		"        %s [<flags>] -b <file>\n"
 		"\n"
 		" Flags:\n"
+		"   -b <file> : run the commands in <file>, '-' for stdin\n"
 		"   -h        : help/usage message\n"
+		"   -m <file> : use a mock kernel saved in <file>\n"
 		"   -p        : make the output pretty\n"
 		"   -t <secs> : timeout\n"
 		"   -v        : verbose mode\n"
@@ -96,17 +219,21 @@ static void nlctl_help_print(FILE *fp)
 		"  mgmt : NetLabel management\n"
 		"    version\n"
 		"    protocols\n"
+		"    snapshot <file>\n"
+		"    fingerprint [<file>|snapshot:<file>]\n"
 		"  map : Domain/Protocol mapping\n"
 		"    add default|domain:<domain> [address:<ADDR>[/<MASK>]]\n"
 		"                                protocol:<protocol>[,<extra>]\n"
 		"    del default|domain:<domain>\n"
 		"    list\n"
+		"    resolve [domain:<domain>] address:<ADDR>\n"
 		"  unlbl : Unlabeled packet handling\n"
 		"    accept on|off\n"
 		"    add default|interface:<DEV> address:<ADDR>[/<MASK>]\n"
 		"                                label:<LABEL>\n"
 		"    del default|interface:<DEV> address:<ADDR>[/<MASK>]\n"
 		"    list\n"
+		"    lookup [interface:<DEV>] address:<ADDR>\n"
 		"  cipso|cipsov4 : CIPSO/IPv4 packet handling\n"
 		"    add trans doi:<DOI> tags:<T1>,<Tn>\n"
 		"            levels:<LL1>=<RL1>,<LLn>=<RLn>\n"
@@ -119,8 +246,11 @@ static void nlctl_help_print(FILE *fp)
 		"    add pass doi:<DOI>\n"
 		"    del doi:<DOI>\n"
 		"    list [doi:<DOI>]\n"
+		"  apply : Configuration reconciliation\n"
+		"    [plan] <file>|snapshot:<file>\n"
+		"  save : Configuration save\n"
 		"\n",
-		nlctl_name);
+		nlctl_name, nlctl_name);
 }
 
 /**
@@ -131,9 +261,9 @@ static void nlctl_help_print(FILE *fp)
  * @rc.
  *
  */
-static char *nlctl_strerror(int rc)
+const char *nlctl_strerror(int rc)
 {
-	char *str = NULL;
+	const char *str = NULL;
 
 	switch (rc) {
 	case 0:
@@ -171,13 +301,14 @@ static char *nlctl_strerror(int rc)
 }
 
 /**
- * Display a network address
+ * Write a network address to a file
+ * @param fp the output file pointer
  * @param addr the IP address to display
  *
- * Print the IP address and mask, specified in @addr, to STDIO.
+ * Print the IP address and mask, specified in @addr, to @fp.
  *
  */
-void nlctl_addr_print(const struct nlbl_netaddr *addr)
+void nlctl_addr_fprint(FILE *fp, const struct nlbl_netaddr *addr)
 {
 	char addr_s[80];
 	socklen_t addr_s_len = 80;
@@ -191,9 +322,9 @@ void nlctl_addr_print(const struct nlbl_netaddr *addr)
 		mask4.s_addr = ntohl(addr->mask.v4.s_addr);
 		for (mask_size = 0; mask4.s_addr != 0; mask_size++)
 			mask4.s_addr <<= 1;
-		printf("%s/%u",
-		       inet_ntop(AF_INET, &addr->addr.v4, addr_s, addr_s_len),
-		       mask_size);
+		fprintf(fp, "%s/%u",
+			inet_ntop(AF_INET, &addr->addr.v4, addr_s, addr_s_len),
+			mask_size);
 		break;
 	case AF_INET6:
 		for (mask_size = 0, mask_off = 0; mask_off < 4; mask_off++) {
@@ -204,16 +335,29 @@ void nlctl_addr_print(const struct nlbl_netaddr *addr)
 				mask6.s6_addr32[mask_off] <<= 1;
 			}
 		}
-		printf("%s/%u",
-		       inet_ntop(AF_INET6, &addr->addr.v6, addr_s, addr_s_len),
-		       mask_size);
+		fprintf(fp, "%s/%u",
+			inet_ntop(AF_INET6, &addr->addr.v6,
+				  addr_s, addr_s_len),
+			mask_size);
 		break;
 	default:
-		printf("UNKNOWN(%u)", addr->type);
+		fprintf(fp, "UNKNOWN(%u)", addr->type);
 		break;
 	}
 }
 
+/**
+ * Display a network address
+ * @param addr the IP address to display
+ *
+ * Print the IP address and mask, specified in @addr, to STDIO.
+ *
+ */
+void nlctl_addr_print(const struct nlbl_netaddr *addr)
+{
+	nlctl_addr_fprint(stdout, addr);
+}
+
 /**
  * Parse an unsigned interger number
  * @param str the number string
@@ -308,6 +452,136 @@ int nlctl_addr_parse(char *addr_str, struct nlbl_netaddr *addr)
 	return -EINVAL;
 }
 
+/**
+ * Lookup a module
+ * @param name the module name
+ *
+ * Return the entry point of the module specified by @name, or NULL if the
+ * module does not exist.
+ *
+ */
+static main_function_t *nlctl_module(const char *name)
+{
+	if (!strcmp(name, "mgmt"))
+		return mgmt_main;
+	else if (!strcmp(name, "map"))
+		return map_main;
+	else if (!strcmp(name, "unlbl"))
+		return unlbl_main;
+	else if (!strcmp(name, "cipsov4") || !strcmp(name, "cipso"))
+		return cipso_main;
+	else if (!strcmp(name, "calipso"))
+		return calipso_main;
+	else if (!strcmp(name, "apply"))
+		return apply_main;
+	else if (!strcmp(name, "save"))
+		return save_main;
+
+	return NULL;
+}
+
+/**
+ * Run the commands in a batch file
+ * @param path the batch file
+ *
+ * Read the commands in @path, or stdin if @path is "-", and run them in order
+ * from the top of the file to the bottom.  Each line contains a single
+ * "<module> [<commands>]" command; blank lines and lines beginning with "#" are
+ * ignored.  The commands all share the same NetLabel handle.  A failed command
+ * is reported along with its line number, but does not stop the remaining
+ * commands from running.  Returns zero if all of the commands succeeded,
+ * negative values otherwise.
+ *
+ */
+int nlctl_batch(const char *path)
+{
+	int rc = 0;
+	int rc_line;
+	FILE *fp;
+	char *line = NULL;
+	size_t line_size = 0;
+	unsigned int line_num = 0;
+	char *cmd;
+	char *cmd_end;
+	char *cmd_buf = NULL;
+	char *args[BATCH_ARGS_MAX];
+	int args_cnt;
+	char *arg;
+	main_function_t *module_main;
+
+	if (!strcmp(path, "-"))
+		fp = stdin;
+	else {
+		fp = fopen(path, "r");
+		if (fp == NULL) {
+			fprintf(stderr,
+				MSG_ERR("unable to open batch file '%s'\n"),
+				path);
+			return -errno;
+		}
+	}
+
+	while (getline(&line, &line_size, fp) >= 0) {
+		line_num++;
+
+		/* trim the line and skip comments and blank lines */
+		cmd = line + strspn(line, " \t\r\n");
+		cmd_end = cmd + strlen(cmd);
+		while (cmd_end > cmd && strchr(" \t\r\n", cmd_end[-1]) != NULL)
+			cmd_end--;
+		*cmd_end = '\0';
+		if (cmd[0] == '#' || cmd[0] == '\0')
+			continue;
+
+		/* split the command into arguments, keeping the original line
+		 * intact for error reporting */
+		free(cmd_buf);
+		cmd_buf = strdup(cmd);
+		if (cmd_buf == NULL) {
+			rc = -ENOMEM;
+			goto batch_return;
+		}
+		args_cnt = 0;
+		for (arg = strtok(cmd_buf, " \t"); arg != NULL;
+		     arg = strtok(NULL, " \t")) {
+			if (args_cnt == BATCH_ARGS_MAX)
+				break;
+			args[args_cnt++] = arg;
+		}
+
+		/* run the command */
+		module_main = nlctl_module(args[0]);
+		if (arg != NULL)
+			rc_line = -E2BIG;
+		else if (module_main == NULL)
+			rc_line = -EINVAL;
+		else
+			rc_line = module_main(args_cnt - 1, args + 1);
+		if (rc_line < 0) {
+			/* flush the command's output so the report follows it */
+			fflush(stdout);
+			fprintf(stderr, "error: line %u \"%s\"\n", line_num, cmd);
+			if (module_main == NULL && arg == NULL)
+				fprintf(stderr,
+					MSG_ERR("unknown or missing module "
+						"'%s'\n"),
+					args[0]);
+			else
+				fprintf(stderr,
+					MSG_ERR("%s\n"),
+					nlctl_strerror(-rc_line));
+			rc = rc_line;
+		}
+	}
+
+batch_return:
+	free(cmd_buf);
+	free(line);
+	if (fp != stdin)
+		fclose(fp);
+	return rc;
+}
+
 /*
  * main
  */
@@ -317,6 +591,8 @@ int main(int argc, char *argv[])
 	int arg_iter;
 	main_function_t *module_main = NULL;
 	char *module_name;
+	char *batch_file = NULL;
+	char *mock_file = NULL;
 
 	/* save the invoked program name for use in user notifications */
 	nlctl_name = strrchr(argv[0], '/');
@@ -329,13 +605,21 @@ int main(int argc, char *argv[])
 
 	/* get the command line arguments and module information */
 	do {
-		arg_iter = getopt(argc, argv, "hvt:pV");
+		arg_iter = getopt(argc, argv, "b:hm:vt:pV");
 		switch (arg_iter) {
+		case 'b':
+			/* batch file */
+			batch_file = optarg;
+			break;
 		case 'h':
 			/* help */
 			nlctl_help_print(stdout);
 			return RET_OK;
 			break;
+		case 'm':
+			/* mock kernel */
+			mock_file = optarg;
+			break;
 		case 'v':
 			/* verbose */
 			opt_verbose = 1;
@@ -360,7 +644,7 @@ int main(int argc, char *argv[])
 		}
 	} while (arg_iter > 0);
 	module_name = argv[optind];
-	if (!module_name) {
+	if ((!module_name && !batch_file) || (module_name && batch_file)) {
 		nlctl_usage_print(stderr);
 		return RET_USAGE;
 	}
@@ -373,20 +657,26 @@ int main(int argc, char *argv[])
 		goto exit;
 	}
 	nlbl_comm_timeout(opt_timeout);
+	if (mock_file) {
+		rc = nlctl_mock_start(mock_file);
+		if (rc < 0) {
+			fprintf(stderr,
+				MSG_ERR("failed to start the mock kernel, %s\n"),
+				nlctl_strerror(-rc));
+			rc = RET_ERR;
+			goto exit;
+		}
+	}
+
+	/* run the batch file, errors are reported as they happen */
+	if (batch_file) {
+		rc = (nlctl_batch(batch_file) < 0 ? RET_ERR : RET_OK);
+		goto exit;
+	}
 
 	/* transfer control to the module */
-	if (!strcmp(module_name, "mgmt")) {
-		module_main = mgmt_main;
-	} else if (!strcmp(module_name, "map")) {
-		module_main = map_main;
-	} else if (!strcmp(module_name, "unlbl")) {
-		module_main = unlbl_main;
-	} else if (!strcmp(module_name, "cipsov4") ||
-		   !strcmp(module_name, "cipso")) {
-		module_main = cipso_main;
-	} else if (!strcmp(module_name, "calipso")) {
-		module_main = calipso_main;
-	} else {
+	module_main = nlctl_module(module_name);
+	if (module_main == NULL) {
 		fprintf(stderr,
 			MSG_ERR("unknown or missing module '%s'\n"),
 			module_name);
@@ -400,6 +690,12 @@ int main(int argc, char *argv[])
 	} else
 		rc = RET_OK;
 exit:
+	if (opt_verbose)
+		nlctl_stats_print(stderr);
+	if (nlctl_mock && nlctl_mock_stop(mock_file) < 0) {
+		fprintf(stderr, MSG_ERR("failed to save the mock kernel\n"));
+		rc = RET_ERR;
+	}
 	nlbl_exit();
 	return rc;
 }
@@ -121,6 +121,14 @@ static int map_add(int argc, char *argv[])
 	if (domain.family == AF_UNSPEC && addr.type != 0)
 		domain.family = addr.type;
 
+	/* record the mapping if we are building a configuration */
+	if (nlctl_cfg != NULL) {
+		if (def_flag != 0)
+			return nlbl_config_mgmt_adddef(nlctl_cfg,
+						       &domain, &addr);
+		return nlbl_config_mgmt_add(nlctl_cfg, &domain, &addr);
+	}
+
 	/* add the mapping */
 	if (def_flag != 0)
 		return nlbl_mgmt_adddef(NULL, &domain, &addr);
@@ -158,6 +166,13 @@ static int map_del(int argc, char *argv[])
 			return -EINVAL;
 	}
 
+	/* record the removal if we are building a configuration */
+	if (nlctl_cfg != NULL) {
+		if (def_flag != 0)
+			return nlbl_config_mgmt_deldef(nlctl_cfg);
+		return nlbl_config_mgmt_del(nlctl_cfg, domain);
+	}
+
 	/* remove the mapping */
 	if (def_flag != 0)
 		return nlbl_mgmt_deldef(NULL);
@@ -326,25 +341,30 @@ static void map_list_print_pretty(struct nlbl_dommap *mapping, size_t count)
 static int map_list(int argc, char *argv[])
 {
 	int rc;
-	struct nlbl_dommap *mapping, *mapping_new;
-	size_t count, def_count;
+	struct nlbl_result *result;
+	struct nlbl_dommap *mapping = NULL, *mapping_all;
+	size_t count, count_all, def_count = 0;
 	uint32_t iter;
 	uint16_t *family, families[] = {AF_INET, AF_INET6, AF_UNSPEC /* terminator */};
 
 	/* get the list of mappings */
-	rc = nlbl_mgmt_listall(NULL, &mapping);
+	rc = nlbl_mgmt_listall_result(NULL, &mapping_all, &result);
 	if (rc < 0)
 		return rc;
 	count = rc;
+	count_all = rc;
 
-	/* get the default mapping */
-	mapping_new = realloc(mapping, sizeof(*mapping) * (count + 2));
-	if (mapping_new == NULL)
+	/* get the default mapping, the strings of the other mappings stay in
+	 * the result set so only the entries are copied */
+	mapping = calloc(count + 2, sizeof(*mapping));
+	if (mapping == NULL) {
+		rc = -ENOMEM;
 		goto list_return;
-	mapping = mapping_new;
-	memset(&mapping[count], 0, sizeof(*mapping) * 2);
+	}
+	if (count > 0)
+		memcpy(mapping, mapping_all, sizeof(*mapping) * count);
 
-	for (family = families, def_count = 0; *family != AF_UNSPEC; family++) {
+	for (family = families; *family != AF_UNSPEC; family++) {
 		rc = nlbl_mgmt_listdef(NULL, *family, &mapping[count + def_count]);
 		if (rc < 0 && rc != -ENOENT)
 			goto list_return;
@@ -370,14 +390,112 @@ static int map_list(int argc, char *argv[])
 
 list_return:
 	if (mapping != NULL) {
-		for (iter = 0; iter < count; iter++)
-			if (mapping[iter].domain != NULL)
-				free(mapping[iter].domain);
+		for (iter = count_all; iter < count_all + def_count; iter++) {
+			free(mapping[iter].domain);
+			if (mapping[iter].proto_type == NETLBL_NLTYPE_ADDRSELECT)
+				free(mapping[iter].proto.addrsel);
+		}
 		free(mapping);
 	}
+	nlbl_result_free(result);
 	return rc;
 }
 
+/**
+ * Resolve the labeling applied to outbound traffic
+ * @param argc the number of arguments
+ * @param argv the argument list
+ *
+ * Find the labeling protocol the kernel would use for traffic from a LSM
+ * domain sent to a destination address.  Returns zero on success, negative
+ * values on failure.
+ *
+ */
+static int map_resolve(int argc, char *argv[])
+{
+	int rc;
+	uint32_t iter;
+	char *domain = NULL;
+	struct nlbl_netaddr addr;
+	struct nlbl_mgmt_table *table;
+	const struct nlbl_dommap_addr *target;
+
+	/* sanity checks */
+	if (argc <= 0 || argv == NULL || argv[0] == NULL)
+		return -EINVAL;
+
+	memset(&addr, 0, sizeof(addr));
+
+	/* parse the arguments */
+	for (iter = 0; iter < argc && argv[iter] != NULL; iter++) {
+		if (strncmp(argv[iter], "domain:", 7) == 0) {
+			domain = argv[iter] + 7;
+		} else if (strncmp(argv[iter], "address:", 8) == 0) {
+			if (nlctl_addr_parse(argv[iter] + 8, &addr) != 0)
+				return -EINVAL;
+		}
+	}
+	if (addr.type == 0)
+		return -EINVAL;
+
+	/* resolve the domain mapping */
+	rc = nlbl_mgmt_table_load(NULL, &table);
+	if (rc < 0)
+		return rc;
+	target = nlbl_mgmt_resolve(table, domain, &addr);
+
+	/* display the domain mapping */
+	if (target == NULL) {
+		if (opt_pretty != 0)
+			printf("No domain mapping applies\n");
+		else
+			printf("none\n");
+		goto resolve_return;
+	}
+	if (opt_pretty != 0) {
+		printf("   address: ");
+		nlctl_addr_print(&target->addr);
+		printf("\n"
+		       "    protocol: ");
+		switch (target->proto_type) {
+		case NETLBL_NLTYPE_UNLABELED:
+			printf("UNLABELED\n");
+			break;
+		case NETLBL_NLTYPE_CIPSOV4:
+			printf("CIPSO, DOI = %u\n", target->proto.cip_doi);
+			break;
+		case NETLBL_NLTYPE_CALIPSO:
+			printf("CALIPSO, DOI = %u\n", target->proto.clp_doi);
+			break;
+		default:
+			printf("UNKNOWN(%u)\n", target->proto_type);
+			break;
+		}
+	} else {
+		printf("address:");
+		nlctl_addr_print(&target->addr);
+		printf(",protocol:");
+		switch (target->proto_type) {
+		case NETLBL_NLTYPE_UNLABELED:
+			printf("UNLABELED\n");
+			break;
+		case NETLBL_NLTYPE_CIPSOV4:
+			printf("CIPSOv4,%u\n", target->proto.cip_doi);
+			break;
+		case NETLBL_NLTYPE_CALIPSO:
+			printf("CALIPSO,%u\n", target->proto.clp_doi);
+			break;
+		default:
+			printf("UNKNOWN(%u)\n", target->proto_type);
+			break;
+		}
+	}
+
+resolve_return:
+	nlbl_mgmt_table_free(table);
+	return 0;
+}
+
 /**
  * Entry point for the NetLabel mapping functions
  * @param argc the number of arguments
@@ -394,6 +512,10 @@ int map_main(int argc, char *argv[])
 	/* sanity checks */
 	if (argc <= 0 || argv == NULL || argv[0] == NULL)
 		return -EINVAL;
+	/* configuration files only hold configuration commands */
+	if (nlctl_cfg != NULL &&
+	    strcmp(argv[0], "add") != 0 && strcmp(argv[0], "del") != 0)
+		return -EINVAL;
 
 	/* handle the request */
 	if (strcmp(argv[0], "add") == 0) {
@@ -405,6 +527,9 @@ int map_main(int argc, char *argv[])
 	} else if (strcmp(argv[0], "list") == 0) {
 		/* list the domain mappings */
 		rc = map_list(argc - 1, argv + 1);
+	} else if (strcmp(argv[0], "resolve") == 0) {
+		/* resolve a domain mapping */
+		rc = map_resolve(argc - 1, argv + 1);
 	} else {
 		/* unknown request */
 		rc = -EINVAL;
@@ -26,6 +26,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <libnetlabel.h>
 
@@ -113,6 +116,102 @@ static int mgmt_version(void)
 	return 0;
 }
 
+/**
+ * Write a NetLabel configuration snapshot
+ * @param cfg the configuration
+ * @param path the snapshot file
+ *
+ * Write @cfg to @path in the binary snapshot format.  The snapshot is written
+ * to a temporary file which replaces @path once it is complete, so that
+ * programs using the old snapshot are not affected.  Returns zero on success,
+ * negative values on failure.
+ *
+ */
+int mgmt_snapshot_write(const struct nlbl_config *cfg, const char *path)
+{
+	int rc;
+	int fd;
+	char *tmp_path;
+
+	tmp_path = malloc(strlen(path) + 8);
+	if (tmp_path == NULL)
+		return -ENOMEM;
+	sprintf(tmp_path, "%s.XXXXXX", path);
+
+	fd = mkstemp(tmp_path);
+	if (fd < 0) {
+		rc = -errno;
+		goto write_return;
+	}
+	rc = nlbl_config_export(cfg, fd);
+	if (rc >= 0 && fchmod(fd, 0644) < 0)
+		rc = -errno;
+	if (close(fd) < 0 && rc >= 0)
+		rc = -errno;
+	if (rc >= 0 && rename(tmp_path, path) < 0)
+		rc = -errno;
+	if (rc < 0)
+		unlink(tmp_path);
+	else
+		rc = 0;
+
+write_return:
+	free(tmp_path);
+	return rc;
+}
+
+/**
+ * Write a snapshot of the kernel's NetLabel configuration
+ * @param path the snapshot file
+ *
+ * Read the kernel's NetLabel configuration and write it to @path, see
+ * mgmt_snapshot_write().  Returns zero on success, negative values on failure.
+ *
+ */
+static int mgmt_snapshot(const char *path)
+{
+	int rc;
+	struct nlbl_config *cfg = NULL;
+
+	rc = nlbl_config_load(NULL, &cfg);
+	if (rc < 0)
+		return rc;
+	rc = mgmt_snapshot_write(cfg, path);
+	nlbl_config_free(cfg);
+	return rc;
+}
+
+/**
+ * Display the fingerprint of a NetLabel configuration
+ * @param path the configuration file, NULL for the kernel's configuration
+ *
+ * Read either the kernel's NetLabel configuration or the configuration in
+ * @path, see apply_config_read(), and display its fingerprint.  Returns zero
+ * on success, negative values on failure.
+ *
+ */
+static int mgmt_fingerprint(const char *path)
+{
+	int rc;
+	struct nlbl_config *cfg = NULL;
+	uint64_t fp;
+
+	if (path == NULL)
+		rc = nlbl_config_load(NULL, &cfg);
+	else
+		rc = apply_config_read(path, &cfg);
+	if (rc < 0)
+		return rc;
+	rc = nlbl_config_fingerprint(cfg, &fp);
+	nlbl_config_free(cfg);
+	if (rc < 0)
+		return rc;
+
+	printf(MSG("NetLabel configuration fingerprint : "));
+	printf("%016" PRIx64 "\n", fp);
+	return 0;
+}
+
 /**
  * Entry point for the NetLabel management functions
  * @param argc the number of arguments
@@ -130,6 +229,9 @@ int mgmt_main(int argc, char *argv[])
 	/* sanity checks */
 	if (argc <= 0 || argv == NULL || argv[0] == NULL)
 		return -EINVAL;
+	/* configuration files only hold configuration commands */
+	if (nlctl_cfg != NULL)
+		return -EINVAL;
 
 	/* handle the request */
 	if (strcmp(argv[0], "version") == 0) {
@@ -138,6 +240,16 @@ int mgmt_main(int argc, char *argv[])
 	} else if (strcmp(argv[0], "protocols") == 0) {
 		/* module list */
 		rc = mgmt_protocols();
+	} else if (strcmp(argv[0], "snapshot") == 0) {
+		/* configuration snapshot */
+		if (argc != 2 || argv[1] == NULL)
+			return -EINVAL;
+		rc = mgmt_snapshot(argv[1]);
+	} else if (strcmp(argv[0], "fingerprint") == 0) {
+		/* configuration fingerprint */
+		if (argc > 2)
+			return -EINVAL;
+		rc = mgmt_fingerprint(argc == 2 ? argv[1] : NULL);
 	} else {
 		/* unknown request */
 		rc = -EINVAL;
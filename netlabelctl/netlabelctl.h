@@ -33,6 +33,9 @@ extern uint32_t opt_verbose;
 extern uint32_t opt_timeout;
 extern uint32_t opt_pretty;
 
+/* configuration being built by the apply module, see apply_main() */
+extern struct nlbl_config *nlctl_cfg;
+
 /* warning/error reporting */
 #define MSG_WARN(_x) "%s: warning, "_x,nlctl_name
 #define MSG_WARN_MOD(_m,_x) "%s: warning[%s], "_x,nlctl_name,_m
@@ -45,7 +48,16 @@ extern uint32_t opt_pretty;
 #define MSG(_x) (opt_pretty?_x:"")
 #define MSG_V(_x) (opt_verbose?_x"")
 
+/* batch file helper functions */
+int nlctl_batch(const char *path);
+const char *nlctl_strerror(int rc);
+
+/* configuration file helper functions */
+int apply_config_read(const char *path, struct nlbl_config **cfg);
+int mgmt_snapshot_write(const struct nlbl_config *cfg, const char *path);
+
 /* network address helper functions */
+void nlctl_addr_fprint(FILE *fp, const struct nlbl_netaddr *addr);
 void nlctl_addr_print(const struct nlbl_netaddr *addr);
 int nlctl_addr_parse(char *addr_str, struct nlbl_netaddr *addr);
 
@@ -56,5 +68,7 @@ int map_main(int argc, char *argv[]);
 int unlbl_main(int argc, char *argv[]);
 int cipso_main(int argc, char *argv[]);
 int calipso_main(int argc, char *argv[]);
+int apply_main(int argc, char *argv[]);
+int save_main(int argc, char *argv[]);
 
 #endif
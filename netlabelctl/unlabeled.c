@@ -61,7 +61,10 @@ static int unlbl_accept(int argc, char *argv[])
 	else
 		return -EINVAL;
 
-	rc = nlbl_unlbl_accept(NULL, flag);
+	if (nlctl_cfg != NULL)
+		rc = nlbl_config_unlbl_accept(nlctl_cfg, flag);
+	else
+		rc = nlbl_unlbl_accept(NULL, flag);
 	if (rc < 0)
 		return rc;
 
@@ -79,10 +82,12 @@ static int unlbl_list(void)
 {
 	int rc;
 	uint8_t flag;
-	struct nlbl_addrmap *addr_p = NULL, *addr_p_new;
-	struct nlbl_addrmap *addrdef_p = NULL;
+	struct nlbl_result *result = NULL, *resultdef = NULL;
+	struct nlbl_addrmap *addr_p = NULL;
+	struct nlbl_addrmap *addrs_p;
+	struct nlbl_addrmap *addrdef_p;
 	struct nlbl_addrmap *iter_p;
-	size_t count;
+	size_t count, count_def;
 	uint32_t iter;
 
 	/* display the accept flag */
@@ -96,19 +101,26 @@ static int unlbl_list(void)
 		printf("accept:%s", (flag ? "on" : "off"));
 
 	/* get the static label mappings */
-	rc = nlbl_unlbl_staticlist(NULL, &addr_p);
+	rc = nlbl_unlbl_staticlist_result(NULL, &addrs_p, &result);
 	if (rc < 0)
 		return rc;
 	count = rc;
-	rc = nlbl_unlbl_staticlistdef(NULL, &addrdef_p);
-	if (rc > 0) {
-		addr_p_new = realloc(addr_p, sizeof(*addr_p) * (count + rc));
-		if (addr_p_new == NULL)
-			goto list_return;
-		addr_p = addr_p_new;
-		memcpy(&addr_p[count], addrdef_p, sizeof(*addr_p) * rc);
-		count += rc;
+	rc = nlbl_unlbl_staticlistdef_result(NULL, &addrdef_p, &resultdef);
+	if (rc < 0)
+		goto list_return;
+	count_def = rc;
+
+	/* the strings stay in the result sets, only the entries are copied */
+	addr_p = malloc(sizeof(*addr_p) * (count + count_def + 1));
+	if (addr_p == NULL) {
+		rc = -ENOMEM;
+		goto list_return;
 	}
+	if (count > 0)
+		memcpy(addr_p, addrs_p, sizeof(*addr_p) * count);
+	if (count_def > 0)
+		memcpy(&addr_p[count], addrdef_p, sizeof(*addr_p) * count_def);
+	count += count_def;
 
 	/* display the static label mappings */
 	if (opt_pretty != 0) {
@@ -156,15 +168,9 @@ static int unlbl_list(void)
 	}
 
 list_return:
-	if (addr_p != NULL) {
-		for (iter = 0; iter < count; iter++) {
-			if (addr_p[iter].dev != NULL)
-				free(addr_p[iter].dev);
-			if (addr_p[iter].label != NULL)
-				free(addr_p[iter].label);
-		}
-		free(addr_p);
-	}
+	free(addr_p);
+	nlbl_result_free(result);
+	nlbl_result_free(resultdef);
 	return rc;
 }
 
@@ -205,6 +211,15 @@ static int unlbl_add(int argc, char *argv[])
 		}
 	}
 
+	/* record the mapping if we are building a configuration */
+	if (nlctl_cfg != NULL) {
+		if (def_flag != 0)
+			return nlbl_config_unlbl_staticadddef(nlctl_cfg,
+							      &addr, label);
+		return nlbl_config_unlbl_staticadd(nlctl_cfg,
+						   dev, &addr, label);
+	}
+
 	/* add the mapping */
 	if (def_flag != 0)
 		return nlbl_unlbl_staticadddef(NULL, &addr, label);
@@ -246,6 +261,13 @@ static int unlbl_del(int argc, char *argv[])
 		}
 	}
 
+	/* record the removal if we are building a configuration */
+	if (nlctl_cfg != NULL) {
+		if (def_flag != 0)
+			return nlbl_config_unlbl_staticdeldef(nlctl_cfg, &addr);
+		return nlbl_config_unlbl_staticdel(nlctl_cfg, dev, &addr);
+	}
+
 	/* add the mapping */
 	if (def_flag != 0)
 		return nlbl_unlbl_staticdeldef(NULL, &addr);
@@ -253,6 +275,74 @@ static int unlbl_del(int argc, char *argv[])
 		return nlbl_unlbl_staticdel(NULL, dev, &addr);
 }
 
+/**
+ * Find the static label applied to traffic
+ * @param argc the number of arguments
+ * @param argv the argument list
+ *
+ * Find the static label the kernel would apply to unlabeled traffic from a
+ * source address arriving on a network interface.  Returns zero on success,
+ * negative values on failure.
+ *
+ */
+static int unlbl_lookup(int argc, char *argv[])
+{
+	int rc;
+	uint32_t iter;
+	nlbl_netdev dev = NULL;
+	struct nlbl_netaddr addr;
+	struct nlbl_unlbl_table *table;
+	const struct nlbl_addrmap *entry;
+
+	/* sanity checks */
+	if (argc <= 0 || argv == NULL || argv[0] == NULL)
+		return -EINVAL;
+
+	memset(&addr, 0, sizeof(addr));
+
+	/* parse the arguments */
+	for (iter = 0; iter < argc && argv[iter] != NULL; iter++) {
+		if (strncmp(argv[iter], "interface:", 10) == 0) {
+			dev = argv[iter] + 10;
+		} else if (strncmp(argv[iter], "address:", 8) == 0) {
+			if (nlctl_addr_parse(argv[iter] + 8, &addr) != 0)
+				return -EINVAL;
+		}
+	}
+	if (addr.type == 0)
+		return -EINVAL;
+
+	/* find the static label */
+	rc = nlbl_unlbl_table_load(NULL, &table);
+	if (rc < 0)
+		return rc;
+	entry = nlbl_unlbl_lookup(table, dev, &addr);
+
+	/* display the static label */
+	if (entry == NULL) {
+		if (opt_pretty != 0)
+			printf("No static label applies\n");
+		else
+			printf("none\n");
+	} else if (opt_pretty != 0) {
+		printf(" interface: %s\n",
+		       (entry->dev != NULL ? entry->dev : "DEFAULT"));
+		printf("   address: ");
+		nlctl_addr_print(&entry->addr);
+		printf("\n");
+		printf("    label: \"%s\"\n", entry->label);
+	} else {
+		printf("interface:%s,",
+		       (entry->dev != NULL ? entry->dev : "DEFAULT"));
+		printf("address:");
+		nlctl_addr_print(&entry->addr);
+		printf(",label:\"%s\"\n", entry->label);
+	}
+
+	nlbl_unlbl_table_free(table);
+	return 0;
+}
+
 /**
  * Entry point for the NetLabel unlabeled functions
  * @param argc the number of arguments
@@ -269,6 +359,10 @@ int unlbl_main(int argc, char *argv[])
 	/* sanity checks */
 	if (argc <= 0 || argv == NULL || argv[0] == NULL)
 		return -EINVAL;
+	/* configuration files only hold configuration commands */
+	if (nlctl_cfg != NULL && strcmp(argv[0], "accept") != 0 &&
+	    strcmp(argv[0], "add") != 0 && strcmp(argv[0], "del") != 0)
+		return -EINVAL;
 
 	/* handle the request */
 	if (strcmp(argv[0], "accept") == 0) {
@@ -283,6 +377,9 @@ int unlbl_main(int argc, char *argv[])
 	} else if (strcmp(argv[0], "del") == 0) {
 		/* del */
 		rc = unlbl_del(argc - 1, argv + 1);
+	} else if (strcmp(argv[0], "lookup") == 0) {
+		/* lookup */
+		rc = unlbl_lookup(argc - 1, argv + 1);
 	} else {
 		/* unknown request */
 		rc = -EINVAL;
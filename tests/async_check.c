@@ -0,0 +1,411 @@
+/** @file
+ * NetLabel Asynchronous Request Checks
+ *
+ * Author: Paul Moore <paul@paul-moore.com>
+ *
+ */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Check the asynchronous request API on a handle attached to a fresh
+ * in-process mock kernel for each check, so that neither root nor kernel
+ * support is needed:
+ *
+ * 1. Static label adds, a failing add and two dumps, the second queued
+ *    behind the first, all complete with the right results.
+ *
+ * 2. Requests sent faster than their acks are read overflow the socket, so
+ *    the outstanding requests, among them a running and a queued dump, fail
+ *    with -ENOBUFS.  The completion callback sends new requests and a dump
+ *    while they fail, each of which must complete exactly once, and the
+ *    handle must then work normally.
+ *
+ * 3. nlbl_async_end() cancels the outstanding requests with -ECANCELED and
+ *    the requests the completion callback sends meanwhile fail with -EBUSY.
+ *
+ * Prints the failed check and exits with a non-zero value on failure.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <arpa/inet.h>
+
+#include <libnetlabel.h>
+
+#define CHECK_DEV		"eth0"
+#define CHECK_LABEL		"system_u:object_r:check_t:s0"
+#define CHECK_ADDR_BASE		0x0a000000
+
+/* static labels added by the first check */
+#define CHECK_LABELS		16
+/* requests sent without reading the acks, enough to overflow the socket */
+#define CHECK_FLOOD		4096
+/* requests the completion callback sends while the requests fail */
+#define CHECK_RETRIES		8
+/* dispatch rounds before the requests are considered stuck */
+#define CHECK_ROUNDS		10000
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", \
+				__FILE__, __LINE__, #cond); \
+			return -1; \
+		} \
+	} while (0)
+
+/* results of the asynchronous requests */
+struct check_state {
+	int rc[CHECK_FLOOD * 2];
+	unsigned char seen[CHECK_FLOOD * 2];
+	unsigned int done;
+	unsigned int twice;
+	unsigned int failed;
+	int fail_rc;
+
+	/* requests sent by the completion callback */
+	int retry_ids[CHECK_RETRIES];
+	unsigned int retries;
+	int retry_rc;
+	int dump_id;
+	int dump_sent;
+	unsigned int entries;
+};
+
+/**
+ * Fill in a static label address
+ * @param addr the address
+ * @param iter the static label number
+ */
+static void check_addr(struct nlbl_netaddr *addr, unsigned int iter)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->type = AF_INET;
+	addr->addr.v4.s_addr = htonl(CHECK_ADDR_BASE + iter);
+	addr->mask.v4.s_addr = 0xffffffff;
+}
+
+/**
+ * Count the entries of a static label dump
+ * @param addr the static label
+ * @param arg the check state
+ */
+static int check_dump_cb(const struct nlbl_addrmap *addr, void *arg)
+{
+	struct check_state *state = arg;
+
+	state->entries++;
+	return 0;
+}
+
+/**
+ * Record the result of an asynchronous request
+ * @param hndl the NetLabel handle
+ * @param id the request id
+ * @param rc the request result
+ * @param arg the check state
+ *
+ * While requests fail with the check's error, send new requests, and a dump,
+ * from the callback for the first few of them.
+ *
+ */
+static void check_async_cb(struct nlbl_handle *hndl, int id, int rc,
+			   void *arg)
+{
+	struct check_state *state = arg;
+	struct nlbl_netaddr addr;
+
+	state->done++;
+	if (id > 0 && id < CHECK_FLOOD * 2) {
+		if (state->seen[id])
+			state->twice++;
+		state->seen[id] = 1;
+		state->rc[id] = rc;
+	}
+	if (state->fail_rc == 0 || rc != state->fail_rc)
+		return;
+	state->failed++;
+
+	if (state->retries < CHECK_RETRIES) {
+		check_addr(&addr, CHECK_FLOOD + state->retries);
+		rc = nlbl_unlbl_staticadd(hndl, CHECK_DEV, &addr, CHECK_LABEL);
+		if (rc < 0)
+			state->retry_rc = rc;
+		else
+			state->retry_ids[state->retries++] = rc;
+	}
+	if (!state->dump_sent) {
+		state->dump_sent = 1;
+		state->dump_id = nlbl_unlbl_staticlist_iter(hndl, check_dump_cb,
+							    state);
+	}
+}
+
+/**
+ * Wait for the outstanding asynchronous requests
+ * @param hndl the NetLabel handle
+ *
+ * Returns zero once no requests are outstanding, negative values on failure.
+ *
+ */
+static int check_drain(struct nlbl_handle *hndl)
+{
+	int rc;
+	unsigned int round;
+	struct pollfd pfd;
+
+	pfd.fd = nlbl_comm_fd(hndl);
+	pfd.events = POLLIN;
+	for (round = 0; round < CHECK_ROUNDS; round++) {
+		if (nlbl_async_pending(hndl) == 0)
+			return 0;
+		if (poll(&pfd, 1, 1000) <= 0)
+			return -ETIMEDOUT;
+		rc = nlbl_async_dispatch(hndl);
+		if (rc < 0)
+			return rc;
+	}
+
+	return -ETIMEDOUT;
+}
+
+/**
+ * Check acks, failures and queued dumps
+ * @param hndl the NetLabel handle
+ * @param state the check state
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int check_basic(struct nlbl_handle *hndl, struct check_state *state)
+{
+	int ids[CHECK_LABELS];
+	int id_dup, id_dump[2];
+	uint32_t version;
+	struct nlbl_netaddr addr;
+	unsigned int iter;
+
+	CHECK(nlbl_async_begin(hndl, check_async_cb, state) == 0);
+	CHECK(nlbl_async_begin(hndl, check_async_cb, state) == -EBUSY);
+	CHECK(nlbl_async_pending(hndl) == 0);
+
+	for (iter = 0; iter < CHECK_LABELS; iter++) {
+		check_addr(&addr, iter);
+		ids[iter] = nlbl_unlbl_staticadd(hndl, CHECK_DEV,
+						 &addr, CHECK_LABEL);
+		CHECK(ids[iter] > 0);
+	}
+	check_addr(&addr, 0);
+	id_dup = nlbl_unlbl_staticadd(hndl, CHECK_DEV, &addr, CHECK_LABEL);
+	CHECK(id_dup > 0);
+	id_dump[0] = nlbl_unlbl_staticlist_iter(hndl, check_dump_cb, state);
+	CHECK(id_dump[0] > 0);
+	id_dump[1] = nlbl_unlbl_staticlist_iter(hndl, check_dump_cb, state);
+	CHECK(id_dump[1] > 0);
+	CHECK(nlbl_async_pending(hndl) == CHECK_LABELS + 3);
+
+	/* only the configuration operations and dumps are asynchronous */
+	CHECK(nlbl_mgmt_version(hndl, &version) == -EBUSY);
+
+	CHECK(check_drain(hndl) == 0);
+	CHECK(state->done == CHECK_LABELS + 3);
+	for (iter = 0; iter < CHECK_LABELS; iter++)
+		CHECK(state->rc[ids[iter]] == 0);
+	CHECK(state->rc[id_dup] == -EEXIST);
+	CHECK(state->rc[id_dump[0]] == CHECK_LABELS);
+	CHECK(state->rc[id_dump[1]] == CHECK_LABELS);
+	CHECK(state->entries == CHECK_LABELS * 2);
+
+	nlbl_async_end(hndl);
+	CHECK(nlbl_async_pending(hndl) == -EINVAL);
+
+	/* the handle is back to blocking operation */
+	CHECK(nlbl_unlbl_staticlist_iter(hndl, check_dump_cb,
+					 state) == CHECK_LABELS);
+
+	return 0;
+}
+
+/**
+ * Check requests sent while the outstanding requests fail
+ * @param hndl the NetLabel handle
+ * @param state the check state
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int check_overflow(struct nlbl_handle *hndl, struct check_state *state)
+{
+	int rc;
+	int id;
+	struct nlbl_netaddr addr;
+	unsigned int iter;
+
+	CHECK(nlbl_async_begin(hndl, check_async_cb, state) == 0);
+	state->fail_rc = -ENOBUFS;
+
+	/* a running dump and a queued one */
+	CHECK(nlbl_unlbl_staticlist_iter(hndl, check_dump_cb, state) > 0);
+	CHECK(nlbl_unlbl_staticlist_iter(hndl, check_dump_cb, state) > 0);
+
+	for (iter = 0; iter < CHECK_FLOOD; iter++) {
+		check_addr(&addr, iter);
+		rc = nlbl_unlbl_staticadd(hndl, CHECK_DEV, &addr, CHECK_LABEL);
+		CHECK(rc > 0);
+	}
+
+	/* every request, including the ones sent by the callback while the
+	 * others failed, completes exactly once */
+	CHECK(check_drain(hndl) == 0);
+	CHECK(state->failed > 0);
+	CHECK(state->retries == CHECK_RETRIES);
+	CHECK(state->retry_rc == 0);
+	CHECK(state->dump_id > 0);
+	CHECK(state->done == CHECK_FLOOD + CHECK_RETRIES + 3);
+	CHECK(state->twice == 0);
+	for (iter = 0; iter < CHECK_RETRIES; iter++) {
+		id = state->retry_ids[iter];
+		CHECK(state->seen[id]);
+		CHECK(state->rc[id] == 0 || state->rc[id] == -ENOBUFS);
+	}
+	CHECK(state->seen[state->dump_id]);
+
+	/* the handle recovers once the lost responses are drained */
+	state->fail_rc = 0;
+	check_addr(&addr, CHECK_FLOOD * 2);
+	id = nlbl_unlbl_staticadd(hndl, CHECK_DEV, &addr, CHECK_LABEL);
+	CHECK(id > 0);
+	CHECK(check_drain(hndl) == 0);
+	CHECK(state->rc[id] == 0);
+	state->entries = 0;
+	id = nlbl_unlbl_staticlist_iter(hndl, check_dump_cb, state);
+	CHECK(id > 0);
+	CHECK(check_drain(hndl) == 0);
+	CHECK(state->rc[id] > CHECK_FLOOD / 2);
+	CHECK(state->rc[id] == (int)state->entries);
+
+	nlbl_async_end(hndl);
+
+	return 0;
+}
+
+/**
+ * Check requests sent while nlbl_async_end() cancels the outstanding requests
+ * @param hndl the NetLabel handle
+ * @param state the check state
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int check_cancel(struct nlbl_handle *hndl, struct check_state *state)
+{
+	int id_add, id_dump[2];
+	struct nlbl_netaddr addr;
+
+	CHECK(nlbl_async_begin(hndl, check_async_cb, state) == 0);
+	state->fail_rc = -ECANCELED;
+
+	check_addr(&addr, 0);
+	id_add = nlbl_unlbl_staticadd(hndl, CHECK_DEV, &addr, CHECK_LABEL);
+	CHECK(id_add > 0);
+	id_dump[0] = nlbl_unlbl_staticlist_iter(hndl, check_dump_cb, state);
+	CHECK(id_dump[0] > 0);
+	id_dump[1] = nlbl_unlbl_staticlist_iter(hndl, check_dump_cb, state);
+	CHECK(id_dump[1] > 0);
+
+	nlbl_async_end(hndl);
+	CHECK(state->done == 3);
+	CHECK(state->failed == 3);
+	CHECK(state->rc[id_add] == -ECANCELED);
+	CHECK(state->rc[id_dump[0]] == -ECANCELED);
+	CHECK(state->rc[id_dump[1]] == -ECANCELED);
+	CHECK(state->retry_rc == -EBUSY);
+	CHECK(state->dump_id == -EBUSY);
+
+	/* the late responses are ignored by the blocking requests */
+	check_addr(&addr, 1);
+	CHECK(nlbl_unlbl_staticadd(hndl, CHECK_DEV, &addr, CHECK_LABEL) == 0);
+
+	return 0;
+}
+
+/**
+ * Run a check against a fresh mock kernel
+ * @param check the check
+ *
+ * Returns zero on success, negative values on failure.
+ *
+ */
+static int check_run(int (*check)(struct nlbl_handle *hndl,
+				  struct check_state *state))
+{
+	int rc;
+	struct nlbl_mock *mock;
+	struct nlbl_handle *hndl;
+	struct check_state *state;
+
+	mock = nlbl_mock_new(NULL);
+	state = calloc(1, sizeof(*state));
+	if (mock == NULL || state == NULL) {
+		rc = -ENOMEM;
+		goto run_return;
+	}
+	hndl = nlbl_mock_open(mock);
+	if (hndl == NULL) {
+		rc = -ENOMEM;
+		goto run_return;
+	}
+	rc = check(hndl, state);
+	nlbl_comm_close(hndl);
+
+run_return:
+	nlbl_mock_free(mock);
+	free(state);
+	return rc;
+}
+
+/**
+ * Run the checks
+ */
+int main(int argc, char *argv[])
+{
+	int rc;
+
+	rc = nlbl_init();
+	if (rc < 0)
+		goto main_return;
+
+	rc = check_run(check_basic);
+	if (rc < 0)
+		goto main_return;
+	rc = check_run(check_overflow);
+	if (rc < 0)
+		goto main_return;
+	rc = check_run(check_cancel);
+
+main_return:
+	nlbl_exit();
+	if (rc < 0) {
+		fprintf(stderr, "error: %s\n", strerror(-rc));
+		return 1;
+	}
+	return 0;
+}